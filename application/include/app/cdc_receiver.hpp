@@ -0,0 +1,83 @@
+#ifndef CDC_RECEIVER_HPP
+#define CDC_RECEIVER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+namespace cdc {
+
+/*
+ * Checks the test pattern the STM32 template streams over its USB CDC port
+ * (built with USB_STREAM=1): consecutive little endian 32 bit counter
+ * values. The checker locks onto the first two consecutive words it finds,
+ * whatever the byte alignment, then counts every word that does not follow
+ * its predecessor. Two bad words in a row (bytes lost or duplicated) drop
+ * the lock and search again.
+ */
+class PatternChecker {
+
+    public:
+        PatternChecker(void);
+
+        void feed(const uint8_t *data, size_t size);
+
+        /* bytes fed in total */
+        uint64_t bytes(void) const { return mBytes; }
+
+        /* words checked while locked */
+        uint64_t words(void) const { return mWords; }
+
+        /* words out of sequence */
+        uint64_t errors(void) const { return mErrors; }
+
+        /* times the lock was lost */
+        uint64_t resyncs(void) const { return mResyncs; }
+
+        /* bytes dropped while searching for the pattern */
+        uint64_t skipped(void) const { return mSkipped; }
+
+        bool locked(void) const { return mLocked; }
+
+    private:
+        void search(uint8_t byte);
+        void check(uint32_t word);
+
+        uint8_t  mWindow[8];
+        size_t   mFill;
+        bool     mLocked;
+        uint32_t mExpected;
+        uint32_t mBad;
+        uint64_t mBytes;
+        uint64_t mWords;
+        uint64_t mErrors;
+        uint64_t mResyncs;
+        uint64_t mSkipped;
+};
+
+/*
+ * Open a serial device (e.g. /dev/ttyACM0) in raw mode. Opening it raises
+ * DTR, which tells the firmware a terminal is listening. Returns -1 and
+ * fills error on failure.
+ */
+int openSerial(const std::string &path, std::string &error);
+
+/*
+ * Stand-in for the device: a pseudo terminal whose master side a child
+ * process (child) feeds with the test pattern as fast as it can. Returns
+ * the raw slave side, or -1 and fills error on failure.
+ */
+int openPtyStandIn(pid_t &child, std::string &error);
+
+/*
+ * Read up to limit bytes from fd into the checker, stopping early at end of
+ * file or after timeout_ms without data. Returns the elapsed seconds, or a
+ * negative value if reading failed.
+ */
+double receive(int fd, uint64_t limit, int timeout_ms, PatternChecker &checker);
+
+}
+
+#endif /* CDC_RECEIVER_HPP */
@@ -0,0 +1,41 @@
+#ifndef ELF_READER_HPP
+#define ELF_READER_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace elf {
+
+/* one section of a 32 bit little endian ELF file */
+struct Section {
+    std::string          name;
+    uint32_t             type;
+    uint32_t             flags;
+    uint32_t             addr;
+    std::vector<uint8_t> data;
+};
+
+/* section header flag: section occupies memory at runtime */
+static const uint32_t SHF_ALLOC = 0x2;
+
+/* section header type: section has no file data */
+static const uint32_t SHT_NOBITS = 8;
+
+/*
+ * Load every section of a 32 bit little endian ELF file (the firmware
+ * images of the embedded templates). Returns false and fills error if the
+ * file cannot be read or is not such an ELF file.
+ */
+bool load(const std::string &path, std::vector<Section> &sections, std::string &error);
+
+/* find a section by name, nullptr if missing */
+const Section *find(const std::vector<Section> &sections, const std::string &name);
+
+/* find the allocated section holding the given address, nullptr if none */
+const Section *findAddress(const std::vector<Section> &sections, uint32_t addr);
+
+}
+
+#endif /* ELF_READER_HPP */
@@ -0,0 +1,51 @@
+#ifndef TOKEN_DECODER_HPP
+#define TOKEN_DECODER_HPP
+
+#include <stdint.h>
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "app/elf_reader.hpp"
+
+namespace token {
+
+/* frame start marker emitted by the firmware's TLOG() macro */
+static const uint8_t SYNC = 0xA5;
+
+/* name of the ELF section holding the format strings */
+static const char * const SECTION = ".tlog";
+
+/*
+ * Decodes the tokenized log stream of the STM32 template against the
+ * firmware ELF. See app/include/token_log.hpp in the STM32 template for the
+ * frame layout.
+ */
+class Decoder {
+
+    public:
+        explicit Decoder(const std::vector<elf::Section> &sections);
+
+        /* decode frames from in until end of stream, one line per record */
+        void run(std::istream &in, std::ostream &out);
+
+        /* format a single record */
+        std::string format(uint32_t tok, const std::vector<uint8_t> &payload) const;
+
+        /* number of bytes skipped while searching for a frame start */
+        uint64_t skipped(void) const { return mSkipped; }
+
+    private:
+        std::string lookup(uint32_t tok, bool &found) const;
+        std::string resolve(uint32_t addr) const;
+
+        const std::vector<elf::Section> &mSections;
+        const elf::Section              *mStrings;
+        uint64_t                         mSkipped;
+};
+
+}
+
+#endif /* TOKEN_DECODER_HPP */
@@ -0,0 +1,217 @@
+#include "app/cdc_receiver.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t read32(const uint8_t *data)
+{
+    return static_cast<uint32_t>(data[0])         |
+           (static_cast<uint32_t>(data[1]) << 8)  |
+           (static_cast<uint32_t>(data[2]) << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* no echo, no line editing, no character translation */
+bool makeRaw(int fd)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return false;
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+/* child of openPtyStandIn: stream the pattern until the reader goes away */
+void feedPattern(int fd)
+{
+    uint8_t  buf[4096];
+    uint32_t counter = 0;
+
+    for (;;) {
+        for (size_t i = 0; i < sizeof(buf); i += 4) {
+            buf[i + 0] = static_cast<uint8_t>(counter);
+            buf[i + 1] = static_cast<uint8_t>(counter >> 8);
+            buf[i + 2] = static_cast<uint8_t>(counter >> 16);
+            buf[i + 3] = static_cast<uint8_t>(counter >> 24);
+            ++counter;
+        }
+        for (size_t done = 0; done < sizeof(buf); ) {
+            const ssize_t count = write(fd, buf + done, sizeof(buf) - done);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return;
+            done += static_cast<size_t>(count);
+        }
+    }
+}
+
+}
+
+cdc::PatternChecker::PatternChecker(void) :
+    mWindow(),
+    mFill(0),
+    mLocked(false),
+    mExpected(0),
+    mBad(0),
+    mBytes(0),
+    mWords(0),
+    mErrors(0),
+    mResyncs(0),
+    mSkipped(0)
+{ }
+
+void cdc::PatternChecker::feed(const uint8_t *data, size_t size)
+{
+    mBytes += size;
+    for (size_t i = 0; i < size; ++i) {
+        if (!mLocked) {
+            search(data[i]);
+            continue;
+        }
+
+        mWindow[mFill++] = data[i];
+        if (mFill == 4) {
+            check(read32(mWindow));
+            mFill = 0;
+        }
+    }
+}
+
+/* slide an 8 byte window until it holds two consecutive words */
+void cdc::PatternChecker::search(uint8_t byte)
+{
+    mWindow[mFill++] = byte;
+    if (mFill < sizeof(mWindow)) return;
+
+    const uint32_t first  = read32(mWindow);
+    const uint32_t second = read32(mWindow + 4);
+    if (second == first + 1) {
+        mLocked   = true;
+        mExpected = second + 1;
+        mBad      = 0;
+        mFill     = 0;
+        return;
+    }
+
+    memmove(mWindow, mWindow + 1, sizeof(mWindow) - 1);
+    mFill = sizeof(mWindow) - 1;
+    ++mSkipped;
+}
+
+void cdc::PatternChecker::check(uint32_t word)
+{
+    ++mWords;
+    if (word == mExpected) {
+        mBad      = 0;
+        mExpected = word + 1;
+        return;
+    }
+
+    ++mErrors;
+    if (++mBad < 2) {
+        /* a lost or repeated word: follow the new value */
+        mExpected = word + 1;
+        return;
+    }
+
+    /* out of step: the byte alignment changed */
+    mLocked = false;
+    ++mResyncs;
+}
+
+int cdc::openSerial(const std::string &path, std::string &error)
+{
+    const int fd = open(path.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        error = path + ": " + strerror(errno);
+        return -1;
+    }
+    if (!makeRaw(fd)) {
+        error = path + ": cannot set raw mode: " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+
+    /* Drop whatever the line buffered before it was raw. */
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+int cdc::openPtyStandIn(pid_t &child, std::string &error)
+{
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        error = std::string("pseudo terminal: ") + strerror(errno);
+        if (master >= 0) close(master);
+        return -1;
+    }
+
+    const char *name  = ptsname(master);
+    const int   slave = (name != nullptr) ? open(name, O_RDWR | O_NOCTTY) : -1;
+    if (slave < 0 || !makeRaw(slave)) {
+        error = std::string("pseudo terminal slave: ") + strerror(errno);
+        if (slave >= 0) close(slave);
+        close(master);
+        return -1;
+    }
+
+    child = fork();
+    if (child < 0) {
+        error = std::string("fork: ") + strerror(errno);
+        close(slave);
+        close(master);
+        return -1;
+    }
+    if (child == 0) {
+        close(slave);
+        feedPattern(master);
+        _exit(0);
+    }
+
+    close(master);
+    return slave;
+}
+
+double cdc::receive(int fd, uint64_t limit, int timeout_ms, PatternChecker &checker)
+{
+    uint8_t      buf[16384];
+    const double start = now();
+
+    while (checker.bytes() < limit) {
+        struct pollfd pfd;
+        pfd.fd      = fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        const int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) return -1.0;
+        if (ready == 0) break;
+
+        const uint64_t left  = limit - checker.bytes();
+        const size_t   want  = (left < sizeof(buf)) ? static_cast<size_t>(left) : sizeof(buf);
+        const ssize_t  count = read(fd, buf, want);
+        if (count < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (count < 0) return -1.0;
+        if (count == 0) break;
+
+        checker.feed(buf, static_cast<size_t>(count));
+    }
+
+    return now() - start;
+}
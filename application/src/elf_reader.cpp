@@ -0,0 +1,103 @@
+#include "app/elf_reader.hpp"
+
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+uint16_t read16(const std::vector<uint8_t> &buf, size_t off)
+{
+    return static_cast<uint16_t>(buf[off] | (buf[off + 1] << 8));
+}
+
+uint32_t read32(const std::vector<uint8_t> &buf, size_t off)
+{
+    return static_cast<uint32_t>(buf[off])             |
+           (static_cast<uint32_t>(buf[off + 1]) << 8)  |
+           (static_cast<uint32_t>(buf[off + 2]) << 16) |
+           (static_cast<uint32_t>(buf[off + 3]) << 24);
+}
+
+}
+
+bool elf::load(const std::string &path, std::vector<Section> &sections, std::string &error)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    const std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)),
+                                   std::istreambuf_iterator<char>());
+
+    /* Identification: magic, 32 bit class (1), little endian data (1). */
+    if (buf.size() < 52 || buf[0] != 0x7F || buf[1] != 'E' || buf[2] != 'L' || buf[3] != 'F' ||
+        buf[4] != 1 || buf[5] != 1) {
+        error = path + " is not a 32 bit little endian ELF file";
+        return false;
+    }
+
+    const uint32_t shoff     = read32(buf, 0x20);
+    const uint16_t shentsize = read16(buf, 0x2E);
+    const uint16_t shnum     = read16(buf, 0x30);
+    const uint16_t shstrndx  = read16(buf, 0x32);
+
+    if (shentsize < 40 || shstrndx >= shnum ||
+        static_cast<uint64_t>(shoff) + static_cast<uint64_t>(shnum) * shentsize > buf.size()) {
+        error = path + " has a corrupt section header table";
+        return false;
+    }
+
+    /* Section names live in the section header string table. */
+    const size_t   strhdr = shoff + static_cast<size_t>(shstrndx) * shentsize;
+    const uint32_t stroff = read32(buf, strhdr + 0x10);
+    const uint32_t strsz  = read32(buf, strhdr + 0x14);
+
+    sections.clear();
+    for (uint16_t i = 0; i < shnum; ++i) {
+        const size_t hdr = shoff + static_cast<size_t>(i) * shentsize;
+
+        Section sec;
+        const uint32_t name = read32(buf, hdr + 0x00);
+        sec.type            = read32(buf, hdr + 0x04);
+        sec.flags           = read32(buf, hdr + 0x08);
+        sec.addr            = read32(buf, hdr + 0x0C);
+        const uint32_t off  = read32(buf, hdr + 0x10);
+        const uint32_t size = read32(buf, hdr + 0x14);
+
+        for (uint32_t c = name; c < strsz && stroff + c < buf.size() && buf[stroff + c] != 0; ++c) {
+            sec.name.push_back(static_cast<char>(buf[stroff + c]));
+        }
+
+        if (sec.type != SHT_NOBITS && static_cast<uint64_t>(off) + size <= buf.size()) {
+            sec.data.assign(buf.begin() + off, buf.begin() + off + size);
+        }
+
+        sections.push_back(sec);
+    }
+
+    return true;
+}
+
+const elf::Section *elf::find(const std::vector<Section> &sections, const std::string &name)
+{
+    for (size_t i = 0; i < sections.size(); ++i) {
+        if (sections[i].name == name) {
+            return &sections[i];
+        }
+    }
+    return nullptr;
+}
+
+const elf::Section *elf::findAddress(const std::vector<Section> &sections, uint32_t addr)
+{
+    for (size_t i = 0; i < sections.size(); ++i) {
+        const Section &sec = sections[i];
+        if ((sec.flags & SHF_ALLOC) && !sec.data.empty() &&
+            addr >= sec.addr && addr - sec.addr < sec.data.size()) {
+            return &sec;
+        }
+    }
+    return nullptr;
+}
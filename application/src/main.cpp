@@ -1,10 +1,118 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
 #include <iostream>
+#include <vector>
 
+#include "app/cdc_receiver.hpp"
 #include "app/cfuncs.h"
+#include "app/elf_reader.hpp"
 #include "app/funcs.hpp"
+#include "app/token_decoder.hpp"
+
+/*
+ * Decode a tokenized log capture (file or stdin) of the STM32 template:
+ *
+ *      template_program <firmware.elf> [capture.bin]
+ */
+static int decode(const char *elf_path, const char *capture_path)
+{
+    std::vector<elf::Section> sections;
+    std::string               error;
+    if (!elf::load(elf_path, sections, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if (elf::find(sections, token::SECTION) == nullptr) {
+        std::cerr << elf_path << ": no " << token::SECTION << " section\n";
+        return 1;
+    }
+
+    token::Decoder decoder(sections);
+    if (capture_path == nullptr) {
+        decoder.run(std::cin, std::cout);
+    } else {
+        std::ifstream capture(capture_path, std::ios::binary);
+        if (!capture) {
+            std::cerr << capture_path << ": cannot open\n";
+            return 1;
+        }
+        decoder.run(capture, std::cout);
+    }
+
+    if (decoder.skipped() != 0) {
+        std::cerr << decoder.skipped() << " bytes skipped while resyncing\n";
+    }
+    return 0;
+}
+
+/*
+ * Receive the USB CDC test pattern of the STM32 template (USB_STREAM=1)
+ * and report throughput and sequence errors:
+ *
+ *      template_program --cdc <device> [bytes]
+ *      template_program --cdc-pty [bytes]
+ *
+ * --cdc-pty runs the same receiver against a pseudo terminal fed by a child
+ * process instead of the board.
+ */
+static int receiveCdc(const char *device, const char *bytes_arg)
+{
+    static const uint64_t DEFAULT_BYTES = 4 * 1024 * 1024;
+    static const int      TIMEOUT_MS    = 2000;
 
-int main(void)
+    const uint64_t limit = (bytes_arg != nullptr) ? strtoull(bytes_arg, nullptr, 0) : DEFAULT_BYTES;
+
+    std::string error;
+    pid_t       child = -1;
+    const int   fd    = (device != nullptr) ? cdc::openSerial(device, error) : cdc::openPtyStandIn(child, error);
+    if (fd < 0) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    cdc::PatternChecker checker;
+    const double        seconds = cdc::receive(fd, limit, TIMEOUT_MS, checker);
+    const int           failure = errno;
+
+    /* The cleanup below may change errno. */
+    close(fd);
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+    }
+
+    if (seconds < 0) {
+        std::cerr << "read failed: " << strerror(failure) << "\n";
+        return 1;
+    }
+
+    const double rate = (seconds > 0) ? checker.bytes() / seconds : 0;
+    std::cout << "received " << checker.bytes() << " bytes in " << seconds << " s ("
+              << static_cast<uint64_t>(rate / 1000) << " kB/s)\n"
+              << "words " << checker.words() << ", errors " << checker.errors()
+              << ", resyncs " << checker.resyncs() << ", skipped " << checker.skipped() << " bytes\n";
+
+    return (checker.words() != 0 && checker.errors() == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
 {
+    if (argc >= 3 && strcmp(argv[1], "--cdc") == 0) {
+        return receiveCdc(argv[2], (argc >= 4) ? argv[3] : nullptr);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--cdc-pty") == 0) {
+        return receiveCdc(nullptr, (argc >= 3) ? argv[2] : nullptr);
+    }
+    if (argc >= 2) {
+        return decode(argv[1], (argc >= 3) ? argv[2] : nullptr);
+    }
+
     std::cout << "Hello from the main function\n";
     cfuncs_hello();
     funcs::hello();
@@ -0,0 +1,205 @@
+#include "app/token_decoder.hpp"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+/* little endian value of up to 8 payload bytes (0 if out of range) */
+uint64_t take(const std::vector<uint8_t> &payload, size_t &pos, size_t size)
+{
+    uint64_t value = 0;
+    if (pos + size > payload.size()) {
+        pos = payload.size() + 1;
+        return 0;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(payload[pos + i]) << (8 * i);
+    }
+    pos += size;
+    return value;
+}
+
+}
+
+token::Decoder::Decoder(const std::vector<elf::Section> &sections) :
+    mSections(sections),
+    mStrings(elf::find(sections, SECTION)),
+    mSkipped(0)
+{ }
+
+std::string token::Decoder::lookup(uint32_t tok, bool &found) const
+{
+    found = false;
+    if (mStrings == nullptr || tok < mStrings->addr) return std::string();
+
+    const size_t off = tok - mStrings->addr;
+    if (off >= mStrings->data.size()) return std::string();
+
+    const char  *str = reinterpret_cast<const char *>(&mStrings->data[off]);
+    const size_t max = mStrings->data.size() - off;
+    found = true;
+    return std::string(str, strnlen(str, max));
+}
+
+std::string token::Decoder::resolve(uint32_t addr) const
+{
+    const elf::Section *sec = elf::findAddress(mSections, addr);
+    if (sec == nullptr) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "<str@0x%08x>", addr);
+        return buf;
+    }
+
+    const size_t off = addr - sec->addr;
+    const char  *str = reinterpret_cast<const char *>(&sec->data[off]);
+    return std::string(str, strnlen(str, sec->data.size() - off));
+}
+
+std::string token::Decoder::format(uint32_t tok, const std::vector<uint8_t> &payload) const
+{
+    bool found = false;
+    const std::string fmt = lookup(tok, found);
+    if (!found) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "<unknown token 0x%08x, %u bytes>", tok,
+                 static_cast<unsigned>(payload.size()));
+        return buf;
+    }
+
+    std::string out;
+    size_t      pos = 0;
+    size_t      i   = 0;
+
+    while (i < fmt.size()) {
+        if (fmt[i] != '%') {
+            out.push_back(fmt[i++]);
+            continue;
+        }
+
+        /*
+         * Split the conversion into flags/width/precision (kept as is),
+         * length modifier (determines the argument size on the target) and
+         * the conversion character.
+         */
+        std::string spec("%");
+        ++i;
+        while (i < fmt.size() && strchr("-+ #0", fmt[i]) != nullptr) spec.push_back(fmt[i++]);
+        while (i < fmt.size() && (isdigit(static_cast<unsigned char>(fmt[i])) || fmt[i] == '.' || fmt[i] == '*')) {
+            if (fmt[i] == '*') {
+                /* Star width/precision arguments are plain ints. */
+                const int32_t arg = static_cast<int32_t>(take(payload, pos, 4));
+                spec += std::to_string(arg);
+                ++i;
+            } else {
+                spec.push_back(fmt[i++]);
+            }
+        }
+
+        std::string length;
+        while (i < fmt.size() && strchr("hljztL", fmt[i]) != nullptr) length.push_back(fmt[i++]);
+        if (i >= fmt.size()) break;
+
+        const char conv = fmt[i++];
+        const bool wide = (length == "ll" || length == "j");
+        char       buf[128];
+
+        switch (conv) {
+        case '%':
+            out.push_back('%');
+            continue;
+
+        case 'd':
+        case 'i': {
+            int64_t value = wide ? static_cast<int64_t>(take(payload, pos, 8))
+                                 : static_cast<int32_t>(take(payload, pos, 4));
+            if (length == "h")  value = static_cast<int16_t>(value);
+            if (length == "hh") value = static_cast<int8_t>(value);
+            snprintf(buf, sizeof(buf), (spec + "lld").c_str(), static_cast<long long>(value));
+            break;
+        }
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            uint64_t value = wide ? take(payload, pos, 8) : take(payload, pos, 4);
+            if (length == "h")  value = static_cast<uint16_t>(value);
+            if (length == "hh") value = static_cast<uint8_t>(value);
+            snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), static_cast<unsigned long long>(value));
+            break;
+        }
+
+        case 'c':
+            snprintf(buf, sizeof(buf), (spec + "c").c_str(), static_cast<int>(take(payload, pos, 4)));
+            break;
+
+        case 'p':
+            snprintf(buf, sizeof(buf), "0x%08x", static_cast<unsigned>(take(payload, pos, 4)));
+            break;
+
+        case 's':
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(),
+                     resolve(static_cast<uint32_t>(take(payload, pos, 4))).c_str());
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            const uint64_t bits  = take(payload, pos, 8);
+            double         value = 0;
+            memcpy(&value, &bits, sizeof(value));
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), value);
+            break;
+        }
+
+        default:
+            snprintf(buf, sizeof(buf), "<bad conversion %%%c>", conv);
+            break;
+        }
+
+        if (pos > payload.size()) {
+            out += "<missing argument>";
+            break;
+        }
+        out += buf;
+    }
+
+    return out;
+}
+
+void token::Decoder::run(std::istream &in, std::ostream &out)
+{
+    std::vector<uint8_t> payload;
+    char                 byte = 0;
+
+    while (in.get(byte)) {
+        if (static_cast<uint8_t>(byte) != SYNC) {
+            ++mSkipped;
+            continue;
+        }
+
+        uint8_t hdr[5];
+        if (!in.read(reinterpret_cast<char *>(hdr), sizeof(hdr))) break;
+
+        const uint32_t tok = static_cast<uint32_t>(hdr[0])         |
+                             (static_cast<uint32_t>(hdr[1]) << 8)  |
+                             (static_cast<uint32_t>(hdr[2]) << 16) |
+                             (static_cast<uint32_t>(hdr[3]) << 24);
+
+        payload.resize(hdr[4]);
+        if (!payload.empty() && !in.read(reinterpret_cast<char *>(&payload[0]), payload.size())) break;
+
+        std::string line = format(tok, payload);
+        if (line.empty() || line[line.size() - 1] != '\n') {
+            line.push_back('\n');
+        }
+        out << line;
+    }
+}
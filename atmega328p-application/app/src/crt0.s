@@ -61,26 +61,62 @@ __my_startup:
 
 .func  __do_copy_data
 
+; Copy the .data load image from ROM to RAM. The byte count is computed once
+; and the copy runs 8 bytes per loop pass: 8 x (lpm 3 + st 2) + sbiw 2 +
+; brne 2 = 44 cycles, 5.5 cycles per byte instead of the 9 of a byte loop
+; that compares the pointer against the end on every byte. The leftover
+; count & 7 bytes are copied one at a time first.
+
 __do_copy_data:
 
-  ldi  r17, hi8(__data_end)
   ldi  r26, lo8(__data_start)
   ldi  r27, hi8(__data_start)
   ldi  r30, lo8(__data_load_start)
   ldi  r31, hi8(__data_load_start)
+  ldi  r24, lo8(__data_end)
+  ldi  r25, hi8(__data_end)
+  sub  r24, r26
+  sbc  r25, r27
 
-  rjmp  .L__do_copy_data_start
+  mov  r18, r24
+  andi r18, 7
+  breq .L__do_copy_data_blocks
 
-  .L__do_copy_data_loop:
+  .L__do_copy_data_byte:
 
   lpm  r0, Z+
-  st  X+, r0
+  st   X+, r0
+  dec  r18
+  brne .L__do_copy_data_byte
+
+  .L__do_copy_data_blocks:
 
-  .L__do_copy_data_start:
+  andi r24, 0xF8
+  adiw r24, 0
+  breq .L__do_copy_data_done
 
-  cpi  r26, lo8(__data_end)
-  cpc  r27, r17
-  brne  .L__do_copy_data_loop
+  .L__do_copy_data_loop:
+
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  lpm  r0, Z+
+  st   X+, r0
+  sbiw r24, 8
+  brne .L__do_copy_data_loop
+
+  .L__do_copy_data_done:
 
   ret
 .endfunc
@@ -89,23 +125,51 @@ __do_copy_data:
 
 .func  __do_clear_bss
 
+; Zero the .bss section 8 bytes per loop pass: 8 x st 2 + sbiw 2 + brne 2 =
+; 20 cycles, 2.5 cycles per byte instead of 6. The leftover count & 7 bytes
+; are cleared one at a time first. The .noinit section follows .bss and is
+; not touched. r1 is the zero register.
+
 __do_clear_bss:
 
-  ldi r17, hi8(__bss_end)
-  ldi r26, lo8(__bss_end)
-  ldi r27, hi8(__bss_start)
-  rjmp .L__do_clear_bss_start
+  ldi  r26, lo8(__bss_start)
+  ldi  r27, hi8(__bss_start)
+  ldi  r24, lo8(__bss_end)
+  ldi  r25, hi8(__bss_end)
+  sub  r24, r26
+  sbc  r25, r27
 
-  .L__do_clear_bss_loop:
+  mov  r18, r24
+  andi r18, 7
+  breq .L__do_clear_bss_blocks
 
-  ST X+, R1
+  .L__do_clear_bss_byte:
 
-  .L__do_clear_bss_start:
+  st   X+, r1
+  dec  r18
+  brne .L__do_clear_bss_byte
 
-  cpi r26, lo8(__bss_end)
-  cpc r27, r17
+  .L__do_clear_bss_blocks:
+
+  andi r24, 0xF8
+  adiw r24, 0
+  breq .L__do_clear_bss_done
+
+  .L__do_clear_bss_loop:
+
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  st   X+, r1
+  sbiw r24, 8
   brne .L__do_clear_bss_loop
 
+  .L__do_clear_bss_done:
+
   ret
 .endfunc
 
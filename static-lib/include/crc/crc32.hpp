@@ -0,0 +1,175 @@
+#ifndef CRC_CRC32_HPP
+#define CRC_CRC32_HPP
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+
+/*
+ * CRC-32 (IEEE 802.3, the one of zlib, PNG and Python's binascii.crc32):
+ * reflected polynomial 0xEDB88320, initial value and final XOR 0xFFFFFFFF.
+ *
+ * The software implementation processes 8 bytes per step with eight 256
+ * entry tables ("slicing-by-8"). The tables are computed by the compiler,
+ * take 8 KiB of read-only memory and are kept in flash on the AVR. Bytes
+ * are always consumed in memory order, so the result is the same on every
+ * target whatever its endianness or alignment rules.
+ *
+ * Results chain: crc32(b, n, crc32(a, m)) is the CRC of a followed by b.
+ * Targets with a CRC unit provide their own front end that falls back to
+ * these functions (see the STM32 crc_unit.hpp).
+ */
+namespace crc {
+
+/* reflected CRC-32 polynomial */
+static constexpr uint32_t POLY = 0xEDB88320UL;
+
+/* register value before the first byte, and XOR applied to the result */
+static constexpr uint32_t INIT = 0xFFFFFFFFUL;
+
+/* CRC-32 of the ASCII string "123456789" */
+static constexpr uint32_t CHECK = 0xCBF43926UL;
+
+namespace detail {
+
+    /* one input bit shifted through the register */
+    static constexpr uint32_t bits(uint32_t value, uint32_t count)
+    {
+        return (count == 0) ? value : bits((value >> 1) ^ ((value & 1) ? POLY : 0), count - 1);
+    }
+
+    /* one zero byte shifted through the register */
+    static constexpr uint32_t zero(uint32_t value)
+    {
+        return (value >> 8) ^ bits(value & 0xFF, 8);
+    }
+
+    /*
+     * Table entry: slice 0 is the classic byte table, slice k is the CRC of
+     * the byte followed by k zero bytes.
+     */
+    static constexpr uint32_t entry(uint32_t slice, uint32_t byte)
+    {
+        return (slice == 0) ? bits(byte, 8) : zero(entry(slice - 1, byte));
+    }
+
+    template <uint32_t... I>
+    struct Indices { };
+
+    /* the sequence followed by a copy shifted by Offset */
+    template <typename Sequence, uint32_t Offset>
+    struct Twice;
+
+    template <uint32_t... I, uint32_t Offset>
+    struct Twice<Indices<I...>, Offset> {
+        typedef Indices<I..., (I + Offset)...> Type;
+    };
+
+    /* 0 .. N - 1 for a power of two N, built by doubling (log2(N) deep) */
+    template <uint32_t N>
+    struct MakeIndices {
+        typedef typename Twice<typename MakeIndices<N / 2>::Type, N / 2>::Type Type;
+    };
+
+    template <>
+    struct MakeIndices<1> {
+        typedef Indices<0> Type;
+    };
+
+    /* number of tables and entries per table */
+    static constexpr uint32_t SLICES  = 8;
+    static constexpr uint32_t ENTRIES = 256;
+
+    /* all tables in one array, slice major */
+    struct Table {
+        uint32_t values[SLICES * ENTRIES];
+    };
+
+    template <uint32_t... I>
+    static constexpr Table build(Indices<I...>)
+    {
+        return Table{ { entry(I / ENTRIES, I % ENTRIES)... } };
+    }
+
+#if defined(__AVR__)
+    /*
+     * Kept in flash: the AVR copies .rodata to its 2 KiB of RAM. GCC drops
+     * section attributes of template members, so this is a plain static and
+     * every translation unit calling update() carries its own copy. Keep the
+     * CRC calls of an AVR program in one module.
+     */
+    static const Table TABLE PROGMEM = build(MakeIndices<SLICES * ENTRIES>::Type());
+#else
+    /* a template so that the table is emitted once for the whole program */
+    template <typename Unused = void>
+    struct Tables {
+        static constexpr Table TABLE = build(MakeIndices<SLICES * ENTRIES>::Type());
+    };
+
+    template <typename Unused>
+    constexpr Table Tables<Unused>::TABLE;
+#endif
+
+    static inline uint32_t lookup(uint32_t slice, uint32_t byte)
+    {
+#if defined(__AVR__)
+        return pgm_read_dword(&TABLE.values[slice * ENTRIES + byte]);
+#else
+        return Tables<>::TABLE.values[slice * ENTRIES + byte];
+#endif
+    }
+
+    /* four bytes in memory order as a little endian word */
+    static inline uint32_t load(const uint8_t *bytes)
+    {
+        return  static_cast<uint32_t>(bytes[0])        |
+               (static_cast<uint32_t>(bytes[1]) << 8)  |
+               (static_cast<uint32_t>(bytes[2]) << 16) |
+               (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+}
+
+/*
+ * Advance a raw CRC register (no initial value, no final XOR) over length
+ * bytes. Building block for front ends that split a buffer between
+ * hardware and software.
+ */
+static inline uint32_t update(uint32_t reg, const void *data, uint32_t length)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+    while (length >= detail::SLICES) {
+        const uint32_t low  = detail::load(bytes) ^ reg;
+        const uint32_t high = detail::load(bytes + 4);
+
+        reg = detail::lookup(7,  low         & 0xFF) ^
+              detail::lookup(6, (low  >> 8)  & 0xFF) ^
+              detail::lookup(5, (low  >> 16) & 0xFF) ^
+              detail::lookup(4,  low  >> 24)         ^
+              detail::lookup(3,  high        & 0xFF) ^
+              detail::lookup(2, (high >> 8)  & 0xFF) ^
+              detail::lookup(1, (high >> 16) & 0xFF) ^
+              detail::lookup(0,  high >> 24);
+
+        bytes  += detail::SLICES;
+        length -= detail::SLICES;
+    }
+
+    while (length-- != 0) {
+        reg = (reg >> 8) ^ detail::lookup(0, (reg ^ *bytes++) & 0xFF);
+    }
+
+    return reg;
+}
+
+/* CRC-32 of length bytes, continuing from the CRC of the preceding data */
+static inline uint32_t crc32(const void *data, uint32_t length, uint32_t previous = 0)
+{
+    return update(previous ^ INIT, data, length) ^ INIT;
+}
+
+} /* namespace crc */
+
+#endif /* CRC_CRC32_HPP */
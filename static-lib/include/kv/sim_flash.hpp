@@ -0,0 +1,113 @@
+#ifndef KV_SIM_FLASH_HPP
+#define KV_SIM_FLASH_HPP
+
+#include <stdint.h>
+
+namespace kv {
+
+/*
+ * RAM simulation of NOR flash pages with the rules of the STM32F1 flash
+ * controller, as a kv::Store backend for host builds:
+ *
+ *  - erase() sets a whole page to 0xFF,
+ *  - program() writes half words to erased locations only (0x0000 may be
+ *    written over anything) and fails like PGERR otherwise.
+ *
+ * powerFail(n) lets the next n operations (half words or page erases)
+ * through and then cuts the power: the operation in progress is torn (a
+ * half written half word, a half erased page) and everything after fails
+ * until restore(). Mounting a new store on the same flash then replays a
+ * power cycle. erases() counts the erase cycles of each page.
+ */
+template <uint32_t PageSize, uint32_t Pages>
+class SimFlash {
+
+    static_assert(PageSize % 2 == 0, "pages hold whole half words");
+
+    public:
+        static constexpr uint32_t PAGE_SIZE = PageSize;
+        static constexpr uint32_t PAGES     = Pages;
+
+        SimFlash(void) : mMemory(), mErases(), mBudget(UNLIMITED)
+        {
+            for (uint32_t i = 0; i < PAGE_SIZE * PAGES; ++i) {
+                mMemory[i] = 0xFF;
+            }
+        }
+
+        SimFlash(const SimFlash &) = delete;
+        SimFlash &operator=(const SimFlash &) = delete;
+
+        const uint8_t *base(void) const { return mMemory; }
+
+        bool program(uint32_t offset, const uint16_t *values, uint32_t count)
+        {
+            if (offset % 2 != 0 || offset + 2 * count > PAGE_SIZE * PAGES) return false;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                if (mBudget == OFF) return false;
+
+                uint8_t *cell = &mMemory[offset + 2 * i];
+                const uint32_t current = cell[0] | (static_cast<uint32_t>(cell[1]) << 8);
+                if (current != 0xFFFF && values[i] != 0) return false;
+
+                if (!spend()) {
+                    /* torn: only the low byte made it */
+                    cell[0] &= static_cast<uint8_t>(values[i]);
+                    return false;
+                }
+                cell[0] &= static_cast<uint8_t>(values[i]);
+                cell[1] &= static_cast<uint8_t>(values[i] >> 8);
+            }
+            return true;
+        }
+
+        bool erase(uint32_t page)
+        {
+            if (page >= PAGES || mBudget == OFF) return false;
+
+            const bool     complete = spend();
+            const uint32_t length   = complete ? PAGE_SIZE : PAGE_SIZE / 2;
+            for (uint32_t i = 0; i < length; ++i) {
+                mMemory[page * PAGE_SIZE + i] = 0xFF;
+            }
+            if (complete) {
+                ++mErases[page];
+            }
+            return complete;
+        }
+
+        /* cut the power after the next operations */
+        void powerFail(uint32_t operations) { mBudget = operations; }
+
+        /* power back on */
+        void restore(void) { mBudget = UNLIMITED; }
+
+        bool powered(void) const { return mBudget != OFF; }
+
+        uint32_t erases(uint32_t page) const { return mErases[page]; }
+
+    private:
+        static constexpr uint32_t UNLIMITED = 0xFFFFFFFFUL;
+        static constexpr uint32_t OFF       = 0xFFFFFFFEUL;
+
+        /* take one operation from the budget, false if it is the torn one */
+        bool spend(void)
+        {
+            if (mBudget == UNLIMITED) return true;
+            if (mBudget == 0) {
+                mBudget = OFF;
+                return false;
+            }
+            --mBudget;
+            return true;
+        }
+
+        uint8_t  mMemory[PAGE_SIZE * PAGES];
+        uint32_t mErases[PAGES];
+        uint32_t mBudget;
+};
+
+} /* namespace kv */
+
+#endif /* KV_SIM_FLASH_HPP */
@@ -0,0 +1,500 @@
+#ifndef KV_STORE_HPP
+#define KV_STORE_HPP
+
+#include <stdint.h>
+
+#include "crc/crc32.hpp"
+
+namespace kv {
+
+/*
+ * Log-structured key-value store on NOR flash pages.
+ *
+ * Every update appends a record to the newest page, nothing is ever written
+ * twice in place. A RAM index maps each key (0 .. MaxKeys - 1) to its newest
+ * record, so lookups are a table access and reads come straight out of the
+ * memory mapped flash.
+ *
+ *      page    | header | record | record | ... | erased |
+ *      header  | magic (16) | state (16) | sequence number (32) |
+ *      record  | key (16) | length (16) | crc32 (32) | data, padded to 4 |
+ *
+ * Pages are opened in ring order with increasing sequence numbers, so they
+ * wear evenly. Space is reclaimed from the oldest page: its records that are
+ * still current are appended again, then the page is marked obsolete and
+ * erased. maintain() does one such step (one record copy or one page erase)
+ * per call, keeping the long erase out of the write path. One erased page is
+ * held back so that a compaction can always complete.
+ *
+ * A record is written key and length first, then the data and the CRC last,
+ * so a write cut short by a power loss fails the CRC. The CRC also covers
+ * the record's own offset, so neither stale data nor a record image inside a
+ * value passes for a record anywhere else. mount() rebuilds the index with
+ * one pass over the pages (sequence order, newest record wins) and steps
+ * over damage in 4 byte increments up to the next valid record or the
+ * erased space, where appending resumes. Pages with a damaged header or
+ * marked obsolete are erased by the next maintain().
+ *
+ * The Flash backend provides:
+ *
+ *      static constexpr uint32_t PAGE_SIZE, PAGES
+ *      const uint8_t *base(void) const             memory mapped pages
+ *      bool program(uint32_t offset, const uint16_t *values, uint32_t count)
+ *      bool erase(uint32_t page)
+ *
+ * program() writes half words to erased (0xFFFF) locations, or 0x0000 over
+ * anything, like the STM32F1 flash controller. See kv/sim_flash.hpp for a
+ * RAM backed simulation.
+ *
+ * Not reentrant: all calls must come from the same context.
+ */
+template <typename Flash, uint32_t MaxKeys>
+class Store {
+
+    static_assert(Flash::PAGES >= 3, "needs a page for data, one to compact into and a spare");
+    static_assert(Flash::PAGE_SIZE % 4 == 0 && Flash::PAGE_SIZE <= 0x10000, "unsupported page size");
+    static_assert(MaxKeys > 0 && MaxKeys < 0xFFFF, "key 0xFFFF marks erased flash");
+
+    public:
+        /* page header and record header sizes */
+        static constexpr uint32_t PAGE_HEADER   = 8;
+        static constexpr uint32_t RECORD_HEADER = 8;
+
+        /*
+         * Largest value. A page is closed when the next record does not fit,
+         * so records of at most a quarter page waste less than that.
+         */
+        static constexpr uint32_t MAX_LENGTH = ((Flash::PAGE_SIZE - PAGE_HEADER) / 4 - RECORD_HEADER) & ~3UL;
+
+        explicit Store(Flash &flash) :
+            mFlash(flash), mIndex(), mState(), mSeq(), mHead(NONE), mHeadOffset(0),
+            mNextSeq(0), mCompactPage(NONE), mCompactOffset(0), mLive(0)
+        { }
+
+        Store(const Store &) = delete;
+        Store &operator=(const Store &) = delete;
+
+        /* rebuild the index from flash (after power up) */
+        void mount(void)
+        {
+            for (uint32_t key = 0; key < MaxKeys; ++key) {
+                mIndex[key] = 0;
+            }
+            mHead        = NONE;
+            mHeadOffset  = 0;
+            mNextSeq     = 0;
+            mCompactPage = NONE;
+
+            for (uint32_t page = 0; page < Flash::PAGES; ++page) {
+                const uint32_t at = page * Flash::PAGE_SIZE;
+                if (load16(at) == MAGIC && load16(at + 2) == ACTIVE) {
+                    mState[page] = State::LOG;
+                    mSeq[page]   = load32(at + 4);
+                } else if (blank(at, Flash::PAGE_SIZE)) {
+                    mState[page] = State::ERASED;
+                } else {
+                    mState[page] = State::DIRTY;
+                }
+            }
+
+            /* replay the pages oldest first */
+            for (uint32_t page = oldest(NONE); page != NONE; page = newer(page)) {
+                Record   record;
+                uint32_t offset = seek(page, PAGE_HEADER, record);
+                while (record.valid) {
+                    if (record.key < MaxKeys) {
+                        mIndex[record.key] = (record.length != 0) ? page * Flash::PAGE_SIZE + offset : 0;
+                    }
+                    offset = seek(page, offset + size(record.length), record);
+                }
+
+                mHead       = page;
+                mHeadOffset = offset;
+                mNextSeq    = mSeq[page] + 1;
+            }
+
+            mLive = 0;
+            for (uint32_t key = 0; key < MaxKeys; ++key) {
+                if (mIndex[key] != 0) {
+                    mLive += size(load16(mIndex[key] + 2));
+                }
+            }
+        }
+
+        bool contains(uint32_t key) const { return key < MaxKeys && mIndex[key] != 0; }
+
+        /* length of the value, 0 if the key is not set */
+        uint32_t length(uint32_t key) const
+        {
+            return contains(key) ? load16(mIndex[key] + 2) : 0;
+        }
+
+        /* the value in place (valid until the next update), nullptr if not set */
+        const uint8_t *data(uint32_t key) const
+        {
+            return contains(key) ? mFlash.base() + mIndex[key] + RECORD_HEADER : nullptr;
+        }
+
+        /* copy up to capacity bytes of the value out, returns the length copied */
+        uint32_t read(uint32_t key, void *value, uint32_t capacity) const
+        {
+            const uint8_t *source = data(key);
+            const uint32_t count  = (length(key) < capacity) ? length(key) : capacity;
+            uint8_t       *target = static_cast<uint8_t *>(value);
+            for (uint32_t i = 0; i < count; ++i) {
+                target[i] = source[i];
+            }
+            return count;
+        }
+
+        /*
+         * Store a value (1 to MAX_LENGTH bytes). Rewriting the current value
+         * costs nothing. Compacts synchronously if maintain() did not keep
+         * up. Returns false if the value does not fit or on a flash error.
+         */
+        bool set(uint32_t key, const void *value, uint32_t length)
+        {
+            if (key >= MaxKeys || length == 0 || length > MAX_LENGTH) return false;
+
+            if (this->length(key) == length && same(data(key), value, length)) return true;
+
+            const uint32_t previous = contains(key) ? size(this->length(key)) : 0;
+            if (mLive - previous + size(length) > capacity()) return false;
+            if (!makeRoom(size(length))) return false;
+
+            const uint32_t at = append(key, value, length, false);
+            if (at == 0) return false;
+
+            mIndex[key] = at;
+            mLive       = mLive - previous + size(length);
+            return true;
+        }
+
+        /* delete a key */
+        bool remove(uint32_t key)
+        {
+            if (!contains(key)) return true;
+            if (!makeRoom(RECORD_HEADER)) return false;
+            if (append(key, nullptr, 0, false) == 0) return false;
+
+            mLive      -= size(length(key));
+            mIndex[key] = 0;
+            return true;
+        }
+
+        /*
+         * One bounded step of background work: erase a damaged or obsolete
+         * page, or move one record out of the oldest page, or erase it.
+         * Works only while fewer than two pages are erased, and only on an
+         * oldest page whose current records fit in the newest, so every page
+         * erased is a page gained and nothing is shuffled around in vain.
+         * Returns true if it did something.
+         */
+        bool maintain(void)
+        {
+            if (count(State::DIRTY) == 0) {
+                if (count(State::ERASED) >= SPARE_PAGES) return false;
+
+                const uint32_t tail = oldest(NONE);
+                if (tail == NONE || tail == mHead || live(tail) > Flash::PAGE_SIZE - mHeadOffset) return false;
+            }
+            return compact();
+        }
+
+        /* bytes of current records, and the most the store accepts */
+        uint32_t used(void) const { return mLive; }
+        static constexpr uint32_t capacity(void)
+        {
+            return (Flash::PAGES - 2) * (Flash::PAGE_SIZE - PAGE_HEADER - size(MAX_LENGTH));
+        }
+
+    private:
+        static constexpr uint32_t NONE   = 0xFFFFFFFFUL;
+        static constexpr uint16_t MAGIC  = 0x4B56;    /* "VK" */
+        static constexpr uint16_t ACTIVE = 0xFFFF;
+
+        /* erased pages maintain() keeps: one for compaction, one for set() */
+        static constexpr uint32_t SPARE_PAGES = 2;
+
+        /* give up on a synchronous compaction after this many steps (two rounds) */
+        static constexpr uint32_t MAX_STEPS = 2 * Flash::PAGES * (Flash::PAGE_SIZE / RECORD_HEADER + 1);
+
+        enum class State : uint8_t { ERASED, LOG, DIRTY };
+
+        struct Record {
+            bool     valid;
+            uint32_t key;
+            uint32_t length;
+        };
+
+        /* flash footprint of a record */
+        static constexpr uint32_t size(uint32_t length)
+        {
+            return RECORD_HEADER + ((length + 3) & ~3UL);
+        }
+
+        uint32_t load16(uint32_t at) const
+        {
+            const uint8_t *bytes = mFlash.base() + at;
+            return bytes[0] | (static_cast<uint32_t>(bytes[1]) << 8);
+        }
+
+        uint32_t load32(uint32_t at) const
+        {
+            return load16(at) | (load16(at + 2) << 16);
+        }
+
+        bool blank(uint32_t at, uint32_t length) const
+        {
+            const uint8_t *bytes = mFlash.base() + at;
+            for (uint32_t i = 0; i < length; ++i) {
+                if (bytes[i] != 0xFF) return false;
+            }
+            return true;
+        }
+
+        static bool same(const uint8_t *stored, const void *value, uint32_t length)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(value);
+            for (uint32_t i = 0; i < length; ++i) {
+                if (stored[i] != bytes[i]) return false;
+            }
+            return true;
+        }
+
+        uint32_t count(State state) const
+        {
+            uint32_t n = 0;
+            for (uint32_t page = 0; page < Flash::PAGES; ++page) {
+                n += (mState[page] == state) ? 1 : 0;
+            }
+            return n;
+        }
+
+        /* oldest log page newer than after (NONE: the oldest of all) */
+        uint32_t oldest(uint32_t after) const
+        {
+            uint32_t found = NONE;
+            for (uint32_t page = 0; page < Flash::PAGES; ++page) {
+                if (mState[page] != State::LOG) continue;
+                if (after != NONE && mSeq[page] <= mSeq[after]) continue;
+                if (found == NONE || mSeq[page] < mSeq[found]) {
+                    found = page;
+                }
+            }
+            return found;
+        }
+
+        uint32_t newer(uint32_t page) const { return oldest(page); }
+
+        /* bytes of current records in page */
+        uint32_t live(uint32_t page) const
+        {
+            const uint32_t first = page * Flash::PAGE_SIZE;
+            uint32_t       bytes = 0;
+            for (uint32_t key = 0; key < MaxKeys; ++key) {
+                if (mIndex[key] != 0 && mIndex[key] >= first && mIndex[key] < first + Flash::PAGE_SIZE) {
+                    bytes += size(load16(mIndex[key] + 2));
+                }
+            }
+            return bytes;
+        }
+
+        /* CRC of a record at offset at */
+        static uint32_t crcOf(uint32_t at, uint32_t key, uint32_t length, const void *value)
+        {
+            const uint8_t header[8] = {
+                static_cast<uint8_t>(at), static_cast<uint8_t>(at >> 8),
+                static_cast<uint8_t>(at >> 16), static_cast<uint8_t>(at >> 24),
+                static_cast<uint8_t>(key), static_cast<uint8_t>(key >> 8),
+                static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+            };
+            return crc::crc32(value, length, crc::crc32(header, sizeof(header)));
+        }
+
+        bool valid(uint32_t page, uint32_t offset, Record &record) const
+        {
+            const uint32_t at = page * Flash::PAGE_SIZE + offset;
+            record.key    = load16(at);
+            record.length = load16(at + 2);
+
+            return offset + size(record.length) <= Flash::PAGE_SIZE &&
+                   crcOf(at, record.key, record.length, mFlash.base() + at + RECORD_HEADER) == load32(at + 4);
+        }
+
+        /*
+         * First record at or after offset. Damage is stepped over until the
+         * next valid record or the erased rest of the page. Returns the
+         * record's offset, or where the erased space starts (PAGE_SIZE if
+         * the page is full) with record.valid cleared.
+         */
+        uint32_t seek(uint32_t page, uint32_t offset, Record &record) const
+        {
+            record.valid = false;
+            for (; offset + RECORD_HEADER <= Flash::PAGE_SIZE; offset += 4) {
+                if (valid(page, offset, record)) {
+                    record.valid = true;
+                    return offset;
+                }
+                if (blank(page * Flash::PAGE_SIZE + offset, Flash::PAGE_SIZE - offset)) {
+                    return offset;
+                }
+            }
+            return Flash::PAGE_SIZE;
+        }
+
+        /* program length bytes at an even offset (an odd tail is padded) */
+        bool write(uint32_t at, const void *data, uint32_t length)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            uint16_t       chunk[16];
+
+            while (length != 0) {
+                uint32_t n = 0;
+                while (n < 16 && length != 0) {
+                    const uint32_t high = (length > 1) ? bytes[1] : 0xFF;
+                    chunk[n++] = static_cast<uint16_t>(bytes[0] | (high << 8));
+                    const uint32_t step = (length > 1) ? 2 : 1;
+                    bytes  += step;
+                    length -= step;
+                }
+                if (!mFlash.program(at, chunk, n)) return false;
+                at += 2 * n;
+            }
+            return true;
+        }
+
+        /* make an erased page the head (only the last one if reserve) */
+        bool open(bool reserve)
+        {
+            if (count(State::ERASED) <= (reserve ? 0 : 1)) return false;
+
+            uint32_t page = (mHead == NONE) ? 0 : mHead;
+            for (uint32_t i = 0; i < Flash::PAGES; ++i) {
+                page = (page + 1) % Flash::PAGES;
+                if (mState[page] == State::ERASED) break;
+            }
+
+            /* sequence number first: the magic commits the header */
+            const uint32_t at  = page * Flash::PAGE_SIZE;
+            const uint16_t seq[2] = { static_cast<uint16_t>(mNextSeq), static_cast<uint16_t>(mNextSeq >> 16) };
+            const uint16_t magic  = MAGIC;
+
+            mState[page] = State::DIRTY;
+            if (!mFlash.program(at + 4, seq, 2) || !mFlash.program(at, &magic, 1)) return false;
+
+            mState[page] = State::LOG;
+            mSeq[page]   = mNextSeq++;
+            mHead        = page;
+            mHeadOffset  = PAGE_HEADER;
+            return true;
+        }
+
+        bool fits(uint32_t bytes) const
+        {
+            return mHead != NONE && mHeadOffset + bytes <= Flash::PAGE_SIZE;
+        }
+
+        /*
+         * Compact until set() can append a record of bytes and still leave
+         * an erased page. While a compaction holds the last one, updates
+         * wait for it to finish, so they never take the room it needs.
+         */
+        bool makeRoom(uint32_t bytes)
+        {
+            for (uint32_t step = 0; count(State::ERASED) < (fits(bytes) ? 1 : SPARE_PAGES); ++step) {
+                if (step == MAX_STEPS || !compact()) return false;
+            }
+            return true;
+        }
+
+        /* append a record, returns its offset (0 on failure) */
+        uint32_t append(uint32_t key, const void *value, uint32_t length, bool reserve)
+        {
+            if (!fits(size(length)) && !open(reserve)) return 0;
+
+            const uint32_t at     = mHead * Flash::PAGE_SIZE + mHeadOffset;
+            const uint16_t head[2] = { static_cast<uint16_t>(key), static_cast<uint16_t>(length) };
+            const uint32_t crc    = crcOf(at, key, length, value);
+            const uint16_t tail[2] = { static_cast<uint16_t>(crc), static_cast<uint16_t>(crc >> 16) };
+
+            mHeadOffset += size(length);
+            if (!mFlash.program(at, head, 2) ||
+                !write(at + RECORD_HEADER, value, length) ||
+                !mFlash.program(at + 4, tail, 2)) {
+                mHeadOffset = Flash::PAGE_SIZE;
+                return 0;
+            }
+            return at;
+        }
+
+        /* one step of reclaiming space */
+        bool compact(void)
+        {
+            for (uint32_t page = 0; page < Flash::PAGES; ++page) {
+                if (mState[page] != State::DIRTY) continue;
+                if (!mFlash.erase(page)) return false;
+                mState[page] = State::ERASED;
+                return true;
+            }
+
+            const uint32_t tail = oldest(NONE);
+            if (tail == NONE || tail == mHead) return false;
+
+            if (mCompactPage != tail) {
+                mCompactPage   = tail;
+                mCompactOffset = PAGE_HEADER;
+            }
+
+            /* move the next current record */
+            Record record;
+            for (mCompactOffset = seek(tail, mCompactOffset, record); record.valid;
+                 mCompactOffset = seek(tail, mCompactOffset, record)) {
+                const uint32_t at = tail * Flash::PAGE_SIZE + mCompactOffset;
+                mCompactOffset += size(record.length);
+
+                if (record.key < MaxKeys && mIndex[record.key] == at) {
+                    const uint32_t moved = append(record.key, mFlash.base() + at + RECORD_HEADER,
+                                                  record.length, true);
+                    if (moved == 0) return false;
+                    mIndex[record.key] = moved;
+                    return true;
+                }
+            }
+
+            /* nothing current left: retire the page, then erase it */
+            const uint16_t obsolete = 0;
+            mFlash.program(tail * Flash::PAGE_SIZE + 2, &obsolete, 1);
+            mState[tail] = State::DIRTY;
+            mCompactPage = NONE;
+            if (!mFlash.erase(tail)) return false;
+            mState[tail] = State::ERASED;
+            return true;
+        }
+
+        Flash &mFlash;
+
+        /* offset of the newest record of each key, 0 if not set */
+        uint32_t mIndex[MaxKeys];
+
+        State    mState[Flash::PAGES];
+        uint32_t mSeq[Flash::PAGES];
+
+        /* page appended to and its write offset */
+        uint32_t mHead;
+        uint32_t mHeadOffset;
+
+        /* sequence number of the next page opened */
+        uint32_t mNextSeq;
+
+        /* page being compacted and the next record to look at */
+        uint32_t mCompactPage;
+        uint32_t mCompactOffset;
+
+        /* flash bytes of current records */
+        uint32_t mLive;
+};
+
+} /* namespace kv */
+
+#endif /* KV_STORE_HPP */
@@ -0,0 +1,197 @@
+#ifndef RING_MPSC_RING_HPP
+#define RING_MPSC_RING_HPP
+
+#include <stdint.h>
+
+#include "ring/port.hpp"
+#include "ring/span.hpp"
+
+namespace ring {
+
+/*
+ * Lock-free multiple producer, single consumer ring buffer.
+ *
+ * Producers claim slots by advancing mHead with compareExchange() and then
+ * fill them. Each slot carries a sequence number that tells the consumer
+ * whether the slot has been published yet, so a producer that is preempted
+ * between claiming and publishing only delays the consumer. No producer ever
+ * waits for another one, which matters when producers are interrupt handlers
+ * of different priorities.
+ *
+ * Slot sequence protocol for position p (slot p & MASK):
+ *
+ *      seq == p        free, may be claimed by the producer of position p
+ *      seq == p + 1    published, may be consumed
+ *      seq == p + N    consumed, free for the producer of position p + N
+ */
+template <typename T, uint32_t N>
+class MpscRing {
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(N <= port::MAX_CAPACITY / 2, "capacity too large for the port index type");
+
+    public:
+        typedef port::Index Index;
+
+        static constexpr uint32_t capacity(void) { return N; }
+
+        /* a span of claimed slots together with its ring position */
+        struct Claim {
+            Span<T> span;
+            Index   position;
+        };
+
+        MpscRing(void) : mHead(0), mTail(0), mSeq(), mSlots()
+        {
+            for (uint32_t i = 0; i < N; ++i) {
+                mSeq[i] = static_cast<Index>(i);
+            }
+        }
+
+        MpscRing(const MpscRing &) = delete;
+        MpscRing &operator=(const MpscRing &) = delete;
+
+        /* PRODUCER SIDE (any context) */
+
+        bool push(const T &value)
+        {
+            const Claim claim = reserve(1);
+            if (claim.span.empty()) return false;
+
+            claim.span.data[0] = value;
+            commit(claim);
+            return true;
+        }
+
+        /*
+         * Claim up to count contiguous slots for in-place filling. The claim
+         * may be shorter than requested when the ring is nearly full or the
+         * run reaches the end of the storage. An empty span means the ring is
+         * full. Every non-empty claim must be handed back to commit().
+         */
+        Claim reserve(uint32_t count)
+        {
+            Index head = mHead;
+            while (true) {
+                const uint32_t offset = head & MASK;
+                const uint32_t run    = N - offset;
+                uint32_t       want   = (count < run) ? count : run;
+
+                /*
+                 * Slots are freed in order, so the claim is possible when the
+                 * first slot is free. Trim it to the slots that are free as
+                 * well.
+                 */
+                uint32_t got = 0;
+                while (got < want && port::distance(head + got, mSeq[offset + got]) == 0) {
+                    ++got;
+                }
+
+                if (got == 0) {
+                    if (port::distance(head, mSeq[offset]) < 0) {
+                        /* The consumer has not freed this slot yet: full. */
+                        const Claim none = { { nullptr, 0 }, head };
+                        return none;
+                    }
+                    /* Another producer claimed it first, catch up. */
+                    head = mHead;
+                    continue;
+                }
+
+                if (port::compareExchange(&mHead, head, static_cast<Index>(head + got))) {
+                    const Claim claim = { { &mSlots[offset], got }, head };
+                    return claim;
+                }
+                /* compareExchange() reloaded head, try again. */
+            }
+        }
+
+        /* publish the slots of a claim returned by reserve() */
+        void commit(const Claim &claim)
+        {
+            port::barrier();
+            for (uint32_t i = 0; i < claim.span.size; ++i) {
+                const Index pos = static_cast<Index>(claim.position + i);
+                mSeq[pos & MASK] = static_cast<Index>(pos + 1);
+            }
+        }
+
+        /* CONSUMER SIDE (single context) */
+
+        bool pop(T &value)
+        {
+            const Span<T> span = readSpan();
+            if (span.empty()) return false;
+
+            value = span.data[0];
+            release(1);
+            return true;
+        }
+
+        /* copy up to count values out, returns the number copied */
+        uint32_t pop(T *values, uint32_t count)
+        {
+            uint32_t done = 0;
+            while (done < count) {
+                const Span<T> span = readSpan();
+                if (span.empty()) break;
+
+                const uint32_t chunk = (count - done < span.size) ? count - done : span.size;
+                for (uint32_t i = 0; i < chunk; ++i) {
+                    values[done + i] = span.data[i];
+                }
+                release(chunk);
+                done += chunk;
+            }
+            return done;
+        }
+
+        /*
+         * Largest contiguous run of published slots at the read position.
+         * A slot still being filled by a preempted producer ends the run.
+         */
+        Span<T> readSpan(void)
+        {
+            const Index    tail   = mTail;
+            const uint32_t offset = tail & MASK;
+            const uint32_t run    = N - offset;
+
+            uint32_t ready = 0;
+            while (ready < run && mSeq[offset + ready] == static_cast<Index>(tail + ready + 1)) {
+                ++ready;
+            }
+            port::barrier();
+
+            const Span<T> span = { &mSlots[offset], ready };
+            return span;
+        }
+
+        /* free count slots previously obtained from readSpan() */
+        void release(uint32_t count)
+        {
+            port::barrier();
+            const Index tail = mTail;
+            for (uint32_t i = 0; i < count; ++i) {
+                const Index pos = static_cast<Index>(tail + i);
+                mSeq[pos & MASK] = static_cast<Index>(pos + N);
+            }
+            mTail = static_cast<Index>(tail + count);
+        }
+
+        bool empty(void) const
+        {
+            return mSeq[mTail & MASK] != static_cast<Index>(mTail + 1);
+        }
+
+    private:
+        static constexpr uint32_t MASK = N - 1;
+
+        volatile Index mHead;
+        Index          mTail;
+        volatile Index mSeq[N];
+        T              mSlots[N];
+};
+
+} /* namespace ring */
+
+#endif /* RING_MPSC_RING_HPP */
@@ -0,0 +1,114 @@
+#ifndef RING_PORT_HPP
+#define RING_PORT_HPP
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+
+/*
+ * Architecture specific primitives used by the ring buffers.
+ *
+ *  - Index      : free running index type. It must be loaded and stored in a
+ *                 single access, so the 8 bit AVR uses an 8 bit index.
+ *  - barrier()  : orders the slot data accesses against the index publish.
+ *  - compareExchange() : atomic index update for multiple producers. The
+ *                 Cortex-M uses LDREX/STREX, the AVR briefly masks
+ *                 interrupts and the host uses the GCC atomic builtins.
+ */
+namespace ring {
+namespace port {
+
+#if defined(__AVR__)
+
+typedef uint8_t Index;
+
+static inline __attribute__((always_inline)) void barrier(void)
+{
+    /* Single core, in-order: only the compiler must not reorder. */
+    __asm__ __volatile__ ("" ::: "memory");
+}
+
+static inline __attribute__((always_inline)) bool compareExchange(volatile Index *target, Index &expected, Index desired)
+{
+    const uint8_t sreg = SREG;
+    cli();
+    const Index current = *target;
+    const bool  swapped = (current == expected);
+    if (swapped) {
+        *target = desired;
+    } else {
+        expected = current;
+    }
+    SREG = sreg;
+    return swapped;
+}
+
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+typedef uint32_t Index;
+
+static inline __attribute__((always_inline)) void barrier(void)
+{
+    __asm__ __volatile__ ("dmb" ::: "memory");
+}
+
+static inline __attribute__((always_inline)) bool compareExchange(volatile Index *target, Index &expected, Index desired)
+{
+    /*
+     * The exclusive monitor is cleared on every exception entry and return,
+     * so the store fails if any interrupt ran between the LDREX and STREX.
+     * That makes the sequence safe against ISR producers without masking
+     * interrupts.
+     */
+    Index    current = 0;
+    uint32_t failed  = 1;
+
+    __asm__ __volatile__ ("ldrex %0, [%1]" : "=r" (current) : "r" (target) : "memory");
+    if (current != expected) {
+        __asm__ __volatile__ ("clrex" ::: "memory");
+        expected = current;
+        return false;
+    }
+
+    __asm__ __volatile__ ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (target), "r" (desired) : "memory");
+    if (failed != 0) {
+        expected = current;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+typedef uint32_t Index;
+
+static inline __attribute__((always_inline)) void barrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline __attribute__((always_inline)) bool compareExchange(volatile Index *target, Index &expected, Index desired)
+{
+    return __atomic_compare_exchange_n(target, &expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+#endif
+
+/* largest capacity a ring can have with the port's index type */
+static constexpr uint32_t MAX_CAPACITY = (static_cast<uint32_t>(static_cast<Index>(~0)) >> 1) + 1;
+
+/* signed distance between two free running indices */
+static inline int32_t distance(Index from, Index to)
+{
+    return (sizeof(Index) == 1) ? static_cast<int8_t>(static_cast<Index>(to - from))
+                                : static_cast<int32_t>(static_cast<Index>(to - from));
+}
+
+} /* namespace port */
+} /* namespace ring */
+
+#endif /* RING_PORT_HPP */
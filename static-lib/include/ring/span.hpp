@@ -0,0 +1,26 @@
+#ifndef RING_SPAN_HPP
+#define RING_SPAN_HPP
+
+#include <stdint.h>
+
+namespace ring {
+
+/*
+ * A contiguous run of ring buffer slots. Spans handed out by the rings point
+ * straight into the ring storage, so they can be given to a DMA channel or
+ * filled/consumed in place without an intermediate copy.
+ */
+template <typename T>
+struct Span {
+    T       *data;
+    uint32_t size;
+
+    bool empty(void) const { return size == 0; }
+    T &operator[](uint32_t idx) const { return data[idx]; }
+    T *begin(void) const { return data; }
+    T *end(void) const { return data + size; }
+};
+
+} /* namespace ring */
+
+#endif /* RING_SPAN_HPP */
@@ -0,0 +1,161 @@
+#ifndef RING_SPSC_RING_HPP
+#define RING_SPSC_RING_HPP
+
+#include <stdint.h>
+
+#include "ring/port.hpp"
+#include "ring/span.hpp"
+
+namespace ring {
+
+/*
+ * Wait-free single producer, single consumer ring buffer.
+ *
+ * The producer only writes mHead and the consumer only writes mTail, so
+ * neither side ever waits on or retries against the other. Typical use is
+ * one interrupt handler producing and thread code consuming (or the other
+ * way around).
+ *
+ * The indices run freely and are masked on access, which keeps every slot
+ * usable and makes the full/empty tests a simple subtraction.
+ */
+template <typename T, uint32_t N>
+class SpscRing {
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(N <= port::MAX_CAPACITY, "capacity too large for the port index type");
+
+    public:
+        typedef port::Index Index;
+
+        static constexpr uint32_t capacity(void) { return N; }
+
+        SpscRing(void) : mHead(0), mTail(0), mSlots() { }
+
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        /* number of filled slots (exact for either side, a hint otherwise) */
+        uint32_t size(void) const { return static_cast<Index>(mHead - mTail); }
+
+        bool empty(void) const { return mHead == mTail; }
+        bool full(void) const { return size() == N; }
+
+        /* PRODUCER SIDE */
+
+        bool push(const T &value)
+        {
+            const Index head = mHead;
+            if (static_cast<Index>(head - mTail) == N) return false;
+
+            mSlots[head & MASK] = value;
+            port::barrier();
+            mHead = static_cast<Index>(head + 1);
+            return true;
+        }
+
+        /* copy up to count values in, returns the number copied */
+        uint32_t push(const T *values, uint32_t count)
+        {
+            uint32_t done = 0;
+            while (done < count) {
+                const Span<T> span = writeSpan();
+                if (span.empty()) break;
+
+                const uint32_t chunk = (count - done < span.size) ? count - done : span.size;
+                for (uint32_t i = 0; i < chunk; ++i) {
+                    span.data[i] = values[done + i];
+                }
+                commit(chunk);
+                done += chunk;
+            }
+            return done;
+        }
+
+        /*
+         * Largest contiguous run of free slots at the write position. Fill
+         * it in place (e.g. with DMA) and publish it with commit().
+         */
+        Span<T> writeSpan(void)
+        {
+            const Index    head   = mHead;
+            const uint32_t free   = N - static_cast<Index>(head - mTail);
+            const uint32_t offset = head & MASK;
+            const uint32_t run    = N - offset;
+            const Span<T>  span   = { &mSlots[offset], (free < run) ? free : run };
+            return span;
+        }
+
+        /* publish count slots previously obtained from writeSpan() */
+        void commit(uint32_t count)
+        {
+            port::barrier();
+            mHead = static_cast<Index>(mHead + count);
+        }
+
+        /* CONSUMER SIDE */
+
+        bool pop(T &value)
+        {
+            const Index tail = mTail;
+            if (tail == mHead) return false;
+
+            port::barrier();
+            value = mSlots[tail & MASK];
+            port::barrier();
+            mTail = static_cast<Index>(tail + 1);
+            return true;
+        }
+
+        /* copy up to count values out, returns the number copied */
+        uint32_t pop(T *values, uint32_t count)
+        {
+            uint32_t done = 0;
+            while (done < count) {
+                const Span<T> span = readSpan();
+                if (span.empty()) break;
+
+                const uint32_t chunk = (count - done < span.size) ? count - done : span.size;
+                for (uint32_t i = 0; i < chunk; ++i) {
+                    values[done + i] = span.data[i];
+                }
+                release(chunk);
+                done += chunk;
+            }
+            return done;
+        }
+
+        /*
+         * Largest contiguous run of filled slots at the read position.
+         * Consume it in place (e.g. hand it to a DMA channel) and free it
+         * with release().
+         */
+        Span<T> readSpan(void)
+        {
+            const Index    tail   = mTail;
+            const uint32_t used   = static_cast<Index>(mHead - tail);
+            const uint32_t offset = tail & MASK;
+            const uint32_t run    = N - offset;
+            port::barrier();
+            const Span<T>  span   = { &mSlots[offset], (used < run) ? used : run };
+            return span;
+        }
+
+        /* free count slots previously obtained from readSpan() */
+        void release(uint32_t count)
+        {
+            port::barrier();
+            mTail = static_cast<Index>(mTail + count);
+        }
+
+    private:
+        static constexpr uint32_t MASK = N - 1;
+
+        volatile Index mHead;
+        volatile Index mTail;
+        T              mSlots[N];
+};
+
+} /* namespace ring */
+
+#endif /* RING_SPSC_RING_HPP */
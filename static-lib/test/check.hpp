@@ -0,0 +1,34 @@
+#ifndef TEST_CHECK_HPP
+#define TEST_CHECK_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Minimal checks for the host test programs: a failed CHECK() prints its
+ * location and is counted, and report() turns the count into the exit
+ * status of main(). Each test program is a single translation unit.
+ */
+
+static uint32_t g_failures = 0;
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++g_failures;                                                       \
+        }                                                                       \
+    } while (0)
+
+static inline int report(const char *name)
+{
+    if (g_failures != 0) {
+        printf("%s: %u failures\n", name, g_failures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+#endif /* TEST_CHECK_HPP */
@@ -0,0 +1,332 @@
+// STANDARD LIBRARY
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// STATIC LIB
+#include "kv/sim_flash.hpp"
+#include "kv/store.hpp"
+
+// TEST
+#include "check.hpp"
+
+/*
+ * Host test of kv::Store on kv::SimFlash. Runs a fixed script of updates
+ * and checks the store against a plain array model, through compaction,
+ * remounts, a power cut at every single flash operation of the script and
+ * a long run of rewrites for wear levelling. Returns non-zero on failure.
+ */
+
+typedef kv::SimFlash<1024, 4> Flash;
+
+static constexpr uint32_t MAX_KEYS = 16;
+typedef kv::Store<Flash, MAX_KEYS> Store;
+
+/* what the store should hold */
+struct Model {
+    bool     set[MAX_KEYS];
+    uint32_t length[MAX_KEYS];
+    uint8_t  value[MAX_KEYS][Store::MAX_LENGTH];
+};
+
+enum class Op : uint8_t { SET, REMOVE, MAINTAIN };
+
+struct Step {
+    Op       op;
+    uint32_t key;
+    uint32_t length;
+    uint8_t  seed;
+};
+
+/* the value a step writes */
+static void fill(const Step &step, uint8_t *value)
+{
+    for (uint32_t i = 0; i < step.length; ++i) {
+        value[i] = static_cast<uint8_t>(step.seed + 31 * i);
+    }
+}
+
+static bool holds(const Store &store, const Model &model, uint32_t key)
+{
+    if (!model.set[key]) return !store.contains(key);
+
+    return store.contains(key) &&
+           store.length(key) == model.length[key] &&
+           memcmp(store.data(key), model.value[key], model.length[key]) == 0;
+}
+
+static bool matches(const Store &store, const Model &model, uint32_t skip = MAX_KEYS)
+{
+    uint32_t live = 0;
+    for (uint32_t key = 0; key < MAX_KEYS; ++key) {
+        if (key != skip && !holds(store, model, key)) return false;
+        if (store.contains(key)) {
+            live += Store::RECORD_HEADER + ((store.length(key) + 3) & ~3UL);
+        }
+    }
+    return store.used() == live;
+}
+
+static void apply(Model &model, const Step &step)
+{
+    if (step.op == Op::SET) {
+        model.set[step.key]    = true;
+        model.length[step.key] = step.length;
+        fill(step, model.value[step.key]);
+    } else if (step.op == Op::REMOVE) {
+        model.set[step.key] = false;
+    }
+}
+
+static bool run(Store &store, const Step &step)
+{
+    uint8_t value[Store::MAX_LENGTH];
+
+    switch (step.op) {
+        case Op::SET:
+            fill(step, value);
+            return store.set(step.key, value, step.length);
+        case Op::REMOVE:
+            return store.remove(step.key);
+        case Op::MAINTAIN:
+            store.maintain();
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Deterministic script: mixed value sizes, rewrites, removes and a
+ * maintain() now and then, several times the flash size in total so that
+ * pages are compacted both by maintain() and synchronously by set().
+ */
+static constexpr uint32_t SCRIPT_STEPS = 120;
+static Step g_script[SCRIPT_STEPS];
+
+static void makeScript(void)
+{
+    uint32_t state = 12345;
+    for (uint32_t i = 0; i < SCRIPT_STEPS; ++i) {
+        state = state * 1103515245UL + 12345;
+        const uint32_t pick = (state >> 16) & 0x7FFF;
+
+        Step &step = g_script[i];
+        step.key    = pick % MAX_KEYS;
+        step.seed   = static_cast<uint8_t>(i);
+        step.length = 0;
+        if (pick % 11 == 0) {
+            step.op = Op::REMOVE;
+        } else if (pick % 5 == 0) {
+            step.op = Op::MAINTAIN;
+        } else {
+            step.op     = Op::SET;
+            step.length = (pick % 7 == 0) ? Store::MAX_LENGTH : 1 + (pick >> 3) % 48;
+        }
+    }
+}
+
+static void testBasic(void)
+{
+    Flash flash;
+    Store store(flash);
+    store.mount();
+
+    CHECK(store.used() == 0);
+    CHECK(!store.contains(3));
+    CHECK(store.length(3) == 0);
+    CHECK(store.data(3) == nullptr);
+
+    const char hello[] = "hello";
+    CHECK(store.set(3, hello, sizeof(hello)));
+    CHECK(store.contains(3));
+    CHECK(store.length(3) == sizeof(hello));
+    CHECK(memcmp(store.data(3), hello, sizeof(hello)) == 0);
+
+    char copy[4];
+    CHECK(store.read(3, copy, sizeof(copy)) == sizeof(copy));
+    CHECK(memcmp(copy, hello, sizeof(copy)) == 0);
+
+    /* rewriting the current value appends nothing */
+    const uint8_t *at = store.data(3);
+    CHECK(store.set(3, hello, sizeof(hello)));
+    CHECK(store.data(3) == at);
+
+    const uint32_t number = 0xC0FFEE;
+    CHECK(store.set(7, &number, sizeof(number)));
+    CHECK(store.set(3, "bye", 3));
+    CHECK(store.remove(7));
+    CHECK(store.remove(7));
+    CHECK(!store.contains(7));
+
+    /* invalid keys and lengths */
+    uint8_t big[Store::MAX_LENGTH + 1] = { 0 };
+    CHECK(!store.set(MAX_KEYS, hello, sizeof(hello)));
+    CHECK(!store.set(1, hello, 0));
+    CHECK(!store.set(1, big, sizeof(big)));
+    CHECK(store.set(1, big, Store::MAX_LENGTH));
+
+    Store mounted(flash);
+    mounted.mount();
+    CHECK(mounted.length(3) == 3 && memcmp(mounted.data(3), "bye", 3) == 0);
+    CHECK(!mounted.contains(7));
+    CHECK(mounted.length(1) == Store::MAX_LENGTH);
+    CHECK(mounted.used() == store.used());
+}
+
+static void testCompaction(void)
+{
+    Flash flash;
+    Model model = Model();
+    Store store(flash);
+    store.mount();
+
+    /* the script alone, then again with maintain() left out */
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+        for (uint32_t i = 0; i < SCRIPT_STEPS; ++i) {
+            const Step &step = g_script[i];
+            if (pass == 1 && step.op == Op::MAINTAIN) continue;
+
+            CHECK(run(store, step));
+            apply(model, step);
+            CHECK(matches(store, model));
+        }
+
+        Store mounted(flash);
+        mounted.mount();
+        CHECK(matches(mounted, model));
+    }
+
+    uint32_t erased = 0;
+    for (uint32_t page = 0; page < Flash::PAGES; ++page) {
+        erased += flash.erases(page);
+    }
+    CHECK(erased >= Flash::PAGES);
+
+    /* fill up to the capacity, the next value is refused */
+    uint8_t value[Store::MAX_LENGTH] = { 0 };
+    uint32_t key = 0;
+    while (store.used() + Store::RECORD_HEADER + Store::MAX_LENGTH <= Store::capacity()) {
+        CHECK(store.set(key++, value, Store::MAX_LENGTH));
+    }
+    CHECK(key < MAX_KEYS);
+    CHECK(!store.set(key, value, Store::MAX_LENGTH));
+
+    Store mounted(flash);
+    mounted.mount();
+    CHECK(mounted.used() == store.used());
+}
+
+/*
+ * Replays the script with the power cut at operation 0, 1, 2, ... until a
+ * run gets through. After each cut the flash is powered up again and a new
+ * store mounted on it: every key must hold the value of the last completed
+ * step, except the one the interrupted step wrote, which holds either its
+ * old or its new value. The recovered store must take further updates.
+ */
+static void testPowerCuts(void)
+{
+    uint32_t cuts = 0;
+
+    for (uint32_t budget = 0; ; ++budget) {
+        Flash flash;
+        Model model = Model();
+        Store store(flash);
+        store.mount();
+
+        flash.powerFail(budget);
+
+        uint32_t cut = SCRIPT_STEPS;
+        for (uint32_t i = 0; i < SCRIPT_STEPS && cut == SCRIPT_STEPS; ++i) {
+            const bool done = run(store, g_script[i]);
+            if (!flash.powered()) {
+                cut = i;
+            } else {
+                CHECK(done);
+                apply(model, g_script[i]);
+            }
+        }
+        if (cut == SCRIPT_STEPS) break;
+        ++cuts;
+
+        flash.restore();
+        Store mounted(flash);
+        mounted.mount();
+
+        const Step &step = g_script[cut];
+        if (step.op == Op::MAINTAIN) {
+            CHECK(matches(mounted, model));
+        } else {
+            Model updated = model;
+            apply(updated, step);
+            CHECK(holds(mounted, model, step.key) || holds(mounted, updated, step.key));
+            if (holds(mounted, updated, step.key)) {
+                model = updated;
+            }
+            CHECK(matches(mounted, model));
+        }
+        if (g_failures != 0) {
+            printf("power cut after %u flash operations, in step %u\n", budget, cut);
+            return;
+        }
+
+        /* cleans up after the cut and goes on */
+        while (mounted.maintain()) { }
+        for (uint32_t i = cut; i < SCRIPT_STEPS; ++i) {
+            CHECK(run(mounted, g_script[i]));
+            apply(model, g_script[i]);
+        }
+        CHECK(matches(mounted, model));
+    }
+
+    /* every record and page header write was interrupted somewhere */
+    CHECK(cuts > SCRIPT_STEPS);
+}
+
+/*
+ * One hot key rewritten over and over next to static data: pages are
+ * opened in ring order and reclaimed oldest first, so all of them wear
+ * alike, static data or not.
+ */
+static void testWear(void)
+{
+    Flash flash;
+    Store store(flash);
+    store.mount();
+
+    const char config[] = "static configuration";
+    CHECK(store.set(0, config, sizeof(config)));
+    CHECK(store.set(1, config, sizeof(config)));
+
+    for (uint32_t i = 0; i < 10000; ++i) {
+        CHECK(store.set(2, &i, sizeof(i)));
+        while (store.maintain()) { }
+    }
+
+    uint32_t least = flash.erases(0);
+    uint32_t most  = flash.erases(0);
+    for (uint32_t page = 1; page < Flash::PAGES; ++page) {
+        least = (flash.erases(page) < least) ? flash.erases(page) : least;
+        most  = (flash.erases(page) > most) ? flash.erases(page) : most;
+    }
+    CHECK(least > 0);
+    CHECK(most - least <= 1);
+
+    Store mounted(flash);
+    mounted.mount();
+    const uint32_t last = 9999;
+    CHECK(mounted.length(2) == sizeof(last) && memcmp(mounted.data(2), &last, sizeof(last)) == 0);
+    CHECK(memcmp(mounted.data(0), config, sizeof(config)) == 0);
+    CHECK(memcmp(mounted.data(1), config, sizeof(config)) == 0);
+}
+
+int main(void)
+{
+    makeScript();
+
+    testBasic();
+    testCompaction();
+    testPowerCuts();
+    testWear();
+
+    return report("kv_store_test");
+}
@@ -0,0 +1,238 @@
+// STANDARD LIBRARY
+#include <stdint.h>
+#include <stdio.h>
+
+// STATIC LIB
+#include "ring/mpsc_ring.hpp"
+#include "ring/spsc_ring.hpp"
+
+// TEST
+#include "check.hpp"
+
+/*
+ * Host test of ring::SpscRing and ring::MpscRing (GCC atomics port). Both
+ * rings are driven from a single thread: empty and full, spans split at
+ * the end of the storage, partial commit() and release() counts, and a
+ * long run of mixed transfers that wraps the storage many times while the
+ * values are checked to come out in order. Returns non-zero on failure.
+ */
+
+static constexpr uint32_t N = 8;
+
+typedef ring::SpscRing<uint32_t, N> Spsc;
+typedef ring::MpscRing<uint32_t, N> Mpsc;
+
+static void testSpscEmptyFull(void)
+{
+    Spsc ring;
+    uint32_t value = 0;
+
+    CHECK(ring.empty());
+    CHECK(!ring.full());
+    CHECK(ring.size() == 0);
+    CHECK(!ring.pop(value));
+    CHECK(ring.readSpan().empty());
+    CHECK(ring.writeSpan().size == N);
+
+    for (uint32_t i = 0; i < N; ++i) {
+        CHECK(ring.push(i));
+    }
+    CHECK(ring.full());
+    CHECK(ring.size() == N);
+    CHECK(!ring.push(N));
+    CHECK(ring.writeSpan().empty());
+
+    for (uint32_t i = 0; i < N; ++i) {
+        CHECK(ring.pop(value) && value == i);
+    }
+    CHECK(ring.empty());
+    CHECK(!ring.pop(value));
+}
+
+static void testSpscSpans(void)
+{
+    Spsc ring;
+    uint32_t value = 0;
+
+    /* move both indices to slot 5 */
+    for (uint32_t i = 0; i < 5; ++i) {
+        ring.push(i);
+        ring.pop(value);
+    }
+
+    /* the free space runs to the end of the storage, then from slot 0 */
+    ring::Span<uint32_t> span = ring.writeSpan();
+    CHECK(span.size == N - 5);
+    uint32_t *const slot5 = span.data;
+    for (uint32_t i = 0; i < span.size; ++i) {
+        span[i] = 100 + i;
+    }
+    ring.commit(span.size);
+
+    span = ring.writeSpan();
+    CHECK(span.size == 5);
+    CHECK(span.data == slot5 - 5);
+
+    /* commit fewer slots than the span holds */
+    span[0] = 103;
+    span[1] = 104;
+    ring.commit(2);
+    CHECK(ring.size() == 5);
+    CHECK(ring.writeSpan().data == slot5 - 3);
+    CHECK(ring.writeSpan().size == 3);
+
+    /* the filled slots are read in two spans as well */
+    span = ring.readSpan();
+    CHECK(span.data == slot5 && span.size == N - 5);
+    CHECK(span[0] == 100 && span[2] == 102);
+
+    /* release part of a span, the rest stays readable */
+    ring.release(1);
+    CHECK(ring.size() == 4);
+    span = ring.readSpan();
+    CHECK(span.data == slot5 + 1 && span.size == 2);
+    ring.release(span.size);
+
+    span = ring.readSpan();
+    CHECK(span.data == slot5 - 5 && span.size == 2);
+    CHECK(span[0] == 103 && span[1] == 104);
+    ring.release(span.size);
+    CHECK(ring.empty());
+
+    /* bulk copies split across the end as well */
+    const uint32_t in[N] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint32_t out[N]      = { 0 };
+    CHECK(ring.push(in, N) == N);
+    CHECK(ring.push(in, 1) == 0);
+    CHECK(ring.pop(out, N + 1) == N);
+    for (uint32_t i = 0; i < N; ++i) {
+        CHECK(out[i] == in[i]);
+    }
+}
+
+static void testMpscEmptyFull(void)
+{
+    Mpsc ring;
+    uint32_t value = 0;
+
+    CHECK(ring.empty());
+    CHECK(!ring.pop(value));
+    CHECK(ring.readSpan().empty());
+
+    for (uint32_t i = 0; i < N; ++i) {
+        CHECK(ring.push(i));
+    }
+    CHECK(!ring.push(N));
+    CHECK(ring.reserve(1).span.empty());
+
+    for (uint32_t i = 0; i < N; ++i) {
+        CHECK(ring.pop(value) && value == i);
+    }
+    CHECK(ring.empty());
+    CHECK(!ring.pop(value));
+}
+
+static void testMpscClaims(void)
+{
+    Mpsc ring;
+
+    /* claims are published in any order, read in ring order */
+    const Mpsc::Claim first = ring.reserve(3);
+    CHECK(first.span.size == 3 && first.position == 0);
+    const Mpsc::Claim second = ring.reserve(2);
+    CHECK(second.span.size == 2 && second.position == 3);
+    CHECK(second.span.data == first.span.data + 3);
+
+    for (uint32_t i = 0; i < 3; ++i) first.span[i] = i;
+    for (uint32_t i = 0; i < 2; ++i) second.span[i] = 3 + i;
+
+    ring.commit(second);
+    CHECK(ring.empty());
+    CHECK(ring.readSpan().empty());
+
+    ring.commit(first);
+    CHECK(!ring.empty());
+    ring::Span<uint32_t> span = ring.readSpan();
+    CHECK(span.size == 5);
+
+    /* a claim stops at the end of the storage */
+    const Mpsc::Claim tail = ring.reserve(N);
+    CHECK(tail.span.size == N - 5 && tail.position == 5);
+    CHECK(ring.reserve(1).span.empty());
+
+    /* released slots are claimed again, from slot 0 */
+    ring.release(2);
+    CHECK(ring.readSpan().size == 3);
+    const Mpsc::Claim wrapped = ring.reserve(N);
+    CHECK(wrapped.span.size == 2 && wrapped.position == N);
+    CHECK(wrapped.span.data == first.span.data);
+
+    for (uint32_t i = 0; i < tail.span.size; ++i) tail.span[i] = 5 + i;
+    for (uint32_t i = 0; i < wrapped.span.size; ++i) wrapped.span[i] = N + i;
+    ring.commit(wrapped);
+    ring.commit(tail);
+
+    /* the published slots are read in two spans */
+    ring.release(3);
+    span = ring.readSpan();
+    CHECK(span.size == N - 5 && span[0] == 5);
+    ring.release(span.size);
+    span = ring.readSpan();
+    CHECK(span.size == 2 && span[0] == N && span[1] == N + 1);
+    ring.release(span.size);
+    CHECK(ring.empty());
+}
+
+/*
+ * Transfers of 1 to N + 1 values in a pattern that does not divide the
+ * capacity, so both indices keep moving across the end of the storage.
+ * Every value must come out once and in order.
+ */
+template <typename Ring>
+static void testStream(void)
+{
+    Ring     ring;
+    uint32_t in[N + 1];
+    uint32_t out[N + 1];
+    uint32_t next_in  = 0;
+    uint32_t next_out = 0;
+
+    for (uint32_t round = 0; round < 10000; ++round) {
+        const uint32_t want_in  = 1 + (round * 7) % (N + 1);
+        const uint32_t want_out = 1 + (round * 5) % (N + 1);
+
+        for (uint32_t i = 0; i < want_in; ++i) {
+            in[i] = next_in + i;
+        }
+        uint32_t pushed = 0;
+        while (pushed < want_in && ring.push(in[pushed])) {
+            ++pushed;
+        }
+        next_in += pushed;
+
+        const uint32_t popped = ring.pop(out, want_out);
+        for (uint32_t i = 0; i < popped; ++i) {
+            CHECK(out[i] == next_out + i);
+        }
+        next_out += popped;
+
+        CHECK(next_in - next_out <= N);
+        if (g_failures != 0) {
+            printf("stream round %u\n", round);
+            return;
+        }
+    }
+    CHECK(next_out > 10 * N);
+}
+
+int main(void)
+{
+    testSpscEmptyFull();
+    testSpscSpans();
+    testMpscEmptyFull();
+    testMpscClaims();
+    testStream<Spsc>();
+    testStream<Mpsc>();
+
+    return report("ring_test");
+}
@@ -0,0 +1,181 @@
+#ifndef ADC_STREAM_HPP
+#define ADC_STREAM_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Continuous ADC acquisition.
+ *
+ * The TIM3 update event (TRGO) starts one scan of the configured channel
+ * list at a fixed rate. DMA1 channel 1 moves every result into a circular
+ * buffer of two blocks without any CPU involvement. When a block is full
+ * (half transfer and transfer complete interrupts) the callback receives it
+ * while the DMA fills the other one, so the CPU only runs once per block.
+ *
+ *      buffer  | block 0 (scan 0, scan 1, ...) | block 1 (...) |
+ *      scan    | ch[0] | ch[1] | ... | ch[channel_count - 1] |
+ *
+ * In the dual modes ADC1 is the master and ADC2 converts along with it. The
+ * DMA moves one 32 bit word per conversion pair from the ADC1 data register
+ * (ADC1 result in the lower, ADC2 result in the upper half word), so every
+ * scan entry above is two samples: ADC1 then ADC2. DualView reads the two
+ * streams out of a block in place. See section 11.9 of the reference manual.
+ *
+ *      DUAL_SIMULTANEOUS   both ADCs scan their own channel list on every
+ *                          trigger, so pairs are sampled at the same time.
+ *      DUAL_INTERLEAVED    both ADCs convert channels[0] continuously, ADC1
+ *                          7 ADC clocks after ADC2, for twice the rate of one
+ *                          ADC (ADCCLK / 7 samples per second). The timer is
+ *                          not used and the sample time must be 1.5 cycles.
+ *
+ * The callback runs in the DMA interrupt and must be done with its block
+ * before the other block fills up (scans_per_block / scan_rate_hz seconds).
+ * A block that was not processed in time is counted by overruns().
+ *
+ * Both the register level and the HAL build are supported (USE_HAL).
+ */
+namespace AdcStream {
+
+    /* highest ADC channel (16: temperature sensor, 17: VREFINT) */
+    static constexpr uint32_t MAX_CHANNEL = 17;
+
+    /* length of the regular sequence */
+    static constexpr uint32_t MAX_SEQUENCE = 16;
+
+    /* sample time in ADC clock cycles (SMPx field values) */
+    enum class SampleTime : uint32_t {
+        CYCLES_1_5,
+        CYCLES_7_5,
+        CYCLES_13_5,
+        CYCLES_28_5,
+        CYCLES_41_5,
+        CYCLES_55_5,
+        CYCLES_71_5,
+        CYCLES_239_5,
+    };
+
+    enum class Mode : uint32_t {
+        /* ADC1 alone */
+        SINGLE,
+
+        /* ADC1 and ADC2 regular simultaneous mode */
+        DUAL_SIMULTANEOUS,
+
+        /* ADC1 and ADC2 fast interleaved mode on one channel */
+        DUAL_INTERLEAVED,
+    };
+
+    /* block ready callback (called from the DMA interrupt) */
+    typedef void (*Callback)(const uint16_t *block, uint32_t scans, void *arg);
+
+    struct Config {
+        Mode           mode;
+
+        /* channels converted by each scan, in order (0-17) */
+        const uint8_t *channels;
+        uint32_t       channel_count;
+
+        /*
+         * ADC2 channels of DUAL_SIMULTANEOUS (channel_count entries). A
+         * channel must not be converted by both ADCs at the same rank.
+         */
+        const uint8_t *adc2_channels;
+
+        /* sample time of every channel */
+        SampleTime     sample_time;
+
+        /* scans per second (ignored by DUAL_INTERLEAVED) */
+        uint32_t       scan_rate_hz;
+
+        /*
+         * Storage of both blocks: 2 * scans_per_block * channel_count
+         * samples, twice that (and 4 byte aligned) in the dual modes.
+         */
+        uint16_t      *buffer;
+        uint32_t       scans_per_block;
+
+        Callback       callback;
+        void          *arg;
+    };
+
+    /*
+     * Configure the ADCs, TIM3 and DMA1 channel 1 and start sampling.
+     * Returns false (and does not start) if the configuration is invalid or
+     * the scan does not fit in one trigger period.
+     */
+    bool start(const Config &config);
+
+    /* stop sampling (a block in progress is discarded) */
+    void stop(void);
+
+    /*
+     * Actual scan rate (the timer divides its clock by an integer). A scan
+     * of DUAL_INTERLEAVED is one pair of samples.
+     */
+    uint32_t scanRate(void);
+
+    /* number of blocks overwritten before the callback got to them */
+    uint32_t overruns(void);
+
+    /* DMA1 channel 1 interrupt service routine */
+    void isr(void);
+
+    /* every stride-th sample of a block, read in place */
+    class Strided {
+
+        public:
+            Strided(const uint16_t *base, uint32_t stride, uint32_t count) :
+                mBase(base), mStride(stride), mCount(count)
+            { }
+
+            inline uint32_t size(void) const { return mCount; }
+
+            inline uint16_t operator[](uint32_t index) const { return mBase[index * mStride]; }
+
+        private:
+            const uint16_t *mBase;
+            uint32_t        mStride;
+            uint32_t        mCount;
+    };
+
+    /*
+     * Zero-copy view of a block delivered in one of the dual modes. Nothing
+     * is moved: the accessors index the half words of the DMA words.
+     */
+    class DualView {
+
+        public:
+            DualView(const uint16_t *block, uint32_t scans, uint32_t channel_count) :
+                mBlock(block), mScans(scans), mChannels(channel_count)
+            { }
+
+            /* ADC1 samples of the channel at rank (0 based) */
+            inline Strided adc1(uint32_t rank = 0) const
+            {
+                return Strided(mBlock + 2 * rank, 2 * mChannels, mScans);
+            }
+
+            /* ADC2 samples of the channel at rank (0 based) */
+            inline Strided adc2(uint32_t rank = 0) const
+            {
+                return Strided(mBlock + 2 * rank + 1, 2 * mChannels, mScans);
+            }
+
+            /* DUAL_INTERLEAVED: number of samples in the block */
+            inline uint32_t samples(void) const { return 2 * mScans; }
+
+            /*
+             * DUAL_INTERLEAVED: sample n in conversion order. ADC2 converts
+             * first, so each word holds the earlier sample in its upper half.
+             */
+            inline uint16_t sample(uint32_t n) const { return mBlock[n ^ 1]; }
+
+        private:
+            const uint16_t *mBlock;
+            uint32_t        mScans;
+            uint32_t        mChannels;
+    };
+}
+
+#endif /* ADC_STREAM_HPP */
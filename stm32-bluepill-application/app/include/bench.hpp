@@ -0,0 +1,40 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * On-target benchmark suite. Built into the application when Make is called
+ * with BENCH=1. Results are collected in a table that can be inspected with
+ * GDB once the suite has finished:
+ *
+ *      (gdb) print Bench::g_results
+ */
+namespace Bench {
+
+    /* maximum number of benchmark results */
+    static constexpr uint32_t MAX_RESULTS = 24;
+
+    struct Result {
+        /* benchmark name */
+        const char *name;
+
+        /* measured core clock cycles (per iteration) */
+        uint32_t cycles;
+    };
+
+    /* benchmark result table */
+    extern Result g_results[MAX_RESULTS];
+
+    /* number of valid entries in the result table */
+    extern uint32_t g_count;
+
+    /* store a result in the table (ignored once the table is full) */
+    void record(const char *name, uint32_t cycles);
+
+    /* run every benchmark (does not return if a benchmark starts the kernel) */
+    void run(void);
+}
+
+#endif /* BENCH_HPP */
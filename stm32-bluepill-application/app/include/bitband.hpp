@@ -0,0 +1,162 @@
+#ifndef BITBAND_HPP
+#define BITBAND_HPP
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+/*
+ * Cortex-M3 bit-band access.
+ *
+ * The first megabyte of SRAM and of the peripheral space are mirrored in an
+ * alias region where every bit has its own word address. A store to the alias
+ * word sets or clears just that bit and a load returns it as 0 or 1. The bus
+ * performs the read-modify-write as one locked transaction, so a single bit
+ * can be changed with one store and without masking interrupts, even when an
+ * ISR modifies other bits of the same word. See section 2.3.2 of the
+ * programming manual (PM0056).
+ *
+ * The System Control Space (SysTick, NVIC, SCB, DWT, CoreDebug) is outside
+ * both regions and cannot be bit-band accessed.
+ *
+ * Registers are addressed by base address plus member offset, e.g.
+ *
+ *      Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_IOPCEN>::set();
+ */
+namespace Bitband {
+
+    /* size of each bit-band region */
+    static constexpr uint32_t REGION_SIZE = 0x100000;
+
+    static constexpr bool inSram(uint32_t addr)
+    {
+        return addr >= SRAM_BASE && addr < SRAM_BASE + REGION_SIZE;
+    }
+
+    static constexpr bool inPeriph(uint32_t addr)
+    {
+        return addr >= PERIPH_BASE && addr < PERIPH_BASE + REGION_SIZE;
+    }
+
+    /* alias word address of bit (0-31) of the word at addr */
+    static constexpr uint32_t alias(uint32_t addr, uint32_t bit)
+    {
+        return inSram(addr) ? SRAM_BB_BASE   + ((addr - SRAM_BASE)   << 5) + (bit << 2) :
+                              PERIPH_BB_BASE + ((addr - PERIPH_BASE) << 5) + (bit << 2) ;
+    }
+
+    /* bit number of a single bit mask (such as the CMSIS register masks) */
+    static constexpr uint32_t bitIndex(uint32_t mask, uint32_t bit = 0)
+    {
+        return (bit == 32 || ((mask >> bit) & 1) != 0) ? bit : bitIndex(mask, bit + 1);
+    }
+
+    /*
+     * One bit of a peripheral register (or of a statically placed SRAM word)
+     * known at compile time. Mask is the single bit mask of the bit.
+     */
+    template <uint32_t Addr, uint32_t Mask>
+    class Bit {
+
+        static_assert(Mask != 0 && (Mask & (Mask - 1)) == 0, "mask must select exactly one bit");
+        static_assert(inSram(Addr) || inPeriph(Addr), "address is outside the bit-band regions");
+        static_assert((Addr & 3) == 0, "address must be word aligned");
+
+        public:
+            static constexpr uint32_t ALIAS = alias(Addr, bitIndex(Mask));
+
+            static inline __attribute__((always_inline)) volatile uint32_t *word(void)
+            {
+                return reinterpret_cast<volatile uint32_t *>(ALIAS);
+            }
+
+            static inline __attribute__((always_inline)) void set(void)
+            {
+                *word() = 1;
+            }
+
+            static inline __attribute__((always_inline)) void clear(void)
+            {
+                *word() = 0;
+            }
+
+            static inline __attribute__((always_inline)) void write(bool value)
+            {
+                *word() = value ? 1 : 0;
+            }
+
+            static inline __attribute__((always_inline)) bool read(void)
+            {
+                return *word() != 0;
+            }
+    };
+
+    /*
+     * Handle to one bit whose address is only known at run time, e.g. a flag
+     * in a statically allocated SRAM object. The alias address is computed
+     * once on construction.
+     */
+    class Flag {
+
+        public:
+            Flag(volatile uint32_t *word, uint32_t bit) :
+                mAlias(reinterpret_cast<volatile uint32_t *>(
+                    alias(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(word)), bit)))
+            { }
+
+            inline void set(void) const { *mAlias = 1; }
+            inline void clear(void) const { *mAlias = 0; }
+            inline void write(bool value) const { *mAlias = value ? 1 : 0; }
+            inline bool read(void) const { return *mAlias != 0; }
+
+        private:
+            volatile uint32_t *mAlias;
+    };
+
+    /*
+     * Array of N flags in SRAM, such as per-channel pending or ready flags
+     * shared between interrupt handlers. Each flag is set, cleared or tested
+     * with a single alias access, so handlers of different priorities may
+     * update different flags without a critical section. The object must be
+     * placed in the first megabyte of SRAM (any ordinary variable is).
+     */
+    template <uint32_t N>
+    class FlagArray {
+
+        public:
+            static constexpr uint32_t WORDS = (N + 31) / 32;
+
+            FlagArray(void) : mWords() { }
+
+            FlagArray(const FlagArray &) = delete;
+            FlagArray &operator=(const FlagArray &) = delete;
+
+            static constexpr uint32_t size(void) { return N; }
+
+            inline void set(uint32_t index) { *bit(index) = 1; }
+            inline void clear(uint32_t index) { *bit(index) = 0; }
+            inline void write(uint32_t index, bool value) { *bit(index) = value ? 1 : 0; }
+            inline bool test(uint32_t index) const { return *bit(index) != 0; }
+
+            /* plain word access, e.g. to scan the flags with __CLZ */
+            inline uint32_t word(uint32_t index) const { return mWords[index]; }
+
+        private:
+            inline volatile uint32_t *bit(uint32_t index) const
+            {
+                /*
+                 * The alias of bit b of the array is the alias of bit 0 plus
+                 * 4 bytes per bit, as the words are contiguous.
+                 */
+                const uint32_t base = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(mWords));
+                return reinterpret_cast<volatile uint32_t *>(alias(base, 0) + (index << 2));
+            }
+
+            volatile uint32_t mWords[WORDS];
+    };
+}
+
+#endif /* BITBAND_HPP */
@@ -4,6 +4,10 @@
 // STANDARD LIBRARY
 #include <stdint.h>
 
+// APP
+#include "clock_tree.hpp"
+#include "gpio.hpp"
+
 // CMSIS
 #include "stm32f1xx.h"
 
@@ -19,12 +23,116 @@ namespace Bsp {
             static constexpr uint32_t LSE_OSC_FREQ_HZ = 32768;
         }
 
+        namespace Clock {
+            /*
+             * Clock tree profiles (source, oscillator, SYSCLK, HCLK, PCLK1,
+             * PCLK2). Each one is checked against the datasheet limits when
+             * selected below.
+             */
+
+            /* 72 MHz from the HSE crystal (USB capable) */
+            typedef ClockTree::Tree<ClockTree::Source::HSE, Osc::HSE_OSC_FREQ_HZ,
+                                    72000000, 72000000, 36000000, 72000000> Hse72Mhz;
+
+            /* 48 MHz from the HSE crystal (USB capable, 1 flash wait state) */
+            typedef ClockTree::Tree<ClockTree::Source::HSE, Osc::HSE_OSC_FREQ_HZ,
+                                    48000000, 48000000, 24000000, 48000000> Hse48Mhz;
+
+            /* 64 MHz from the internal oscillator (no crystal needed) */
+            typedef ClockTree::Tree<ClockTree::Source::HSI, ClockTree::HSI_HZ,
+                                    64000000, 64000000, 32000000, 64000000> Hsi64Mhz;
+
+            /* clock tree configured by SystemInit */
+            typedef Hse72Mhz Tree;
+
+            /* core (AHB) clock frequency */
+            static constexpr uint32_t HCLK_FREQ_HZ = Tree::HCLK_HZ;
+
+            /* APB1 (low speed) peripheral clock frequency */
+            static constexpr uint32_t PCLK1_FREQ_HZ = Tree::PCLK1_HZ;
+
+            /* APB2 (high speed) peripheral clock frequency */
+            static constexpr uint32_t PCLK2_FREQ_HZ = Tree::PCLK2_HZ;
+
+            /* timer kernel clocks of the APB1 (TIM2-4) and APB2 (TIM1) timers */
+            static constexpr uint32_t TIM_APB1_FREQ_HZ = Tree::TIM_APB1_HZ;
+            static constexpr uint32_t TIM_APB2_FREQ_HZ = Tree::TIM_APB2_HZ;
+
+            /* ADC clock frequency */
+            static constexpr uint32_t ADC_FREQ_HZ = Tree::ADC_HZ;
+
+            /* SysTick interrupt frequency */
+            static constexpr uint32_t TICK_FREQ_HZ = 1000;
+        }
+
         namespace Led {
-            /* on board LED GPIO port pin */
-            static constexpr uint32_t pin = 13;
+            /* on board LED (PC13, lit when driven low) */
+            typedef Gpio::Pin<GPIOC_BASE, 13, Gpio::Mode::OUTPUT> Pin;
+        }
+
+        namespace Console {
+            /* console baud rate */
+            static constexpr uint32_t baud = 115200;
+
+            /* console USART (USART1, DMA1 channel 4 TX / channel 5 RX) */
+            static USART_TypeDef * const usart = USART1;
 
-            /* on board LED GPIO port */
-            static GPIO_TypeDef * const port = GPIOC;
+            /* console TX and RX pins (PA9, PA10) */
+            typedef Gpio::Pin<GPIOA_BASE, 9, Gpio::Mode::AF>              TxPin;
+            typedef Gpio::Pin<GPIOA_BASE, 10, Gpio::Mode::INPUT_FLOATING> RxPin;
+        }
+
+        namespace Usb {
+            /*
+             * USB D+ (PA12, D- is PA11). The peripheral takes both pins over
+             * once enabled. The board pulls D+ up with a fixed resistor, so
+             * driving it low is the only way to signal a disconnect.
+             */
+            typedef Gpio::Pin<GPIOA_BASE, 12, Gpio::Mode::INPUT_FLOATING> DpPin;
+            typedef Gpio::Pin<GPIOA_BASE, 12, Gpio::Mode::OUTPUT>         DpLow;
+        }
+
+        namespace Spi1 {
+            /* SPI1 pins (PA5 SCK, PA6 MISO, PA7 MOSI) */
+            typedef Gpio::Pin<GPIOA_BASE, 5, Gpio::Mode::AF>             SckPin;
+            typedef Gpio::Pin<GPIOA_BASE, 6, Gpio::Mode::INPUT_FLOATING> MisoPin;
+            typedef Gpio::Pin<GPIOA_BASE, 7, Gpio::Mode::AF>             MosiPin;
+
+            /* chip select of the first device (PA4, the NSS pin) */
+            typedef Gpio::Pin<GPIOA_BASE, 4, Gpio::Mode::OUTPUT>         Cs0Pin;
+        }
+
+        namespace Spi2 {
+            /* SPI2 pins (PB13 SCK, PB14 MISO, PB15 MOSI) */
+            typedef Gpio::Pin<GPIOB_BASE, 13, Gpio::Mode::AF>             SckPin;
+            typedef Gpio::Pin<GPIOB_BASE, 14, Gpio::Mode::INPUT_FLOATING> MisoPin;
+            typedef Gpio::Pin<GPIOB_BASE, 15, Gpio::Mode::AF>             MosiPin;
+        }
+
+        namespace I2c1 {
+            /* bus clock (fast mode) */
+            static constexpr uint32_t CLOCK_HZ = 400000;
+
+            /* I2C1 SCL and SDA (PB6, PB7), open drain with external pull-ups */
+            typedef Gpio::Pin<GPIOB_BASE, 6, Gpio::Mode::AF_OD> SclPin;
+            typedef Gpio::Pin<GPIOB_BASE, 7, Gpio::Mode::AF_OD> SdaPin;
+
+            /* the same pins as plain GPIOs, to clock a stuck slave free */
+            typedef Gpio::Pin<GPIOB_BASE, 6, Gpio::Mode::OUTPUT_OD> SclGpio;
+            typedef Gpio::Pin<GPIOB_BASE, 7, Gpio::Mode::OUTPUT_OD> SdaGpio;
+        }
+
+        namespace Can {
+            /* bus bit rate */
+            static constexpr uint32_t BITRATE = 1000000;
+
+            /*
+             * CAN1 RX and TX remapped to PB8 and PB9 (PA11/PA12 are the USB
+             * pins), to an external transceiver. RX is pulled up so an open
+             * input reads recessive.
+             */
+            typedef Gpio::Pin<GPIOB_BASE, 8, Gpio::Mode::INPUT_PULL_UP> RxPin;
+            typedef Gpio::Pin<GPIOB_BASE, 9, Gpio::Mode::AF>            TxPin;
         }
     }
 
@@ -32,15 +140,12 @@ namespace Bsp {
         /* number of milliseconds counted by the SysTick interrupt */
         extern volatile uint32_t g_tick_ms;
 
-        /* primitive delay routine */
+        /* sleep (WFI) for the given number of milliseconds */
         void delay(uint32_t delay_ms);
     }
 
     /* board specific initialization */
-    static inline void init(void)
-    {
-        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
-    }
+    void init(void);
 }
 
 #endif /* BSP_HPP */
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef CAN_BUS_HPP
+#define CAN_BUS_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "can_filters.hpp"
+
+/*
+ * CAN1 (bxCAN) at Bsp::Components::Can::BITRATE, with hardware filtering
+ * and one receive queue per filter.
+ *
+ * RX_FILTERS below is the receive list. CanFilters::Plan packs it into the
+ * filter banks at compile time, so the controller drops every other frame
+ * and the CPU never sees it. The FIFO interrupts empty both hardware FIFOs
+ * (3 frames each, about 150 us of a busy 1 Mbit/s bus) into the queue of
+ * the filter that matched, found from the filter match index. The queues
+ * are single producer, single consumer rings: thread code reads them
+ * without masking anything.
+ *
+ * Transmission is in identifier order. send() inserts the frame into a
+ * queue sorted by arbitration priority, and the three mailboxes (sent
+ * lowest identifier first by the controller) are refilled from its head.
+ * When all three hold frames of lower priority than the head, the lowest
+ * one is aborted and queued again, so a waiting urgent frame gets a mailbox
+ * without waiting for a whole queue of bulk traffic. Frames with the same
+ * identifier keep their order.
+ *
+ * CAN and USB share the 512 byte packet memory and the FIFO 0 interrupt
+ * vector, so only one of them can run; build with CAN=1 to start CAN
+ * instead of USB.
+ *
+ * Both the register level and the HAL build are supported (USE_HAL).
+ */
+namespace CanBus {
+
+    using CanFilters::EXTENDED;
+
+    struct Frame {
+        /* identifier, EXTENDED set for an extended one */
+        uint32_t id;
+
+        /* data length (0-8) */
+        uint8_t  length;
+
+        uint8_t  data[8];
+    };
+
+    /* RECEIVE FILTERS (queue index = position in the list) */
+    static constexpr CanFilters::Filter RX_FILTERS[] = {
+        CanFilters::exact(0x000),                           /* NMT                  */
+        CanFilters::exact(0x080),                           /* SYNC                 */
+        CanFilters::exact(0x181),                           /* TPDO1 of node 1      */
+        CanFilters::exact(0x182),                           /* TPDO1 of node 2      */
+        CanFilters::exact(0x281),                           /* TPDO2 of node 1      */
+        CanFilters::exact(0x282),                           /* TPDO2 of node 2      */
+        CanFilters::masked(0x580, 0x780),                   /* SDO responses        */
+        CanFilters::masked(0x700, 0x780),                   /* heartbeats           */
+        CanFilters::exact(EXTENDED | 0x18FEF100),           /* J1939 CCVS, source 0 */
+    };
+
+    /* number of receive filters (and queues) */
+    static constexpr uint32_t FILTER_COUNT = sizeof(RX_FILTERS) / sizeof(RX_FILTERS[0]);
+
+    typedef CanFilters::Plan<RX_FILTERS, FILTER_COUNT> FilterPlan;
+
+    /* frames per receive queue (power of two) */
+    static constexpr uint32_t RX_QUEUE_DEPTH = 8;
+
+    /* frames waiting for a transmit mailbox */
+    static constexpr uint32_t TX_QUEUE_SIZE = 16;
+
+    /*
+     * Set up the filters and join the bus. Returns false if the controller
+     * did not see the bus idle (no transceiver, bus stuck dominant).
+     */
+    bool init(void);
+
+    /* init() succeeded */
+    bool running(void);
+
+    /*
+     * Queue a data frame for transmission in identifier order. Returns false
+     * if the transmit queue is full. Call from thread code or from a handler
+     * masked by a CriticalSection.
+     */
+    bool send(const Frame &frame);
+
+    /* take the oldest frame of the queue of RX_FILTERS[filter] */
+    bool receive(uint32_t filter, Frame &frame);
+
+    /* frames waiting in the queue of RX_FILTERS[filter] */
+    uint32_t pending(uint32_t filter);
+
+    /* received frames lost: FIFO overruns and full queues */
+    uint32_t dropped(void);
+
+    /* transmit mailbox (USB_HP_CAN1_TX) and FIFO 0 / FIFO 1 interrupt service routines */
+    void txIsr(void);
+    void rxIsr(uint32_t fifo);
+}
+
+#endif /* CAN_BUS_HPP */
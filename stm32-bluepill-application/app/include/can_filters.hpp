@@ -0,0 +1,259 @@
+#ifndef CAN_FILTERS_HPP
+#define CAN_FILTERS_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Compile-time packing of receive filters into the 14 filter banks of the
+ * bxCAN controller.
+ *
+ * The application lists the identifiers it wants, each one exact() or a
+ * masked() range. Plan sorts them by kind and packs each kind into banks in
+ * the densest mode that still matches exactly:
+ *
+ *      exact standard      16 bit list mode, 4 per bank
+ *      exact extended      32 bit list mode, 2 per bank
+ *      masked standard     16 bit mask mode, 2 per bank
+ *      masked extended     32 bit mask mode, 1 per bank
+ *
+ * Only data frames are accepted. Banks alternate between FIFO 0 and FIFO 1,
+ * so all frames of one filter go through the same FIFO and keep their order.
+ *
+ * A received frame carries the filter match index (FMI) of the filter that
+ * took it. Each bank records which list entry every one of its filter
+ * numbers stands for, so the receiver maps FMI to the entry with a table
+ * lookup and never looks at the identifier. A plan that does not fit the
+ * banks, or a malformed filter, does not build.
+ *
+ * See section 24.7.4 (identifier filtering) of the reference manual (RM0008).
+ */
+namespace CanFilters {
+
+    /* flag of an extended (29 bit) identifier */
+    static constexpr uint32_t EXTENDED = 1UL << 31;
+
+    /* identifier bits of a standard and an extended identifier */
+    static constexpr uint32_t STD_ID_MASK = 0x7FF;
+    static constexpr uint32_t EXT_ID_MASK = 0x1FFFFFFF;
+
+    /* filter banks of CAN1 */
+    static constexpr uint32_t BANKS = 14;
+
+    /* filter numbers a bank holds at most (16 bit list mode) */
+    static constexpr uint32_t BANK_FILTERS = 4;
+
+    struct Filter {
+        /* identifier, EXTENDED set for an extended one */
+        uint32_t id;
+
+        /* identifier bits that must match */
+        uint32_t mask;
+    };
+
+    /* exactly one identifier */
+    static constexpr Filter exact(uint32_t id)
+    {
+        return Filter{ id, (id & EXTENDED) ? EXT_ID_MASK : STD_ID_MASK };
+    }
+
+    /* every identifier that matches id in the bits of mask */
+    static constexpr Filter masked(uint32_t id, uint32_t mask)
+    {
+        return Filter{ id, mask };
+    }
+
+    /* register contents of one filter bank */
+    struct Bank {
+        bool     active;
+
+        /* identifier list mode (else identifier and mask) */
+        bool     list;
+
+        /* one 32 bit filter (else two 16 bit ones) */
+        bool     wide;
+
+        /* receive FIFO (0 or 1) */
+        uint8_t  fifo;
+
+        uint32_t fr1;
+        uint32_t fr2;
+
+        /* filter numbers the bank takes in its FIFO */
+        uint8_t  filters;
+
+        /* list entry of each filter number */
+        uint8_t  entries[BANK_FILTERS];
+    };
+
+    namespace Detail {
+
+        /* bank kinds, in bank order */
+        static constexpr uint32_t STD_LIST   = 0;
+        static constexpr uint32_t EXT_LIST   = 1;
+        static constexpr uint32_t STD_MASKED = 2;
+        static constexpr uint32_t EXT_MASKED = 3;
+        static constexpr uint32_t KINDS      = 4;
+
+        /* 32 bit scale layout: STID[31:21] EXID[20:3] IDE RTR 0 */
+        static constexpr uint32_t IDE32 = 1UL << 2;
+        static constexpr uint32_t RTR32 = 1UL << 1;
+
+        /* 16 bit scale layout: STID[15:5] RTR IDE EXID[17:15] */
+        static constexpr uint32_t RTR16 = 1UL << 4;
+        static constexpr uint32_t IDE16 = 1UL << 3;
+
+        static constexpr bool extended(const Filter &filter)
+        {
+            return (filter.id & EXTENDED) != 0;
+        }
+
+        static constexpr uint32_t idMask(const Filter &filter)
+        {
+            return extended(filter) ? EXT_ID_MASK : STD_ID_MASK;
+        }
+
+        static constexpr uint32_t kind(const Filter &filter)
+        {
+            return extended(filter) ? (filter.mask == EXT_ID_MASK ? EXT_LIST : EXT_MASKED) :
+                                      (filter.mask == STD_ID_MASK ? STD_LIST : STD_MASKED);
+        }
+
+        /* filters of a kind per bank */
+        static constexpr uint32_t slots(uint32_t kind)
+        {
+            return (kind == STD_LIST) ? 4 : (kind == EXT_MASKED) ? 1 : 2;
+        }
+
+        /* identifier and mask inside their range, no identifier bit outside the mask */
+        static constexpr bool valid(const Filter *list, uint32_t size, uint32_t index = 0)
+        {
+            return (index == size) ||
+                   (((list[index].id & ~EXTENDED) & ~idMask(list[index])) == 0 &&
+                    (list[index].mask & ~idMask(list[index])) == 0 &&
+                    (list[index].id & ~EXTENDED & ~list[index].mask) == 0 &&
+                    valid(list, size, index + 1));
+        }
+
+        /* number of filters of a kind */
+        static constexpr uint32_t count(const Filter *list, uint32_t size, uint32_t kind, uint32_t index = 0)
+        {
+            return (index == size) ? 0 :
+                   (Detail::kind(list[index]) == kind ? 1 : 0) + count(list, size, kind, index + 1);
+        }
+
+        /* list index of the n-th filter of a kind */
+        static constexpr uint32_t nth(const Filter *list, uint32_t size, uint32_t kind, uint32_t n, uint32_t index = 0)
+        {
+            return (index == size) ? size :
+                   (Detail::kind(list[index]) != kind) ? nth(list, size, kind, n, index + 1) :
+                   (n == 0) ? index : nth(list, size, kind, n - 1, index + 1);
+        }
+
+        static constexpr uint32_t banksOf(const Filter *list, uint32_t size, uint32_t kind)
+        {
+            return (count(list, size, kind) + slots(kind) - 1) / slots(kind);
+        }
+
+        /* first bank of a kind (the number of banks in use for KINDS) */
+        static constexpr uint32_t firstBank(const Filter *list, uint32_t size, uint32_t kind)
+        {
+            return (kind == 0) ? 0 : firstBank(list, size, kind - 1) + banksOf(list, size, kind - 1);
+        }
+
+        static constexpr uint32_t bankKind(const Filter *list, uint32_t size, uint32_t bank, uint32_t kind = 0)
+        {
+            return (kind + 1 == KINDS || bank < firstBank(list, size, kind + 1)) ?
+                   kind : bankKind(list, size, bank, kind + 1);
+        }
+
+        /* list index behind filter number slot of a bank (unused slots repeat the last filter) */
+        static constexpr uint32_t entry(const Filter *list, uint32_t size, uint32_t bank, uint32_t slot)
+        {
+            return nth(list, size, bankKind(list, size, bank),
+                       ((bank - firstBank(list, size, bankKind(list, size, bank))) * slots(bankKind(list, size, bank)) + slot <
+                        count(list, size, bankKind(list, size, bank))) ?
+                       (bank - firstBank(list, size, bankKind(list, size, bank))) * slots(bankKind(list, size, bank)) + slot :
+                       count(list, size, bankKind(list, size, bank)) - 1);
+        }
+
+        static constexpr uint32_t id32(const Filter &filter)
+        {
+            return extended(filter) ? ((filter.id & EXT_ID_MASK) << 3) | IDE32 : (filter.id & STD_ID_MASK) << 21;
+        }
+
+        static constexpr uint32_t mask32(const Filter &filter)
+        {
+            return (extended(filter) ? (filter.mask & EXT_ID_MASK) << 3 : (filter.mask & STD_ID_MASK) << 21) |
+                   IDE32 | RTR32;
+        }
+
+        static constexpr uint32_t id16(const Filter &filter)
+        {
+            return (filter.id & STD_ID_MASK) << 5;
+        }
+
+        static constexpr uint32_t mask16(const Filter &filter)
+        {
+            return ((filter.mask & STD_ID_MASK) << 5) | RTR16 | IDE16;
+        }
+
+        static constexpr uint32_t fr1(const Filter *list, uint32_t size, uint32_t bank, uint32_t kind)
+        {
+            return (kind == STD_LIST)   ? id16(list[entry(list, size, bank, 0)]) |
+                                          (id16(list[entry(list, size, bank, 1)]) << 16) :
+                   (kind == STD_MASKED) ? id16(list[entry(list, size, bank, 0)]) |
+                                          (mask16(list[entry(list, size, bank, 0)]) << 16) :
+                                          id32(list[entry(list, size, bank, 0)]);
+        }
+
+        static constexpr uint32_t fr2(const Filter *list, uint32_t size, uint32_t bank, uint32_t kind)
+        {
+            return (kind == STD_LIST)   ? id16(list[entry(list, size, bank, 2)]) |
+                                          (id16(list[entry(list, size, bank, 3)]) << 16) :
+                   (kind == STD_MASKED) ? id16(list[entry(list, size, bank, 1)]) |
+                                          (mask16(list[entry(list, size, bank, 1)]) << 16) :
+                   (kind == EXT_LIST)   ? id32(list[entry(list, size, bank, 1)]) :
+                                          mask32(list[entry(list, size, bank, 0)]);
+        }
+
+        static constexpr Bank bank(const Filter *list, uint32_t size, uint32_t bank)
+        {
+            return (bank >= firstBank(list, size, KINDS)) ?
+                   Bank{ false, false, false, 0, 0, 0, 0, { 0, 0, 0, 0 } } :
+                   Bank{ true,
+                         bankKind(list, size, bank) == STD_LIST || bankKind(list, size, bank) == EXT_LIST,
+                         bankKind(list, size, bank) == EXT_LIST || bankKind(list, size, bank) == EXT_MASKED,
+                         static_cast<uint8_t>(bank & 1),
+                         fr1(list, size, bank, bankKind(list, size, bank)),
+                         fr2(list, size, bank, bankKind(list, size, bank)),
+                         static_cast<uint8_t>(slots(bankKind(list, size, bank))),
+                         { static_cast<uint8_t>(entry(list, size, bank, 0)),
+                           static_cast<uint8_t>(entry(list, size, bank, 1)),
+                           static_cast<uint8_t>(entry(list, size, bank, 2)),
+                           static_cast<uint8_t>(entry(list, size, bank, 3)) } };
+        }
+    }
+
+    /* the bank layout of a filter list (List must have static storage) */
+    template <const Filter *List, uint32_t Size>
+    struct Plan {
+        static_assert(Size > 0 && Size < 0xFF, "between 1 and 254 receive filters");
+        static_assert(Detail::valid(List, Size),
+                      "filter identifier or mask out of range, or identifier bits outside the mask");
+
+        /* banks in use */
+        static constexpr uint32_t USED = Detail::firstBank(List, Size, Detail::KINDS);
+
+        static_assert(USED <= BANKS, "receive filters do not fit the 14 filter banks, "
+                                     "merge identifiers into masked() ranges");
+
+        /* contents of bank index (inactive past USED) */
+        static constexpr Bank bank(uint32_t index)
+        {
+            return Detail::bank(List, Size, index);
+        }
+    };
+}
+
+#endif /* CAN_FILTERS_HPP */
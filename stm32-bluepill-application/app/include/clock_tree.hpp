@@ -0,0 +1,188 @@
+#ifndef CLOCK_TREE_HPP
+#define CLOCK_TREE_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+/*
+ * Compile-time clock tree solver.
+ *
+ * A Tree is instantiated with the oscillator and the wanted SYSCLK and bus
+ * frequencies. It finds the PLL settings and prescalers that produce exactly
+ * those frequencies, derives the flash wait states and the ADC and timer
+ * clocks, and checks everything against the datasheet limits with
+ * static_assert. SystemInit writes the resulting register values as
+ * constants, so a profile change costs nothing at runtime and an invalid
+ * profile does not build.
+ *
+ * See Figure 8 (clock tree) and sections 3.3.3 and 7.3.2 of the reference
+ * manual (RM0008), and section 5.3 of the datasheet.
+ */
+namespace ClockTree {
+
+    enum class Source {
+        /* 8 MHz internal RC oscillator, fed to the PLL divided by 2 */
+        HSI,
+
+        /* external crystal, fed to the PLL undivided or divided by 2 */
+        HSE,
+    };
+
+    /* DATASHEET LIMITS */
+    static constexpr uint32_t HSI_HZ         = 8000000;
+    static constexpr uint32_t HSE_MIN_HZ     = 4000000;
+    static constexpr uint32_t HSE_MAX_HZ     = 16000000;
+    static constexpr uint32_t PLL_OUT_MIN_HZ = 16000000;
+    static constexpr uint32_t SYSCLK_MAX_HZ  = 72000000;
+    static constexpr uint32_t PCLK1_MAX_HZ   = 36000000;
+    static constexpr uint32_t PCLK2_MAX_HZ   = 72000000;
+    static constexpr uint32_t ADC_MIN_HZ     = 600000;
+    static constexpr uint32_t ADC_MAX_HZ     = 14000000;
+    static constexpr uint32_t USB_HZ         = 48000000;
+
+    /* highest SYSCLK for 0 and 1 flash wait states */
+    static constexpr uint32_t FLASH_0WS_MAX_HZ = 24000000;
+    static constexpr uint32_t FLASH_1WS_MAX_HZ = 48000000;
+
+    /* marks a divider that is not available */
+    static constexpr uint32_t INVALID = 0xFFFFFFFF;
+
+    namespace Detail {
+
+        /* PLL multiplier (2-16) turning in_hz into out_hz, 0 if none */
+        static constexpr uint32_t pllMul(uint32_t in_hz, uint32_t out_hz, uint32_t mul = 2)
+        {
+            return (mul > 16)              ? 0   :
+                   (in_hz * mul == out_hz) ? mul :
+                                             pllMul(in_hz, out_hz, mul + 1);
+        }
+
+        /* exact integer ratio of two frequencies, 0 if not exact */
+        static constexpr uint32_t ratio(uint32_t in_hz, uint32_t out_hz)
+        {
+            return (out_hz == 0 || (in_hz % out_hz) != 0) ? 0 : in_hz / out_hz;
+        }
+
+        /* HPRE field value for an AHB divider */
+        static constexpr uint32_t hpre(uint32_t div)
+        {
+            return (div == 1)   ? 0x0 :
+                   (div == 2)   ? 0x8 :
+                   (div == 4)   ? 0x9 :
+                   (div == 8)   ? 0xA :
+                   (div == 16)  ? 0xB :
+                   (div == 64)  ? 0xC :
+                   (div == 128) ? 0xD :
+                   (div == 256) ? 0xE :
+                   (div == 512) ? 0xF :
+                                  INVALID;
+        }
+
+        /* PPRE1/PPRE2 field value for an APB divider */
+        static constexpr uint32_t ppre(uint32_t div)
+        {
+            return (div == 1)  ? 0x0 :
+                   (div == 2)  ? 0x4 :
+                   (div == 4)  ? 0x5 :
+                   (div == 8)  ? 0x6 :
+                   (div == 16) ? 0x7 :
+                                 INVALID;
+        }
+
+        /* smallest ADC divider (2, 4, 6 or 8) keeping ADCCLK in spec */
+        static constexpr uint32_t adcDiv(uint32_t pclk2_hz, uint32_t div = 2)
+        {
+            return (div > 8 || pclk2_hz / div <= ADC_MAX_HZ) ? div : adcDiv(pclk2_hz, div + 2);
+        }
+
+        /* flash wait states needed at the given SYSCLK */
+        static constexpr uint32_t latency(uint32_t sysclk_hz)
+        {
+            return (sysclk_hz <= FLASH_0WS_MAX_HZ) ? 0 :
+                   (sysclk_hz <= FLASH_1WS_MAX_HZ) ? 1 :
+                                                     2;
+        }
+
+        /* APB timers run at twice the bus clock unless the bus is undivided */
+        static constexpr uint32_t timerClock(uint32_t hclk_hz, uint32_t pclk_hz)
+        {
+            return (pclk_hz == hclk_hz) ? pclk_hz : 2 * pclk_hz;
+        }
+    }
+
+    template <Source Src, uint32_t SrcHz, uint32_t SysclkHz,
+              uint32_t HclkHz, uint32_t Pclk1Hz, uint32_t Pclk2Hz>
+    class Tree {
+
+        public:
+            /* OSCILLATOR AND PLL */
+            static constexpr bool     USES_HSE   = (Src == Source::HSE);
+            static constexpr bool     USES_PLL   = (SysclkHz != SrcHz);
+
+            /* PLL input divider: HSI is always halved, HSE only if needed */
+            static constexpr uint32_t PLL_PREDIV = !USES_HSE                                ? 2 :
+                                                   (Detail::pllMul(SrcHz, SysclkHz) != 0) ? 1 :
+                                                                                            2;
+            static constexpr uint32_t PLL_IN_HZ  = SrcHz / PLL_PREDIV;
+            static constexpr uint32_t PLL_MUL    = USES_PLL ? Detail::pllMul(PLL_IN_HZ, SysclkHz) : 0;
+
+            /* BUS DIVIDERS */
+            static constexpr uint32_t AHB_DIV  = Detail::ratio(SysclkHz, HclkHz);
+            static constexpr uint32_t APB1_DIV = Detail::ratio(HclkHz, Pclk1Hz);
+            static constexpr uint32_t APB2_DIV = Detail::ratio(HclkHz, Pclk2Hz);
+            static constexpr uint32_t ADC_DIV  = Detail::adcDiv(Pclk2Hz);
+
+            /* DERIVED FREQUENCIES */
+            static constexpr uint32_t SYSCLK_HZ    = SysclkHz;
+            static constexpr uint32_t HCLK_HZ      = HclkHz;
+            static constexpr uint32_t PCLK1_HZ     = Pclk1Hz;
+            static constexpr uint32_t PCLK2_HZ     = Pclk2Hz;
+            static constexpr uint32_t ADC_HZ       = Pclk2Hz / ADC_DIV;
+            static constexpr uint32_t TIM_APB1_HZ  = Detail::timerClock(HclkHz, Pclk1Hz);
+            static constexpr uint32_t TIM_APB2_HZ  = Detail::timerClock(HclkHz, Pclk2Hz);
+
+            /* USB needs 48 MHz: the PLL output undivided or divided by 1.5 */
+            static constexpr bool     USB_CAPABLE  = USES_PLL && (SysclkHz == USB_HZ || SysclkHz * 2 == USB_HZ * 3);
+
+            static constexpr uint32_t FLASH_LATENCY = Detail::latency(SysclkHz);
+
+            /* REGISTER VALUES */
+            static constexpr uint32_t CR   = RCC_CR_HSION | (0x10 << RCC_CR_HSITRIM_Pos) |
+                                             (USES_HSE ? RCC_CR_HSEON : 0);
+
+            /* CFGR without the system clock switch (SW) */
+            static constexpr uint32_t CFGR = (Detail::hpre(AHB_DIV)  << RCC_CFGR_HPRE_Pos)   |
+                                             (Detail::ppre(APB1_DIV) << RCC_CFGR_PPRE1_Pos)  |
+                                             (Detail::ppre(APB2_DIV) << RCC_CFGR_PPRE2_Pos)  |
+                                             (((ADC_DIV / 2) - 1)    << RCC_CFGR_ADCPRE_Pos) |
+                                             (USES_PLL ? ((PLL_MUL - 2) << RCC_CFGR_PLLMULL_Pos) : 0) |
+                                             ((USES_PLL && USES_HSE) ? RCC_CFGR_PLLSRC : 0) |
+                                             ((USES_PLL && USES_HSE && PLL_PREDIV == 2) ? RCC_CFGR_PLLXTPRE : 0) |
+                                             ((SysclkHz == USB_HZ) ? RCC_CFGR_USBPRE : 0);
+
+            static constexpr uint32_t SW   = USES_PLL ? RCC_CFGR_SW_PLL :
+                                             USES_HSE ? RCC_CFGR_SW_HSE :
+                                                        RCC_CFGR_SW_HSI;
+            static constexpr uint32_t SWS  = SW << RCC_CFGR_SWS_Pos;
+
+            static constexpr uint32_t FLASH_ACR = FLASH_ACR_PRFTBE | (FLASH_LATENCY << FLASH_ACR_LATENCY_Pos);
+
+        private:
+            static_assert(USES_HSE || SrcHz == HSI_HZ, "the HSI runs at 8 MHz");
+            static_assert(!USES_HSE || (SrcHz >= HSE_MIN_HZ && SrcHz <= HSE_MAX_HZ), "HSE crystal out of range");
+            static_assert(!USES_PLL || PLL_MUL != 0, "SYSCLK cannot be reached with the PLL");
+            static_assert(!USES_PLL || SysclkHz >= PLL_OUT_MIN_HZ, "PLL output below its minimum");
+            static_assert(SysclkHz <= SYSCLK_MAX_HZ, "SYSCLK above 72 MHz");
+            static_assert(Detail::hpre(AHB_DIV) != INVALID, "HCLK is not an AHB division of SYSCLK");
+            static_assert(Detail::ppre(APB1_DIV) != INVALID, "PCLK1 is not an APB division of HCLK");
+            static_assert(Detail::ppre(APB2_DIV) != INVALID, "PCLK2 is not an APB division of HCLK");
+            static_assert(Pclk1Hz <= PCLK1_MAX_HZ, "PCLK1 above 36 MHz");
+            static_assert(Pclk2Hz <= PCLK2_MAX_HZ, "PCLK2 above 72 MHz");
+            static_assert(ADC_HZ <= ADC_MAX_HZ && ADC_HZ >= ADC_MIN_HZ, "no ADC prescaler gives a valid ADCCLK");
+    };
+}
+
+#endif /* CLOCK_TREE_HPP */
@@ -0,0 +1,39 @@
+#ifndef CRC_UNIT_HPP
+#define CRC_UNIT_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * CRC-32 on the CRC calculation unit, with the same results as the shared
+ * software implementation (crc/crc32.hpp) and the host.
+ *
+ * The unit shifts each 32 bit word written to its data register in MSB
+ * first with the normal polynomial 0x04C11DB7. The standard CRC-32 is the
+ * reflected form: bytes in memory order, each one LSB first. On the little
+ * endian core that is exactly the word loaded from memory with its bits
+ * reversed, so every word is fed through RBIT (one cycle) and the result is
+ * read back through RBIT. The F1 unit can neither reflect the input nor be
+ * preloaded, which is why it is fed by the CPU and not by DMA: a DMA feed
+ * could only produce the unreflected CRC that no host tool computes. A
+ * previous CRC is loaded by writing one word chosen so the unit ends up in
+ * the wanted state (see preset()).
+ *
+ * Unaligned head bytes, the tail of a length that is not a multiple of 4 and
+ * short buffers go through the software tables. If the unit is already in
+ * use (a handler preempted a calculation) the caller falls back to software
+ * instead of waiting, so crc32() may be called from any context.
+ */
+namespace CrcUnit {
+
+    /* buffers shorter than this are not worth the unit's setup */
+    static constexpr uint32_t MIN_BYTES = 16;
+
+    /* enable the unit's clock */
+    void init(void);
+
+    /* CRC-32 of length bytes, continuing from the CRC of the preceding data */
+    uint32_t crc32(const void *data, uint32_t length, uint32_t previous = 0);
+}
+
+#endif /* CRC_UNIT_HPP */
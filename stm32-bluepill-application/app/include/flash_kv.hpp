@@ -0,0 +1,59 @@
+#ifndef FLASH_KV_HPP
+#define FLASH_KV_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// STATIC LIB
+#include "kv/store.hpp"
+
+/*
+ * Persistent configuration and counters in the last pages of the on-chip
+ * flash (the KVSTORE region of the linker script), on the log-structured
+ * store of kv/store.hpp.
+ *
+ * An update appends a record of 8 bytes plus the value (about 50 us per
+ * half word). Erasing is left to maintain(), one 1 KiB page (about 20 ms) at
+ * a time; an update only erases when maintain() fell behind. Call it from
+ * thread code when a stall is acceptable: the CPU cannot fetch from flash
+ * while a page is erased, so interrupts wait as well. Pages are erased in
+ * rotation, each one once per PAGES pages written.
+ *
+ * Flashing the application only erases the pages it programs, so the store
+ * survives firmware updates. Keys must keep their meaning across versions.
+ */
+namespace FlashKv {
+
+    /* KEYS */
+    static constexpr uint32_t BOOT_COUNT = 0;
+
+    /* number of keys (size of the RAM index) */
+    static constexpr uint32_t MAX_KEYS = 32;
+
+    /* flash backend of the store */
+    class Flash {
+
+        public:
+            /* must match _Kv_Size in the linker script */
+            static constexpr uint32_t PAGE_SIZE = 1024;
+            static constexpr uint32_t PAGES     = 4;
+
+            const uint8_t *base(void) const;
+
+            bool program(uint32_t offset, const uint16_t *values, uint32_t count);
+
+            bool erase(uint32_t page);
+    };
+
+    typedef kv::Store<Flash, MAX_KEYS> Store;
+
+    /* check the flash region and rebuild the index */
+    void init(void);
+
+    Store &store(void);
+
+    /* one step of compaction (see kv::Store::maintain) */
+    bool maintain(void);
+}
+
+#endif /* FLASH_KV_HPP */
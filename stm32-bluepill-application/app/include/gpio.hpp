@@ -0,0 +1,293 @@
+#ifndef GPIO_HPP
+#define GPIO_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "bitband.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+/*
+ * Compile-time GPIO pins.
+ *
+ * A pin is a type, Pin<GPIOx_BASE, N, Mode>, rather than an object holding a
+ * port pointer and pin number. Every register address and bit mask is a
+ * constant, so the output operations are a single store to BSRR or BRR.
+ * Those registers only affect the pins written with a 1, which makes the
+ * operations atomic against interrupt handlers driving other pins of the same
+ * port (an ODR read-modify-write is not).
+ *
+ * The operations are forced inline so the application's -O0 build still
+ * emits a single store instead of a call.
+ */
+namespace Gpio {
+
+    /*
+     * Pin configuration, the 4 bit CNF[1:0] MODE[1:0] field of CRL/CRH. The
+     * outputs use the 50 MHz output mode. See section 9.2.1 of the reference
+     * manual.
+     */
+    enum class Mode : uint32_t {
+        ANALOG          = 0x0,
+        INPUT_FLOATING  = 0x4,
+        INPUT_PULL_DOWN = 0x8,
+        INPUT_PULL_UP   = 0x18, /* 0x8 with the ODR bit set */
+        OUTPUT          = 0x3,
+        OUTPUT_OD       = 0x7,
+        AF              = 0xB,
+        AF_OD           = 0xF,
+    };
+
+    namespace Detail {
+
+        static constexpr uint32_t cnfMode(Mode mode)
+        {
+            return static_cast<uint32_t>(mode) & 0xF;
+        }
+
+        static constexpr bool isOutput(Mode mode)
+        {
+            return (static_cast<uint32_t>(mode) & 0x3) != 0 && (static_cast<uint32_t>(mode) & 0x8) == 0;
+        }
+
+        /*
+         * Level written to ODR before the pin is configured: pull-up inputs
+         * and open-drain outputs start released (high), everything else low.
+         */
+        static constexpr bool initialHigh(Mode mode)
+        {
+            return mode == Mode::INPUT_PULL_UP || mode == Mode::OUTPUT_OD || mode == Mode::AF_OD;
+        }
+
+        static constexpr uint32_t rccEnable(uint32_t port_base)
+        {
+            return port_base == GPIOA_BASE ? RCC_APB2ENR_IOPAEN :
+                   port_base == GPIOB_BASE ? RCC_APB2ENR_IOPBEN :
+                   port_base == GPIOC_BASE ? RCC_APB2ENR_IOPCEN :
+                   port_base == GPIOD_BASE ? RCC_APB2ENR_IOPDEN :
+                                             0                  ;
+        }
+
+        /*
+         * CRL (high == false) or CRH (high == true) value with the given 4 bit
+         * field placed at every pin of mask that register configures.
+         */
+        static constexpr uint32_t crField(uint32_t mask, uint32_t field, bool high, uint32_t pin = 0)
+        {
+            return (pin == 8) ? 0 :
+                   ((((mask >> (pin + (high ? 8 : 0))) & 1) != 0) ? (field << (pin << 2)) : 0) |
+                   crField(mask, field, high, pin + 1);
+        }
+
+        /*
+         * Enable the port clock, write the initial levels and update the
+         * configuration registers. Every argument is a compile time constant,
+         * so this is one store per register touched. The levels are written
+         * before the pins become outputs to avoid a glitch.
+         */
+        template <uint32_t PortBase, uint32_t CrlMask, uint32_t Crl,
+                  uint32_t CrhMask, uint32_t Crh, uint32_t Bsrr>
+        static inline void configure(void)
+        {
+            GPIO_TypeDef * const port = reinterpret_cast<GPIO_TypeDef *>(PortBase);
+
+            Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), rccEnable(PortBase)>::set();
+            port->BSRR = Bsrr;
+            if (CrlMask != 0) {
+                port->CRL = (port->CRL & ~CrlMask) | Crl;
+            }
+            if (CrhMask != 0) {
+                port->CRH = (port->CRH & ~CrhMask) | Crh;
+            }
+        }
+    }
+
+    template <typename... Pins>
+    class Group;
+
+    template <uint32_t PortBase, uint32_t N, Mode M>
+    class Pin {
+
+        static_assert(N < 16, "GPIO pin number out of range");
+        static_assert(Detail::rccEnable(PortBase) != 0, "not a GPIO port base address");
+
+        public:
+            static constexpr uint32_t PORT_BASE = PortBase;
+            static constexpr uint32_t NUMBER    = N;
+            static constexpr Mode     MODE      = M;
+            static constexpr uint32_t MASK      = 1UL << N;
+
+            /* configuration register values folded by Group::init() */
+            static constexpr uint32_t CRL_MASK  = Detail::crField(MASK, 0xF, false);
+            static constexpr uint32_t CRL_BITS  = Detail::crField(MASK, Detail::cnfMode(M), false);
+            static constexpr uint32_t CRH_MASK  = Detail::crField(MASK, 0xF, true);
+            static constexpr uint32_t CRH_BITS  = Detail::crField(MASK, Detail::cnfMode(M), true);
+            static constexpr uint32_t BSRR_INIT = Detail::initialHigh(M) ? MASK : (MASK << 16);
+
+            static inline __attribute__((always_inline)) GPIO_TypeDef *port(void)
+            {
+                return reinterpret_cast<GPIO_TypeDef *>(PortBase);
+            }
+
+            /* enable the port clock, set the initial level and configure the pin */
+            static inline void init(void)
+            {
+                Group<Pin>::init();
+            }
+
+            static inline __attribute__((always_inline)) void set(void)
+            {
+                static_assert(Detail::isOutput(M), "pin is not a GPIO output");
+                port()->BSRR = MASK;
+            }
+
+            static inline __attribute__((always_inline)) void clear(void)
+            {
+                static_assert(Detail::isOutput(M), "pin is not a GPIO output");
+                port()->BRR = MASK;
+            }
+
+            static inline __attribute__((always_inline)) void write(bool high)
+            {
+                static_assert(Detail::isOutput(M), "pin is not a GPIO output");
+                port()->BSRR = high ? MASK : (MASK << 16);
+            }
+
+            static inline __attribute__((always_inline)) void toggle(void)
+            {
+                static_assert(Detail::isOutput(M), "pin is not a GPIO output");
+
+                /*
+                 * Set the pin if it is low and reset it if it is high. The
+                 * update is still a single BSRR store, so other pins of the
+                 * port changed by an interrupt in between are not clobbered.
+                 */
+                const uint32_t odr = port()->ODR;
+                port()->BSRR = ((odr & MASK) << 16) | (~odr & MASK);
+            }
+
+            static inline __attribute__((always_inline)) bool read(void)
+            {
+                return (port()->IDR & MASK) != 0;
+            }
+    };
+
+    /*
+     * A set of pins on the same port, written together with a single BSRR
+     * store. Useful for parallel buses and for initializing several pins with
+     * one configuration register update.
+     */
+    template <>
+    class Group<> {
+
+        public:
+            static constexpr uint32_t PORT_BASE = 0;
+            static constexpr uint32_t MASK      = 0;
+            static constexpr uint32_t CRL_MASK  = 0;
+            static constexpr uint32_t CRL_BITS  = 0;
+            static constexpr uint32_t CRH_MASK  = 0;
+            static constexpr uint32_t CRH_BITS  = 0;
+            static constexpr uint32_t BSRR_INIT = 0;
+    };
+
+    template <typename First, typename... Rest>
+    class Group<First, Rest...> {
+
+        typedef Group<Rest...> Tail;
+
+        static_assert(sizeof...(Rest) == 0 || Tail::PORT_BASE == First::PORT_BASE,
+                      "all pins of a group must be on the same port");
+        static_assert((Tail::MASK & First::MASK) == 0, "pin listed twice in a group");
+
+        public:
+            static constexpr uint32_t PORT_BASE = First::PORT_BASE;
+            static constexpr uint32_t MASK      = First::MASK      | Tail::MASK;
+            static constexpr uint32_t CRL_MASK  = First::CRL_MASK  | Tail::CRL_MASK;
+            static constexpr uint32_t CRL_BITS  = First::CRL_BITS  | Tail::CRL_BITS;
+            static constexpr uint32_t CRH_MASK  = First::CRH_MASK  | Tail::CRH_MASK;
+            static constexpr uint32_t CRH_BITS  = First::CRH_BITS  | Tail::CRH_BITS;
+            static constexpr uint32_t BSRR_INIT = First::BSRR_INIT | Tail::BSRR_INIT;
+
+            static inline __attribute__((always_inline)) GPIO_TypeDef *port(void)
+            {
+                return reinterpret_cast<GPIO_TypeDef *>(PORT_BASE);
+            }
+
+            /* enable the port clock and configure every pin of the group */
+            static inline void init(void)
+            {
+                Detail::configure<PORT_BASE, CRL_MASK, CRL_BITS, CRH_MASK, CRH_BITS, BSRR_INIT>();
+            }
+
+            static inline __attribute__((always_inline)) void set(void)
+            {
+                port()->BSRR = MASK;
+            }
+
+            static inline __attribute__((always_inline)) void clear(void)
+            {
+                port()->BRR = MASK;
+            }
+
+            /*
+             * Drive every pin of the group at once from a port wide value:
+             * pins whose bit is set in bits go high, the others go low. Pins
+             * outside the group are not affected.
+             */
+            static inline __attribute__((always_inline)) void write(uint32_t bits)
+            {
+                port()->BSRR = (bits & MASK) | ((~bits & MASK) << 16);
+            }
+
+            /* port wide input value masked to the pins of the group */
+            static inline __attribute__((always_inline)) uint32_t read(void)
+            {
+                return port()->IDR & MASK;
+            }
+    };
+
+    /*
+     * Width contiguous output pins starting at First, e.g. the data lines of
+     * a parallel display bus. A value is written with a single BSRR store.
+     */
+    template <uint32_t PortBase, uint32_t First, uint32_t Width, Mode M = Mode::OUTPUT>
+    class Bus {
+
+        static_assert(Width > 0 && First + Width <= 16, "bus does not fit in the port");
+
+        public:
+            static constexpr uint32_t VALUE_MASK = (1UL << Width) - 1;
+            static constexpr uint32_t MASK       = VALUE_MASK << First;
+            static constexpr uint32_t CRL_MASK   = Detail::crField(MASK, 0xF, false);
+            static constexpr uint32_t CRL_BITS   = Detail::crField(MASK, Detail::cnfMode(M), false);
+            static constexpr uint32_t CRH_MASK   = Detail::crField(MASK, 0xF, true);
+            static constexpr uint32_t CRH_BITS   = Detail::crField(MASK, Detail::cnfMode(M), true);
+            static constexpr uint32_t BSRR_INIT  = Detail::initialHigh(M) ? MASK : (MASK << 16);
+
+            static inline __attribute__((always_inline)) GPIO_TypeDef *port(void)
+            {
+                return reinterpret_cast<GPIO_TypeDef *>(PortBase);
+            }
+
+            /* enable the port clock and configure every pin of the bus */
+            static inline void init(void)
+            {
+                Detail::configure<PortBase, CRL_MASK, CRL_BITS, CRH_MASK, CRH_BITS, BSRR_INIT>();
+            }
+
+            static inline __attribute__((always_inline)) void write(uint32_t value)
+            {
+                port()->BSRR = ((value & VALUE_MASK) << First) | ((~value & VALUE_MASK) << (First + 16));
+            }
+
+            static inline __attribute__((always_inline)) uint32_t read(void)
+            {
+                return (port()->IDR >> First) & VALUE_MASK;
+            }
+    };
+}
+
+#endif /* GPIO_HPP */
@@ -0,0 +1,103 @@
+#ifndef I2C_BUS_HPP
+#define I2C_BUS_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Queued, interrupt and DMA driven I2C master on I2C1 (SCL PB6, SDA PB7).
+ *
+ * A Transaction addresses one slave: it writes tx_length bytes, then reads
+ * rx_length bytes after a repeated start (a register read is a one byte
+ * write of the register address followed by the read). Either part may be
+ * empty. submit() returns at once; transactions run in submission order and
+ * the completion callback runs from the interrupt that ended one, after the
+ * next one has been started. The CPU only handles the start, address and
+ * end events, the data bytes move by DMA (I2C1 TX on DMA1 channel 6, RX on
+ * channel 7).
+ *
+ * Workarounds for the I2C section of the errata sheet (doc/errata.pdf):
+ *
+ *  - "Some software events must be managed before the current byte is
+ *    being transferred": reads of two bytes or more use DMA with the LAST
+ *    bit, so the NACK of the last byte needs no software timing. A single
+ *    byte read sets STOP right after clearing ADDR, and the handlers run
+ *    at the highest maskable priority.
+ *  - "I2C analog filter may provide wrong value, locking BUSY flag": the
+ *    bus is recovered (below) when BUSY is set at init.
+ *  - "Spurious bus error detection in master mode": a bus error (BERR)
+ *    alone is cleared and the transaction goes on.
+ *  - A slave holding SDA low, or a real bus fault that stalls the
+ *    transaction, leaves the peripheral unable to finish or start. Both
+ *    end in a bus recovery: up to nine SCL pulses as a GPIO until SDA is
+ *    released, a stop condition, then a software reset of the peripheral.
+ *
+ * A transaction that does not end in time (watchdog() runs every tick) is
+ * failed with TIMEOUT and the bus is recovered as well.
+ *
+ * I2C2 is not supported: its DMA channels (4 and 5) belong to the console.
+ *
+ * Both the register level and the HAL build are supported (USE_HAL).
+ */
+namespace I2cBus {
+
+    enum class Status : uint32_t {
+        OK,
+        NACK,               /* address or data byte not acknowledged */
+        ARBITRATION_LOST,   /* another master won the bus */
+        BUS_ERROR,          /* other I2C error or DMA error, bus recovered */
+        TIMEOUT,            /* bus stuck or slave stretching too long, bus recovered */
+    };
+
+    /* bytes of one transfer direction at most (DMA counter) */
+    static constexpr uint32_t MAX_LENGTH = 0xFFFF;
+
+    struct Transaction;
+
+    /* completion callback (called from an I2C interrupt or the tick) */
+    typedef void (*Callback)(Transaction &transaction, Status status, void *arg);
+
+    struct Transaction {
+        /* 7 bit slave address */
+        uint8_t        address;
+
+        /* bytes written first, then bytes read after a repeated start */
+        const uint8_t *tx;
+        uint32_t       tx_length;
+        uint8_t       *rx;
+        uint32_t       rx_length;
+
+        Callback       callback;
+        void          *arg;
+
+        /* queue link, owned by the driver from submit() to the callback */
+        Transaction   *next;
+    };
+
+    /* configure the pins, the peripheral and its DMA channels */
+    void init(void);
+
+    /*
+     * Queue a transaction. Returns false if it transfers nothing or either
+     * length is above MAX_LENGTH. The transaction and its buffers must stay
+     * valid until the callback ran. May be called from a callback.
+     */
+    bool submit(Transaction &transaction);
+
+    /* nothing queued or in progress */
+    bool idle(void);
+
+    /* number of bus recoveries since init */
+    uint32_t recoveries(void);
+
+    /* event, error and DMA (RX channel 7, TX channel 6) interrupt service routines */
+    void evIsr(void);
+    void erIsr(void);
+    void rxIsr(void);
+    void txIsr(void);
+
+    /* transaction timeout (called from the SysTick interrupt) */
+    void watchdog(void);
+}
+
+#endif /* I2C_BUS_HPP */
@@ -0,0 +1,163 @@
+#ifndef ISR_STATS_HPP
+#define ISR_STATS_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+/*
+ * Interrupt handler timing statistics.
+ *
+ * Built into the application when Make is called with ISR_STATS=1. A handler
+ * is instrumented by creating a Scope as its first statement:
+ *
+ *      IsrStats::Scope scope(IsrStats::Id::SYSTICK);
+ *
+ * The scope samples the DWT cycle counter on entry and exit and records the
+ * handler's own execution time, i.e. without the time spent in handlers that
+ * preempted it, together with a log2 histogram and the nesting depth. Without
+ * ISR_STATS the scope is empty and costs nothing.
+ *
+ * Every entry of the table is written by its own handler only, and a handler
+ * never preempts itself, so the table needs no locking. The nesting state
+ * shared by all handlers (Detail::g_depth and g_nested) is another matter:
+ * a handler preempting between the cycle counter sample and its update
+ * would be counted twice or lost. Entry and exit therefore sample and
+ * update it with PRIMASK set, for a few instructions. A reader (GDB, dump())
+ * may see an entry half updated, which is harmless for statistics.
+ *
+ *      (gdb) isrstats
+ */
+namespace IsrStats {
+
+    /* instrumented handlers */
+    enum class Id : uint32_t {
+        SYSTICK,
+        DMA1_CHANNEL1,
+        DMA1_CHANNEL2,
+        DMA1_CHANNEL3,
+        DMA1_CHANNEL4,
+        DMA1_CHANNEL5,
+        DMA1_CHANNEL6,
+        DMA1_CHANNEL7,
+        CAN_TX,
+        USB_LP,
+        CAN_RX1,
+        I2C1_EV,
+        I2C1_ER,
+        CONSOLE_RX,
+        COUNT,
+    };
+
+    /* number of table entries */
+    static constexpr uint32_t ID_COUNT = static_cast<uint32_t>(Id::COUNT);
+
+    /*
+     * Number of histogram bins. Bin 0 counts runs shorter than 16 cycles and
+     * bin n (n > 0) runs of 16 << (n - 1) up to 16 << n cycles. The last bin
+     * also takes everything longer.
+     */
+    static constexpr uint32_t HIST_BINS = 12;
+
+    struct Stats {
+        /* number of completed runs */
+        volatile uint32_t count;
+
+        /* cycle counter at the last entry */
+        volatile uint32_t last_entry;
+
+        /* shortest, longest and accumulated execution cycles */
+        volatile uint32_t min_cycles;
+        volatile uint32_t max_cycles;
+        volatile uint64_t total_cycles;
+
+        /* longest delay from the request to the handler entry (if known) */
+        volatile uint32_t max_latency;
+
+        /* deepest nesting seen on entry (1 = not nested) */
+        volatile uint32_t max_nesting;
+
+        /* execution time histogram */
+        volatile uint32_t histogram[HIST_BINS];
+    };
+
+    /* per handler statistics */
+    extern Stats g_stats[ID_COUNT];
+
+    /* handler names, in Id order */
+    extern const char *const g_names[ID_COUNT];
+
+    /* clear the table */
+    void reset(void);
+
+    /* send the table as token log records (see token_log.hpp) */
+    void dump(void);
+
+#if defined(APP_ISR_STATS)
+    namespace Detail {
+
+        /* number of instrumented handlers currently active */
+        extern volatile uint32_t g_depth;
+
+        /* running sum of the cycles of completed handlers */
+        extern volatile uint32_t g_nested;
+
+        void record(Id id, uint32_t entry, uint32_t nested);
+
+        void latency(Id id, uint32_t cycles);
+    }
+
+    class Scope {
+
+        public:
+            explicit inline __attribute__((always_inline)) Scope(Id id) :
+                mEntry(0), mId(id), mNested(0)
+            {
+                const uint32_t primask = __get_PRIMASK();
+                __disable_irq();
+                mEntry  = DWT->CYCCNT;
+                mNested = Detail::g_nested;
+                Detail::g_depth = Detail::g_depth + 1;
+                __set_PRIMASK(primask);
+            }
+
+            inline __attribute__((always_inline)) ~Scope()
+            {
+                Detail::record(mId, mEntry, mNested);
+            }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            /* cycle counter on entry */
+            uint32_t mEntry;
+
+            const Id mId;
+
+            /* Detail::g_nested on entry */
+            uint32_t mNested;
+    };
+
+    /* record how many cycles after its request the handler was entered */
+    static inline void latency(Id id, uint32_t cycles)
+    {
+        Detail::latency(id, cycles);
+    }
+#else
+    class Scope {
+
+        public:
+            explicit inline Scope(Id id) { }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+    };
+
+    static inline void latency(Id id, uint32_t cycles) { }
+#endif
+}
+
+#endif /* ISR_STATS_HPP */
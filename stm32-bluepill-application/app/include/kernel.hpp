@@ -0,0 +1,101 @@
+#ifndef KERNEL_HPP
+#define KERNEL_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Minimal preemptive priority kernel.
+ *
+ * Every priority level has a FIFO ready queue and one bit in a ready bitmap.
+ * The highest ready priority is found in constant time with a count leading
+ * zeros instruction. Context switches happen in the PendSV handler, which
+ * runs at the lowest exception priority so it never preempts an ISR. The
+ * SysTick wakes sleeping tasks and rotates tasks of equal priority (time
+ * slicing).
+ *
+ * Tasks run on the process stack (PSP). Exceptions and the code before
+ * start() run on the main stack (MSP).
+ */
+namespace Kernel {
+
+    /* number of priority levels (one bitmap bit each) */
+    static constexpr uint32_t PRIORITIES = 32;
+
+    /* priority of the idle task (lowest). Application tasks use 1 and up. */
+    static constexpr uint32_t IDLE_PRIORITY = 0;
+
+    /* smallest usable task stack (hardware + software frame and margin) */
+    static constexpr uint32_t MIN_STACK_WORDS = 64;
+
+    /* task entry point signature */
+    typedef void (*Entry)(void *arg);
+
+    class Scheduler;
+
+    class Task {
+
+        public:
+            Task(void) { }
+
+            Task(const Task &) = delete;
+            Task &operator=(const Task &) = delete;
+
+        private:
+            friend class Scheduler;
+
+            /*
+             * Saved process stack pointer. This MUST stay the first member,
+             * the PendSV handler accesses it at offset 0.
+             */
+            uint32_t *mSp       = nullptr;
+
+            /* next task in the ready queue or the sleep list */
+            Task     *mNext     = nullptr;
+
+            /* scheduling priority (higher number runs first) */
+            uint32_t  mPriority = 0;
+
+            /* tick count at which a sleeping task becomes ready */
+            uint32_t  mWake     = 0;
+
+            /* stack memory, kept for the high-water mark */
+            uint32_t *mStack      = nullptr;
+            uint32_t  mStackWords = 0;
+    };
+
+    /*
+     * Prepare a statically allocated task control block and stack and make
+     * the task ready. May be called before or after start(). The stack is
+     * painted for stackHighWater().
+     */
+    void createTask(Task &task, Entry entry, void *arg,
+                    uint32_t *stack, uint32_t stack_words, uint32_t priority);
+
+    /* start scheduling (never returns) */
+    void start(void) __attribute__((noreturn));
+
+    /* true once start() has been called */
+    bool running(void);
+
+    /* give the CPU to the next ready task of the same priority (no-op before start()) */
+    void yield(void);
+
+    /* block the calling task for the given number of ticks (WFI before start()) */
+    void sleep(uint32_t ticks);
+
+    /* kernel tick count */
+    uint32_t ticks(void);
+
+    /* advance the kernel time (called from the SysTick ISR) */
+    void tick(void);
+
+    /*
+     * Deepest use of a task's stack in bytes, including the initial context
+     * frame. Interrupts taken while the task runs use the main stack and are
+     * not counted here (see StackMonitor::mainUsed()).
+     */
+    uint32_t stackHighWater(const Task &task);
+}
+
+#endif /* KERNEL_HPP */
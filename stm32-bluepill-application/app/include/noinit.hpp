@@ -0,0 +1,14 @@
+#ifndef NOINIT_HPP
+#define NOINIT_HPP
+
+/*
+ * Place a variable in the .noinit section. The startup code neither copies
+ * nor zeroes it, so large buffers whose initial contents do not matter (DMA
+ * buffers, stacks, pools) do not add to the time to main. The contents are
+ * undefined after a power on and survive a reset.
+ *
+ *      NOINIT static uint8_t g_buffer[1024];
+ */
+#define NOINIT __attribute__((section(".noinit")))
+
+#endif /* NOINIT_HPP */
@@ -0,0 +1,165 @@
+#ifndef NVIC_HPP
+#define NVIC_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+/*
+ * Interrupt priority plan and priority masking critical sections.
+ *
+ * Every exception and interrupt the application uses is listed in PLAN with
+ * its priority, and static_asserts check the plan as a whole. A lower number
+ * is a higher priority. AIRCR is set up so all 4 priority bits are preemption
+ * bits (no subpriority).
+ *
+ *      0 .. MASK_LEVEL - 1     never masked: hard real-time handlers (motor
+ *                              control, timing capture). These must not call
+ *                              the kernel, UartLog or anything else that uses
+ *                              a CriticalSection.
+ *      MASK_LEVEL .. LOWEST    masked by a CriticalSection.
+ *      LOWEST                  SysTick and PendSV (kernel).
+ *
+ * A CriticalSection raises BASEPRI to MASK_LEVEL instead of setting PRIMASK,
+ * so handlers above the threshold keep running while thread code and the
+ * lower handlers protect shared state. See sections 2.3.7 and 4.4.5 of the
+ * programming manual (PM0056).
+ *
+ * Drivers enable their interrupt with enable<IRQn>(), which takes the
+ * priority from the plan and does not build for an IRQ missing from it.
+ */
+namespace Nvic {
+
+    /* number of implemented priority levels */
+    static constexpr uint32_t LEVELS = 1UL << __NVIC_PRIO_BITS;
+
+    /* lowest priority (highest number) */
+    static constexpr uint32_t LOWEST = LEVELS - 1;
+
+    /* highest priority masked by a CriticalSection */
+    static constexpr uint32_t MASK_LEVEL = 4;
+
+    struct Entry {
+        /* exception or interrupt number */
+        IRQn_Type irq;
+
+        /* preemption priority */
+        uint32_t priority;
+
+        /* true if the handler uses critical sections (must be maskable) */
+        bool maskable;
+    };
+
+    /* PRIORITY PLAN */
+    static constexpr Entry PLAN[] = {
+        { I2C1_EV_IRQn,         4,      true },   /* I2C1 events (errata)  */
+        { I2C1_ER_IRQn,         4,      true },   /* I2C1 errors           */
+        { DMA1_Channel6_IRQn,   4,      true },   /* I2C1 TX (I2cBus)      */
+        { DMA1_Channel7_IRQn,   4,      true },   /* I2C1 RX (I2cBus)      */
+        { USART1_IRQn,          5,      true },   /* console RX (UartRx)   */
+        { DMA1_Channel5_IRQn,   5,      true },   /* console RX half/full  */
+        { USB_LP_CAN1_RX0_IRQn, 6,      true },   /* CAN FIFO 0 or USB CDC */
+        { CAN1_RX1_IRQn,        6,      true },   /* CAN FIFO 1 (CanBus)   */
+        { DMA1_Channel1_IRQn,   8,      true },   /* ADC1 blocks           */
+        { DMA1_Channel2_IRQn,   9,      true },   /* SPI1 RX or PwmStream  */
+        { DMA1_Channel3_IRQn,   9,      true },   /* SPI1 TX errors        */
+        { USB_HP_CAN1_TX_IRQn,  10,     true },   /* CAN TX mailboxes      */
+        { DMA1_Channel4_IRQn,   12,     true },   /* console TX (UartLog)  */
+        { SysTick_IRQn,         LOWEST, true },   /* tick, soft timers     */
+        { PendSV_IRQn,          LOWEST, true },   /* kernel context switch */
+    };
+
+    /* number of plan entries */
+    static constexpr uint32_t PLAN_SIZE = sizeof(PLAN) / sizeof(PLAN[0]);
+
+    namespace Detail {
+
+        /* index of irq in the plan, PLAN_SIZE if missing */
+        static constexpr uint32_t find(IRQn_Type irq, uint32_t index = 0)
+        {
+            return (index == PLAN_SIZE || PLAN[index].irq == irq) ? index : find(irq, index + 1);
+        }
+
+        /* number of plan entries for irq */
+        static constexpr uint32_t occurrences(IRQn_Type irq, uint32_t index = 0)
+        {
+            return (index == PLAN_SIZE) ? 0 :
+                   (PLAN[index].irq == irq ? 1 : 0) + occurrences(irq, index + 1);
+        }
+
+        static constexpr bool valid(uint32_t index = 0)
+        {
+            return (index == PLAN_SIZE) ||
+                   (PLAN[index].priority < LEVELS &&
+                    occurrences(PLAN[index].irq) == 1 &&
+                    PLAN[index].maskable == (PLAN[index].priority >= MASK_LEVEL) &&
+                    valid(index + 1));
+        }
+
+        /* BASEPRI value masking priority and everything below it */
+        static constexpr uint32_t basepri(uint32_t priority)
+        {
+            return priority << (8 - __NVIC_PRIO_BITS);
+        }
+    }
+
+    static_assert(MASK_LEVEL > 0 && MASK_LEVEL < LEVELS, "BASEPRI 0 does not mask anything");
+    static_assert(Detail::valid(), "invalid priority plan: duplicate IRQ, priority out of range, "
+                                   "or a handler on the wrong side of MASK_LEVEL");
+    static_assert(PLAN[Detail::find(PendSV_IRQn)].priority == LOWEST,
+                  "PendSV must have the lowest priority so it never preempts a handler");
+    static_assert(PLAN[Detail::find(SysTick_IRQn)].priority == LOWEST,
+                  "SysTick must share the PendSV priority (see Kernel::tick)");
+
+    /* priority of Irq from the plan (does not build if Irq is missing) */
+    template <IRQn_Type Irq>
+    struct Priority {
+        static_assert(Detail::find(Irq) != PLAN_SIZE, "IRQ missing from Nvic::PLAN");
+
+        static constexpr uint32_t VALUE = PLAN[Detail::find(Irq) % PLAN_SIZE].priority;
+    };
+
+    /* set the priority grouping and the priority of every plan entry */
+    void init(void);
+
+    /* enable a peripheral interrupt at its planned priority */
+    template <IRQn_Type Irq>
+    static inline void enable(void)
+    {
+        static_assert(Irq >= 0, "core exceptions are always enabled");
+        NVIC_SetPriority(Irq, Priority<Irq>::VALUE);
+        NVIC_EnableIRQ(Irq);
+    }
+
+    /*
+     * Scoped critical section. Masks every handler at level or below and
+     * restores the previous mask when it goes out of scope. BASEPRI_MAX only
+     * ever raises the mask, so nesting a weaker section inside a stronger one
+     * (or using one inside a masked handler) is harmless.
+     */
+    class CriticalSection {
+
+        public:
+            explicit inline __attribute__((always_inline)) CriticalSection(uint32_t level = MASK_LEVEL) :
+                mSaved(__get_BASEPRI())
+            {
+                __set_BASEPRI_MAX(Detail::basepri(level));
+            }
+
+            inline __attribute__((always_inline)) ~CriticalSection()
+            {
+                __set_BASEPRI(mSaved);
+            }
+
+            CriticalSection(const CriticalSection &) = delete;
+            CriticalSection &operator=(const CriticalSection &) = delete;
+
+        private:
+            /* BASEPRI on entry */
+            const uint32_t mSaved;
+    };
+}
+
+#endif /* NVIC_HPP */
@@ -0,0 +1,88 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed-block memory pools.
+ *
+ * The blocks of all classes live in one array in the .pool region of SRAM,
+ * sized by CLASSES at compile time, which init() carves into size classes
+ * of equally sized blocks. The link fails if it outgrows _Pool_Size. Each class keeps its free blocks in
+ * a singly linked list used as a stack, so allocating and freeing is a pop
+ * or a push: constant time and no fragmentation. The list head is updated
+ * with LDREX/STREX, which makes alloc() and free() safe from interrupt
+ * handlers without masking interrupts.
+ *
+ * alloc() takes a block of the smallest class that fits and falls back to
+ * the larger classes when that one is empty. The global operator new and
+ * delete and (through linker wrapping) malloc and free all use the pools.
+ *
+ * The statistics can be inspected with GDB:
+ *
+ *      (gdb) print Pool::g_stats
+ */
+namespace Pool {
+
+    struct Config {
+        /* block size in bytes (a multiple of 8) */
+        uint32_t block_size;
+
+        /* number of blocks */
+        uint32_t blocks;
+    };
+
+    /* size classes, smallest first */
+    static constexpr Config CLASSES[] = {
+        {  16, 64 },
+        {  32, 32 },
+        {  64, 16 },
+        { 128,  8 },
+        { 256,  4 },
+    };
+
+    /* number of size classes */
+    static constexpr uint32_t CLASS_COUNT = sizeof(CLASSES) / sizeof(CLASSES[0]);
+
+    struct Stats {
+        /* block size of the class */
+        uint32_t block_size;
+
+        /* number of blocks of the class */
+        uint32_t blocks;
+
+        /* blocks currently allocated */
+        volatile uint32_t used;
+
+        /* most blocks allocated at once */
+        volatile uint32_t high_water;
+
+        /* requests that found the class empty */
+        volatile uint32_t failures;
+    };
+
+    /* per class statistics */
+    extern Stats g_stats[CLASS_COUNT];
+
+    /* carve the .pool region into the size classes (called by SystemInit) */
+    void init(void);
+
+    /* allocate a block of at least size bytes, nullptr if none is free */
+    void *alloc(size_t size);
+
+    /* return a block obtained from alloc() (nullptr is ignored) */
+    void free(void *ptr);
+
+    /* usable size of an allocated block, 0 if ptr is not a pool block */
+    size_t blockSize(const void *ptr);
+
+    /*
+     * Walk every free list and check that it holds exactly the blocks not in
+     * use. Not interrupt safe, meant for tests and debugging.
+     */
+    bool verify(void);
+}
+
+#endif /* POOL_HPP */
@@ -0,0 +1,103 @@
+#ifndef PWM_STREAM_HPP
+#define PWM_STREAM_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * PWM waveform engine: TIM2 compare values streamed from memory.
+ *
+ * TIM2 generates PWM on up to four adjacent channels (CH1-CH4 on PA0-PA3).
+ * Every update event (the start of a period) requests a DMA burst through
+ * the TIMx_DMAR register: DMA1 channel 2 writes the next frame, one compare
+ * value per channel, into the CCR preload registers, which take effect at
+ * the following update. The waveform is exact to the timer tick and costs
+ * the CPU nothing per period, so WS2812 bit streams (800 kHz, one frame per
+ * bit), servo pulse trains and audio rate PWM run next to everything else.
+ *
+ *      buffer  | block 0 (frame 0, frame 1, ...) | block 1 (...) |
+ *      frame   | CCR[first] | CCR[first + 1] | ... |
+ *
+ * A compare value c gives a duty cycle of c / top() (0: low, top(): high).
+ *
+ * With repeat set the buffer is a circular double buffer: the half transfer
+ * and transfer complete interrupts hand the callback the block that was just
+ * sent while the DMA sends the other one, so long or endless sequences are
+ * refilled on the fly. A block the DMA got back to before the callback
+ * returned (a late interrupt or a slow refill) goes out stale, at least in
+ * part, and is counted by underruns(). Without repeat the buffer is sent once
+ * and the callback receives all of it when the last frame was loaded; the
+ * timer then repeats that frame until stop(), so a sequence should end with
+ * the idle level (a WS2812 stream with a zero frame for the reset time).
+ *
+ * DMA1 channel 2 is also the SPI1 receive channel (TIM2_UP and SPI1_RX
+ * share it, reference manual table 78). The two cannot run together:
+ * start() fails while SPI1 has transactions queued, SpiBus::submit()
+ * refuses SPI1 transactions while the stream runs, and SPI1 has to be set
+ * up again with SpiBus::init() once the stream is stopped. The on board LED
+ * (PC13) has no timer output and cannot be driven from here.
+ *
+ * Both the register level and the HAL build are supported (USE_HAL).
+ */
+namespace PwmStream {
+
+    /* number of TIM2 channels */
+    static constexpr uint32_t MAX_CHANNELS = 4;
+
+    /*
+     * HCLK cycles allowed per transfer of a burst. The whole burst has to
+     * land within one period, so this bounds the period from below.
+     */
+    static constexpr uint32_t BURST_CYCLES_PER_CHANNEL = 16;
+
+    /* block done callback (called from the DMA interrupt) */
+    typedef void (*Callback)(uint16_t *block, uint32_t frames, void *arg);
+
+    struct Config {
+        /* first channel driven (1-4) and number of adjacent channels */
+        uint32_t  first_channel;
+        uint32_t  channel_count;
+
+        /* PWM frequency, one frame per period */
+        uint32_t  period_hz;
+
+        /* storage of both blocks: 2 * frames_per_block * channel_count compare values */
+        uint16_t *buffer;
+        uint32_t  frames_per_block;
+
+        /* circular double buffer (true) or a single pass over the buffer */
+        bool      repeat;
+
+        /* required with repeat, optional without */
+        Callback  callback;
+        void     *arg;
+    };
+
+    /*
+     * Configure TIM2, its pins and DMA1 channel 2 and start the waveform.
+     * The outputs stay low for the first period. Returns false (and does
+     * not start) if the configuration is invalid, the burst does not fit in
+     * a period or SPI1 is busy.
+     */
+    bool start(const Config &config);
+
+    /* stop the timer and release the DMA channel, the outputs go low */
+    void stop(void);
+
+    /* a waveform is being generated (DMA1 channel 2 belongs to the stream) */
+    bool running(void);
+
+    /* compare value of a 100 % duty cycle (the timer period in ticks) */
+    uint32_t top(void);
+
+    /* actual PWM frequency (the timer divides its clock by an integer) */
+    uint32_t rate(void);
+
+    /* number of blocks sent (partly) stale because the refill was late */
+    uint32_t underruns(void);
+
+    /* DMA1 channel 2 interrupt service routine (while running()) */
+    void isr(void);
+}
+
+#endif /* PWM_STREAM_HPP */
@@ -0,0 +1,23 @@
+#ifndef RAMFUNC_HPP
+#define RAMFUNC_HPP
+
+/*
+ * Place a function in SRAM. The linker script collects these functions in
+ * the .ramfunc output section, which is stored in flash and copied to SRAM
+ * by the Reset_Handler before SystemInit runs.
+ *
+ * Code in SRAM is fetched without flash wait states, which makes the timing
+ * of short ISRs and inner loops deterministic at 72 MHz. SRAM instruction
+ * fetches share the System bus with data accesses, so measure before moving
+ * code (see the ramfunc benchmark).
+ *
+ * SRAM and flash are too far apart for a BL instruction, so the function is
+ * reached through a long call. It should not call flash functions in its
+ * hot path for the same reason. noinline keeps the compiler from copying
+ * the body back into a flash caller.
+ *
+ *      RAMFUNC void fastIsrWork(void);
+ */
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call))
+
+#endif /* RAMFUNC_HPP */
@@ -0,0 +1,83 @@
+#ifndef SOFT_TIMER_HPP
+#define SOFT_TIMER_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Software timers kept in a statically allocated hierarchical timing wheel.
+ *
+ * The wheel has LEVELS levels of SLOTS slots each. Level 0 holds timers that
+ * expire within the next SLOTS ticks, level 1 timers that expire within the
+ * next SLOTS^2 ticks and so on. Every time level 0 wraps, the matching slot of
+ * the next level is cascaded down. Arming, cancelling and expiring a timer
+ * are all constant time list operations.
+ *
+ * The SysTick ISR only calls tick(), which bumps a counter. All list
+ * manipulation (arm, cancel, dispatch and the callbacks) happens in thread
+ * context, so no critical sections are needed. Never arm or cancel a timer
+ * from an interrupt handler.
+ */
+namespace SoftTimer {
+
+    /* number of bits of the expiry time resolved by each wheel level */
+    static constexpr uint32_t LEVEL_BITS = 6;
+
+    /* number of slots per level */
+    static constexpr uint32_t SLOTS = 1UL << LEVEL_BITS;
+
+    /* number of wheel levels */
+    static constexpr uint32_t LEVELS = 4;
+
+    /*
+     * Longest delay the wheel can hold directly (~4.6 hours at 1 ms/tick).
+     * Longer delays are parked in the last level and cascaded again.
+     */
+    static constexpr uint32_t MAX_DELAY = (1UL << (LEVEL_BITS * LEVELS)) - 1;
+
+    /* expiry callback signature */
+    typedef void (*Callback)(void *arg);
+
+    /* wheel internals (defined in soft_timer.cpp) */
+    class Wheel;
+
+    class Timer {
+
+        public:
+            Timer(Callback callback, void *arg);
+
+            /*
+             * Arm the timer to expire delay ticks from now. A non-zero period
+             * re-arms the timer every period ticks after the first expiry
+             * without accumulating drift. Arming an armed timer restarts it.
+             */
+            void arm(uint32_t delay, uint32_t period = 0);
+
+            /* disarm the timer (no-op if it is not armed) */
+            void cancel(void);
+
+            /* true while the timer is waiting to expire */
+            bool armed(void) const { return mPprev != nullptr; }
+
+            Timer(const Timer &) = delete;
+            Timer &operator=(const Timer &) = delete;
+
+        private:
+            friend class Wheel;
+
+            Timer   *mNext    = nullptr;
+            Timer  **mPprev   = nullptr;
+            uint32_t mExpires = 0;
+            uint32_t mPeriod  = 0;
+            Callback mCallback;
+            void    *mArg;
+    };
+
+    /* advance the wheel by one tick (called from the SysTick ISR) */
+    void tick(void);
+
+    /* run the callbacks of all expired timers (called from thread context) */
+    void dispatch(void);
+}
+
+#endif /* SOFT_TIMER_HPP */
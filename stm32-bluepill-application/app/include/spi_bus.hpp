@@ -0,0 +1,134 @@
+#ifndef SPI_BUS_HPP
+#define SPI_BUS_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Queued SPI master on SPI1 with DMA full-duplex transfers (SPI2 is
+ * prepared but refused, see below).
+ *
+ * Every peripheral on a bus is described by a Device: its chip select pin,
+ * clock mode, highest clock frequency and bit order. Callers fill in a
+ * Transaction and submit() it, which returns at once. Transactions of all
+ * devices on a bus run in submission order; the DMA receive complete
+ * interrupt releases chip select, calls the callback and starts the next
+ * one, so chained transactions follow each other within a few microseconds
+ * without the submitting code being involved. The bus is reconfigured only
+ * when the next transaction is for a device with different settings.
+ *
+ * The DMA channels are fixed by the hardware (reference manual, table 78):
+ *
+ *      SPI1    RX DMA1 channel 2, TX DMA1 channel 3    (SCK PA5, MISO PA6, MOSI PA7)
+ *      SPI2    RX DMA1 channel 4, TX DMA1 channel 5    (SCK PB13, MISO PB14, MOSI PB15)
+ *
+ * The console (UartLog TX, UartRx RX) owns DMA1 channels 4 and 5 on this
+ * board, and only the SPI1 channels are routed to their interrupt handlers.
+ * Setting SPI2 up would switch the console's DMA off and its transactions
+ * would never complete, so init() and submit() refuse SPI2. Using it means
+ * moving the console, routing the channel 4/5 interrupts to rxIsr()/txIsr()
+ * and lifting that check.
+ *
+ * The SPI1 receive channel is shared with the TIM2 PWM stream (PwmStream).
+ * While the stream runs, SPI1 transactions are refused; once it is stopped
+ * init(SPI1_BUS) has to be called again before SPI1 is used.
+ *
+ * The receive channel has the higher DMA priority so no byte is overrun at
+ * full speed. SPI1 runs from PCLK2 (72 MHz) and reaches 36 MHz, SPI2 from
+ * PCLK1 (36 MHz) and reaches 18 MHz.
+ *
+ * Both the register level and the HAL build are supported (USE_HAL).
+ */
+namespace SpiBus {
+
+    enum class Bus : uint32_t {
+        SPI1_BUS,
+        SPI2_BUS,
+        COUNT,
+    };
+
+    /* clock polarity (CPOL, bit 1) and phase (CPHA, bit 0) */
+    enum class Mode : uint32_t {
+        MODE0,
+        MODE1,
+        MODE2,
+        MODE3,
+    };
+
+    /* byte clocked out when a transaction has no TX buffer */
+    static constexpr uint8_t FILL = 0xFF;
+
+    /* bytes of one transaction at most (DMA counter) */
+    static constexpr uint32_t MAX_LENGTH = 0xFFFF;
+
+    struct Device {
+        Bus      bus;
+
+        /* chip select (active low): GPIO port base address and pin mask */
+        uint32_t cs_port_base;
+        uint32_t cs_mask;
+
+        Mode     mode;
+
+        /* highest SCK frequency, the bus takes the fastest prescaler not above it */
+        uint32_t max_hz;
+
+        bool     lsb_first;
+    };
+
+    struct Transaction;
+
+    /* completion callback (called from the DMA interrupt), ok false on a DMA error */
+    typedef void (*Callback)(Transaction &transaction, bool ok, void *arg);
+
+    struct Transaction {
+        const Device  *device;
+
+        /*
+         * Bytes to send (nullptr: FILL) and room for the bytes received
+         * (nullptr: discarded). At least one of them is needed.
+         */
+        const uint8_t *tx;
+        uint8_t       *rx;
+        uint32_t       length;
+
+        /*
+         * Keep chip select low after this transaction if the next one is
+         * for the same device (a command, then its data).
+         */
+        bool           keep_selected;
+
+        Callback       callback;
+        void          *arg;
+
+        /* queue link, owned by the driver from submit() to the callback */
+        Transaction   *next;
+    };
+
+    /*
+     * Configure the pins, the peripheral and its DMA channels. Returns
+     * false (and touches nothing) for SPI2, whose DMA channels belong to
+     * the console.
+     */
+    bool init(Bus bus);
+
+    /* put a device's chip select pin in its idle (high) state */
+    void attach(const Device &device);
+
+    /*
+     * Queue a transaction. Returns false if its length is 0 or above
+     * MAX_LENGTH, it has no buffer, it is for SPI2 (see init()), or it is
+     * for SPI1 while PwmStream owns the receive channel. The transaction and its buffers must stay valid
+     * until the callback ran. May be called from a callback.
+     */
+    bool submit(Transaction &transaction);
+
+    /* nothing queued or in progress on bus */
+    bool idle(Bus bus);
+
+    /* DMA receive and transmit channel interrupt service routines */
+    void rxIsr(Bus bus);
+    void txIsr(Bus bus);
+}
+
+#endif /* SPI_BUS_HPP */
@@ -0,0 +1,43 @@
+#ifndef STACK_MONITOR_HPP
+#define STACK_MONITOR_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Stack high-water monitoring.
+ *
+ * Unused stack is filled with a known pattern ("painted") and the deepest
+ * point a stack ever reached is found later by scanning from its bottom for
+ * the first word that no longer holds the pattern. The Reset_Handler paints
+ * the main stack before anything runs on it, the kernel paints every task
+ * stack in createTask().
+ *
+ * Interrupt and exception handlers always run on the main stack (MSP), so
+ * once the kernel is started the main stack figure is the ISR stack usage,
+ * including nesting. Before that it also includes main() and SystemInit.
+ *
+ * A stack reporting used == size has (most likely) overflowed. See
+ * scripts/stack_report.py for the static worst case per entry point.
+ *
+ *      (gdb) print StackMonitor::mainUsed()
+ */
+namespace StackMonitor {
+
+    /* fill pattern of unused stack */
+    static constexpr uint32_t PAINT = 0xA5A5A5A5;
+
+    /* fill words of stack (lowest address first) with the pattern */
+    void paint(uint32_t *base, uint32_t words);
+
+    /* bytes of the stack at base that have been used at least once */
+    uint32_t used(const uint32_t *base, uint32_t words);
+
+    /* size of the main stack in bytes (from the end of the heap to _estack) */
+    uint32_t mainSize(void);
+
+    /* high-water mark of the main stack in bytes */
+    uint32_t mainUsed(void);
+}
+
+#endif /* STACK_MONITOR_HPP */
@@ -7,26 +7,26 @@
 
 /* Module Selection */
 #define HAL_MODULE_ENABLED
-// #define HAL_ADC_MODULE_ENABLED
+#define HAL_ADC_MODULE_ENABLED
 // #define HAL_CRYP_MODULE_ENABLED
-// #define HAL_CAN_MODULE_ENABLED
+#define HAL_CAN_MODULE_ENABLED
 // #define HAL_CAN_LEGACY_MODULE_ENABLED
 // #define HAL_CEC_MODULE_ENABLED
 #define HAL_CORTEX_MODULE_ENABLED
 // #define HAL_CRC_MODULE_ENABLED
 // #define HAL_DAC_MODULE_ENABLED
-// #define HAL_DMA_MODULE_ENABLED
+#define HAL_DMA_MODULE_ENABLED
 // #define HAL_ETH_MODULE_ENABLED
 #define HAL_FLASH_MODULE_ENABLED
 #define HAL_GPIO_MODULE_ENABLED
-// #define HAL_I2C_MODULE_ENABLED
+#define HAL_I2C_MODULE_ENABLED
 // #define HAL_I2S_MODULE_ENABLED
 // #define HAL_IRDA_MODULE_ENABLED
 // #define HAL_IWDG_MODULE_ENABLED
 // #define HAL_NOR_MODULE_ENABLED
 // #define HAL_NAND_MODULE_ENABLED
 // #define HAL_PCCARD_MODULE_ENABLED
-// #define HAL_PCD_MODULE_ENABLED
+#define HAL_PCD_MODULE_ENABLED
 // #define HAL_HCD_MODULE_ENABLED
 // #define HAL_PWR_MODULE_ENABLED
 #define HAL_RCC_MODULE_ENABLED
@@ -35,9 +35,9 @@
 // #define HAL_MMC_MODULE_ENABLED
 // #define HAL_SDRAM_MODULE_ENABLED
 // #define HAL_SMARTCARD_MODULE_ENABLED
-// #define HAL_SPI_MODULE_ENABLED
+#define HAL_SPI_MODULE_ENABLED
 // #define HAL_SRAM_MODULE_ENABLED
-// #define HAL_TIM_MODULE_ENABLED
+#define HAL_TIM_MODULE_ENABLED
 // #define HAL_UART_MODULE_ENABLED
 // #define HAL_USART_MODULE_ENABLED
 // #define HAL_WWDG_MODULE_ENABLED
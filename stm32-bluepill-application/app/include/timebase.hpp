@@ -0,0 +1,68 @@
+#ifndef TIMEBASE_HPP
+#define TIMEBASE_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+extern "C" {
+    /*
+     * Core clock cycles the Reset_Handler spent initializing the .data,
+     * .ramfunc and .bss sections (set by the startup code).
+     */
+    extern uint32_t g_startup_cycles;
+}
+
+namespace Timebase {
+
+    /* number of core clock cycles in one microsecond */
+    static constexpr uint32_t CYCLES_PER_US = Bsp::Components::Clock::HCLK_FREQ_HZ / 1000000;
+
+    /* number of core clock cycles in one SysTick period */
+    static constexpr uint32_t CYCLES_PER_TICK = Bsp::Components::Clock::HCLK_FREQ_HZ /
+                                                Bsp::Components::Clock::TICK_FREQ_HZ;
+
+    /* start the DWT cycle counter */
+    void init(void);
+
+    /*
+     * Wrap-safe deadline check. The difference of two free running counters
+     * is interpreted as signed so a deadline is correctly detected as long as
+     * it is less than half the counter range away.
+     */
+    static inline bool reached(uint32_t now, uint32_t deadline)
+    {
+        return static_cast<int32_t>(now - deadline) >= 0;
+    }
+
+    /* core clock cycles since init (wraps every ~59s at 72MHz) */
+    static inline uint32_t cycles(void)
+    {
+        return DWT->CYCCNT;
+    }
+
+    /* milliseconds since the SysTick was enabled */
+    static inline uint32_t millis(void)
+    {
+        return Bsp::Util::g_tick_ms;
+    }
+
+    /* microseconds since the SysTick was enabled (wraps every ~71min) */
+    uint32_t micros(void);
+
+    /* spin for the given number of core clock cycles */
+    void delayCycles(uint32_t count);
+
+    /* spin for the given number of microseconds */
+    void delayUs(uint32_t delay_us);
+
+    /* park the core with WFI until the millisecond deadline is reached */
+    void sleepUntil(uint32_t deadline_ms);
+}
+
+#endif /* TIMEBASE_HPP */
@@ -0,0 +1,117 @@
+#ifndef TOKEN_LOG_HPP
+#define TOKEN_LOG_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+#include <string.h>
+
+// APP
+#include "uart_log.hpp"
+
+/*
+ * Tokenized (deferred) logging.
+ *
+ * The format string of every TLOG() call is placed in the .tlog section. The
+ * linker script keeps that section in the ELF as a non-loaded (INFO) section
+ * at address 0, so the strings cost no flash and the address of a string is
+ * its token. At runtime only the token and the raw argument bytes are sent:
+ *
+ *      byte 0      SYNC (0xA5)
+ *      byte 1-4    token (little endian)
+ *      byte 5      payload length in bytes
+ *      byte 6-     arguments, little endian, in call order
+ *
+ * Integers up to 32 bits and pointers take 4 bytes. 64 bit integers and
+ * floating point values (sent as double) take 8 bytes. A %s argument is sent
+ * as a pointer; the host decoder resolves it if it points into the ELF's
+ * read-only data. A frame that does not fit in the log buffer is dropped
+ * whole (UartLog::dropped() counts it), never cut, so the stream stays in
+ * sync. The host application decodes the stream against the ELF:
+ *
+ *      template_program bin/blinky.elf capture.bin
+ */
+#define TLOG(fmt, ...)                                                          \
+    do {                                                                        \
+        static const char tlog_fmt[] __attribute__((section(".tlog"), used)) = fmt; \
+        TokenLog::emit(reinterpret_cast<uintptr_t>(tlog_fmt), ##__VA_ARGS__);  \
+    } while (0)
+
+namespace TokenLog {
+
+    /* frame start marker */
+    static constexpr uint8_t SYNC = 0xA5;
+
+    /* size of the frame header (sync, token, length) */
+    static constexpr uint32_t HEADER_SIZE = 6;
+
+    namespace Detail {
+
+        template <typename T>
+        static inline uint32_t store(uint8_t *dst, T value)
+        {
+            const uint32_t word = static_cast<uint32_t>(value);
+            memcpy(dst, &word, sizeof(word));
+            return sizeof(word);
+        }
+
+        template <typename T>
+        static inline uint32_t store(uint8_t *dst, T *value)
+        {
+            const uint32_t word = reinterpret_cast<uintptr_t>(value);
+            memcpy(dst, &word, sizeof(word));
+            return sizeof(word);
+        }
+
+        static inline uint32_t store(uint8_t *dst, long long value)
+        {
+            memcpy(dst, &value, sizeof(value));
+            return sizeof(value);
+        }
+
+        static inline uint32_t store(uint8_t *dst, unsigned long long value)
+        {
+            memcpy(dst, &value, sizeof(value));
+            return sizeof(value);
+        }
+
+        static inline uint32_t store(uint8_t *dst, double value)
+        {
+            memcpy(dst, &value, sizeof(value));
+            return sizeof(value);
+        }
+
+        static inline uint32_t store(uint8_t *dst, float value)
+        {
+            return store(dst, static_cast<double>(value));
+        }
+
+        static inline uint32_t pack(uint8_t *dst)
+        {
+            return 0;
+        }
+
+        template <typename T, typename... Rest>
+        static inline uint32_t pack(uint8_t *dst, T value, Rest... rest)
+        {
+            const uint32_t size = store(dst, value);
+            return size + pack(dst + size, rest...);
+        }
+    }
+
+    /* send one tokenized record (use the TLOG macro instead) */
+    template <typename... Args>
+    static inline void emit(uint32_t token, Args... args)
+    {
+        uint8_t frame[HEADER_SIZE + (sizeof...(Args) * 8)];
+
+        frame[0] = SYNC;
+        memcpy(&frame[1], &token, sizeof(token));
+        const uint32_t size = Detail::pack(&frame[HEADER_SIZE], args...);
+        frame[5] = static_cast<uint8_t>(size);
+
+        /* A cut frame would make the decoder lose sync, drop it whole. */
+        UartLog::tryWrite(frame, HEADER_SIZE + size);
+    }
+}
+
+#endif /* TOKEN_LOG_HPP */
@@ -0,0 +1,44 @@
+#ifndef UART_LOG_HPP
+#define UART_LOG_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+/*
+ * Non-blocking log output on the console USART (USART1 TX, DMA1 channel 4).
+ *
+ * Two buffers are used ping-pong style. Log calls copy into the active
+ * buffer while the DMA drains the other one. When the DMA transfer completes,
+ * its interrupt hands the filled buffer to the DMA and makes the drained one
+ * active. A log call therefore costs a short critical section and a memcpy.
+ * Data that does not fit in the active buffer is dropped and counted instead
+ * of stalling the caller.
+ */
+namespace UartLog {
+
+    /* size of each of the two ping-pong buffers */
+    static constexpr uint32_t BUFFER_SIZE = 256;
+
+    /* configure the USART, its TX pin and the DMA channel */
+    void init(void);
+
+    /* queue raw bytes, returns the number of bytes accepted */
+    uint32_t write(const void *data, uint32_t len);
+
+    /*
+     * Queue all len bytes or none of them (a record that must not be cut,
+     * such as a binary frame). Returns false if they were dropped.
+     */
+    bool tryWrite(const void *data, uint32_t len);
+
+    /* queue a NUL terminated string, returns the number of bytes accepted */
+    uint32_t write(const char *str);
+
+    /* number of bytes dropped because the active buffer was full */
+    uint32_t dropped(void);
+
+    /* DMA1 channel 4 interrupt service routine */
+    void isr(void);
+}
+
+#endif /* UART_LOG_HPP */
@@ -0,0 +1,61 @@
+#ifndef UART_RX_HPP
+#define UART_RX_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// STATIC LIB
+#include "ring/span.hpp"
+
+/*
+ * Console receive path (USART1 RX on PA10, DMA1 channel 5).
+ *
+ * The DMA channel runs in circular mode and never stops: the USART hands
+ * every byte to it, so there is no per byte interrupt at any baud rate. The
+ * receive position is published by three events:
+ *
+ *      half transfer       the DMA passed the middle of the buffer
+ *      transfer complete   the DMA wrapped to the start
+ *      IDLE                the line went quiet for one frame (end of a burst)
+ *
+ * so received bytes reach the reader at the latest one frame after a burst
+ * ends, or after half a buffer while the stream goes on. The reader gets
+ * them in place with readSpan() and frees them with release(); nothing is
+ * copied. The buffer cannot be paused, so the reader has to stay less than
+ * BUFFER_SIZE bytes behind: at 4.5 Mbaud (PCLK2 / 16, the highest rate) that
+ * is about 2 ms. A reader that falls further behind loses the unread bytes
+ * and an overrun is counted.
+ *
+ * There must be a single reader. The baud rate is the console's
+ * (Bsp::Components::Console::baud), UartLog::init() sets it.
+ */
+namespace UartRx {
+
+    /* receive buffer size in bytes (power of two) */
+    static constexpr uint32_t BUFFER_SIZE = 1024;
+
+    /* enable the receiver, its RX pin and the DMA channel (after UartLog::init()) */
+    void init(void);
+
+    /* largest contiguous run of published bytes, valid until release() */
+    ring::Span<const uint8_t> readSpan(void);
+
+    /*
+     * Free count bytes previously obtained from readSpan(). Returns false if
+     * the DMA overwrote some of them before they were released; they have
+     * to be discarded.
+     */
+    bool release(uint32_t count);
+
+    /* number of times the reader fell a whole buffer behind */
+    uint32_t overruns(void);
+
+    /* number of framing, noise and overrun errors seen by the USART */
+    uint32_t errors(void);
+
+    /* USART1 (IDLE, errors) and DMA1 channel 5 interrupt service routines */
+    void usartIsr(void);
+    void dmaIsr(void);
+}
+
+#endif /* UART_RX_HPP */
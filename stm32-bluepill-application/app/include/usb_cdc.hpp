@@ -0,0 +1,76 @@
+#ifndef USB_CDC_HPP
+#define USB_CDC_HPP
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// STATIC LIB
+#include "ring/span.hpp"
+
+/*
+ * USB CDC-ACM (virtual serial port) device on the full speed USB peripheral
+ * (PA11/PA12), for streaming data to a host at close to the bus limit
+ * (about 1 MB/s).
+ *
+ *      EP0     control (64 byte packets)
+ *      EP1 IN  bulk data to the host, double buffered
+ *      EP2 OUT bulk data from the host, double buffered
+ *      EP3 IN  interrupt notifications (never sent)
+ *
+ * Data goes through two rings: thread code fills the TX ring in place
+ * (writeSpan() and commit()) or by copy (write()), and the USB interrupt
+ * moves it into the packet memory, one packet while the host reads the
+ * other. The peripheral has no DMA, so that copy is the only one. Received
+ * packets go into the RX ring; while it has no room for a whole packet the
+ * endpoint NAKs and the host waits. See section 23.4.3 of the reference
+ * manual for double buffered endpoints.
+ *
+ * All endpoint state belongs to the USB interrupt. The thread side only
+ * touches its end of the rings and pends the interrupt to get things moving.
+ * There must be a single producer of TX data and a single consumer of RX
+ * data.
+ *
+ * The D+ pull-up of the board is fixed, so init() holds D+ low for a moment
+ * to make the host see a reconnect after a reset.
+ *
+ * Both the register level and the HAL (PCD driver) build are supported
+ * (USE_HAL).
+ */
+namespace UsbCdc {
+
+    /* max packet size of the control and bulk endpoints */
+    static constexpr uint32_t PACKET_SIZE = 64;
+
+    /* ring sizes in bytes (powers of two) */
+    static constexpr uint32_t TX_BUFFER_SIZE = 2048;
+    static constexpr uint32_t RX_BUFFER_SIZE = 256;
+
+    /* reconnect to the host and start the device */
+    void init(void);
+
+    /* configured by the host and a terminal has the port open (DTR) */
+    bool connected(void);
+
+    /* copy up to len bytes into the TX ring, returns the number taken */
+    uint32_t write(const void *data, uint32_t len);
+
+    /*
+     * Largest contiguous free run of the TX ring. Fill it in place and send
+     * the bytes with commit().
+     */
+    ring::Span<uint8_t> writeSpan(void);
+
+    /* send count bytes previously obtained from writeSpan() */
+    void commit(uint32_t count);
+
+    /* copy up to len received bytes out, returns the number copied */
+    uint32_t read(void *data, uint32_t len);
+
+    /* number of received bytes waiting in the RX ring */
+    uint32_t available(void);
+
+    /* USB low priority interrupt service routine */
+    void isr(void);
+}
+
+#endif /* USB_CDC_HPP */
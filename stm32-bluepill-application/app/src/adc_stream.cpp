@@ -0,0 +1,563 @@
+#include "adc_stream.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+#include "timebase.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace AdcStream {
+
+    /* twice the sample time of each SampleTime, in ADC clock cycles */
+    static constexpr uint32_t SAMPLE_HALF_CYCLES[] = { 3, 15, 27, 57, 83, 111, 143, 479 };
+
+    /* twice the successive approximation time (12.5 ADC clock cycles) */
+    static constexpr uint32_t CONVERSION_HALF_CYCLES = 25;
+
+    /* ADC clocks per conversion pair in fast interleaved mode (1.5 + 12.5) */
+    static constexpr uint32_t INTERLEAVED_CYCLES = 14;
+
+    /* active configuration */
+    static Config g_config;
+
+    /* TIM3 prescaler and auto reload values */
+    static uint32_t g_prescaler;
+    static uint32_t g_reload;
+
+    static volatile bool     g_running;
+    static volatile uint32_t g_overruns;
+
+    static bool valid(const Config &config);
+    static bool validChannels(const uint8_t *channels, uint32_t count, uint32_t highest);
+    static bool usesPin(uint32_t channel);
+    static bool dual(void);
+    static const uint8_t *adc2Channels(void);
+    static uint32_t transfers(void);
+    static void deliver(uint32_t block);
+    static void startHardware(void);
+    static void stopHardware(void);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace AdcStream {
+    static ADC_HandleTypeDef g_hadc;
+    static ADC_HandleTypeDef g_hadc2;
+    static DMA_HandleTypeDef g_hdma;
+    static TIM_HandleTypeDef g_htim;
+
+    static void initAdc(ADC_HandleTypeDef &handle, ADC_TypeDef *instance,
+                        const uint8_t *channels, uint32_t trigger);
+}
+#else
+namespace AdcStream {
+    static void initAdc(ADC_TypeDef *adc, const uint8_t *channels, uint32_t cr1, uint32_t cr2);
+}
+#endif
+
+bool AdcStream::start(const Config &config)
+{
+    stop();
+
+    if (!valid(config)) return false;
+
+    /*
+     * The timer counts at the APB1 timer clock. Pick the smallest prescaler
+     * that lets the period fit in the 16 bit auto reload register.
+     */
+    if (config.mode != Mode::DUAL_INTERLEAVED) {
+        const uint32_t ticks = Bsp::Components::Clock::TIM_APB1_FREQ_HZ / config.scan_rate_hz;
+        g_prescaler = (ticks - 1) / 0x10000;
+        g_reload    = ticks / (g_prescaler + 1) - 1;
+    }
+
+    g_config    = config;
+    g_overruns  = 0;
+    g_running   = true;
+
+    startHardware();
+    return true;
+}
+
+void AdcStream::stop(void)
+{
+    if (!g_running) return;
+
+    g_running = false;
+    stopHardware();
+}
+
+uint32_t AdcStream::scanRate(void)
+{
+    if (g_config.mode == Mode::DUAL_INTERLEAVED) {
+        return Bsp::Components::Clock::ADC_FREQ_HZ / INTERLEAVED_CYCLES;
+    }
+    return Bsp::Components::Clock::TIM_APB1_FREQ_HZ / ((g_prescaler + 1) * (g_reload + 1));
+}
+
+uint32_t AdcStream::overruns(void)
+{
+    return g_overruns;
+}
+
+void AdcStream::isr(void)
+{
+    /*
+     * Both the half and the full transfer flag pending means a whole block
+     * went by without this interrupt being served: the older block has
+     * already been overwritten.
+     */
+    const uint32_t flags = DMA1->ISR;
+    if ((flags & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) == (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) {
+        g_overruns = g_overruns + 1;
+    }
+
+#if defined(USE_HAL_DRIVER)
+    HAL_DMA_IRQHandler(&g_hdma);
+#else
+    DMA1->IFCR = DMA_IFCR_CGIF1;
+
+    /* A transfer error disables the channel, there is nothing to recover. */
+    if (flags & DMA_ISR_TEIF1) {
+        stop();
+        return;
+    }
+
+    if (flags & DMA_ISR_TCIF1) {
+        deliver(1);
+    } else if (flags & DMA_ISR_HTIF1) {
+        deliver(0);
+    }
+#endif
+}
+
+bool AdcStream::valid(const Config &config)
+{
+    if (config.channels == nullptr || config.buffer == nullptr || config.callback == nullptr) return false;
+    if (config.channel_count == 0 || config.channel_count > MAX_SEQUENCE) return false;
+    if (config.scans_per_block == 0) return false;
+    if (static_cast<uint32_t>(config.sample_time) > static_cast<uint32_t>(SampleTime::CYCLES_239_5)) return false;
+
+    /* The DMA transfer counter is 16 bits wide. */
+    if (2 * config.scans_per_block * config.channel_count > 0xFFFF) return false;
+
+    switch (config.mode) {
+        case Mode::SINGLE:
+            if (!validChannels(config.channels, config.channel_count, MAX_CHANNEL)) return false;
+            break;
+
+        case Mode::DUAL_SIMULTANEOUS:
+            /* ADC2 has no internal channels. */
+            if (config.adc2_channels == nullptr) return false;
+            if (!validChannels(config.channels, config.channel_count, MAX_CHANNEL)) return false;
+            if (!validChannels(config.adc2_channels, config.channel_count, 9)) return false;
+            for (uint32_t i = 0; i < config.channel_count; ++i) {
+                if (config.channels[i] == config.adc2_channels[i]) return false;
+            }
+            break;
+
+        case Mode::DUAL_INTERLEAVED:
+            /*
+             * A sample time longer than the 7 cycle offset would let the two
+             * ADCs sample the channel at the same time.
+             */
+            if (config.channel_count != 1 || config.sample_time != SampleTime::CYCLES_1_5) return false;
+            return validChannels(config.channels, 1, 9) &&
+                   (reinterpret_cast<uintptr_t>(config.buffer) & 3) == 0;
+
+        default:
+            return false;
+    }
+
+    /* The DMA reads 32 bit words in the dual modes. */
+    if (config.mode != Mode::SINGLE && (reinterpret_cast<uintptr_t>(config.buffer) & 3) != 0) return false;
+
+    /* The timer needs at least two ticks per period. */
+    if (config.scan_rate_hz == 0 || config.scan_rate_hz > Bsp::Components::Clock::TIM_APB1_FREQ_HZ / 2) return false;
+
+    /* A scan must complete before the next trigger. */
+    const uint64_t half_cycles = static_cast<uint64_t>(config.channel_count) *
+                                 (SAMPLE_HALF_CYCLES[static_cast<uint32_t>(config.sample_time)] +
+                                  CONVERSION_HALF_CYCLES);
+    return half_cycles * config.scan_rate_hz <= 2ULL * Bsp::Components::Clock::ADC_FREQ_HZ;
+}
+
+/*
+ * Channels must exist and be bonded: channels 10-15 (PC0-PC5) are not on the
+ * 48 pin package.
+ */
+bool AdcStream::validChannels(const uint8_t *channels, uint32_t count, uint32_t highest)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t channel = channels[i];
+        if (channel > highest || (channel >= 10 && channel <= 15)) return false;
+    }
+    return true;
+}
+
+/* true for the channels on a package pin (PA0-PA7, PB0-PB1) */
+bool AdcStream::usesPin(uint32_t channel)
+{
+    return channel < 10;
+}
+
+bool AdcStream::dual(void)
+{
+    return g_config.mode != Mode::SINGLE;
+}
+
+/* ADC2 sequence: its own list, or the ADC1 channel when interleaving */
+const uint8_t *AdcStream::adc2Channels(void)
+{
+    return (g_config.mode == Mode::DUAL_SIMULTANEOUS) ? g_config.adc2_channels : g_config.channels;
+}
+
+/* DMA transfers for both blocks (half words, or words in the dual modes) */
+uint32_t AdcStream::transfers(void)
+{
+    return 2 * g_config.scans_per_block * g_config.channel_count;
+}
+
+void AdcStream::deliver(uint32_t block)
+{
+    const uint32_t samples = g_config.scans_per_block * g_config.channel_count * (dual() ? 2 : 1);
+    g_config.callback(g_config.buffer + block * samples, g_config.scans_per_block, g_config.arg);
+}
+
+#if defined(USE_HAL_DRIVER)
+void AdcStream::initAdc(ADC_HandleTypeDef &handle, ADC_TypeDef *instance,
+                        const uint8_t *channels, uint32_t trigger)
+{
+    GPIO_InitTypeDef pin;
+    pin.Mode  = GPIO_MODE_ANALOG;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_LOW;
+    for (uint32_t i = 0; i < g_config.channel_count; ++i) {
+        const uint32_t channel = channels[i];
+        if (!usesPin(channel)) continue;
+
+        pin.Pin = (channel < 8) ? (1UL << channel) : (1UL << (channel - 8));
+        HAL_GPIO_Init((channel < 8) ? GPIOA : GPIOB, &pin);
+    }
+
+    handle.Instance                   = instance;
+    handle.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
+    handle.Init.ScanConvMode          = ADC_SCAN_ENABLE;
+    handle.Init.ContinuousConvMode    = (g_config.mode == Mode::DUAL_INTERLEAVED) ? ENABLE : DISABLE;
+    handle.Init.NbrOfConversion       = g_config.channel_count;
+    handle.Init.DiscontinuousConvMode = DISABLE;
+    handle.Init.NbrOfDiscConversion   = 1;
+    handle.Init.ExternalTrigConv      = trigger;
+    if (HAL_ADC_Init(&handle) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    /* The HAL channel, rank and sample time values are the register values. */
+    ADC_ChannelConfTypeDef config;
+    config.SamplingTime = static_cast<uint32_t>(g_config.sample_time);
+    for (uint32_t i = 0; i < g_config.channel_count; ++i) {
+        config.Channel = channels[i];
+        config.Rank    = ADC_REGULAR_RANK_1 + i;
+        if (HAL_ADC_ConfigChannel(&handle, &config) != HAL_OK) {
+            __BKPT(0);
+        }
+    }
+
+    if (HAL_ADCEx_Calibration_Start(&handle) != HAL_OK) {
+        __BKPT(0);
+    }
+}
+
+void AdcStream::startHardware(void)
+{
+    const bool timed = (g_config.mode != Mode::DUAL_INTERLEAVED);
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    __HAL_RCC_TIM3_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /*
+     * SystemClock_Config leaves ADCPRE at its reset value (PCLK2 / 2), above
+     * the 14 MHz maximum. Use the divider of the Bsp clock tree, which is
+     * what ADC_FREQ_HZ (and so the scan timing checks) assume. The HAL
+     * divider values are the ADCPRE field values.
+     */
+    typedef Bsp::Components::Clock::Tree Tree;
+
+    RCC_PeriphCLKInitTypeDef clock = RCC_PeriphCLKInitTypeDef();
+    clock.PeriphClockSelection = RCC_PERIPHCLK_ADC;
+    clock.AdcClockSelection    = ((Tree::ADC_DIV / 2) - 1) << RCC_CFGR_ADCPRE_Pos;
+    if (HAL_RCCEx_PeriphCLKConfig(&clock) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    initAdc(g_hadc, ADC1, g_config.channels,
+            timed ? ADC_EXTERNALTRIGCONV_T3_TRGO : ADC_SOFTWARE_START);
+
+    if (dual()) {
+        __HAL_RCC_ADC2_CLK_ENABLE();
+
+        /* The slave converts on the master's trigger. */
+        initAdc(g_hadc2, ADC2, adc2Channels(), ADC_SOFTWARE_START);
+
+        ADC_MultiModeTypeDef multi;
+        multi.Mode = timed ? ADC_DUALMODE_REGSIMULT : ADC_DUALMODE_INTERLFAST;
+        if (HAL_ADCEx_MultiModeConfigChannel(&g_hadc, &multi) != HAL_OK) {
+            __BKPT(0);
+        }
+    }
+
+    g_hdma.Instance                 = DMA1_Channel1;
+    g_hdma.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    g_hdma.Init.PeriphInc           = DMA_PINC_DISABLE;
+    g_hdma.Init.MemInc              = DMA_MINC_ENABLE;
+    g_hdma.Init.PeriphDataAlignment = dual() ? DMA_PDATAALIGN_WORD : DMA_PDATAALIGN_HALFWORD;
+    g_hdma.Init.MemDataAlignment    = dual() ? DMA_MDATAALIGN_WORD : DMA_MDATAALIGN_HALFWORD;
+    g_hdma.Init.Mode                = DMA_CIRCULAR;
+    g_hdma.Init.Priority            = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&g_hdma) != HAL_OK) {
+        __BKPT(0);
+    }
+    __HAL_LINKDMA(&g_hadc, DMA_Handle, g_hdma);
+
+    if (timed) {
+        g_htim.Instance               = TIM3;
+        g_htim.Init.Prescaler         = g_prescaler;
+        g_htim.Init.CounterMode       = TIM_COUNTERMODE_UP;
+        g_htim.Init.Period            = g_reload;
+        g_htim.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+        g_htim.Init.RepetitionCounter = 0;
+        g_htim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+        if (HAL_TIM_Base_Init(&g_htim) != HAL_OK) {
+            __BKPT(0);
+        }
+
+        TIM_MasterConfigTypeDef master;
+        master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+        master.MasterSlaveMode     = TIM_MASTERSLAVEMODE_DISABLE;
+        if (HAL_TIMEx_MasterConfigSynchronization(&g_htim, &master) != HAL_OK) {
+            __BKPT(0);
+        }
+    }
+
+    Nvic::enable<DMA1_Channel1_IRQn>();
+
+    uint32_t *buffer = reinterpret_cast<uint32_t *>(g_config.buffer);
+    HAL_StatusTypeDef status = HAL_OK;
+    if (dual()) {
+        /* The slave must be enabled before the master starts. */
+        status = HAL_ADC_Start(&g_hadc2);
+        if (status == HAL_OK) {
+            status = HAL_ADCEx_MultiModeStart_DMA(&g_hadc, buffer, transfers());
+        }
+    } else {
+        status = HAL_ADC_Start_DMA(&g_hadc, buffer, transfers());
+    }
+    if (status != HAL_OK) {
+        __BKPT(0);
+    }
+
+    if (timed) {
+        HAL_TIM_Base_Start(&g_htim);
+    }
+}
+
+void AdcStream::stopHardware(void)
+{
+    if (g_config.mode != Mode::DUAL_INTERLEAVED) {
+        HAL_TIM_Base_Stop(&g_htim);
+    }
+
+    if (dual()) {
+        HAL_ADCEx_MultiModeStop_DMA(&g_hadc);
+        HAL_ADC_Stop(&g_hadc2);
+    } else {
+        HAL_ADC_Stop_DMA(&g_hadc);
+    }
+    NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    AdcStream::deliver(0);
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    AdcStream::deliver(1);
+}
+
+extern "C" void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc)
+{
+    AdcStream::stop();
+}
+#else
+/*
+ * Make the channel pins analog inputs, program the sequence and sample times,
+ * then power up and calibrate the ADC. Returns with the ADC on (CR2 = cr2).
+ */
+void AdcStream::initAdc(ADC_TypeDef *adc, const uint8_t *channels, uint32_t cr1, uint32_t cr2)
+{
+    /*
+     * The channel list is only known at run time, so the ports are written
+     * directly instead of through Gpio::Pin (analog is CNF and MODE 0).
+     */
+    uint32_t smpr1 = 0;
+    uint32_t smpr2 = 0;
+    uint32_t sqr[3] = { 0, 0, 0 };
+
+    for (uint32_t i = 0; i < g_config.channel_count; ++i) {
+        const uint32_t channel = channels[i];
+        const uint32_t smp     = static_cast<uint32_t>(g_config.sample_time);
+
+        if (channel < 8) {
+            GPIOA->CRL &= ~(0xFUL << (channel * 4));
+        } else if (usesPin(channel)) {
+            GPIOB->CRL &= ~(0xFUL << ((channel - 8) * 4));
+        }
+
+        /* SMPR2 holds channels 0-9, SMPR1 10-17, 3 bits each */
+        if (channel < 10) {
+            smpr2 |= smp << (channel * 3);
+        } else {
+            smpr1 |= smp << ((channel - 10) * 3);
+        }
+
+        /* SQR3 holds ranks 1-6, SQR2 7-12, SQR1 13-16, 5 bits each */
+        sqr[2 - (i / 6)] |= channel << ((i % 6) * 5);
+    }
+
+    adc->CR1   = cr1;
+    adc->SMPR1 = smpr1;
+    adc->SMPR2 = smpr2;
+    adc->SQR1  = sqr[0] | ((g_config.channel_count - 1) << ADC_SQR1_L_Pos);
+    adc->SQR2  = sqr[1];
+    adc->SQR3  = sqr[2];
+
+    /* Calibrate once the ADC is stable (tSTAB is 1 us). */
+    adc->CR2 = cr2;
+    Timebase::delayUs(1);
+
+    adc->CR2 = cr2 | ADC_CR2_RSTCAL;
+    while (adc->CR2 & ADC_CR2_RSTCAL) { }
+    adc->CR2 = cr2 | ADC_CR2_CAL;
+    while (adc->CR2 & ADC_CR2_CAL) { }
+}
+
+void AdcStream::startHardware(void)
+{
+    const bool timed = (g_config.mode != Mode::DUAL_INTERLEAVED);
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_IOPAEN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_IOPBEN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_ADC1EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_TIM3EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+
+    /* The temperature sensor and VREFINT are only connected with TSVREFE. */
+    bool internal = false;
+    for (uint32_t i = 0; i < g_config.channel_count; ++i) {
+        internal = internal || !usesPin(g_config.channels[i]);
+    }
+
+    /*
+     * Fast interleaved mode converts continuously from one software start,
+     * the other modes convert one scan per TIM3 TRGO (EXTSEL 100).
+     */
+    const uint32_t extsel = timed ? ADC_CR2_EXTSEL_2 : ADC_CR2_EXTSEL;
+    const uint32_t cont   = timed ? 0 : ADC_CR2_CONT;
+    const uint32_t cr2    = ADC_CR2_ADON | (internal ? ADC_CR2_TSVREFE : 0);
+
+    /* DUALMOD 0110 is regular simultaneous, 0111 fast interleaved. */
+    uint32_t dualmod = 0;
+    if (g_config.mode == Mode::DUAL_SIMULTANEOUS) {
+        dualmod = ADC_CR1_DUALMOD_2 | ADC_CR1_DUALMOD_1;
+    } else if (g_config.mode == Mode::DUAL_INTERLEAVED) {
+        dualmod = ADC_CR1_DUALMOD_2 | ADC_CR1_DUALMOD_1 | ADC_CR1_DUALMOD_0;
+    }
+
+    if (dual()) {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_ADC2EN>::set();
+        initAdc(ADC2, adc2Channels(), ADC_CR1_SCAN, ADC_CR2_ADON);
+    }
+    initAdc(ADC1, g_config.channels, ADC_CR1_SCAN | dualmod, cr2);
+
+    /*
+     * DMA1 channel 1 is hard wired to the ADC1 request. Results go from the
+     * data register to the buffer, wrapping around at its end, with an
+     * interrupt at the middle (block 0 full) and at the end (block 1 full).
+     * In the dual modes the data register holds both results, so whole words
+     * are moved.
+     */
+    const uint32_t size = dual() ? (DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1) : (DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0);
+    DMA1_Channel1->CCR   = 0;
+    DMA1_Channel1->CPAR  = reinterpret_cast<uintptr_t>(&ADC1->DR);
+    DMA1_Channel1->CMAR  = reinterpret_cast<uintptr_t>(g_config.buffer);
+    DMA1_Channel1->CNDTR = transfers();
+    DMA1->IFCR           = DMA_IFCR_CGIF1;
+    DMA1_Channel1->CCR   = DMA_CCR_PL_1 | size | DMA_CCR_MINC | DMA_CCR_CIRC |
+                           DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+
+    /*
+     * TIM3 drives TRGO on every update event. The UG event loads the
+     * prescaler before the ADC listens to the trigger.
+     */
+    if (timed) {
+        TIM3->CR1 = 0;
+        TIM3->PSC = g_prescaler;
+        TIM3->ARR = g_reload;
+        TIM3->CR2 = TIM_CR2_MMS_1;
+        TIM3->EGR = TIM_EGR_UG;
+    }
+
+    /*
+     * The slave always uses the software trigger (EXTSEL 111) and converts
+     * on the master's trigger. Setting other bits together with ADON does
+     * not start a conversion.
+     */
+    if (dual()) {
+        ADC2->CR2 = ADC_CR2_ADON | ADC_CR2_EXTTRIG | ADC_CR2_EXTSEL | cont;
+    }
+    ADC1->CR2 = cr2 | ADC_CR2_DMA | ADC_CR2_EXTTRIG | extsel | cont;
+
+    Nvic::enable<DMA1_Channel1_IRQn>();
+
+    if (timed) {
+        TIM3->CR1 = TIM_CR1_CEN;
+    } else {
+        ADC1->CR2 = cr2 | ADC_CR2_DMA | ADC_CR2_EXTTRIG | extsel | cont | ADC_CR2_SWSTART;
+    }
+}
+
+void AdcStream::stopHardware(void)
+{
+    TIM3->CR1          = 0;
+    ADC1->CR2          = 0;
+    ADC1->CR1          = 0;
+    DMA1_Channel1->CCR = 0;
+    DMA1->IFCR         = DMA_IFCR_CGIF1;
+    if (dual()) {
+        ADC2->CR2 = 0;
+    }
+    NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+}
+#endif
@@ -0,0 +1,621 @@
+#include "bench.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "adc_stream.hpp"
+#include "bitband.hpp"
+#include "bsp.hpp"
+#include "crc_unit.hpp"
+#include "i2c_bus.hpp"
+#include "kernel.hpp"
+#include "nvic.hpp"
+#include "pool.hpp"
+#include "pwm_stream.hpp"
+#include "ramfunc.hpp"
+#include "spi_bus.hpp"
+#include "timebase.hpp"
+
+// STATIC LIB
+#include "crc/crc32.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+Bench::Result Bench::g_results[Bench::MAX_RESULTS];
+uint32_t      Bench::g_count;
+
+namespace Bench {
+
+    /* bytes copied and zeroed by the startup init comparison */
+    static constexpr uint32_t STARTUP_BYTES = 1024;
+
+    /* destination of the startup init comparison */
+    static uint32_t g_startup_scratch[STARTUP_BYTES / 4];
+
+    /* number of iterations of the GPIO benchmarks */
+    static constexpr uint32_t GPIO_ITERATIONS = 1000;
+
+    /* number of iterations of the flag update benchmarks */
+    static constexpr uint32_t FLAG_ITERATIONS = 1000;
+
+    /* flags updated by the flag benchmarks */
+    static Bitband::FlagArray<32> g_flags;
+    static volatile uint32_t      g_flag_word;
+
+    /* number of alloc/free pairs of the pool benchmark */
+    static constexpr uint32_t POOL_ITERATIONS = 1000;
+
+    /* number of samples processed by the flash/RAM execution benchmark */
+    static constexpr uint32_t EXEC_SAMPLES = 256;
+
+    /* input of the flash/RAM execution benchmark */
+    static int16_t g_exec_samples[EXEC_SAMPLES];
+
+    /* size of the buffer checksummed by the CRC benchmarks */
+    static constexpr uint32_t CRC_BYTES = 1024;
+
+    /* input of the CRC benchmarks (words keep the buffer aligned) */
+    static uint32_t g_crc_data[CRC_BYTES / 4];
+
+    /* sample pairs per block and blocks timed by the ADC benchmark */
+    static constexpr uint32_t ADC_BLOCK_WORDS = 256;
+    static constexpr uint32_t ADC_BLOCKS      = 16;
+
+    /* give up on the ADC benchmark after this many milliseconds */
+    static constexpr uint32_t ADC_TIMEOUT_MS = 100;
+
+    /* both blocks of the ADC benchmark (words keep the buffer aligned) */
+    static uint32_t g_adc_buffer[2 * ADC_BLOCK_WORDS];
+
+    /* blocks received and the cycle stamps of the first and last one */
+    static volatile uint32_t g_adc_blocks;
+    static volatile uint32_t g_adc_first;
+    static volatile uint32_t g_adc_last;
+
+    /* SCK frequency, transaction size and chained transactions of the SPI benchmark */
+    static constexpr uint32_t SPI_HZ           = 18000000;
+    static constexpr uint32_t SPI_BYTES        = 512;
+    static constexpr uint32_t SPI_TRANSACTIONS = 8;
+
+    /* give up on the SPI benchmark after this many milliseconds */
+    static constexpr uint32_t SPI_TIMEOUT_MS = 100;
+
+    /* data clocked out and in by the SPI benchmark (MOSI may loop back to MISO) */
+    static uint8_t g_spi_tx[SPI_BYTES];
+    static uint8_t g_spi_rx[SPI_BYTES];
+
+    static SpiBus::Transaction g_spi_transactions[SPI_TRANSACTIONS];
+
+    /* completed transactions and the cycle stamp of the last completion */
+    static volatile uint32_t g_spi_done;
+    static volatile uint32_t g_spi_last;
+
+    /* WS2812 bit rate, bits per block and blocks timed by the PWM benchmark */
+    static constexpr uint32_t PWM_HZ               = 800000;
+    static constexpr uint32_t PWM_FRAMES_PER_BLOCK = 96;
+    static constexpr uint32_t PWM_BLOCKS           = 16;
+
+    /* give up on the PWM benchmark after this many milliseconds */
+    static constexpr uint32_t PWM_TIMEOUT_MS = 20;
+
+    /* both blocks of the PWM benchmark, one compare value per bit */
+    static uint16_t g_pwm_buffer[2 * PWM_FRAMES_PER_BLOCK];
+
+    /* blocks refilled and the cycles spent refilling them */
+    static volatile uint32_t g_pwm_blocks;
+    static volatile uint32_t g_pwm_cycles;
+
+    /* slave, register and length of the I2C register read (MPU-6050 accelerometer) */
+    static constexpr uint8_t  I2C_ADDRESS  = 0x68;
+    static constexpr uint8_t  I2C_REGISTER = 0x3B;
+    static constexpr uint32_t I2C_BYTES    = 6;
+
+    /* give up on the I2C benchmark after this many milliseconds */
+    static constexpr uint32_t I2C_TIMEOUT_MS = 20;
+
+    static uint8_t             g_i2c_data[I2C_BYTES];
+    static I2cBus::Transaction g_i2c_transaction;
+
+    /* outcome and cycle stamp of the I2C register read */
+    static volatile bool     g_i2c_ok;
+    static volatile uint32_t g_i2c_end;
+
+    /* number of yields performed by each task of the kernel benchmark */
+    static constexpr uint32_t SWITCH_ITERATIONS = 1000;
+
+    /* priority of the context switch ping-pong tasks */
+    static constexpr uint32_t SWITCH_PRIORITY = 1;
+
+    /* stack size of the context switch ping-pong tasks */
+    static constexpr uint32_t SWITCH_STACK_WORDS = 128;
+
+    static Kernel::Task g_switch_tasks[2];
+    static uint32_t     g_switch_stacks[2][SWITCH_STACK_WORDS];
+
+    /* cycle stamp taken right before a yield */
+    static volatile uint32_t g_switch_stamp;
+
+    /* accumulated yield-to-resume cycles */
+    static uint32_t g_switch_total;
+
+    /* number of tasks done with the ping-pong */
+    static uint32_t g_switch_done;
+
+    static void startupCopy(uint32_t *dst, uint32_t *end, const uint32_t *src) __attribute__((naked, noinline));
+    static void startupFill(uint32_t *dst, uint32_t *end, uint32_t value) __attribute__((naked, noinline));
+    static void wordLoopCopy(uint32_t *dst, uint32_t *end, const uint32_t *src) __attribute__((naked, noinline));
+    static void wordLoopZero(uint32_t *dst, uint32_t *end) __attribute__((naked, noinline));
+    static void benchStartup(void);
+    static void benchGpio(void);
+    static void benchFlags(void);
+    static void benchRamfunc(void);
+    static void benchPool(void);
+    static void benchCrc(void);
+    static void adcBlock(const uint16_t *block, uint32_t scans, void *arg);
+    static void benchAdc(void);
+    static void spiDone(SpiBus::Transaction &transaction, bool ok, void *arg);
+    static void benchSpi(void);
+    static void pwmBlock(uint16_t *block, uint32_t frames, void *arg);
+    static void benchPwm(void);
+    static void i2cDone(I2cBus::Transaction &transaction, I2cBus::Status status, void *arg);
+    static void benchI2c(void);
+    static inline __attribute__((always_inline)) int32_t execKernel(const int16_t *samples, uint32_t count);
+    static int32_t execFromFlash(const int16_t *samples, uint32_t count) __attribute__((noinline));
+    RAMFUNC static int32_t execFromRam(const int16_t *samples, uint32_t count);
+    static void switchTask(void *arg);
+    static void benchContextSwitch(void) __attribute__((noreturn));
+}
+
+void Bench::record(const char *name, uint32_t cycles)
+{
+    if (g_count >= MAX_RESULTS) return;
+
+    g_results[g_count].name   = name;
+    g_results[g_count].cycles = cycles;
+    ++g_count;
+}
+
+void Bench::run(void)
+{
+    benchStartup();
+    benchGpio();
+    benchFlags();
+    benchRamfunc();
+    benchPool();
+    benchCrc();
+    benchAdc();
+    benchSpi();
+    benchPwm();
+    benchI2c();
+
+    /* The context switch benchmark starts the kernel, so it must run last. */
+    benchContextSwitch();
+}
+
+/*
+ * The Reset_Handler's section helpers (startup_stm32f103c8tx.s) take their
+ * arguments in r0-r2 and clobber r4-r11, which the wrappers save.
+ */
+void Bench::startupCopy(uint32_t *dst, uint32_t *end, const uint32_t *src)
+{
+    __asm volatile(
+        "push {r4-r11, lr}  \n"
+        "bl CopyWords       \n"
+        "pop {r4-r11, pc}   \n"
+    );
+}
+
+void Bench::startupFill(uint32_t *dst, uint32_t *end, uint32_t value)
+{
+    __asm volatile(
+        "push {r4-r11, lr}  \n"
+        "bl FillWords       \n"
+        "pop {r4-r11, pc}   \n"
+    );
+}
+
+/* the .data copy loop of the original Reset_Handler, one word per iteration */
+void Bench::wordLoopCopy(uint32_t *dst, uint32_t *end, const uint32_t *src)
+{
+    __asm volatile(
+        "push {r4, lr}      \n"
+        "movs r3, #0        \n"
+        "b 2f               \n"
+        "1:                 \n"
+        "ldr r4, [r2, r3]   \n"
+        "str r4, [r0, r3]   \n"
+        "adds r3, r3, #4    \n"
+        "2:                 \n"
+        "adds r4, r0, r3    \n"
+        "cmp r4, r1         \n"
+        "bcc 1b             \n"
+        "pop {r4, pc}       \n"
+    );
+}
+
+/* the .bss zero loop of the original Reset_Handler */
+void Bench::wordLoopZero(uint32_t *dst, uint32_t *end)
+{
+    __asm volatile(
+        "movs r3, #0        \n"
+        "b 2f               \n"
+        "1:                 \n"
+        "str r3, [r0]       \n"
+        "adds r0, r0, #4    \n"
+        "2:                 \n"
+        "cmp r0, r1         \n"
+        "bcc 1b             \n"
+        "bx lr              \n"
+    );
+}
+
+void Bench::benchStartup(void)
+{
+    /* Measured by the Reset_Handler itself, before any C++ code ran. */
+    record("startup section init", g_startup_cycles);
+
+    /*
+     * The sections cannot be initialized a second time, so the original
+     * word loops and the block helpers now used by the Reset_Handler are
+     * compared on a scratch buffer. Like .data, the copy reads from flash
+     * (the first kilobyte of the image).
+     */
+    uint32_t * const dst = g_startup_scratch;
+    uint32_t * const end = g_startup_scratch + STARTUP_BYTES / 4;
+    const uint32_t  *src = reinterpret_cast<const uint32_t *>(FLASH_BASE);
+
+    uint32_t start = Timebase::cycles();
+    wordLoopCopy(dst, end, src);
+    record("startup copy 1 KiB word loop", Timebase::cycles() - start);
+
+    start = Timebase::cycles();
+    startupCopy(dst, end, src);
+    record("startup copy 1 KiB ldm/stm", Timebase::cycles() - start);
+
+    start = Timebase::cycles();
+    wordLoopZero(dst, end);
+    record("startup zero 1 KiB word loop", Timebase::cycles() - start);
+
+    start = Timebase::cycles();
+    startupFill(dst, end, 0);
+    record("startup zero 1 KiB stm", Timebase::cycles() - start);
+}
+
+void Bench::benchGpio(void)
+{
+    typedef Bsp::Components::Led::Pin Pin;
+
+    uint32_t start = Timebase::cycles();
+    for (uint32_t i = 0; i < GPIO_ITERATIONS; ++i) {
+        Pin::set();
+        Pin::clear();
+    }
+    record("gpio set + clear", (Timebase::cycles() - start) / GPIO_ITERATIONS);
+
+    start = Timebase::cycles();
+    for (uint32_t i = 0; i < GPIO_ITERATIONS; ++i) {
+        Pin::toggle();
+    }
+    record("gpio toggle", (Timebase::cycles() - start) / GPIO_ITERATIONS);
+}
+
+void Bench::benchFlags(void)
+{
+    /* Interrupt safe flag set the usual way: masked read-modify-write. */
+    uint32_t start = Timebase::cycles();
+    for (uint32_t i = 0; i < FLAG_ITERATIONS; ++i) {
+        Nvic::CriticalSection cs;
+        g_flag_word = g_flag_word | (1UL << (i & 31));
+    }
+    record("masked rmw flag set", (Timebase::cycles() - start) / FLAG_ITERATIONS);
+
+    /* The same through the bit-band alias: one store, nothing masked. */
+    start = Timebase::cycles();
+    for (uint32_t i = 0; i < FLAG_ITERATIONS; ++i) {
+        g_flags.set(i & 31);
+    }
+    record("bitband flag set", (Timebase::cycles() - start) / FLAG_ITERATIONS);
+}
+
+/*
+ * Branchy integer loop (clipped multiply-accumulate) shared by the flash and
+ * RAM copies of the execution benchmark. The taken branches defeat the flash
+ * prefetch buffer, so the wait states show up.
+ */
+int32_t Bench::execKernel(const int16_t *samples, uint32_t count)
+{
+    int32_t acc = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const int32_t sample = samples[i];
+        acc += sample * sample;
+        if (acc > 0x3FFFFFFF) {
+            acc >>= 1;
+        }
+    }
+    return acc;
+}
+
+int32_t Bench::execFromFlash(const int16_t *samples, uint32_t count)
+{
+    return execKernel(samples, count);
+}
+
+int32_t Bench::execFromRam(const int16_t *samples, uint32_t count)
+{
+    return execKernel(samples, count);
+}
+
+void Bench::benchRamfunc(void)
+{
+    for (uint32_t i = 0; i < EXEC_SAMPLES; ++i) {
+        g_exec_samples[i] = static_cast<int16_t>(i * 97);
+    }
+
+    uint32_t start = Timebase::cycles();
+    volatile int32_t sink = execFromFlash(g_exec_samples, EXEC_SAMPLES);
+    record("exec from flash", (Timebase::cycles() - start) / EXEC_SAMPLES);
+
+    start = Timebase::cycles();
+    sink = execFromRam(g_exec_samples, EXEC_SAMPLES);
+    record("exec from ram", (Timebase::cycles() - start) / EXEC_SAMPLES);
+
+    (void)sink;
+}
+
+void Bench::benchPool(void)
+{
+    const uint32_t start = Timebase::cycles();
+    for (uint32_t i = 0; i < POOL_ITERATIONS; ++i) {
+        Pool::free(Pool::alloc(24));
+    }
+    record("pool alloc + free", (Timebase::cycles() - start) / POOL_ITERATIONS);
+}
+
+void Bench::benchCrc(void)
+{
+    for (uint32_t i = 0; i < CRC_BYTES / 4; ++i) {
+        g_crc_data[i] = i * 0x9E3779B9UL;
+    }
+
+    uint32_t start = Timebase::cycles();
+    const uint32_t software = crc::crc32(g_crc_data, CRC_BYTES);
+    record("crc32 software 1 KiB", Timebase::cycles() - start);
+
+    start = Timebase::cycles();
+    const uint32_t hardware = CrcUnit::crc32(g_crc_data, CRC_BYTES);
+    record("crc32 crc unit 1 KiB", Timebase::cycles() - start);
+
+    /* Both must agree with each other and with the host. */
+    if (software != hardware || crc::crc32("123456789", 9) != crc::CHECK) {
+        __BKPT(0);
+    }
+}
+
+void Bench::adcBlock(const uint16_t *block, uint32_t scans, void *arg)
+{
+    const uint32_t now = Timebase::cycles();
+    if (g_adc_blocks == 0) {
+        g_adc_first = now;
+    }
+    g_adc_last   = now;
+    g_adc_blocks = g_adc_blocks + 1;
+}
+
+void Bench::benchAdc(void)
+{
+    /*
+     * Dual fast interleaved mode on PA0 (channel 0). The blocks arrive at the
+     * sampling rate, so the cycles between the first and the last block per
+     * sample give the throughput: HCLK / cycles samples per second.
+     */
+    static const uint8_t channel = 0;
+
+    AdcStream::Config config = AdcStream::Config();
+    config.mode            = AdcStream::Mode::DUAL_INTERLEAVED;
+    config.channels        = &channel;
+    config.channel_count   = 1;
+    config.sample_time     = AdcStream::SampleTime::CYCLES_1_5;
+    config.buffer          = reinterpret_cast<uint16_t *>(g_adc_buffer);
+    config.scans_per_block = ADC_BLOCK_WORDS;
+    config.callback        = adcBlock;
+
+    g_adc_blocks = 0;
+    if (!AdcStream::start(config)) return;
+
+    const uint32_t deadline = Timebase::millis() + ADC_TIMEOUT_MS;
+    while (g_adc_blocks <= ADC_BLOCKS && !Timebase::reached(Timebase::millis(), deadline)) { }
+    AdcStream::stop();
+
+    const uint32_t blocks = g_adc_blocks;
+    if (blocks < 2) return;
+
+    const uint32_t samples = (blocks - 1) * ADC_BLOCK_WORDS * 2;
+    record("adc dual interleaved", (g_adc_last - g_adc_first) / samples);
+}
+
+void Bench::spiDone(SpiBus::Transaction &transaction, bool ok, void *arg)
+{
+    g_spi_last = Timebase::cycles();
+    if (ok) {
+        g_spi_done = g_spi_done + 1;
+    }
+}
+
+void Bench::benchSpi(void)
+{
+    /*
+     * Chained full-duplex transactions to one device on SPI1. At 18 MHz a
+     * byte takes 32 HCLK cycles on the wire, so anything above that per byte
+     * is the chip select toggling and the interrupt starting the next
+     * transaction. Nothing has to be connected: MISO floats.
+     */
+    typedef Bsp::Components::Spi1::Cs0Pin CsPin;
+
+    static const SpiBus::Device device = {
+        SpiBus::Bus::SPI1_BUS, CsPin::PORT_BASE, CsPin::MASK,
+        SpiBus::Mode::MODE0, SPI_HZ, false,
+    };
+
+    SpiBus::init(SpiBus::Bus::SPI1_BUS);
+    SpiBus::attach(device);
+
+    for (uint32_t i = 0; i < SPI_BYTES; ++i) {
+        g_spi_tx[i] = static_cast<uint8_t>(i);
+    }
+
+    g_spi_done = 0;
+
+    /* The bus settles on the device settings with the first transaction. */
+    const uint32_t start = Timebase::cycles();
+    for (uint32_t i = 0; i < SPI_TRANSACTIONS; ++i) {
+        SpiBus::Transaction &transaction = g_spi_transactions[i];
+
+        transaction.device        = &device;
+        transaction.tx            = g_spi_tx;
+        transaction.rx            = g_spi_rx;
+        transaction.length        = SPI_BYTES;
+        transaction.keep_selected = false;
+        transaction.callback      = spiDone;
+        transaction.arg           = nullptr;
+
+        if (!SpiBus::submit(transaction)) return;
+    }
+
+    const uint32_t deadline = Timebase::millis() + SPI_TIMEOUT_MS;
+    while (!SpiBus::idle(SpiBus::Bus::SPI1_BUS) && !Timebase::reached(Timebase::millis(), deadline)) { }
+
+    if (g_spi_done != SPI_TRANSACTIONS) return;
+
+    const uint32_t cycles = g_spi_last - start;
+    record("spi1 18 MHz per byte", cycles / (SPI_TRANSACTIONS * SPI_BYTES));
+
+    /* whatever the wire time does not explain, per transaction */
+    const uint32_t wire = SPI_TRANSACTIONS * SPI_BYTES * 8 * (Bsp::Components::Clock::HCLK_FREQ_HZ / SPI_HZ);
+    record("spi1 transaction overhead", cycles > wire ? (cycles - wire) / SPI_TRANSACTIONS : 0);
+}
+
+/*
+ * Encode the next LED colour bytes into the block just sent, MSB first: a
+ * WS2812 zero bit is high for about 0.35 us, a one bit for about 0.7 us.
+ */
+void Bench::pwmBlock(uint16_t *block, uint32_t frames, void *arg)
+{
+    const uint32_t start = Timebase::cycles();
+    const uint32_t top   = PwmStream::top();
+    const uint16_t zero  = static_cast<uint16_t>(top * 7 / 25);
+    const uint16_t one   = static_cast<uint16_t>(top * 14 / 25);
+    const uint32_t seed  = g_pwm_blocks;
+
+    for (uint32_t i = 0; i < frames; i += 8) {
+        const uint32_t byte = (seed + i / 8) & 0xFF;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            block[i + bit] = (byte & (0x80 >> bit)) ? one : zero;
+        }
+    }
+
+    g_pwm_cycles = g_pwm_cycles + (Timebase::cycles() - start);
+    g_pwm_blocks = g_pwm_blocks + 1;
+}
+
+void Bench::benchPwm(void)
+{
+    /*
+     * An endless WS2812 bit stream on TIM2 CH2 (PA1): the timer and the DMA
+     * send one bit per 800 kHz period, the CPU only encodes a block of 4
+     * LEDs while the other one goes out. Recorded is the CPU time per bit.
+     * SPI1 is done by now; the stream borrows its receive DMA channel.
+     */
+    PwmStream::Config config = PwmStream::Config();
+    config.first_channel    = 2;
+    config.channel_count    = 1;
+    config.period_hz        = PWM_HZ;
+    config.buffer           = g_pwm_buffer;
+    config.frames_per_block = PWM_FRAMES_PER_BLOCK;
+    config.repeat           = true;
+    config.callback         = pwmBlock;
+
+    for (uint32_t i = 0; i < 2 * PWM_FRAMES_PER_BLOCK; ++i) {
+        g_pwm_buffer[i] = 0;
+    }
+
+    g_pwm_blocks = 0;
+    g_pwm_cycles = 0;
+    if (!PwmStream::start(config)) return;
+
+    const uint32_t deadline = Timebase::millis() + PWM_TIMEOUT_MS;
+    while (g_pwm_blocks < PWM_BLOCKS && !Timebase::reached(Timebase::millis(), deadline)) { }
+    PwmStream::stop();
+
+    const uint32_t blocks = g_pwm_blocks;
+    if (blocks == 0 || PwmStream::underruns() != 0) return;
+
+    record("pwm ws2812 refill per bit", g_pwm_cycles / (blocks * PWM_FRAMES_PER_BLOCK));
+}
+
+void Bench::i2cDone(I2cBus::Transaction &transaction, I2cBus::Status status, void *arg)
+{
+    g_i2c_end = Timebase::cycles();
+    g_i2c_ok  = (status == I2cBus::Status::OK);
+}
+
+void Bench::benchI2c(void)
+{
+    /*
+     * A sensor register read at 400 kHz: address and register, repeated
+     * start, address and 6 bytes, about 25 us on the wire at best. Only
+     * recorded when a slave answers at I2C_ADDRESS.
+     */
+    static const uint8_t reg = I2C_REGISTER;
+
+    I2cBus::init();
+
+    I2cBus::Transaction &transaction = g_i2c_transaction;
+    transaction.address   = I2C_ADDRESS;
+    transaction.tx        = &reg;
+    transaction.tx_length = 1;
+    transaction.rx        = g_i2c_data;
+    transaction.rx_length = I2C_BYTES;
+    transaction.callback  = i2cDone;
+
+    g_i2c_ok = false;
+
+    const uint32_t start = Timebase::cycles();
+    if (!I2cBus::submit(transaction)) return;
+
+    const uint32_t deadline = Timebase::millis() + I2C_TIMEOUT_MS;
+    while (!I2cBus::idle() && !Timebase::reached(Timebase::millis(), deadline)) { }
+
+    if (!I2cBus::idle() || !g_i2c_ok) return;
+
+    record("i2c 400 kHz register read", g_i2c_end - start);
+}
+
+void Bench::switchTask(void *arg)
+{
+    /*
+     * Two tasks of equal priority yield to each other. The time between one
+     * task stamping the cycle counter right before its yield and the other
+     * task resuming is one full context switch (yield call, PendSV entry,
+     * register save/restore and exception return).
+     */
+    for (uint32_t i = 0; i < SWITCH_ITERATIONS; ++i) {
+        g_switch_stamp = Timebase::cycles();
+        Kernel::yield();
+        g_switch_total += Timebase::cycles() - g_switch_stamp;
+    }
+
+    if (++g_switch_done == 2) {
+        record("kernel context switch", g_switch_total / (2 * SWITCH_ITERATIONS));
+    }
+}
+
+void Bench::benchContextSwitch(void)
+{
+    for (uint32_t i = 0; i < 2; ++i) {
+        Kernel::createTask(g_switch_tasks[i], switchTask, nullptr,
+                           g_switch_stacks[i], SWITCH_STACK_WORDS, SWITCH_PRIORITY);
+    }
+    Kernel::start();
+}
@@ -3,6 +3,12 @@
 // STANDARD LIBRARY
 #include <stdint.h>
 
+// APP
+#include "crc_unit.hpp"
+#include "timebase.hpp"
+#include "uart_log.hpp"
+#include "uart_rx.hpp"
+
 // CMSIS
 #include "stm32f1xx.h"
 
@@ -10,9 +16,21 @@ volatile uint32_t Bsp::Util::g_tick_ms;
 
 void Bsp::Util::delay(uint32_t delay_ms)
 {
-    /* Compute the end tick of the delay */
+    /*
+     * Compute the end tick of the delay. The deadline check is wrap-safe, so
+     * a late wake up can never turn into a full counter wrap.
+     */
     const uint32_t end = delay_ms + g_tick_ms;
 
-    /* Wait for the delay to lapse. */
-    while(g_tick_ms != end) { }
+    /* Sleep until the delay lapses. */
+    Timebase::sleepUntil(end);
+}
+
+void Bsp::init(void)
+{
+    Timebase::init();
+    UartLog::init();
+    UartRx::init();
+    CrcUnit::init();
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
 }
\ No newline at end of file
@@ -0,0 +1,640 @@
+#include "can_bus.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+
+// STATIC LIB
+#include "ring/spsc_ring.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+#include "timebase.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace CanBus {
+
+    /* transmit mailboxes */
+    static constexpr uint32_t MAILBOXES     = 3;
+    static constexpr uint32_t ALL_MAILBOXES = (1UL << MAILBOXES) - 1;
+
+    /* filter numbers of one FIFO at most */
+    static constexpr uint32_t FIFO_FILTERS = CanFilters::BANKS * CanFilters::BANK_FILTERS;
+
+    /* filter number without a list entry */
+    static constexpr uint8_t NO_ENTRY = 0xFF;
+
+    /*
+     * BIT TIMING
+     *
+     * A bit is 1 + BS1 + BS2 time quanta of BRP PCLK1 cycles. The most quanta
+     * that divide the bit exactly are used, with BS2 about 1/8 of the bit for
+     * a sample point near 87.5% (CiA 301). See section 24.7.7 of the
+     * reference manual.
+     */
+    static constexpr uint32_t PCLK1_HZ = Bsp::Components::Clock::PCLK1_FREQ_HZ;
+    static constexpr uint32_t BITRATE  = Bsp::Components::Can::BITRATE;
+    static constexpr uint32_t TQ_MIN   = 8;
+    static constexpr uint32_t TQ_MAX   = 25;
+
+    static constexpr uint32_t seg2(uint32_t quanta)
+    {
+        return (quanta + 4) / 8;
+    }
+
+    static constexpr uint32_t seg1(uint32_t quanta)
+    {
+        return quanta - 1 - seg2(quanta);
+    }
+
+    /* quanta per bit, 0 if BITRATE cannot be made from PCLK1 */
+    static constexpr uint32_t quantaPerBit(uint32_t quanta = TQ_MAX)
+    {
+        return (quanta < TQ_MIN) ? 0 :
+               ((PCLK1_HZ % (BITRATE * quanta)) == 0 &&
+                PCLK1_HZ / (BITRATE * quanta) <= 1024 &&
+                seg1(quanta) <= 16 && seg2(quanta) <= 8) ? quanta : quantaPerBit(quanta - 1);
+    }
+
+    static constexpr uint32_t QUANTA    = quantaPerBit();
+    static constexpr uint32_t PRESCALER = (QUANTA == 0) ? 1 : PCLK1_HZ / (BITRATE * QUANTA);
+    static constexpr uint32_t BS1       = seg1(QUANTA);
+    static constexpr uint32_t BS2       = seg2(QUANTA);
+    static constexpr uint32_t SJW       = (BS2 < 4) ? BS2 : 4;
+
+    static_assert(QUANTA != 0, "no exact CAN bit timing for BITRATE from PCLK1");
+
+    /* banks of RX_FILTERS */
+    static constexpr CanFilters::Bank BANKS[CanFilters::BANKS] = {
+        FilterPlan::bank(0),  FilterPlan::bank(1),  FilterPlan::bank(2),  FilterPlan::bank(3),
+        FilterPlan::bank(4),  FilterPlan::bank(5),  FilterPlan::bank(6),  FilterPlan::bank(7),
+        FilterPlan::bank(8),  FilterPlan::bank(9),  FilterPlan::bank(10), FilterPlan::bank(11),
+        FilterPlan::bank(12), FilterPlan::bank(13),
+    };
+
+    /* RECEIVE (FIFO interrupts produce, thread code consumes) */
+    static ring::SpscRing<Frame, RX_QUEUE_DEPTH> g_rx[FILTER_COUNT];
+
+    /* list entry of each filter match index, per FIFO */
+    static uint8_t g_entries[2][FIFO_FILTERS];
+
+    static volatile uint32_t g_dropped;
+
+    static volatile bool g_running;
+
+    /* TRANSMIT (TX interrupt, or thread code in a CriticalSection) */
+
+    /* frames waiting for a mailbox, highest priority first */
+    static Frame    g_tx_queue[TX_QUEUE_SIZE];
+    static uint32_t g_tx_count;
+
+    /* frame loaded into each mailbox */
+    static Frame    g_mailbox[MAILBOXES];
+
+    /* mailboxes holding a frame, and those asked to abort it */
+    static uint32_t g_busy;
+    static uint32_t g_aborting;
+
+    static void mapFilters(void);
+    static void deliver(uint32_t fifo, uint32_t fmi, const Frame &frame);
+    static uint32_t priority(uint32_t id);
+    static void enqueue(const Frame &frame, bool ahead);
+    static bool inMailbox(uint32_t id);
+    static void schedule(void);
+    static void txDone(uint32_t mailbox, bool sent);
+
+    /* DRIVER PRIMITIVES (register level or HAL) */
+    static bool start(void);
+    static bool load(const Frame &frame, uint32_t &mailbox);
+    static void abort(uint32_t mailbox);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace CanBus {
+    static CAN_HandleTypeDef g_hcan;
+
+    static void drain(uint32_t fifo);
+}
+#else
+namespace CanBus {
+
+    /* time to enter initialization mode, and to see 11 recessive bits */
+    static constexpr uint32_t MODE_TIMEOUT_US = 10000;
+
+    /* 32 bit identifier register layout (TIxR, RIxR) */
+    static constexpr uint32_t STID_SHIFT = 21;
+    static constexpr uint32_t EXID_SHIFT = 3;
+
+    static bool waitInit(bool entered);
+}
+#endif
+
+bool CanBus::init(void)
+{
+    mapFilters();
+    if (!start()) {
+        return false;
+    }
+
+    /* USB_LP_CAN1_RX0_IRQHandler dispatches on g_running. */
+    g_running = true;
+
+    Nvic::enable<USB_HP_CAN1_TX_IRQn>();
+    Nvic::enable<USB_LP_CAN1_RX0_IRQn>();
+    Nvic::enable<CAN1_RX1_IRQn>();
+    return true;
+}
+
+bool CanBus::running(void)
+{
+    return g_running;
+}
+
+bool CanBus::send(const Frame &frame)
+{
+    Nvic::CriticalSection cs;
+
+    /* Keep a slot for a frame coming back from an aborted mailbox. */
+    if (!g_running || g_tx_count + (g_aborting != 0 ? 1 : 0) >= TX_QUEUE_SIZE) {
+        return false;
+    }
+
+    enqueue(frame, false);
+    schedule();
+    return true;
+}
+
+bool CanBus::receive(uint32_t filter, Frame &frame)
+{
+    return filter < FILTER_COUNT && g_rx[filter].pop(frame);
+}
+
+uint32_t CanBus::pending(uint32_t filter)
+{
+    return (filter < FILTER_COUNT) ? g_rx[filter].size() : 0;
+}
+
+uint32_t CanBus::dropped(void)
+{
+    return g_dropped;
+}
+
+/*
+ * Number the filters of each FIFO the way the controller does: banks in
+ * order, every bank taking as many numbers as it holds filters.
+ */
+void CanBus::mapFilters(void)
+{
+    uint32_t next[2] = { 0, 0 };
+
+    memset(g_entries, NO_ENTRY, sizeof(g_entries));
+    for (uint32_t b = 0; b < FilterPlan::USED; ++b) {
+        const CanFilters::Bank &bank = BANKS[b];
+        for (uint32_t i = 0; i < bank.filters; ++i) {
+            g_entries[bank.fifo][next[bank.fifo]++] = bank.entries[i];
+        }
+    }
+}
+
+/* hand a received frame to the queue of the filter that took it */
+void CanBus::deliver(uint32_t fifo, uint32_t fmi, const Frame &frame)
+{
+    const uint32_t entry = (fmi < FIFO_FILTERS) ? g_entries[fifo][fmi] : NO_ENTRY;
+
+    if (entry == NO_ENTRY || !g_rx[entry].push(frame)) {
+        ++g_dropped;
+    }
+}
+
+/*
+ * Arbitration order of an identifier, lowest wins: the 11 base bits, then a
+ * standard frame before an extended one with the same base, then the 18
+ * extension bits.
+ */
+uint32_t CanBus::priority(uint32_t id)
+{
+    return (id & EXTENDED) ? (((id & CanFilters::EXT_ID_MASK) << 1) | 1) :
+                             ((id & CanFilters::STD_ID_MASK) << 19);
+}
+
+/*
+ * Insert into the sorted transmit queue, behind the frames of the same
+ * priority, or ahead of them for a frame coming back from a mailbox. The
+ * caller checks for room.
+ */
+void CanBus::enqueue(const Frame &frame, bool ahead)
+{
+    const uint32_t key = priority(frame.id);
+
+    uint32_t pos = 0;
+    while (pos < g_tx_count &&
+           (ahead ? priority(g_tx_queue[pos].id) < key : priority(g_tx_queue[pos].id) <= key)) {
+        ++pos;
+    }
+
+    memmove(&g_tx_queue[pos + 1], &g_tx_queue[pos], (g_tx_count - pos) * sizeof(Frame));
+    g_tx_queue[pos] = frame;
+    ++g_tx_count;
+}
+
+bool CanBus::inMailbox(uint32_t id)
+{
+    for (uint32_t m = 0; m < MAILBOXES; ++m) {
+        if ((g_busy & (1UL << m)) && g_mailbox[m].id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Load free mailboxes from the head of the queue. The controller sends
+ * mailboxes of equal identifier lowest number first, so a frame waits while
+ * its identifier is in a mailbox. With all mailboxes taken by frames of
+ * lower priority than the head, abort the lowest one.
+ */
+void CanBus::schedule(void)
+{
+    while (g_tx_count != 0 && g_busy != ALL_MAILBOXES && !inMailbox(g_tx_queue[0].id)) {
+        uint32_t mailbox;
+        if (!load(g_tx_queue[0], mailbox)) {
+            return;
+        }
+        g_mailbox[mailbox] = g_tx_queue[0];
+        g_busy |= 1UL << mailbox;
+
+        --g_tx_count;
+        memmove(&g_tx_queue[0], &g_tx_queue[1], g_tx_count * sizeof(Frame));
+    }
+
+    if (g_tx_count == 0 || g_busy != ALL_MAILBOXES || g_aborting != 0 || g_tx_count == TX_QUEUE_SIZE) {
+        return;
+    }
+
+    uint32_t lowest = 0;
+    for (uint32_t m = 1; m < MAILBOXES; ++m) {
+        if (priority(g_mailbox[m].id) > priority(g_mailbox[lowest].id)) {
+            lowest = m;
+        }
+    }
+    if (priority(g_tx_queue[0].id) < priority(g_mailbox[lowest].id)) {
+        g_aborting = 1UL << lowest;
+        abort(lowest);
+    }
+}
+
+/*
+ * A mailbox is free again: its frame went out, or the abort took effect
+ * before it did and the frame goes back to the queue.
+ */
+void CanBus::txDone(uint32_t mailbox, bool sent)
+{
+    const uint32_t bit = 1UL << mailbox;
+
+    g_busy &= ~bit;
+    if (!sent && (g_aborting & bit)) {
+        enqueue(g_mailbox[mailbox], true);
+    }
+    g_aborting &= ~bit;
+
+    schedule();
+}
+
+#if defined(USE_HAL_DRIVER)
+bool CanBus::start(void)
+{
+    using namespace Bsp::Components;
+
+    __HAL_RCC_CAN1_CLK_ENABLE();
+    __HAL_RCC_AFIO_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_AFIO_REMAP_CAN1_2();
+
+    GPIO_InitTypeDef pin;
+    pin.Pin   = 1UL << Can::RxPin::NUMBER;
+    pin.Mode  = GPIO_MODE_INPUT;
+    pin.Pull  = GPIO_PULLUP;
+    pin.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(GPIOB, &pin);
+    pin.Pin   = 1UL << Can::TxPin::NUMBER;
+    pin.Mode  = GPIO_MODE_AF_PP;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(GPIOB, &pin);
+
+    g_hcan.Instance                  = CAN1;
+    g_hcan.Init.Prescaler            = PRESCALER;
+    g_hcan.Init.Mode                 = CAN_MODE_NORMAL;
+    g_hcan.Init.SyncJumpWidth        = (SJW - 1) << CAN_BTR_SJW_Pos;
+    g_hcan.Init.TimeSeg1             = (BS1 - 1) << CAN_BTR_TS1_Pos;
+    g_hcan.Init.TimeSeg2             = (BS2 - 1) << CAN_BTR_TS2_Pos;
+    g_hcan.Init.TimeTriggeredMode    = DISABLE;
+    g_hcan.Init.AutoBusOff           = ENABLE;
+    g_hcan.Init.AutoWakeUp           = DISABLE;
+    g_hcan.Init.AutoRetransmission   = ENABLE;
+    g_hcan.Init.ReceiveFifoLocked    = DISABLE;
+    g_hcan.Init.TransmitFifoPriority = DISABLE;
+    if (HAL_CAN_Init(&g_hcan) != HAL_OK) {
+        return false;
+    }
+
+    /* HAL_CAN_ConfigFilter() takes the halves of FR1 and FR2 in a scale dependent order. */
+    for (uint32_t b = 0; b < FilterPlan::USED; ++b) {
+        const CanFilters::Bank &bank = BANKS[b];
+
+        CAN_FilterTypeDef filter;
+        if (bank.wide) {
+            filter.FilterIdHigh     = bank.fr1 >> 16;
+            filter.FilterIdLow      = bank.fr1 & 0xFFFF;
+            filter.FilterMaskIdHigh = bank.fr2 >> 16;
+            filter.FilterMaskIdLow  = bank.fr2 & 0xFFFF;
+        } else {
+            filter.FilterIdLow      = bank.fr1 & 0xFFFF;
+            filter.FilterMaskIdLow  = bank.fr1 >> 16;
+            filter.FilterIdHigh     = bank.fr2 & 0xFFFF;
+            filter.FilterMaskIdHigh = bank.fr2 >> 16;
+        }
+        filter.FilterFIFOAssignment = bank.fifo;
+        filter.FilterBank           = b;
+        filter.FilterMode           = bank.list ? CAN_FILTERMODE_IDLIST : CAN_FILTERMODE_IDMASK;
+        filter.FilterScale          = bank.wide ? CAN_FILTERSCALE_32BIT : CAN_FILTERSCALE_16BIT;
+        filter.FilterActivation     = CAN_FILTER_ENABLE;
+        filter.SlaveStartFilterBank = CanFilters::BANKS;
+        if (HAL_CAN_ConfigFilter(&g_hcan, &filter) != HAL_OK) {
+            return false;
+        }
+    }
+
+    HAL_CAN_ActivateNotification(&g_hcan, CAN_IT_TX_MAILBOX_EMPTY     |
+                                          CAN_IT_RX_FIFO0_MSG_PENDING |
+                                          CAN_IT_RX_FIFO1_MSG_PENDING |
+                                          CAN_IT_RX_FIFO0_OVERRUN     |
+                                          CAN_IT_RX_FIFO1_OVERRUN);
+
+    return HAL_CAN_Start(&g_hcan) == HAL_OK;
+}
+
+void CanBus::txIsr(void)
+{
+    HAL_CAN_IRQHandler(&g_hcan);
+}
+
+void CanBus::rxIsr(uint32_t fifo)
+{
+    HAL_CAN_IRQHandler(&g_hcan);
+}
+
+bool CanBus::load(const Frame &frame, uint32_t &mailbox)
+{
+    CAN_TxHeaderTypeDef header;
+    header.StdId              = frame.id & CanFilters::STD_ID_MASK;
+    header.ExtId              = frame.id & CanFilters::EXT_ID_MASK;
+    header.IDE                = (frame.id & EXTENDED) ? CAN_ID_EXT : CAN_ID_STD;
+    header.RTR                = CAN_RTR_DATA;
+    header.DLC                = frame.length;
+    header.TransmitGlobalTime = DISABLE;
+
+    uint8_t  data[8];
+    uint32_t box;
+    memcpy(data, frame.data, sizeof(data));
+    if (HAL_CAN_AddTxMessage(&g_hcan, &header, data, &box) != HAL_OK) {
+        return false;
+    }
+
+    mailbox = (box == CAN_TX_MAILBOX0) ? 0 : (box == CAN_TX_MAILBOX1) ? 1 : 2;
+    return true;
+}
+
+void CanBus::abort(uint32_t mailbox)
+{
+    HAL_CAN_AbortTxRequest(&g_hcan, 1UL << mailbox);
+}
+
+void CanBus::drain(uint32_t fifo)
+{
+    while (HAL_CAN_GetRxFifoFillLevel(&g_hcan, fifo) != 0) {
+        CAN_RxHeaderTypeDef header;
+        Frame               frame;
+        if (HAL_CAN_GetRxMessage(&g_hcan, fifo, &header, frame.data) != HAL_OK) {
+            return;
+        }
+        frame.id     = (header.IDE == CAN_ID_EXT) ? (header.ExtId | EXTENDED) : header.StdId;
+        frame.length = static_cast<uint8_t>((header.DLC > 8) ? 8 : header.DLC);
+        deliver(fifo, header.FilterMatchIndex, frame);
+    }
+}
+
+extern "C" void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::drain(CAN_RX_FIFO0);
+}
+
+extern "C" void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::drain(CAN_RX_FIFO1);
+}
+
+extern "C" void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(0, true);
+}
+
+extern "C" void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(1, true);
+}
+
+extern "C" void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(2, true);
+}
+
+extern "C" void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(0, false);
+}
+
+extern "C" void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(1, false);
+}
+
+extern "C" void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan)
+{
+    CanBus::txDone(2, false);
+}
+
+/* FIFO overruns are the only error interrupts enabled */
+extern "C" void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+    if (HAL_CAN_GetError(hcan) & (HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1)) {
+        ++CanBus::g_dropped;
+    }
+    HAL_CAN_ResetError(hcan);
+}
+#else
+bool CanBus::start(void)
+{
+    using namespace Bsp::Components;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_CAN1EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_AFIOEN>::set();
+
+    /* SWJ_CFG is write only (reads as zero), zero is its reset value. */
+    AFIO->MAPR = (AFIO->MAPR & ~(AFIO_MAPR_CAN_REMAP | AFIO_MAPR_SWJ_CFG)) | AFIO_MAPR_CAN_REMAP_REMAP2;
+    Can::RxPin::init();
+    Can::TxPin::init();
+
+    /* Leave sleep mode for initialization mode. */
+    CAN1->MCR = CAN_MCR_INRQ;
+    if (!waitInit(true)) {
+        return false;
+    }
+
+    /*
+     * Recover from bus-off by itself, retransmit until sent, overwrite the
+     * last frame of a full FIFO, and send mailboxes in identifier order
+     * (TXFP clear).
+     */
+    CAN1->MCR = CAN_MCR_INRQ | CAN_MCR_ABOM;
+    CAN1->BTR = ((SJW - 1) << CAN_BTR_SJW_Pos) |
+                ((BS2 - 1) << CAN_BTR_TS2_Pos) |
+                ((BS1 - 1) << CAN_BTR_TS1_Pos) |
+                (PRESCALER - 1);
+
+    /* Filters, with all banks off while they change. */
+    uint32_t list   = 0;
+    uint32_t wide   = 0;
+    uint32_t fifo1  = 0;
+    uint32_t active = 0;
+
+    CAN1->FMR |= CAN_FMR_FINIT;
+    CAN1->FA1R = 0;
+    for (uint32_t b = 0; b < FilterPlan::USED; ++b) {
+        const CanFilters::Bank &bank = BANKS[b];
+        const uint32_t          bit  = 1UL << b;
+
+        CAN1->sFilterRegister[b].FR1 = bank.fr1;
+        CAN1->sFilterRegister[b].FR2 = bank.fr2;
+        list   |= bank.list ? bit : 0;
+        wide   |= bank.wide ? bit : 0;
+        fifo1  |= bank.fifo ? bit : 0;
+        active |= bit;
+    }
+    CAN1->FM1R  = list;
+    CAN1->FS1R  = wide;
+    CAN1->FFA1R = fifo1;
+    CAN1->FA1R  = active;
+    CAN1->FMR  &= ~CAN_FMR_FINIT;
+
+    CAN1->IER = CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FMPIE1;
+
+    /* Join the bus once it was idle (11 recessive bits) for a moment. */
+    CAN1->MCR &= ~CAN_MCR_INRQ;
+    return waitInit(false);
+}
+
+/* wait for INAK to follow INRQ */
+bool CanBus::waitInit(bool entered)
+{
+    for (uint32_t waited = 0; waited < MODE_TIMEOUT_US; waited += 10) {
+        if (((CAN1->MSR & CAN_MSR_INAK) != 0) == entered) {
+            return true;
+        }
+        Timebase::delayUs(10);
+    }
+    return false;
+}
+
+/* RQCP is set when a mailbox went out (TXOK) or its abort took effect */
+void CanBus::txIsr(void)
+{
+    const uint32_t tsr = CAN1->TSR;
+
+    for (uint32_t m = 0; m < MAILBOXES; ++m) {
+        const uint32_t rqcp = CAN_TSR_RQCP0 << (8 * m);
+        if (tsr & rqcp) {
+            /* Writing RQCP clears TXOK, ALST and TERR as well. */
+            CAN1->TSR = rqcp;
+            txDone(m, (tsr & (CAN_TSR_TXOK0 << (8 * m))) != 0);
+        }
+    }
+}
+
+/* RF0R and RF1R have the same layout */
+void CanBus::rxIsr(uint32_t fifo)
+{
+    volatile uint32_t &rfr = (fifo == 0) ? CAN1->RF0R : CAN1->RF1R;
+
+    while (rfr & CAN_RF0R_FMP0) {
+        const CAN_FIFOMailBox_TypeDef &box  = CAN1->sFIFOMailBox[fifo];
+        const uint32_t                 rir  = box.RIR;
+        const uint32_t                 rdtr = box.RDTR;
+        const uint32_t                 dlc  = rdtr & CAN_RDT0R_DLC;
+        const uint32_t                 low  = box.RDLR;
+        const uint32_t                 high = box.RDHR;
+
+        Frame frame;
+        frame.id     = (rir & CAN_RI0R_IDE) ? (((rir >> EXID_SHIFT) & CanFilters::EXT_ID_MASK) | EXTENDED) :
+                                              (rir >> STID_SHIFT);
+        frame.length = static_cast<uint8_t>((dlc > 8) ? 8 : dlc);
+        memcpy(&frame.data[0], &low, sizeof(low));
+        memcpy(&frame.data[4], &high, sizeof(high));
+
+        /* Release the output mailbox before the copy into the queue. */
+        rfr = CAN_RF0R_RFOM0;
+        deliver(fifo, (rdtr & CAN_RDT0R_FMI) >> CAN_RDT0R_FMI_Pos, frame);
+    }
+
+    /* A frame arrived to a full FIFO and replaced the newest one. */
+    if (rfr & CAN_RF0R_FOVR0) {
+        rfr = CAN_RF0R_FOVR0 | CAN_RF0R_FULL0;
+        ++g_dropped;
+    }
+}
+
+bool CanBus::load(const Frame &frame, uint32_t &mailbox)
+{
+    const uint32_t tsr = CAN1->TSR;
+    if ((tsr & (CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2)) == 0) {
+        return false;
+    }
+
+    /* CODE names the next empty mailbox. */
+    mailbox = (tsr & CAN_TSR_CODE) >> CAN_TSR_CODE_Pos;
+
+    CAN_TxMailBox_TypeDef &box = CAN1->sTxMailBox[mailbox];
+    uint32_t low;
+    uint32_t high;
+    memcpy(&low, &frame.data[0], sizeof(low));
+    memcpy(&high, &frame.data[4], sizeof(high));
+    box.TDTR = frame.length;
+    box.TDLR = low;
+    box.TDHR = high;
+    box.TIR  = ((frame.id & EXTENDED) ? (((frame.id & CanFilters::EXT_ID_MASK) << EXID_SHIFT) | CAN_TI0R_IDE) :
+                                        ((frame.id & CanFilters::STD_ID_MASK) << STID_SHIFT)) |
+               CAN_TI0R_TXRQ;
+    return true;
+}
+
+void CanBus::abort(uint32_t mailbox)
+{
+    CAN1->TSR = CAN_TSR_ABRQ0 << (8 * mailbox);
+}
+#endif
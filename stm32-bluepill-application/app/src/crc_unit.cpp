@@ -0,0 +1,108 @@
+#include "crc_unit.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// STATIC LIB
+#include "crc/crc32.hpp"
+#include "ring/port.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace CrcUnit {
+
+    /* polynomial of the unit (normal form) */
+    static constexpr uint32_t POLY = 0x04C11DB7UL;
+
+    /* data register value after a reset */
+    static constexpr uint32_t RESET_VALUE = 0xFFFFFFFFUL;
+
+    /* 1 while a calculation owns the unit */
+    static volatile ring::port::Index g_owner;
+
+    static bool acquire(void);
+    static void release(void);
+    static uint32_t preset(uint32_t state);
+}
+
+void CrcUnit::init(void)
+{
+#if defined(USE_HAL_DRIVER)
+    __HAL_RCC_CRC_CLK_ENABLE();
+#else
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_CRCEN>::set();
+#endif
+}
+
+bool CrcUnit::acquire(void)
+{
+    ring::port::Index expected = 0;
+    return ring::port::compareExchange(&g_owner, expected, 1);
+}
+
+void CrcUnit::release(void)
+{
+    ring::port::barrier();
+    g_owner = 0;
+}
+
+/*
+ * Word to write right after a reset to bring the unit to state. Writing d
+ * to the reset unit gives (RESET_VALUE ^ d) * x^32 mod POLY, so d is
+ * RESET_VALUE ^ (state * x^-32 mod POLY): the 32 shifts undone one by one.
+ * A shift left the low bit clear unless the polynomial was added, which
+ * happens exactly when the top bit was shifted out.
+ */
+uint32_t CrcUnit::preset(uint32_t state)
+{
+    for (uint32_t i = 0; i < 32; ++i) {
+        state = (state & 1) ? ((state ^ POLY) >> 1) | 0x80000000UL : state >> 1;
+    }
+    return RESET_VALUE ^ state;
+}
+
+uint32_t CrcUnit::crc32(const void *data, uint32_t length, uint32_t previous)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+    /* reflected register as the software tables use it */
+    uint32_t reg = previous ^ crc::INIT;
+
+    const uint32_t head = (0U - reinterpret_cast<uintptr_t>(bytes)) & 3;
+    if (length < head + MIN_BYTES || !acquire()) {
+        return crc::update(reg, bytes, length) ^ crc::INIT;
+    }
+
+    reg     = crc::update(reg, bytes, head);
+    bytes  += head;
+    length -= head;
+
+    const uint32_t *words = reinterpret_cast<const uint32_t *>(bytes);
+    const uint32_t  count = length / 4;
+
+    CRC->CR = CRC_CR_RESET;
+    if (__RBIT(reg) != RESET_VALUE) {
+        CRC->DR = preset(__RBIT(reg));
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        CRC->DR = __RBIT(words[i]);
+    }
+    reg = __RBIT(CRC->DR);
+    release();
+
+    return crc::update(reg, words + count, length & 3) ^ crc::INIT;
+}
@@ -0,0 +1,162 @@
+#include "flash_kv.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+extern "C" {
+    /* store region (defined in the linker script) */
+    extern uint8_t _skvstore[];
+    extern uint8_t _ekvstore[];
+}
+
+namespace FlashKv {
+
+    static Flash g_flash;
+    static Store g_store(g_flash);
+
+#if !defined(USE_HAL_DRIVER)
+    /* flash controller error flags */
+    static constexpr uint32_t SR_ERRORS = FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+
+    static bool unlock(void);
+    static bool wait(void);
+    static void lock(bool stop_hsi);
+#endif
+}
+
+void FlashKv::init(void)
+{
+    if (static_cast<uint32_t>(_ekvstore - _skvstore) != Flash::PAGES * Flash::PAGE_SIZE) {
+        __BKPT(0);
+    }
+    g_store.mount();
+}
+
+FlashKv::Store &FlashKv::store(void)
+{
+    return g_store;
+}
+
+bool FlashKv::maintain(void)
+{
+    return g_store.maintain();
+}
+
+const uint8_t *FlashKv::Flash::base(void) const
+{
+    return _skvstore;
+}
+
+#if defined(USE_HAL_DRIVER)
+bool FlashKv::Flash::program(uint32_t offset, const uint16_t *values, uint32_t count)
+{
+    HAL_FLASH_Unlock();
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        const uint32_t address = reinterpret_cast<uintptr_t>(_skvstore) + offset + 2 * i;
+        ok = (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, values[i]) == HAL_OK);
+    }
+    HAL_FLASH_Lock();
+    return ok;
+}
+
+bool FlashKv::Flash::erase(uint32_t page)
+{
+    FLASH_EraseInitTypeDef erase_init = FLASH_EraseInitTypeDef();
+    erase_init.TypeErase   = FLASH_TYPEERASE_PAGES;
+    erase_init.Banks       = FLASH_BANK_1;
+    erase_init.PageAddress = reinterpret_cast<uintptr_t>(_skvstore) + page * PAGE_SIZE;
+    erase_init.NbPages     = 1;
+
+    uint32_t failed = 0;
+    HAL_FLASH_Unlock();
+    const bool ok = (HAL_FLASHEx_Erase(&erase_init, &failed) == HAL_OK);
+    HAL_FLASH_Lock();
+    return ok;
+}
+#else
+/*
+ * The flash controller runs program and erase operations on the HSI, which
+ * SystemInit switches off when the PLL runs from the HSE. unlock() turns it
+ * back on for the operation and returns whether lock() must stop it again.
+ */
+bool FlashKv::unlock(void)
+{
+    const bool start_hsi = (RCC->CR & RCC_CR_HSION) == 0;
+    if (start_hsi) {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, CR), RCC_CR_HSION>::set();
+        while ((RCC->CR & RCC_CR_HSIRDY) == 0) { }
+    }
+
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+    FLASH->SR = SR_ERRORS | FLASH_SR_EOP;
+    return start_hsi;
+}
+
+/* wait for the operation in progress, true if it succeeded */
+bool FlashKv::wait(void)
+{
+    while (FLASH->SR & FLASH_SR_BSY) { }
+
+    const bool ok = (FLASH->SR & SR_ERRORS) == 0;
+    FLASH->SR = SR_ERRORS | FLASH_SR_EOP;
+    return ok;
+}
+
+void FlashKv::lock(bool stop_hsi)
+{
+    FLASH->CR = FLASH_CR_LOCK;
+    if (stop_hsi) {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, CR), RCC_CR_HSION>::clear();
+    }
+}
+
+bool FlashKv::Flash::program(uint32_t offset, const uint16_t *values, uint32_t count)
+{
+    volatile uint16_t *target = reinterpret_cast<volatile uint16_t *>(_skvstore + offset);
+
+    const bool stop_hsi = unlock();
+    FLASH->CR = FLASH_CR_PG;
+
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        target[i] = values[i];
+        ok = wait();
+    }
+
+    lock(stop_hsi);
+    return ok;
+}
+
+bool FlashKv::Flash::erase(uint32_t page)
+{
+    const bool stop_hsi = unlock();
+    FLASH->CR = FLASH_CR_PER;
+    FLASH->AR = reinterpret_cast<uintptr_t>(_skvstore) + page * PAGE_SIZE;
+    FLASH->CR = FLASH_CR_PER | FLASH_CR_STRT;
+
+    const bool ok = wait();
+
+    lock(stop_hsi);
+    return ok;
+}
+#endif
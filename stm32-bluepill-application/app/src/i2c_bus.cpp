@@ -0,0 +1,638 @@
+#include "i2c_bus.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+#include "timebase.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace I2cBus {
+
+    static constexpr uint32_t PCLK1_HZ  = Bsp::Components::Clock::PCLK1_FREQ_HZ;
+    static constexpr uint32_t PCLK1_MHZ = PCLK1_HZ / 1000000;
+    static constexpr uint32_t CLOCK_HZ  = Bsp::Components::I2c1::CLOCK_HZ;
+
+    /* fast mode (above 100 kHz) */
+    static constexpr bool FAST = CLOCK_HZ > 100000;
+
+    /*
+     * CCR field: SCL high and low are CCR PCLK1 periods each in standard
+     * mode, low is twice high in fast mode (DUTY 0, 36 MHz / (3 * 30) is
+     * exactly 400 kHz). Rounded up so the bus never runs above CLOCK_HZ.
+     */
+    static constexpr uint32_t CCR_VALUE = FAST ? (PCLK1_HZ + 3 * CLOCK_HZ - 1) / (3 * CLOCK_HZ)
+                                               : (PCLK1_HZ + 2 * CLOCK_HZ - 1) / (2 * CLOCK_HZ);
+
+    /* TRISE: the longest SCL rise time (1000 ns, fast mode 300 ns) in PCLK1 periods, plus one */
+    static constexpr uint32_t TRISE_VALUE = (FAST ? PCLK1_MHZ * 300 / 1000 : PCLK1_MHZ) + 1;
+
+    static_assert(CLOCK_HZ <= 400000, "I2C1 runs at 400 kHz at most");
+    static_assert(PCLK1_MHZ >= (FAST ? 4 : 2) && PCLK1_MHZ <= 36, "PCLK1 out of the I2C range");
+    static_assert(CCR_VALUE >= (FAST ? 1 : 4) && CCR_VALUE <= 0xFFF, "I2C clock out of range");
+
+    /* time allowed on top of twice the wire time before a transaction fails */
+    static constexpr uint32_t TIMEOUT_MS = 5;
+
+    /* half a period of the 100 kHz clock pulses of a bus recovery */
+    static constexpr uint32_t RECOVERY_HALF_PERIOD_US = 5;
+
+    /* SCL pulses that free any slave in the middle of a byte */
+    static constexpr uint32_t RECOVERY_PULSES = 9;
+
+    struct State {
+        /* queue, head is the transaction in progress while active */
+        Transaction *head;
+        Transaction *tail;
+        bool         active;
+
+        /* in the read part of the head transaction */
+        bool         reading;
+
+        /* ticks the head transaction has run and may run */
+        uint32_t     ticks;
+        uint32_t     budget;
+
+        uint32_t     recoveries;
+    };
+
+    /* queue and bus state (I2C interrupts, or code in a CriticalSection) */
+    static State g_state;
+
+    static uint32_t budget(const Transaction &transaction);
+    static void begin(void);
+    static void finish(Status status);
+    static void recover(void);
+    static bool spuriousBusError(void);
+
+    /* DRIVER PRIMITIVES (register level or HAL) */
+    static void setup(void);
+    static void reset(void);
+    static bool start(const Transaction &transaction);
+    static void stop(void);
+    static void pause(void);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace I2cBus {
+    static I2C_HandleTypeDef g_hi2c;
+    static DMA_HandleTypeDef g_hdma_rx;
+    static DMA_HandleTypeDef g_hdma_tx;
+}
+#else
+namespace I2cBus {
+
+    /* CR2 with the peripheral clock only: no interrupts, no DMA */
+    static constexpr uint32_t CR2_IDLE = PCLK1_MHZ;
+
+    static void arm(DMA_Channel_TypeDef *channel, uint32_t memory, uint32_t length, uint32_t ccr);
+}
+#endif
+
+void I2cBus::init(void)
+{
+    g_state.head       = nullptr;
+    g_state.tail       = nullptr;
+    g_state.active     = false;
+    g_state.reading    = false;
+    g_state.recoveries = 0;
+
+    setup();
+
+    /* A slave reset in the middle of a byte, or the BUSY erratum. */
+    if (I2C1->SR2 & I2C_SR2_BUSY) {
+        recover();
+    }
+}
+
+bool I2cBus::submit(Transaction &transaction)
+{
+    if ((transaction.tx_length == 0 && transaction.rx_length == 0) ||
+        transaction.tx_length > MAX_LENGTH || transaction.rx_length > MAX_LENGTH) {
+        return false;
+    }
+
+    transaction.next = nullptr;
+
+    Nvic::CriticalSection cs;
+    if (g_state.tail != nullptr) {
+        g_state.tail->next = &transaction;
+    } else {
+        g_state.head = &transaction;
+    }
+    g_state.tail = &transaction;
+
+    if (!g_state.active) {
+        begin();
+    }
+    return true;
+}
+
+bool I2cBus::idle(void)
+{
+    return g_state.head == nullptr;
+}
+
+uint32_t I2cBus::recoveries(void)
+{
+    return g_state.recoveries;
+}
+
+/*
+ * A transaction that outlives its budget has lost the bus: a slave holds
+ * SDA or SCL low, or BUSY is stuck and the start never went out.
+ */
+void I2cBus::watchdog(void)
+{
+    Nvic::CriticalSection cs;
+    if (!g_state.active || ++g_state.ticks < g_state.budget) return;
+
+    stop();
+    recover();
+    finish(Status::TIMEOUT);
+}
+
+/* ticks a transaction may take: twice its wire time (9 bits a byte) plus TIMEOUT_MS */
+uint32_t I2cBus::budget(const Transaction &transaction)
+{
+    const uint32_t bits = (transaction.tx_length + transaction.rx_length + 2) * 9;
+    const uint32_t ms   = TIMEOUT_MS + (2 * bits * 1000) / CLOCK_HZ;
+
+    return ms * Bsp::Components::Clock::TICK_FREQ_HZ / 1000 + 1;
+}
+
+void I2cBus::begin(void)
+{
+    if (g_state.head == nullptr) return;
+
+    g_state.active  = true;
+    g_state.reading = (g_state.head->tx_length == 0);
+    g_state.ticks   = 0;
+    g_state.budget  = budget(*g_state.head);
+
+    if (!start(*g_state.head)) {
+        stop();
+        recover();
+        finish(Status::BUS_ERROR);
+    }
+}
+
+/*
+ * The head transaction is over and the peripheral is quiet. Start the next
+ * one before the callback so the bus does not wait for it.
+ */
+void I2cBus::finish(Status status)
+{
+    Transaction &transaction = *g_state.head;
+
+    g_state.head   = transaction.next;
+    g_state.active = false;
+    if (g_state.head == nullptr) {
+        g_state.tail = nullptr;
+    }
+
+    begin();
+
+    if (transaction.callback != nullptr) {
+        transaction.callback(transaction, status, transaction.arg);
+    }
+}
+
+/*
+ * Clock a slave stuck in the middle of a byte free (it releases SDA once it
+ * has shifted out its bits and sees no acknowledge), end with a stop
+ * condition so every slave is idle, then reset the peripheral. This is the
+ * recovery of the I2C specification (section 3.1.16) and also the sequence
+ * the errata sheet gives for the stuck BUSY flag.
+ */
+void I2cBus::recover(void)
+{
+    using namespace Bsp::Components;
+
+    ++g_state.recoveries;
+
+    CLEAR_BIT(I2C1->CR1, I2C_CR1_PE);
+    I2c1::SclGpio::init();
+    I2c1::SdaGpio::init();
+    pause();
+
+    for (uint32_t i = 0; i < RECOVERY_PULSES && !I2c1::SdaGpio::read(); ++i) {
+        I2c1::SclGpio::clear();
+        pause();
+        I2c1::SclGpio::set();
+        pause();
+    }
+
+    /* stop condition: SDA rises while SCL is high */
+    I2c1::SclGpio::clear();
+    pause();
+    I2c1::SdaGpio::clear();
+    pause();
+    I2c1::SclGpio::set();
+    pause();
+    I2c1::SdaGpio::set();
+    pause();
+
+    I2c1::SclPin::init();
+    I2c1::SdaPin::init();
+    reset();
+}
+
+/*
+ * Errata "spurious bus error detection in master mode": BERR may be set
+ * without any misplaced start or stop. The driver is the only master, so
+ * while a transaction runs a bus error alone is cleared and the transfer
+ * goes on (error flags are cleared by writing 0, writing 1 has no effect).
+ * A real bus fault stalls the transfer and ends in the watchdog recovery.
+ */
+bool I2cBus::spuriousBusError(void)
+{
+    static constexpr uint32_t ERRORS = I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR |
+                                       I2C_SR1_PECERR | I2C_SR1_TIMEOUT | I2C_SR1_SMBALERT;
+
+    if (!g_state.active || (I2C1->SR1 & ERRORS) != I2C_SR1_BERR) return false;
+
+    I2C1->SR1 = ~I2C_SR1_BERR & 0xFFFF;
+    return true;
+}
+
+#if defined(USE_HAL_DRIVER)
+void I2cBus::setup(void)
+{
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_I2C1_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+
+    GPIO_InitTypeDef pin;
+    pin.Pin   = GPIO_PIN_6 | GPIO_PIN_7;
+    pin.Mode  = GPIO_MODE_AF_OD;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(GPIOB, &pin);
+
+    DMA_HandleTypeDef * const dma[2] = { &g_hdma_rx, &g_hdma_tx };
+    for (uint32_t d = 0; d < 2; ++d) {
+        dma[d]->Init.PeriphInc           = DMA_PINC_DISABLE;
+        dma[d]->Init.MemInc              = DMA_MINC_ENABLE;
+        dma[d]->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        dma[d]->Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        dma[d]->Init.Mode                = DMA_NORMAL;
+    }
+    g_hdma_rx.Instance       = DMA1_Channel7;
+    g_hdma_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    g_hdma_rx.Init.Priority  = DMA_PRIORITY_HIGH;
+    g_hdma_tx.Instance       = DMA1_Channel6;
+    g_hdma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    g_hdma_tx.Init.Priority  = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&g_hdma_rx) != HAL_OK || HAL_DMA_Init(&g_hdma_tx) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    g_hi2c.Instance             = I2C1;
+    g_hi2c.Init.ClockSpeed      = CLOCK_HZ;
+    g_hi2c.Init.DutyCycle       = I2C_DUTYCYCLE_2;
+    g_hi2c.Init.OwnAddress1     = 0;
+    g_hi2c.Init.AddressingMode  = I2C_ADDRESSINGMODE_7BIT;
+    g_hi2c.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+    g_hi2c.Init.OwnAddress2     = 0;
+    g_hi2c.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+    g_hi2c.Init.NoStretchMode   = I2C_NOSTRETCH_DISABLE;
+    __HAL_LINKDMA(&g_hi2c, hdmarx, g_hdma_rx);
+    __HAL_LINKDMA(&g_hi2c, hdmatx, g_hdma_tx);
+    reset();
+
+    Nvic::enable<I2C1_EV_IRQn>();
+    Nvic::enable<I2C1_ER_IRQn>();
+    Nvic::enable<DMA1_Channel6_IRQn>();
+    Nvic::enable<DMA1_Channel7_IRQn>();
+}
+
+/* HAL_I2C_Init() pulses SWRST before it programs the timing */
+void I2cBus::reset(void)
+{
+    if (HAL_I2C_DeInit(&g_hi2c) != HAL_OK || HAL_I2C_Init(&g_hi2c) != HAL_OK) {
+        __BKPT(0);
+    }
+}
+
+/*
+ * The sequential API keeps the write and the read one transaction: the
+ * write ends without a stop (FIRST_FRAME) and the read started from its
+ * completion callback begins with a repeated start.
+ */
+bool I2cBus::start(const Transaction &transaction)
+{
+    const uint16_t address = static_cast<uint16_t>(transaction.address << 1);
+
+    HAL_StatusTypeDef status;
+    if (transaction.tx_length != 0) {
+        status = HAL_I2C_Master_Seq_Transmit_DMA(&g_hi2c, address, const_cast<uint8_t *>(transaction.tx),
+                                                 static_cast<uint16_t>(transaction.tx_length),
+                                                 transaction.rx_length != 0 ? I2C_FIRST_FRAME
+                                                                            : I2C_FIRST_AND_LAST_FRAME);
+    } else {
+        status = HAL_I2C_Master_Seq_Receive_DMA(&g_hi2c, address, transaction.rx,
+                                                static_cast<uint16_t>(transaction.rx_length),
+                                                I2C_FIRST_AND_LAST_FRAME);
+    }
+    return status == HAL_OK;
+}
+
+void I2cBus::stop(void)
+{
+    (void)HAL_DMA_Abort(&g_hdma_rx);
+    (void)HAL_DMA_Abort(&g_hdma_tx);
+    __HAL_I2C_DISABLE_IT(&g_hi2c, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR);
+}
+
+/* HAL_Delay() counts milliseconds, spin on the SysTick counter instead */
+void I2cBus::pause(void)
+{
+    const uint32_t period = SysTick->LOAD + 1;
+    const uint32_t wait   = RECOVERY_HALF_PERIOD_US * (HAL_RCC_GetHCLKFreq() / 1000000);
+    const uint32_t first  = SysTick->VAL;
+
+    while ((first + period - SysTick->VAL) % period < wait) { }
+}
+
+void I2cBus::evIsr(void)
+{
+    HAL_I2C_EV_IRQHandler(&g_hi2c);
+}
+
+/* The HAL aborts the transfer on any error, a spurious BERR never gets to it. */
+void I2cBus::erIsr(void)
+{
+    if (spuriousBusError()) return;
+
+    HAL_I2C_ER_IRQHandler(&g_hi2c);
+}
+
+void I2cBus::rxIsr(void)
+{
+    HAL_DMA_IRQHandler(&g_hdma_rx);
+}
+
+void I2cBus::txIsr(void)
+{
+    HAL_DMA_IRQHandler(&g_hdma_tx);
+}
+
+extern "C" void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    using namespace I2cBus;
+
+    if (!g_state.active) return;
+
+    Transaction &transaction = *g_state.head;
+    if (transaction.rx_length == 0) {
+        finish(Status::OK);
+        return;
+    }
+
+    g_state.reading = true;
+    if (HAL_I2C_Master_Seq_Receive_DMA(hi2c, static_cast<uint16_t>(transaction.address << 1), transaction.rx,
+                                       static_cast<uint16_t>(transaction.rx_length), I2C_LAST_FRAME) != HAL_OK) {
+        stop();
+        recover();
+        finish(Status::BUS_ERROR);
+    }
+}
+
+extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    if (!I2cBus::g_state.active) return;
+
+    I2cBus::finish(I2cBus::Status::OK);
+}
+
+/* HAL generates the stop after a NACK and frees the bus after a lost arbitration */
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    using namespace I2cBus;
+
+    if (!g_state.active) return;
+
+    const uint32_t error = HAL_I2C_GetError(hi2c);
+    if (error & HAL_I2C_ERROR_AF) {
+        finish(Status::NACK);
+    } else if (error & HAL_I2C_ERROR_ARLO) {
+        finish(Status::ARBITRATION_LOST);
+    } else {
+        stop();
+        recover();
+        finish(Status::BUS_ERROR);
+    }
+}
+#else
+void I2cBus::setup(void)
+{
+    using namespace Bsp::Components;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_I2C1EN>::set();
+    I2c1::SclPin::init();
+    I2c1::SdaPin::init();
+    reset();
+
+    DMA1_Channel7->CCR  = 0;
+    DMA1_Channel7->CPAR = reinterpret_cast<uintptr_t>(&I2C1->DR);
+    DMA1_Channel6->CCR  = 0;
+    DMA1_Channel6->CPAR = reinterpret_cast<uintptr_t>(&I2C1->DR);
+
+    Nvic::enable<I2C1_EV_IRQn>();
+    Nvic::enable<I2C1_ER_IRQn>();
+    Nvic::enable<DMA1_Channel6_IRQn>();
+    Nvic::enable<DMA1_Channel7_IRQn>();
+}
+
+/* software reset, then the timing (only writable with PE clear) */
+void I2cBus::reset(void)
+{
+    I2C1->CR1   = I2C_CR1_SWRST;
+    I2C1->CR1   = 0;
+    I2C1->CR2   = CR2_IDLE;
+    I2C1->CCR   = (FAST ? I2C_CCR_FS : 0) | CCR_VALUE;
+    I2C1->TRISE = TRISE_VALUE;
+    I2C1->CR1   = I2C_CR1_PE;
+}
+
+/*
+ * Request the start condition, evIsr() takes it from there. A stop still
+ * being generated (set by the previous transaction, at most one SCL period)
+ * would swallow the start, so wait for it first.
+ */
+bool I2cBus::start(const Transaction &transaction)
+{
+    while (I2C1->CR1 & I2C_CR1_STOP) { }
+
+    I2C1->CR2 = CR2_IDLE | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN;
+    I2C1->CR1 = I2C_CR1_PE | I2C_CR1_START;
+    return true;
+}
+
+void I2cBus::stop(void)
+{
+    DMA1_Channel6->CCR = 0;
+    DMA1_Channel7->CCR = 0;
+    DMA1->IFCR = DMA_IFCR_CGIF6 | DMA_IFCR_CGIF7;
+    I2C1->CR2  = CR2_IDLE;
+}
+
+void I2cBus::pause(void)
+{
+    Timebase::delayUs(RECOVERY_HALF_PERIOD_US);
+}
+
+/* a DMA request of the channel is served once it is enabled */
+void I2cBus::arm(DMA_Channel_TypeDef *channel, uint32_t memory, uint32_t length, uint32_t ccr)
+{
+    channel->CMAR  = memory;
+    channel->CNDTR = length;
+    channel->CCR   = ccr | DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+}
+
+/*
+ * Start (SB), address (ADDR) and the end of a write (BTF) or of a single
+ * byte read (RXNE). Data bytes move by DMA in between, with the event
+ * interrupt off so BTF does not fire whenever the DMA falls behind.
+ */
+void I2cBus::evIsr(void)
+{
+    I2C_TypeDef * const regs = I2C1;
+    const uint32_t      sr1  = regs->SR1;
+
+    if (!g_state.active) {
+        regs->CR2 = CR2_IDLE;
+        return;
+    }
+
+    const Transaction &transaction = *g_state.head;
+
+    if (sr1 & I2C_SR1_SB) {
+        /* Reading SR1, then writing DR clears SB. */
+        if (!g_state.reading) {
+            arm(DMA1_Channel6, reinterpret_cast<uintptr_t>(transaction.tx), transaction.tx_length,
+                DMA_CCR_PL_0 | DMA_CCR_DIR);
+            regs->DR = static_cast<uint32_t>(transaction.address << 1);
+        } else if (transaction.rx_length == 1) {
+            /* NACK the only byte, received with RXNE instead of DMA */
+            regs->CR1 &= ~I2C_CR1_ACK;
+            regs->CR2 &= ~I2C_CR2_DMAEN;
+            regs->DR   = static_cast<uint32_t>(transaction.address << 1) | 1;
+        } else {
+            /* LAST: the DMA end of transfer NACKs the last byte */
+            regs->CR1 |= I2C_CR1_ACK;
+            regs->CR2 |= I2C_CR2_LAST;
+            arm(DMA1_Channel7, reinterpret_cast<uintptr_t>(transaction.rx), transaction.rx_length,
+                DMA_CCR_PL_1);
+            regs->DR   = static_cast<uint32_t>(transaction.address << 1) | 1;
+        }
+    } else if (sr1 & I2C_SR1_ADDR) {
+        if (g_state.reading && transaction.rx_length == 1) {
+            /*
+             * Clear ADDR and set STOP before the byte is in (erratum: only
+             * the never-masked handlers can delay these two accesses).
+             */
+            (void)regs->SR2;
+            regs->CR1 |= I2C_CR1_STOP;
+            regs->CR2 |= I2C_CR2_ITBUFEN;
+        } else {
+            regs->CR2 &= ~I2C_CR2_ITEVTEN;
+            (void)regs->SR2;
+        }
+    } else if ((sr1 & I2C_SR1_RXNE) && g_state.reading) {
+        transaction.rx[0] = static_cast<uint8_t>(regs->DR);
+        regs->CR2 = CR2_IDLE;
+        finish(Status::OK);
+    } else if ((sr1 & I2C_SR1_BTF) && !g_state.reading) {
+        /* The last byte written is out and acknowledged. */
+        if (transaction.rx_length != 0) {
+            /* BTF stays set until the restart is out, reading ignores it */
+            g_state.reading = true;
+            regs->CR1 |= I2C_CR1_START;
+        } else {
+            regs->CR1 |= I2C_CR1_STOP;
+            regs->CR2  = CR2_IDLE;
+            finish(Status::OK);
+        }
+    }
+}
+
+/*
+ * The error flags are cleared by writing 0. A NACK needs a stop, a lost
+ * arbitration already released the bus, everything else recovers it.
+ */
+void I2cBus::erIsr(void)
+{
+    if (spuriousBusError()) return;
+
+    I2C_TypeDef * const regs = I2C1;
+    const uint32_t      sr1  = regs->SR1;
+
+    regs->SR1 = 0;
+    if (!g_state.active) return;
+
+    stop();
+    if (sr1 & I2C_SR1_AF) {
+        regs->CR1 |= I2C_CR1_STOP;
+        finish(Status::NACK);
+    } else if (sr1 & I2C_SR1_ARLO) {
+        finish(Status::ARBITRATION_LOST);
+    } else {
+        recover();
+        finish(Status::BUS_ERROR);
+    }
+}
+
+/* every byte read is in memory, the last one was NACKed (LAST) */
+void I2cBus::rxIsr(void)
+{
+    const uint32_t isr = DMA1->ISR;
+
+    if (isr & DMA_ISR_TEIF7) {
+        stop();
+        recover();
+        finish(Status::BUS_ERROR);
+    } else if (isr & DMA_ISR_TCIF7) {
+        DMA1->IFCR = DMA_IFCR_CGIF7;
+        DMA1_Channel7->CCR = 0;
+        I2C1->CR1 |= I2C_CR1_STOP;
+        I2C1->CR2  = CR2_IDLE;
+        finish(Status::OK);
+    }
+}
+
+/* every byte written is in DR or the shift register, BTF ends the write */
+void I2cBus::txIsr(void)
+{
+    const uint32_t isr = DMA1->ISR;
+
+    if (isr & DMA_ISR_TEIF6) {
+        stop();
+        recover();
+        finish(Status::BUS_ERROR);
+    } else if (isr & DMA_ISR_TCIF6) {
+        DMA1->IFCR = DMA_IFCR_CGIF6;
+        DMA1_Channel6->CCR = 0;
+        I2C1->CR2 |= I2C_CR2_ITEVTEN;
+    }
+}
+#endif
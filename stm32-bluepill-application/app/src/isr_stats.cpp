@@ -0,0 +1,135 @@
+#include "isr_stats.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "nvic.hpp"
+#include "token_log.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+IsrStats::Stats IsrStats::g_stats[IsrStats::ID_COUNT];
+
+const char *const IsrStats::g_names[IsrStats::ID_COUNT] = {
+    "SysTick",
+    "DMA1_Channel1",
+    "DMA1_Channel2",
+    "DMA1_Channel3",
+    "DMA1_Channel4",
+    "DMA1_Channel5",
+    "DMA1_Channel6",
+    "DMA1_Channel7",
+    "USB_HP_CAN1_TX",
+    "USB_LP_CAN1_RX0",
+    "CAN1_RX1",
+    "I2C1_EV",
+    "I2C1_ER",
+    "USART1",
+};
+
+#if defined(APP_ISR_STATS)
+volatile uint32_t IsrStats::Detail::g_depth;
+volatile uint32_t IsrStats::Detail::g_nested;
+
+namespace IsrStats {
+
+    /* histogram bin of an execution time */
+    static uint32_t bin(uint32_t cycles);
+}
+#endif
+
+void IsrStats::reset(void)
+{
+    Nvic::CriticalSection cs;
+
+    for (uint32_t i = 0; i < ID_COUNT; ++i) {
+        Stats &stats = g_stats[i];
+
+        stats.count        = 0;
+        stats.last_entry   = 0;
+        stats.min_cycles   = 0;
+        stats.max_cycles   = 0;
+        stats.total_cycles = 0;
+        stats.max_latency  = 0;
+        stats.max_nesting  = 0;
+        for (uint32_t b = 0; b < HIST_BINS; ++b) {
+            stats.histogram[b] = 0;
+        }
+    }
+}
+
+void IsrStats::dump(void)
+{
+    for (uint32_t i = 0; i < ID_COUNT; ++i) {
+        const Stats    &stats = g_stats[i];
+        const char     *name  = g_names[i];
+        const uint32_t  count = stats.count;
+        const uint32_t  mean  = (count == 0) ? 0 : static_cast<uint32_t>(stats.total_cycles / count);
+
+        TLOG("isr %s: count %u min %u mean %u max %u latency %u nesting %u",
+             name, count, stats.min_cycles, mean, stats.max_cycles,
+             stats.max_latency, stats.max_nesting);
+        TLOG("isr %s: histogram %u %u %u %u %u %u %u %u %u %u %u %u",
+             name,
+             stats.histogram[0], stats.histogram[1], stats.histogram[2],
+             stats.histogram[3], stats.histogram[4], stats.histogram[5],
+             stats.histogram[6], stats.histogram[7], stats.histogram[8],
+             stats.histogram[9], stats.histogram[10], stats.histogram[11]);
+    }
+    static_assert(HIST_BINS == 12, "update the histogram record");
+}
+
+#if defined(APP_ISR_STATS)
+uint32_t IsrStats::bin(uint32_t cycles)
+{
+    const uint32_t index = 32 - __CLZ(cycles >> 4);
+    return (index < HIST_BINS) ? index : HIST_BINS - 1;
+}
+
+void IsrStats::Detail::record(Id id, uint32_t entry, uint32_t nested)
+{
+    /*
+     * Handlers that preempted this one have added their (inclusive) time to
+     * g_nested. Subtract it to get this handler's own time, then replace it
+     * by this handler's inclusive time for the benefit of the handler this
+     * one preempted (if any). Nested handlers have all returned, so the
+     * depth is the one on entry.
+     *
+     * A handler preempting between the cycle counter sample and the update
+     * of g_nested would break the sum (its time counted as inner but not
+     * elapsed, so self wraps), so this part runs with PRIMASK set.
+     */
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    const uint32_t elapsed = DWT->CYCCNT - entry;
+    const uint32_t inner   = g_nested - nested;
+    g_nested = nested + elapsed;
+
+    const uint32_t depth = g_depth;
+    g_depth = depth - 1;
+
+    __set_PRIMASK(primask);
+
+    const uint32_t self = elapsed - inner;
+    Stats &stats = g_stats[static_cast<uint32_t>(id)];
+
+    if (stats.count == 0 || self < stats.min_cycles) stats.min_cycles = self;
+    if (self > stats.max_cycles) stats.max_cycles = self;
+    if (depth > stats.max_nesting) stats.max_nesting = depth;
+
+    stats.total_cycles = stats.total_cycles + self;
+    const uint32_t slot = bin(self);
+    stats.histogram[slot] = stats.histogram[slot] + 1;
+    stats.last_entry = entry;
+    stats.count = stats.count + 1;
+}
+
+void IsrStats::Detail::latency(Id id, uint32_t cycles)
+{
+    Stats &stats = g_stats[static_cast<uint32_t>(id)];
+    if (cycles > stats.max_latency) stats.max_latency = cycles;
+}
+#endif
@@ -0,0 +1,372 @@
+#include "kernel.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+#include "stack_monitor.hpp"
+#include "timebase.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+namespace Kernel {
+
+    class Scheduler {
+
+        public:
+            static void init(Task &task, Entry entry, void *arg,
+                             uint32_t *stack, uint32_t stack_words, uint32_t priority);
+            static void makeReady(Task &task);
+            static void removeHead(uint32_t priority);
+            static void rotate(uint32_t priority);
+            static void wakeSleepers(void);
+            static bool needSwitch(void);
+            static Task *highest(void);
+            static void block(uint32_t wake);
+            static uint32_t currentPriority(void);
+            static uint32_t stackUsed(const Task &task);
+
+            /* ready queue heads and tails, one per priority */
+            static Task *sHead[PRIORITIES];
+            static Task *sTail[PRIORITIES];
+
+            /* bit n set while the priority n ready queue is non-empty */
+            static uint32_t sReady;
+
+            /* singly linked list of sleeping tasks */
+            static Task *sSleeping;
+
+            /* kernel tick count */
+            static volatile uint32_t sTicks;
+
+            /* set once start() is called */
+            static volatile bool sRunning;
+    };
+
+    Task             *Scheduler::sHead[PRIORITIES];
+    Task             *Scheduler::sTail[PRIORITIES];
+    uint32_t          Scheduler::sReady;
+    Task             *Scheduler::sSleeping;
+    volatile uint32_t Scheduler::sTicks;
+    volatile bool     Scheduler::sRunning;
+
+    /* idle task storage */
+    static Task     g_idle_task;
+    static uint32_t g_idle_stack[MIN_STACK_WORDS];
+
+    /* request a context switch on exception return */
+    static inline void pendSwitch(void)
+    {
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+    }
+
+    static void idle(void *arg);
+    static void taskExit(void);
+}
+
+extern "C" {
+    /* task currently owning the CPU (accessed from the PendSV handler) */
+    Kernel::Task *g_kernel_current = nullptr;
+
+    /* select the next task to run and return it (called from PendSV) */
+    Kernel::Task *kernelSelect(void);
+
+    void kernelPendSv(void);
+}
+
+void Kernel::Scheduler::init(Task &task, Entry entry, void *arg,
+                             uint32_t *stack, uint32_t stack_words, uint32_t priority)
+{
+    StackMonitor::paint(stack, stack_words);
+
+    /*
+     * The AAPCS requires an 8 byte aligned stack at public interfaces, so the
+     * top of the stack is rounded down before building the initial frame.
+     */
+    uint32_t *sp = reinterpret_cast<uint32_t *>(
+        reinterpret_cast<uintptr_t>(stack + stack_words) & ~static_cast<uintptr_t>(7));
+
+    /*
+     * Build the frame the PendSV handler expects to restore. The hardware
+     * frame (xPSR, PC, LR, R12, R3-R0) is unstacked on exception return, the
+     * software frame (R11-R4) is popped by the handler itself. The entry
+     * argument is passed in R0 and a return from the entry function lands in
+     * taskExit.
+     */
+    *(--sp) = 0x01000000;                                     /* xPSR (Thumb) */
+    *(--sp) = reinterpret_cast<uintptr_t>(entry) & ~1UL;      /* PC           */
+    *(--sp) = reinterpret_cast<uintptr_t>(&taskExit);         /* LR           */
+    *(--sp) = 0;                                              /* R12          */
+    *(--sp) = 0;                                              /* R3           */
+    *(--sp) = 0;                                              /* R2           */
+    *(--sp) = 0;                                              /* R1           */
+    *(--sp) = reinterpret_cast<uintptr_t>(arg);               /* R0           */
+    for (uint32_t reg = 0; reg < 8; ++reg) {
+        *(--sp) = 0;                                          /* R11-R4       */
+    }
+
+    task.mSp       = sp;
+    task.mNext     = nullptr;
+    task.mPriority = (priority < PRIORITIES) ? priority : PRIORITIES - 1;
+    task.mWake     = 0;
+
+    task.mStack      = stack;
+    task.mStackWords = stack_words;
+}
+
+void Kernel::Scheduler::makeReady(Task &task)
+{
+    const uint32_t prio = task.mPriority;
+
+    task.mNext = nullptr;
+    if (sHead[prio] == nullptr) {
+        sHead[prio] = &task;
+    } else {
+        sTail[prio]->mNext = &task;
+    }
+    sTail[prio] = &task;
+    sReady |= (1UL << prio);
+}
+
+void Kernel::Scheduler::removeHead(uint32_t priority)
+{
+    Task *head = sHead[priority];
+    if (head == nullptr) return;
+
+    sHead[priority] = head->mNext;
+    head->mNext     = nullptr;
+    if (sHead[priority] == nullptr) {
+        sTail[priority] = nullptr;
+        sReady &= ~(1UL << priority);
+    }
+}
+
+void Kernel::Scheduler::rotate(uint32_t priority)
+{
+    Task *head = sHead[priority];
+    if (head == nullptr || head->mNext == nullptr) return;
+
+    removeHead(priority);
+    makeReady(*head);
+}
+
+void Kernel::Scheduler::wakeSleepers(void)
+{
+    Task **link = &sSleeping;
+    while (*link != nullptr) {
+        Task &task = **link;
+        if (static_cast<int32_t>(sTicks - task.mWake) >= 0) {
+            *link = task.mNext;
+            makeReady(task);
+        } else {
+            link = &task.mNext;
+        }
+    }
+}
+
+Kernel::Task *Kernel::Scheduler::highest(void)
+{
+    /*
+     * The idle task is always ready, so the bitmap is never empty and the
+     * count leading zeros result is always valid.
+     */
+    const uint32_t top = (PRIORITIES - 1) - __CLZ(sReady);
+    return sHead[top];
+}
+
+uint32_t Kernel::Scheduler::currentPriority(void)
+{
+    return g_kernel_current->mPriority;
+}
+
+uint32_t Kernel::Scheduler::stackUsed(const Task &task)
+{
+    return StackMonitor::used(task.mStack, task.mStackWords);
+}
+
+bool Kernel::Scheduler::needSwitch(void)
+{
+    return highest() != g_kernel_current;
+}
+
+void Kernel::Scheduler::block(uint32_t wake)
+{
+    Task &self = *g_kernel_current;
+
+    /* A running task is always the head of its ready queue. */
+    removeHead(self.mPriority);
+    self.mWake = wake;
+    self.mNext = sSleeping;
+    sSleeping  = &self;
+}
+
+void Kernel::createTask(Task &task, Entry entry, void *arg,
+                        uint32_t *stack, uint32_t stack_words, uint32_t priority)
+{
+    Scheduler::init(task, entry, arg, stack, stack_words, priority);
+
+    Nvic::CriticalSection cs;
+    Scheduler::makeReady(task);
+    if (Scheduler::sRunning && Scheduler::needSwitch()) {
+        pendSwitch();
+    }
+}
+
+void Kernel::start(void)
+{
+    createTask(g_idle_task, idle, nullptr, g_idle_stack, MIN_STACK_WORDS, IDLE_PRIORITY);
+
+    /*
+     * PendSV must be the lowest priority exception so a context switch is
+     * only ever performed when returning to thread mode. The SysTick shares
+     * that priority so it never preempts a switch in progress. Both are
+     * checked in the priority plan, which also puts them below the critical
+     * section threshold, so no switch happens inside a critical section.
+     */
+    NVIC_SetPriority(PendSV_IRQn, Nvic::Priority<PendSV_IRQn>::VALUE);
+
+    /*
+     * The first PendSV finds no current task, so it skips the context save
+     * and switches thread mode over to the process stack of the highest
+     * priority task. It runs as soon as the critical section ends. The main
+     * stack is only used by exceptions from here on.
+     */
+    {
+        Nvic::CriticalSection cs;
+        g_kernel_current     = nullptr;
+        Scheduler::sRunning  = true;
+        SysTick->CTRL       |= SysTick_CTRL_ENABLE_Msk;
+        pendSwitch();
+    }
+
+    while (1) { }
+}
+
+bool Kernel::running(void)
+{
+    return Scheduler::sRunning;
+}
+
+void Kernel::yield(void)
+{
+    /* Before start() there is no current task and nothing to yield to. */
+    if (!Scheduler::sRunning) return;
+
+    Nvic::CriticalSection cs;
+    Scheduler::rotate(Scheduler::currentPriority());
+    if (Scheduler::needSwitch()) {
+        pendSwitch();
+    }
+}
+
+void Kernel::sleep(uint32_t count)
+{
+    /*
+     * Init code runs before start() without a task to block. Kernel ticks
+     * are SysTick ticks, so it sleeps on the millisecond count instead.
+     */
+    static_assert(Bsp::Components::Clock::TICK_FREQ_HZ == 1000, "kernel ticks are milliseconds");
+    if (!Scheduler::sRunning) {
+        Timebase::sleepUntil(Timebase::millis() + count);
+        return;
+    }
+
+    Nvic::CriticalSection cs;
+    Scheduler::block(Scheduler::sTicks + count);
+    pendSwitch();
+}
+
+uint32_t Kernel::ticks(void)
+{
+    return Scheduler::sTicks;
+}
+
+void Kernel::tick(void)
+{
+    if (!Scheduler::sRunning) return;
+
+    /*
+     * The SysTick and PendSV share the lowest priority, so the scheduler
+     * state cannot change under this handler except from thread code, which
+     * always uses a critical section while touching it.
+     */
+    Scheduler::sTicks = Scheduler::sTicks + 1;
+    Scheduler::wakeSleepers();
+
+    /* Time slice: move the running task behind its equal priority peers. */
+    if (g_kernel_current != nullptr) {
+        Scheduler::rotate(Scheduler::currentPriority());
+    }
+
+    if (Scheduler::needSwitch()) {
+        pendSwitch();
+    }
+}
+
+uint32_t Kernel::stackHighWater(const Task &task)
+{
+    return Scheduler::stackUsed(task);
+}
+
+void Kernel::idle(void *arg)
+{
+    while (1) {
+        __WFI();
+    }
+}
+
+void Kernel::taskExit(void)
+{
+    /* A task that returns from its entry function is retired for good. */
+    {
+        Nvic::CriticalSection cs;
+        Scheduler::removeHead(Scheduler::currentPriority());
+        pendSwitch();
+    }
+
+    while (1) { }
+}
+
+extern "C" Kernel::Task *kernelSelect(void)
+{
+    g_kernel_current = Kernel::Scheduler::highest();
+    return g_kernel_current;
+}
+
+/*
+ * Context switch. Entered by a tail branch from PendSV_Handler with the
+ * EXC_RETURN value still in LR.
+ *
+ *  1. If a task is running, push R4-R11 onto its process stack and save the
+ *     resulting stack pointer in its control block.
+ *  2. Pick the highest priority ready task.
+ *  3. Pop R4-R11 from the new task's stack and point PSP at the hardware
+ *     frame, which is unstacked on exception return.
+ *
+ * Bit 2 of EXC_RETURN is forced so the return always uses the process stack,
+ * which also moves thread mode from MSP to PSP on the very first switch.
+ */
+extern "C" __attribute__((naked)) void kernelPendSv(void)
+{
+    __asm volatile (
+        "   mrs     r0, psp                 \n"
+        "   ldr     r3, =g_kernel_current   \n"
+        "   ldr     r2, [r3]                \n"
+        "   cbz     r2, 1f                  \n"
+        "   stmdb   r0!, {r4-r11}           \n"
+        "   str     r0, [r2]                \n"
+        "1:                                 \n"
+        "   push    {r3, lr}                \n"
+        "   bl      kernelSelect            \n"
+        "   pop     {r3, lr}                \n"
+        "   ldr     r0, [r0]                \n"
+        "   ldmia   r0!, {r4-r11}           \n"
+        "   msr     psp, r0                 \n"
+        "   orr     lr, lr, #4              \n"
+        "   bx      lr                      \n"
+        "   .ltorg                          \n"
+    );
+}
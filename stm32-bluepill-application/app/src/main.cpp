@@ -5,11 +5,22 @@
 // STM32 HAL
 #include "stm32f1xx_hal.h"
 
+// APP
+#include "can_bus.hpp"
+#include "usb_cdc.hpp"
+
 #else
 
 // APP
+#include "bench.hpp"
 #include "bsp.hpp"
-#include "led.hpp"
+#include "can_bus.hpp"
+#include "flash_kv.hpp"
+#include "isr_stats.hpp"
+#include "soft_timer.hpp"
+#include "token_log.hpp"
+#include "uart_rx.hpp"
+#include "usb_cdc.hpp"
 
 // CMSIS
 #include "stm32f1xx.h"
@@ -21,6 +32,30 @@ static constexpr uint32_t LED_Pin = GPIO_PIN_13;
 static GPIO_TypeDef *LED_GPIO_Port = GPIOC;
 static void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+#else
+static constexpr uint32_t LED_PERIOD_MS = 500;
+static constexpr uint32_t KV_MAINTAIN_PERIOD_MS = 100;
+static void toggleLed(void *arg);
+static void maintainKv(void *arg);
+static constexpr uint32_t CONSOLE_REPORT_PERIOD_MS = 1000;
+static uint32_t g_console_bytes;
+static void countBoot(void);
+static void serviceConsole(void);
+static void reportConsole(void *arg);
+#if defined(APP_USB_STREAM)
+static void streamUsb(void);
+#endif
+#if defined(APP_CAN)
+static constexpr uint32_t CAN_NODE_ID = 0x10;
+static constexpr uint32_t CAN_HEARTBEAT_PERIOD_MS = 1000;
+static uint32_t g_can_frames;
+static void serviceCan(void);
+static void canHeartbeat(void *arg);
+#endif
+#if defined(APP_ISR_STATS)
+static constexpr uint32_t ISR_STATS_PERIOD_MS = 5000;
+static void dumpIsrStats(void *arg);
+#endif
 #endif
 
 int main(void)
@@ -30,21 +65,59 @@ int main(void)
     HAL_Init();
     SystemClock_Config();
     MX_GPIO_Init();
+#if defined(APP_CAN)
+    CanBus::init();
+#else
+    UsbCdc::init();
+#endif
 #else
     Bsp::init();
-    Led led(Bsp::Components::Led::port, Bsp::Components::Led::pin);
+    FlashKv::init();
+    countBoot();
+#if defined(APP_CAN)
+    if (!CanBus::init()) {
+        TLOG("CAN did not join the bus");
+    }
+#else
+    UsbCdc::init();
+#endif
+    TLOG("blinky started, LED period %u ms", LED_PERIOD_MS);
+#if defined(APP_BENCH)
+    Bench::run();
+#endif
+    SoftTimer::Timer led_timer(toggleLed, nullptr);
+    led_timer.arm(LED_PERIOD_MS, LED_PERIOD_MS);
+    SoftTimer::Timer kv_timer(maintainKv, nullptr);
+    kv_timer.arm(KV_MAINTAIN_PERIOD_MS, KV_MAINTAIN_PERIOD_MS);
+    SoftTimer::Timer console_timer(reportConsole, nullptr);
+    console_timer.arm(CONSOLE_REPORT_PERIOD_MS, CONSOLE_REPORT_PERIOD_MS);
+#if defined(APP_CAN)
+    SoftTimer::Timer can_timer(canHeartbeat, nullptr);
+    can_timer.arm(CAN_HEARTBEAT_PERIOD_MS, CAN_HEARTBEAT_PERIOD_MS);
+#endif
+#if defined(APP_ISR_STATS)
+    SoftTimer::Timer stats_timer(dumpIsrStats, nullptr);
+    stats_timer.arm(ISR_STATS_PERIOD_MS, ISR_STATS_PERIOD_MS);
+#endif
 #endif
     
     /* Main loop */
     while (1) {
 
-        /* Toggle the LED */
+        /* Toggle the LED (from a soft timer in the non-HAL build) */
 #if defined(USE_HAL_DRIVER)
         HAL_GPIO_TogglePin(LED_GPIO_Port, LED_Pin);
         HAL_Delay(500);
 #else
-        led.toggle();
-        Bsp::Util::delay(500);
+#if defined(APP_USB_STREAM)
+        streamUsb();
+#endif
+#if defined(APP_CAN)
+        serviceCan();
+#endif
+        serviceConsole();
+        SoftTimer::dispatch();
+        __WFI();
 #endif
     }
 
@@ -105,3 +178,122 @@ static void MX_GPIO_Init(void)
     HAL_GPIO_Init(LED_GPIO_Port, &GPIO_InitStruct);
 }
 #endif
+
+#if !defined(USE_HAL_DRIVER)
+static void toggleLed(void *arg)
+{
+    Bsp::Components::Led::Pin::toggle();
+}
+
+/* one bounded compaction step, a page erase stalls the CPU for about 20 ms */
+static void maintainKv(void *arg)
+{
+    FlashKv::maintain();
+}
+
+static void countBoot(void)
+{
+    uint32_t boots = 0;
+    FlashKv::store().read(FlashKv::BOOT_COUNT, &boots, sizeof(boots));
+    ++boots;
+    if (!FlashKv::store().set(FlashKv::BOOT_COUNT, &boots, sizeof(boots))) {
+        TLOG("boot count not stored");
+    }
+    TLOG("boot %u", boots);
+}
+
+/*
+ * Take the received console bytes in place. The USART interrupts wake the
+ * main loop at the end of every burst, so this is where a command parser
+ * would look at them.
+ */
+static void serviceConsole(void)
+{
+    for (;;) {
+        const ring::Span<const uint8_t> span = UartRx::readSpan();
+        if (span.empty()) return;
+
+        if (UartRx::release(span.size)) {
+            g_console_bytes += span.size;
+        }
+    }
+}
+
+/* console receive counters, only while something arrives */
+static void reportConsole(void *arg)
+{
+    static uint32_t reported;
+
+    if (g_console_bytes == reported) return;
+    reported = g_console_bytes;
+
+    TLOG("console rx %u bytes, %u overruns, %u errors",
+         g_console_bytes, UartRx::overruns(), UartRx::errors());
+}
+
+#if defined(APP_USB_STREAM)
+/*
+ * Keep the USB TX ring full of a counting pattern (consecutive little endian
+ * 32 bit words) while a terminal has the port open. The host side checks it
+ * with template_program --cdc. Every USB interrupt wakes the main loop, so
+ * the ring is topped up once per packet.
+ */
+static void streamUsb(void)
+{
+    static uint32_t counter;
+
+    if (!UsbCdc::connected()) return;
+
+    for (;;) {
+        const ring::Span<uint8_t> span  = UsbCdc::writeSpan();
+        const uint32_t            words = span.size / 4;
+        if (words == 0) return;
+
+        for (uint32_t i = 0; i < words; ++i) {
+            span.data[4 * i + 0] = static_cast<uint8_t>(counter);
+            span.data[4 * i + 1] = static_cast<uint8_t>(counter >> 8);
+            span.data[4 * i + 2] = static_cast<uint8_t>(counter >> 16);
+            span.data[4 * i + 3] = static_cast<uint8_t>(counter >> 24);
+            ++counter;
+        }
+        UsbCdc::commit(4 * words);
+    }
+}
+#endif
+
+#if defined(APP_CAN)
+/*
+ * Empty the receive queues. Every CAN interrupt wakes the main loop, so a
+ * queue holds at most the frames of one pass.
+ */
+static void serviceCan(void)
+{
+    CanBus::Frame frame;
+
+    for (uint32_t filter = 0; filter < CanBus::FILTER_COUNT; ++filter) {
+        while (CanBus::receive(filter, frame)) {
+            ++g_can_frames;
+        }
+    }
+}
+
+/* CANopen heartbeat (state operational) and receive counters */
+static void canHeartbeat(void *arg)
+{
+    CanBus::Frame heartbeat = CanBus::Frame();
+    heartbeat.id      = 0x700 + CAN_NODE_ID;
+    heartbeat.length  = 1;
+    heartbeat.data[0] = 0x05;
+    CanBus::send(heartbeat);
+
+    TLOG("can rx %u frames, %u dropped", g_can_frames, CanBus::dropped());
+}
+#endif
+
+#if defined(APP_ISR_STATS)
+static void dumpIsrStats(void *arg)
+{
+    IsrStats::dump();
+}
+#endif
+#endif
@@ -0,0 +1,26 @@
+#include "nvic.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+void Nvic::init(void)
+{
+    /*
+     * Give all priority bits to the preemption (group) priority. PRIGROUP is
+     * bits [10:8] and the register only updates with the key 0x05FA in the
+     * upper 16 bits. See section 4.4.5 of the programming manual.
+     */
+    SCB->AIRCR = (0x05FA << 16) | (0x3 << 8);
+
+    /*
+     * Peripheral interrupts get their priority again when a driver enables
+     * them, but setting everything here leaves no interrupt at the default
+     * priority 0, which is above MASK_LEVEL.
+     */
+    for (uint32_t i = 0; i < PLAN_SIZE; ++i) {
+        NVIC_SetPriority(PLAN[i].irq, PLAN[i].priority);
+    }
+}
@@ -0,0 +1,311 @@
+#include "pool.hpp"
+
+// STANDARD LIBRARY
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// CMSIS
+#include "stm32f1xx.h"
+
+Pool::Stats Pool::g_stats[Pool::CLASS_COUNT];
+
+namespace Pool {
+
+    struct Block {
+        Block *next;
+    };
+
+    struct SizeClass {
+        /* head of the free list */
+        volatile uint32_t head;
+
+        /* address range of the class' blocks */
+        uintptr_t begin;
+        uintptr_t end;
+    };
+
+    static constexpr uint32_t totalBytes(uint32_t index = 0)
+    {
+        return (index == CLASS_COUNT) ? 0 :
+               CLASSES[index].block_size * CLASSES[index].blocks + totalBytes(index + 1);
+    }
+
+    static constexpr bool validClasses(uint32_t index = 0)
+    {
+        return (index == CLASS_COUNT) ||
+               ((CLASSES[index].block_size % 8) == 0 &&
+                CLASSES[index].block_size >= sizeof(Block) &&
+                (index == 0 || CLASSES[index - 1].block_size < CLASSES[index].block_size) &&
+                validClasses(index + 1));
+    }
+
+    static_assert(validClasses(), "pool block sizes must be ascending multiples of 8");
+
+    /* bytes of the .pool region used by the size classes */
+    static constexpr uint32_t TOTAL_BYTES = totalBytes();
+
+    /*
+     * Storage of all classes. The linker script collects it in the .pool
+     * region and fails the link if it outgrows _Pool_Size.
+     */
+    static uint8_t g_region[TOTAL_BYTES] __attribute__((section(".pool"), aligned(8)));
+
+    static SizeClass g_classes[CLASS_COUNT];
+
+    static Block *pop(SizeClass &cls);
+    static void push(SizeClass &cls, Block *block);
+    static void atomicAdd(volatile uint32_t *value, int32_t delta, volatile uint32_t *high_water);
+    static int32_t classOf(const void *ptr);
+}
+
+void Pool::init(void)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(g_region);
+    for (uint32_t i = 0; i < CLASS_COUNT; ++i) {
+        SizeClass &cls = g_classes[i];
+        const uint32_t size = CLASSES[i].block_size;
+
+        cls.begin = addr;
+        cls.end   = addr + size * CLASSES[i].blocks;
+        cls.head  = 0;
+
+        /* Push the blocks in reverse so the lowest address is handed out first. */
+        for (uintptr_t block = cls.end; block > cls.begin; ) {
+            block -= size;
+            push(cls, reinterpret_cast<Block *>(block));
+        }
+
+        g_stats[i].block_size = size;
+        g_stats[i].blocks     = CLASSES[i].blocks;
+        g_stats[i].used       = 0;
+        g_stats[i].high_water = 0;
+        g_stats[i].failures   = 0;
+
+        addr = cls.end;
+    }
+}
+
+void *Pool::alloc(size_t size)
+{
+    for (uint32_t i = 0; i < CLASS_COUNT; ++i) {
+        if (size > CLASSES[i].block_size) continue;
+
+        Block *block = pop(g_classes[i]);
+        if (block != nullptr) {
+            atomicAdd(&g_stats[i].used, 1, &g_stats[i].high_water);
+            return block;
+        }
+        atomicAdd(&g_stats[i].failures, 1, nullptr);
+    }
+    return nullptr;
+}
+
+void Pool::free(void *ptr)
+{
+    const int32_t index = classOf(ptr);
+    if (index < 0) return;
+
+    push(g_classes[index], static_cast<Block *>(ptr));
+    atomicAdd(&g_stats[index].used, -1, nullptr);
+}
+
+size_t Pool::blockSize(const void *ptr)
+{
+    const int32_t index = classOf(ptr);
+    return (index < 0) ? 0 : CLASSES[index].block_size;
+}
+
+bool Pool::verify(void)
+{
+    for (uint32_t i = 0; i < CLASS_COUNT; ++i) {
+        const SizeClass &cls  = g_classes[i];
+        const uint32_t   size = CLASSES[i].block_size;
+
+        uint32_t free_count = 0;
+        for (uintptr_t addr = cls.head; addr != 0;
+             addr = reinterpret_cast<uintptr_t>(reinterpret_cast<Block *>(addr)->next)) {
+            if (addr < cls.begin || addr >= cls.end || ((addr - cls.begin) % size) != 0) {
+                return false;
+            }
+            if (++free_count > CLASSES[i].blocks) {
+                return false;
+            }
+        }
+
+        if (free_count + g_stats[i].used != CLASSES[i].blocks) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Pop the head of a free list. The exclusive monitor is cleared by every
+ * exception entry and return, so the store fails (and the pop is retried) if
+ * an interrupt touched the list between the LDREX and the STREX. That also
+ * rules out the ABA problem: the head cannot be popped and pushed back
+ * unnoticed.
+ */
+Pool::Block *Pool::pop(SizeClass &cls)
+{
+    Block *head = nullptr;
+    do {
+        head = reinterpret_cast<Block *>(static_cast<uintptr_t>(__LDREXW(&cls.head)));
+        if (head == nullptr) {
+            __CLREX();
+            return nullptr;
+        }
+    } while (__STREXW(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(head->next)), &cls.head) != 0);
+
+    return head;
+}
+
+void Pool::push(SizeClass &cls, Block *block)
+{
+    do {
+        block->next = reinterpret_cast<Block *>(static_cast<uintptr_t>(__LDREXW(&cls.head)));
+    } while (__STREXW(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(block)), &cls.head) != 0);
+}
+
+/* add delta to value and raise high_water (if given) to the new value */
+void Pool::atomicAdd(volatile uint32_t *value, int32_t delta, volatile uint32_t *high_water)
+{
+    uint32_t updated = 0;
+    do {
+        updated = __LDREXW(value) + delta;
+    } while (__STREXW(updated, value) != 0);
+
+    if (high_water == nullptr) return;
+
+    uint32_t seen = 0;
+    do {
+        seen = __LDREXW(high_water);
+        if (seen >= updated) {
+            __CLREX();
+            return;
+        }
+    } while (__STREXW(updated, high_water) != 0);
+}
+
+/* index of the class a block belongs to, -1 if it is not a pool block */
+int32_t Pool::classOf(const void *ptr)
+{
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    for (uint32_t i = 0; i < CLASS_COUNT; ++i) {
+        if (addr >= g_classes[i].begin && addr < g_classes[i].end) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Global operator new and delete. The application is built without
+ * exceptions, so running out of blocks stops at a breakpoint instead of
+ * throwing std::bad_alloc. The nothrow versions return nullptr.
+ */
+void *operator new(size_t size)
+{
+    void *ptr = Pool::alloc(size);
+    if (ptr == nullptr) {
+        __BKPT(0);
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return Pool::alloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return Pool::alloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    Pool::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    Pool::free(ptr);
+}
+
+/*
+ * malloc and friends. The Makefile links with --wrap for these symbols
+ * (and the reentrant _r versions newlib uses internally), so every C
+ * allocation lands here instead of in newlib's first-fit heap.
+ */
+extern "C" {
+
+    void *__wrap_malloc(size_t size)
+    {
+        return Pool::alloc(size);
+    }
+
+    void __wrap_free(void *ptr)
+    {
+        Pool::free(ptr);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        const size_t total = count * size;
+        if (size != 0 && total / size != count) return nullptr;
+
+        void *ptr = Pool::alloc(total);
+        if (ptr != nullptr) {
+            memset(ptr, 0, total);
+        }
+        return ptr;
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        if (ptr == nullptr) return Pool::alloc(size);
+        if (size == 0) {
+            Pool::free(ptr);
+            return nullptr;
+        }
+
+        /* The block may already be big enough. */
+        const size_t old_size = Pool::blockSize(ptr);
+        if (size <= old_size) return ptr;
+
+        void *moved = Pool::alloc(size);
+        if (moved != nullptr) {
+            memcpy(moved, ptr, old_size);
+            Pool::free(ptr);
+        }
+        return moved;
+    }
+
+    void *__wrap__malloc_r(struct _reent *, size_t size)
+    {
+        return __wrap_malloc(size);
+    }
+
+    void __wrap__free_r(struct _reent *, void *ptr)
+    {
+        __wrap_free(ptr);
+    }
+
+    void *__wrap__calloc_r(struct _reent *, size_t count, size_t size)
+    {
+        return __wrap_calloc(count, size);
+    }
+
+    void *__wrap__realloc_r(struct _reent *, void *ptr, size_t size)
+    {
+        return __wrap_realloc(ptr, size);
+    }
+}
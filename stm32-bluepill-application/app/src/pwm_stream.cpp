@@ -0,0 +1,427 @@
+#include "pwm_stream.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+#include "spi_bus.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+#include "gpio.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace PwmStream {
+
+    /* active configuration */
+    static Config g_config;
+
+    /* TIM2 prescaler and auto reload values */
+    static uint32_t g_prescaler;
+    static uint32_t g_reload;
+
+    static volatile bool     g_running;
+    static volatile uint32_t g_underruns;
+
+    static bool valid(const Config &config);
+    static uint32_t transfers(void);
+    static void deliver(uint32_t block);
+    static void finish(void);
+    static void startHardware(void);
+    static void stopHardware(void);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace PwmStream {
+    static DMA_HandleTypeDef g_hdma;
+    static TIM_HandleTypeDef g_htim;
+
+    static uint32_t halChannel(uint32_t channel);
+}
+#endif
+
+bool PwmStream::start(const Config &config)
+{
+    stop();
+
+    /*
+     * Claim DMA1 channel 2 in one go: SpiBus::submit() refuses SPI1 work
+     * from the moment the stream runs, so none can sneak in after the
+     * idle check in valid().
+     */
+    {
+        Nvic::CriticalSection cs;
+        if (!valid(config)) return false;
+        g_running = true;
+    }
+
+    /*
+     * The timer counts at the APB1 timer clock. Pick the smallest prescaler
+     * that lets the period fit in the 16 bit auto reload register, which
+     * keeps the duty cycle resolution as fine as possible.
+     */
+    const uint32_t ticks = Bsp::Components::Clock::TIM_APB1_FREQ_HZ / config.period_hz;
+    g_prescaler = (ticks - 1) / 0x10000;
+    g_reload    = ticks / (g_prescaler + 1) - 1;
+
+    g_config    = config;
+    g_underruns = 0;
+
+    startHardware();
+    return true;
+}
+
+/*
+ * The shared DMA1 channel 2 interrupt goes to SpiBus once running() is
+ * false, so the channel has to be quiet by then.
+ */
+void PwmStream::stop(void)
+{
+    if (!g_running) return;
+
+    Nvic::CriticalSection cs;
+    stopHardware();
+    NVIC_ClearPendingIRQ(DMA1_Channel2_IRQn);
+    g_running = false;
+}
+
+bool PwmStream::running(void)
+{
+    return g_running;
+}
+
+uint32_t PwmStream::top(void)
+{
+    return g_reload + 1;
+}
+
+uint32_t PwmStream::rate(void)
+{
+    return Bsp::Components::Clock::TIM_APB1_FREQ_HZ / ((g_prescaler + 1) * (g_reload + 1));
+}
+
+uint32_t PwmStream::underruns(void)
+{
+    return g_underruns;
+}
+
+/*
+ * The HAL serves the half and the full transfer flag one at a time, so a
+ * late interrupt is caught by deliver() there.
+ */
+void PwmStream::isr(void)
+{
+#if defined(USE_HAL_DRIVER)
+    HAL_DMA_IRQHandler(&g_hdma);
+#else
+    /*
+     * Both the half and the full transfer flag pending means a whole block
+     * went by without this interrupt being served: the older block has
+     * been sent again.
+     */
+    const uint32_t flags = DMA1->ISR;
+    if (g_config.repeat &&
+        (flags & (DMA_ISR_HTIF2 | DMA_ISR_TCIF2)) == (DMA_ISR_HTIF2 | DMA_ISR_TCIF2)) {
+        g_underruns = g_underruns + 1;
+    }
+
+    DMA1->IFCR = DMA_IFCR_CGIF2;
+
+    /* A transfer error disables the channel, there is nothing to recover. */
+    if (flags & DMA_ISR_TEIF2) {
+        stop();
+        return;
+    }
+
+    if (flags & DMA_ISR_TCIF2) {
+        if (g_config.repeat) {
+            deliver(1);
+        } else {
+            finish();
+        }
+    } else if (flags & DMA_ISR_HTIF2) {
+        deliver(0);
+    }
+#endif
+}
+
+bool PwmStream::valid(const Config &config)
+{
+    if (config.buffer == nullptr || config.frames_per_block == 0) return false;
+    if (config.repeat && config.callback == nullptr) return false;
+
+    /* The burst writes adjacent CCR registers. */
+    if (config.first_channel == 0 || config.channel_count == 0 ||
+        config.first_channel + config.channel_count - 1 > MAX_CHANNELS) {
+        return false;
+    }
+
+    /* The DMA transfer counter is 16 bits wide. */
+    if (2 * config.frames_per_block * config.channel_count > 0xFFFF) return false;
+
+    /* The timer needs at least two ticks per period. */
+    if (config.period_hz == 0 || config.period_hz > Bsp::Components::Clock::TIM_APB1_FREQ_HZ / 2) return false;
+
+    /* The burst must complete before the next update event. */
+    if (Bsp::Components::Clock::HCLK_FREQ_HZ / config.period_hz <
+        BURST_CYCLES_PER_CHANNEL * config.channel_count) {
+        return false;
+    }
+
+    /* DMA1 channel 2 is SPI1's receive channel. */
+    return SpiBus::idle(SpiBus::Bus::SPI1_BUS);
+}
+
+/* DMA transfers for both blocks (half words) */
+uint32_t PwmStream::transfers(void)
+{
+    return 2 * g_config.frames_per_block * g_config.channel_count;
+}
+
+/*
+ * The flag of the other half is raised when the DMA moves on into the block
+ * being refilled (the transfer complete flag when it wraps to block 0, the
+ * half transfer flag when it enters block 1). Still pending when the
+ * callback returns, it means the DMA was already sending that block.
+ */
+void PwmStream::deliver(uint32_t block)
+{
+    const uint32_t values = g_config.frames_per_block * g_config.channel_count;
+    g_config.callback(g_config.buffer + block * values, g_config.frames_per_block, g_config.arg);
+
+    const uint32_t next = (block == 0) ? DMA_ISR_TCIF2 : DMA_ISR_HTIF2;
+    if (DMA1->ISR & next) {
+        g_underruns = g_underruns + 1;
+    }
+}
+
+/* end of a single pass: the whole buffer was loaded */
+void PwmStream::finish(void)
+{
+    if (g_config.callback != nullptr) {
+        g_config.callback(g_config.buffer, 2 * g_config.frames_per_block, g_config.arg);
+    }
+}
+
+#if defined(USE_HAL_DRIVER)
+/* HAL channel identifier of TIM2 channel 1-4 */
+uint32_t PwmStream::halChannel(uint32_t channel)
+{
+    return TIM_CHANNEL_1 + (channel - 1) * (TIM_CHANNEL_2 - TIM_CHANNEL_1);
+}
+
+void PwmStream::startHardware(void)
+{
+    const uint32_t first = g_config.first_channel;
+    const uint32_t last  = first + g_config.channel_count - 1;
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /* CH1-CH4 are PA0-PA3 */
+    GPIO_InitTypeDef pin;
+    pin.Pin   = 0;
+    pin.Mode  = GPIO_MODE_AF_PP;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_HIGH;
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        pin.Pin |= 1UL << (channel - 1);
+    }
+    HAL_GPIO_Init(GPIOA, &pin);
+
+    g_hdma.Instance                 = DMA1_Channel2;
+    g_hdma.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    g_hdma.Init.PeriphInc           = DMA_PINC_DISABLE;
+    g_hdma.Init.MemInc              = DMA_MINC_ENABLE;
+    g_hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    g_hdma.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+    g_hdma.Init.Mode                = g_config.repeat ? DMA_CIRCULAR : DMA_NORMAL;
+    g_hdma.Init.Priority            = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&g_hdma) != HAL_OK) {
+        __BKPT(0);
+    }
+    __HAL_LINKDMA(&g_htim, hdma[TIM_DMA_ID_UPDATE], g_hdma);
+
+    g_htim.Instance               = TIM2;
+    g_htim.Init.Prescaler         = g_prescaler;
+    g_htim.Init.CounterMode       = TIM_COUNTERMODE_UP;
+    g_htim.Init.Period            = g_reload;
+    g_htim.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+    g_htim.Init.RepetitionCounter = 0;
+    g_htim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    if (HAL_TIM_PWM_Init(&g_htim) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    TIM_OC_InitTypeDef oc;
+    oc.OCMode       = TIM_OCMODE_PWM1;
+    oc.Pulse        = 0;
+    oc.OCPolarity   = TIM_OCPOLARITY_HIGH;
+    oc.OCNPolarity  = TIM_OCNPOLARITY_HIGH;
+    oc.OCFastMode   = TIM_OCFAST_DISABLE;
+    oc.OCIdleState  = TIM_OCIDLESTATE_RESET;
+    oc.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        if (HAL_TIM_PWM_ConfigChannel(&g_htim, &oc, halChannel(channel)) != HAL_OK) {
+            __BKPT(0);
+        }
+    }
+
+    Nvic::enable<DMA1_Channel2_IRQn>();
+
+    /* The burst lengths and base addresses are the DCR field values. */
+    const uint32_t base = TIM_DMABASE_CCR1 + (first - 1);
+    const uint32_t burst = (g_config.channel_count - 1) << TIM_DCR_DBL_Pos;
+    if (HAL_TIM_DMABurst_MultiWriteStart(&g_htim, base, TIM_DMA_UPDATE,
+                                         reinterpret_cast<uint32_t *>(g_config.buffer),
+                                         burst, transfers()) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    /* Load the first frame now, see the register level build. */
+    HAL_TIM_GenerateEvent(&g_htim, TIM_EVENTSOURCE_UPDATE);
+
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        HAL_TIM_PWM_Start(&g_htim, halChannel(channel));
+    }
+}
+
+void PwmStream::stopHardware(void)
+{
+    const uint32_t first = g_config.first_channel;
+    const uint32_t last  = first + g_config.channel_count - 1;
+
+    HAL_TIM_DMABurst_WriteStop(&g_htim, TIM_DMA_UPDATE);
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        HAL_TIM_PWM_Stop(&g_htim, halChannel(channel));
+    }
+    HAL_DMA_DeInit(&g_hdma);
+}
+
+extern "C" void HAL_TIM_PeriodElapsedHalfCpltCallback(TIM_HandleTypeDef *htim)
+{
+    /* A single pass has no blocks, but the HAL enables the interrupt anyway. */
+    if (htim == &PwmStream::g_htim && PwmStream::g_config.repeat) {
+        PwmStream::deliver(0);
+    }
+}
+
+extern "C" void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+    if (htim != &PwmStream::g_htim) return;
+
+    if (PwmStream::g_config.repeat) {
+        PwmStream::deliver(1);
+    } else {
+        PwmStream::finish();
+    }
+}
+
+extern "C" void HAL_TIM_ErrorCallback(TIM_HandleTypeDef *htim)
+{
+    if (htim == &PwmStream::g_htim) {
+        PwmStream::stop();
+    }
+}
+#else
+void PwmStream::startHardware(void)
+{
+    const uint32_t first = g_config.first_channel;
+    const uint32_t last  = first + g_config.channel_count - 1;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_IOPAEN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_TIM2EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+
+    /*
+     * PWM mode 1 (OCxM 110, high while the counter is below the compare
+     * value) with the compare preload on, so a new value only takes effect
+     * at the next update event. The CCMR registers hold two channels each.
+     */
+    uint32_t ccmr[2] = { 0, 0 };
+    uint32_t ccer    = 0;
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        const uint32_t oc = TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;
+        ccmr[(channel - 1) / 2] |= oc << (((channel - 1) % 2) * 8);
+        ccer                    |= TIM_CCER_CC1E << ((channel - 1) * 4);
+    }
+
+    TIM2->CR1   = TIM_CR1_ARPE;
+    TIM2->DIER  = 0;
+    TIM2->PSC   = g_prescaler;
+    TIM2->ARR   = g_reload;
+    TIM2->CCR1  = 0;
+    TIM2->CCR2  = 0;
+    TIM2->CCR3  = 0;
+    TIM2->CCR4  = 0;
+    TIM2->CCMR1 = ccmr[0];
+    TIM2->CCMR2 = ccmr[1];
+    TIM2->CCER  = ccer;
+
+    /*
+     * Each update event starts a burst of channel_count transfers to DMAR,
+     * which the timer redirects to CCR[first], CCR[first + 1], ... (DBA is
+     * the register offset in words, DBL the length minus one).
+     */
+    TIM2->DCR = ((offsetof(TIM_TypeDef, CCR1) / 4 + (first - 1)) << TIM_DCR_DBA_Pos) |
+                ((g_config.channel_count - 1) << TIM_DCR_DBL_Pos);
+
+    /*
+     * DMA1 channel 2 is hard wired to the TIM2 update request. Half words go
+     * from the buffer to DMAR; in repeat mode the buffer wraps around with an
+     * interrupt at the middle (block 0 sent) and at the end (block 1 sent).
+     */
+    const uint32_t mode = g_config.repeat ? (DMA_CCR_CIRC | DMA_CCR_HTIE) : 0;
+    DMA1_Channel2->CCR   = 0;
+    DMA1_Channel2->CPAR  = reinterpret_cast<uintptr_t>(&TIM2->DMAR);
+    DMA1_Channel2->CMAR  = reinterpret_cast<uintptr_t>(g_config.buffer);
+    DMA1_Channel2->CNDTR = transfers();
+    DMA1->IFCR           = DMA_IFCR_CGIF2;
+    DMA1_Channel2->CCR   = DMA_CCR_PL_1 | DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC |
+                           DMA_CCR_DIR | mode | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+
+    Nvic::enable<DMA1_Channel2_IRQn>();
+
+    /*
+     * The UG event loads the prescaler, the auto reload value and the zero
+     * compare values, and its DMA request writes the first frame to the
+     * preload registers. So the outputs are low for the first period and
+     * follow the buffer from the first update event on.
+     */
+    TIM2->DIER = TIM_DIER_UDE;
+    TIM2->EGR  = TIM_EGR_UG;
+
+    /* CH1-CH4 are PA0-PA3, only known at run time (alternate function push-pull). */
+    for (uint32_t channel = first; channel <= last; ++channel) {
+        const uint32_t shift = (channel - 1) * 4;
+        GPIOA->CRL = (GPIOA->CRL & ~(0xFUL << shift)) | (Gpio::Detail::cnfMode(Gpio::Mode::AF) << shift);
+    }
+
+    TIM2->CR1 = TIM_CR1_ARPE | TIM_CR1_CEN;
+}
+
+/* With CCxE cleared the outputs are driven low. */
+void PwmStream::stopHardware(void)
+{
+    TIM2->CR1          = 0;
+    TIM2->DIER         = 0;
+    TIM2->CCER         = 0;
+    DMA1_Channel2->CCR = 0;
+    DMA1->IFCR         = DMA_IFCR_CGIF2;
+}
+#endif
@@ -0,0 +1,195 @@
+#include "soft_timer.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+namespace SoftTimer {
+
+    /* mask of the slot index bits of one level */
+    static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+
+    class Wheel {
+
+        public:
+            static void insert(Timer &timer);
+            static void unlink(Timer &timer);
+            static void dispatch(void);
+
+        private:
+            static void push(Timer * &head, Timer &timer);
+            static uint32_t cascade(uint32_t level);
+            static void runOne(void);
+
+            /* list heads of every slot of every level */
+            static Timer *sSlots[LEVELS][SLOTS];
+
+            /* wheel time of the next slot to be processed */
+            static uint32_t sTime;
+    };
+
+    Timer   *Wheel::sSlots[LEVELS][SLOTS];
+    uint32_t Wheel::sTime;
+
+    /* number of ticks signalled by the SysTick ISR */
+    static volatile uint32_t g_ticks;
+}
+
+void SoftTimer::Wheel::push(Timer * &head, Timer &timer)
+{
+    timer.mNext  = head;
+    timer.mPprev = &head;
+    if (head != nullptr) {
+        head->mPprev = &timer.mNext;
+    }
+    head = &timer;
+}
+
+void SoftTimer::Wheel::unlink(Timer &timer)
+{
+    if (timer.mPprev == nullptr) return;
+
+    *timer.mPprev = timer.mNext;
+    if (timer.mNext != nullptr) {
+        timer.mNext->mPprev = timer.mPprev;
+    }
+    timer.mNext  = nullptr;
+    timer.mPprev = nullptr;
+}
+
+void SoftTimer::Wheel::insert(Timer &timer)
+{
+    /*
+     * The level is chosen from the distance to the expiry. The slot within
+     * the level is taken from the absolute expiry time so cascading can find
+     * it again when the lower levels wrap.
+     */
+    const uint32_t expires = timer.mExpires;
+    uint32_t       delta   = expires - sTime;
+
+    /* Already expired: run on the next processed slot. */
+    if (static_cast<int32_t>(delta) < 0) {
+        push(sSlots[0][sTime & SLOT_MASK], timer);
+        return;
+    }
+
+    for (uint32_t level = 0; level < LEVELS - 1; ++level) {
+        if (delta < (1UL << (LEVEL_BITS * (level + 1)))) {
+            const uint32_t idx = (expires >> (LEVEL_BITS * level)) & SLOT_MASK;
+            push(sSlots[level][idx], timer);
+            return;
+        }
+    }
+
+    /*
+     * Beyond the wheel range the timer is parked in the furthest slot of the
+     * last level. It is re-inserted with its real expiry when that slot is
+     * cascaded.
+     */
+    if (delta > MAX_DELAY) {
+        delta = MAX_DELAY;
+    }
+    const uint32_t slot_time = sTime + delta;
+    const uint32_t idx       = (slot_time >> (LEVEL_BITS * (LEVELS - 1))) & SLOT_MASK;
+    push(sSlots[LEVELS - 1][idx], timer);
+}
+
+uint32_t SoftTimer::Wheel::cascade(uint32_t level)
+{
+    /*
+     * Move every timer of the current slot of the given level one or more
+     * levels down. Returns the slot index so the caller knows whether this
+     * level wrapped as well.
+     */
+    const uint32_t idx  = (sTime >> (LEVEL_BITS * level)) & SLOT_MASK;
+    Timer         *list = sSlots[level][idx];
+    sSlots[level][idx]  = nullptr;
+
+    while (list != nullptr) {
+        Timer &timer = *list;
+        list = timer.mNext;
+        timer.mNext  = nullptr;
+        timer.mPprev = nullptr;
+        insert(timer);
+    }
+
+    return idx;
+}
+
+void SoftTimer::Wheel::runOne(void)
+{
+    const uint32_t idx = sTime & SLOT_MASK;
+
+    /* Cascade the upper levels each time the level below wraps. */
+    if (idx == 0) {
+        for (uint32_t level = 1; level < LEVELS; ++level) {
+            if (cascade(level) != 0) break;
+        }
+    }
+
+    /*
+     * Detach the expiring slot into a local work list before advancing the
+     * wheel time. Timers re-armed from a callback then land in a future slot
+     * instead of the one being processed.
+     */
+    Timer *work = sSlots[0][idx];
+    sSlots[0][idx] = nullptr;
+    if (work != nullptr) {
+        work->mPprev = &work;
+    }
+    ++sTime;
+
+    /*
+     * Pop one timer at a time so a callback may safely cancel any other
+     * timer, including ones still on the work list.
+     */
+    while (work != nullptr) {
+        Timer &timer = *work;
+        unlink(timer);
+
+        if (timer.mPeriod != 0) {
+            timer.mExpires += timer.mPeriod;
+            insert(timer);
+        }
+
+        timer.mCallback(timer.mArg);
+    }
+}
+
+void SoftTimer::Wheel::dispatch(void)
+{
+    /*
+     * The ISR only ever increments the tick count, so every tick that has
+     * been signalled but not yet processed is handled here in order.
+     */
+    while (sTime != g_ticks) {
+        runOne();
+    }
+}
+
+SoftTimer::Timer::Timer(Callback callback, void *arg) :
+    mCallback(callback),
+    mArg(arg)
+{ }
+
+void SoftTimer::Timer::arm(uint32_t delay, uint32_t period)
+{
+    Wheel::unlink(*this);
+    mExpires = g_ticks + delay;
+    mPeriod  = period;
+    Wheel::insert(*this);
+}
+
+void SoftTimer::Timer::cancel(void)
+{
+    Wheel::unlink(*this);
+}
+
+void SoftTimer::tick(void)
+{
+    g_ticks = g_ticks + 1;
+}
+
+void SoftTimer::dispatch(void)
+{
+    Wheel::dispatch();
+}
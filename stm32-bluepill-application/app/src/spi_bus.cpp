@@ -0,0 +1,533 @@
+#include "spi_bus.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+#include "pwm_stream.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace SpiBus {
+
+    static constexpr uint32_t BUSES = static_cast<uint32_t>(Bus::COUNT);
+
+    /* CR1 settings of no device (forces the first configuration) */
+    static constexpr uint32_t UNCONFIGURED = 0xFFFFFFFF;
+
+    struct State {
+        /* queue, head is the transaction in progress while active */
+        Transaction  *head;
+        Transaction  *tail;
+        bool          active;
+
+        /* BR, CPOL, CPHA and LSBFIRST the peripheral is set up with */
+        uint32_t      settings;
+
+        /* device whose chip select is low */
+        const Device *selected;
+    };
+
+    /* queue and bus state (DMA interrupts, or code in a CriticalSection) */
+    static State g_state[BUSES];
+
+    static bool usable(Bus bus);
+    static uint32_t index(Bus bus);
+    static uint32_t settings(const Device &device);
+    static GPIO_TypeDef *csPort(const Device &device);
+    static void begin(Bus bus);
+    static void complete(Bus bus, bool ok);
+
+    /* DRIVER PRIMITIVES (register level or HAL) */
+    static void setup(Bus bus);
+    static void configure(Bus bus, uint32_t settings);
+    static bool transfer(Bus bus, const Transaction &transaction);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace SpiBus {
+    static SPI_HandleTypeDef g_hspi[BUSES];
+    static DMA_HandleTypeDef g_hdma_rx[BUSES];
+    static DMA_HandleTypeDef g_hdma_tx[BUSES];
+
+    static Bus busOf(const SPI_HandleTypeDef *hspi);
+}
+#else
+namespace SpiBus {
+
+    /* target of discarded bytes and source of FILL bytes (memory address fixed) */
+    static uint8_t       g_sink;
+    static const uint8_t g_fill = FILL;
+
+    static SPI_TypeDef *spi(Bus bus);
+    static DMA_Channel_TypeDef *rxChannel(Bus bus);
+    static DMA_Channel_TypeDef *txChannel(Bus bus);
+    static uint32_t rxFlags(Bus bus, uint32_t flag);
+    static uint32_t txFlags(Bus bus, uint32_t flag);
+    static void stop(Bus bus);
+}
+#endif
+
+bool SpiBus::init(Bus bus)
+{
+    if (!usable(bus)) return false;
+
+    State &state = g_state[index(bus)];
+
+    state.head     = nullptr;
+    state.tail     = nullptr;
+    state.active   = false;
+    state.settings = UNCONFIGURED;
+    state.selected = nullptr;
+
+    setup(bus);
+    return true;
+}
+
+bool SpiBus::submit(Transaction &transaction)
+{
+    if (transaction.length == 0 || transaction.length > MAX_LENGTH ||
+        (transaction.tx == nullptr && transaction.rx == nullptr) ||
+        !usable(transaction.device->bus)) {
+        return false;
+    }
+
+    const Bus bus   = transaction.device->bus;
+    State    &state = g_state[index(bus)];
+
+    transaction.next = nullptr;
+
+    Nvic::CriticalSection cs;
+
+    /* DMA1 channel 2 belongs to the PWM stream while it runs. */
+    if (bus == Bus::SPI1_BUS && PwmStream::running()) return false;
+
+    if (state.tail != nullptr) {
+        state.tail->next = &transaction;
+    } else {
+        state.head = &transaction;
+    }
+    state.tail = &transaction;
+
+    if (!state.active) {
+        begin(bus);
+    }
+    return true;
+}
+
+bool SpiBus::idle(Bus bus)
+{
+    return g_state[index(bus)].head == nullptr;
+}
+
+/*
+ * SPI2's DMA channels (4 and 5) belong to the console and their interrupts
+ * are not routed here, so only SPI1 can be used.
+ */
+bool SpiBus::usable(Bus bus)
+{
+    return bus == Bus::SPI1_BUS;
+}
+
+uint32_t SpiBus::index(Bus bus)
+{
+    return static_cast<uint32_t>(bus);
+}
+
+/* CR1 fields of a device: the fastest prescaler (PCLK / 2 .. / 256) not above max_hz */
+uint32_t SpiBus::settings(const Device &device)
+{
+    using namespace Bsp::Components;
+
+    const uint32_t pclk = (device.bus == Bus::SPI1_BUS) ? Clock::PCLK2_FREQ_HZ : Clock::PCLK1_FREQ_HZ;
+    const uint32_t mode = static_cast<uint32_t>(device.mode);
+
+    uint32_t br = 0;
+    while (br < 7 && (pclk >> (br + 1)) > device.max_hz) {
+        ++br;
+    }
+
+    return (br << SPI_CR1_BR_Pos)           |
+           ((mode & 2) ? SPI_CR1_CPOL : 0)  |
+           ((mode & 1) ? SPI_CR1_CPHA : 0)  |
+           (device.lsb_first ? SPI_CR1_LSBFIRST : 0);
+}
+
+GPIO_TypeDef *SpiBus::csPort(const Device &device)
+{
+    return reinterpret_cast<GPIO_TypeDef *>(device.cs_port_base);
+}
+
+/*
+ * Start the head of the queue: release a chip select kept low for another
+ * device, reconfigure if the settings differ, select and start the DMA.
+ */
+void SpiBus::begin(Bus bus)
+{
+    State &state = g_state[index(bus)];
+    if (state.head == nullptr) return;
+
+    const Transaction &transaction = *state.head;
+    const Device      &device      = *transaction.device;
+
+    if (state.selected != nullptr && state.selected != &device) {
+        csPort(*state.selected)->BSRR = state.selected->cs_mask;
+        state.selected = nullptr;
+    }
+
+    const uint32_t wanted = settings(device);
+    if (state.settings != wanted) {
+        configure(bus, wanted);
+        state.settings = wanted;
+    }
+
+    csPort(device)->BSRR = device.cs_mask << 16;
+    state.selected = &device;
+    state.active   = true;
+
+    if (!transfer(bus, transaction)) {
+        complete(bus, false);
+    }
+}
+
+/*
+ * The head transaction is over. Start the next one before the callback so
+ * the bus does not wait for it.
+ */
+void SpiBus::complete(Bus bus, bool ok)
+{
+    State       &state       = g_state[index(bus)];
+    Transaction &transaction = *state.head;
+
+    state.head   = transaction.next;
+    state.active = false;
+    if (state.head == nullptr) {
+        state.tail = nullptr;
+    }
+
+    if (!ok || !transaction.keep_selected) {
+        csPort(*transaction.device)->BSRR = transaction.device->cs_mask;
+        state.selected = nullptr;
+    }
+
+    begin(bus);
+
+    if (transaction.callback != nullptr) {
+        transaction.callback(transaction, ok, transaction.arg);
+    }
+}
+
+#if defined(USE_HAL_DRIVER)
+void SpiBus::attach(const Device &device)
+{
+    SET_BIT(RCC->APB2ENR, Gpio::Detail::rccEnable(device.cs_port_base));
+
+    GPIO_InitTypeDef pin;
+    pin.Pin   = device.cs_mask;
+    pin.Mode  = GPIO_MODE_OUTPUT_PP;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_WritePin(csPort(device), device.cs_mask, GPIO_PIN_SET);
+    HAL_GPIO_Init(csPort(device), &pin);
+}
+
+void SpiBus::setup(Bus bus)
+{
+    const uint32_t i    = index(bus);
+    const bool     spi1 = (bus == Bus::SPI1_BUS);
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    if (spi1) {
+        __HAL_RCC_SPI1_CLK_ENABLE();
+        __HAL_RCC_GPIOA_CLK_ENABLE();
+    } else {
+        __HAL_RCC_SPI2_CLK_ENABLE();
+        __HAL_RCC_GPIOB_CLK_ENABLE();
+    }
+
+    GPIO_InitTypeDef pin;
+    pin.Pin   = spi1 ? (GPIO_PIN_5 | GPIO_PIN_7) : (GPIO_PIN_13 | GPIO_PIN_15);
+    pin.Mode  = GPIO_MODE_AF_PP;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(spi1 ? GPIOA : GPIOB, &pin);
+    pin.Pin   = spi1 ? GPIO_PIN_6 : GPIO_PIN_14;
+    pin.Mode  = GPIO_MODE_INPUT;
+    HAL_GPIO_Init(spi1 ? GPIOA : GPIOB, &pin);
+
+    DMA_HandleTypeDef * const dma[2] = { &g_hdma_rx[i], &g_hdma_tx[i] };
+    for (uint32_t d = 0; d < 2; ++d) {
+        dma[d]->Init.PeriphInc           = DMA_PINC_DISABLE;
+        dma[d]->Init.MemInc              = DMA_MINC_ENABLE;
+        dma[d]->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        dma[d]->Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        dma[d]->Init.Mode                = DMA_NORMAL;
+    }
+    g_hdma_rx[i].Instance       = spi1 ? DMA1_Channel2 : DMA1_Channel4;
+    g_hdma_rx[i].Init.Direction = DMA_PERIPH_TO_MEMORY;
+    g_hdma_rx[i].Init.Priority  = DMA_PRIORITY_VERY_HIGH;
+    g_hdma_tx[i].Instance       = spi1 ? DMA1_Channel3 : DMA1_Channel5;
+    g_hdma_tx[i].Init.Direction = DMA_MEMORY_TO_PERIPH;
+    g_hdma_tx[i].Init.Priority  = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&g_hdma_rx[i]) != HAL_OK || HAL_DMA_Init(&g_hdma_tx[i]) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    g_hspi[i].Instance = spi1 ? SPI1 : SPI2;
+    __HAL_LINKDMA(&g_hspi[i], hdmarx, g_hdma_rx[i]);
+    __HAL_LINKDMA(&g_hspi[i], hdmatx, g_hdma_tx[i]);
+
+    if (spi1) {
+        Nvic::enable<DMA1_Channel2_IRQn>();
+        Nvic::enable<DMA1_Channel3_IRQn>();
+    }
+}
+
+/* HAL_SPI_Init() takes the CR1 fields as they are */
+void SpiBus::configure(Bus bus, uint32_t settings)
+{
+    SPI_HandleTypeDef &hspi = g_hspi[index(bus)];
+
+    hspi.Init.Mode              = SPI_MODE_MASTER;
+    hspi.Init.Direction         = SPI_DIRECTION_2LINES;
+    hspi.Init.DataSize          = SPI_DATASIZE_8BIT;
+    hspi.Init.CLKPolarity       = settings & SPI_CR1_CPOL;
+    hspi.Init.CLKPhase          = settings & SPI_CR1_CPHA;
+    hspi.Init.NSS               = SPI_NSS_SOFT;
+    hspi.Init.BaudRatePrescaler = settings & SPI_CR1_BR;
+    hspi.Init.FirstBit          = settings & SPI_CR1_LSBFIRST;
+    hspi.Init.TIMode            = SPI_TIMODE_DISABLE;
+    hspi.Init.CRCCalculation    = SPI_CRCCALCULATION_DISABLE;
+    hspi.Init.CRCPolynomial     = 7;
+    if (HAL_SPI_Init(&hspi) != HAL_OK) {
+        __BKPT(0);
+    }
+}
+
+/*
+ * A receive only transfer sends its own buffer (HAL_SPI_Receive_DMA in
+ * full-duplex master mode), so fill it with FILL first.
+ */
+bool SpiBus::transfer(Bus bus, const Transaction &transaction)
+{
+    SPI_HandleTypeDef &hspi   = g_hspi[index(bus)];
+    const uint16_t     length = static_cast<uint16_t>(transaction.length);
+    uint8_t           *tx     = const_cast<uint8_t *>(transaction.tx);
+
+    HAL_StatusTypeDef status;
+    if (transaction.rx == nullptr) {
+        status = HAL_SPI_Transmit_DMA(&hspi, tx, length);
+    } else if (tx == nullptr) {
+        memset(transaction.rx, FILL, transaction.length);
+        status = HAL_SPI_Receive_DMA(&hspi, transaction.rx, length);
+    } else {
+        status = HAL_SPI_TransmitReceive_DMA(&hspi, tx, transaction.rx, length);
+    }
+    return status == HAL_OK;
+}
+
+void SpiBus::rxIsr(Bus bus)
+{
+    HAL_DMA_IRQHandler(&g_hdma_rx[index(bus)]);
+}
+
+void SpiBus::txIsr(Bus bus)
+{
+    HAL_DMA_IRQHandler(&g_hdma_tx[index(bus)]);
+}
+
+SpiBus::Bus SpiBus::busOf(const SPI_HandleTypeDef *hspi)
+{
+    return (hspi == &g_hspi[index(Bus::SPI1_BUS)]) ? Bus::SPI1_BUS : Bus::SPI2_BUS;
+}
+
+extern "C" void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    SpiBus::complete(SpiBus::busOf(hspi), true);
+}
+
+extern "C" void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    SpiBus::complete(SpiBus::busOf(hspi), true);
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    SpiBus::complete(SpiBus::busOf(hspi), true);
+}
+
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    SpiBus::complete(SpiBus::busOf(hspi), false);
+}
+#else
+void SpiBus::attach(const Device &device)
+{
+    GPIO_TypeDef * const port  = csPort(device);
+    const uint32_t       pin   = static_cast<uint32_t>(__builtin_ctz(device.cs_mask));
+    volatile uint32_t   &cr    = (pin < 8) ? port->CRL : port->CRH;
+    const uint32_t       shift = (pin & 7) * 4;
+
+    {
+        Nvic::CriticalSection cs;
+        RCC->APB2ENR |= Gpio::Detail::rccEnable(device.cs_port_base);
+    }
+
+    /* High first, then a push-pull output (50 MHz). */
+    port->BSRR = device.cs_mask;
+    cr = (cr & ~(0xFUL << shift)) | (Gpio::Detail::cnfMode(Gpio::Mode::OUTPUT) << shift);
+}
+
+void SpiBus::setup(Bus bus)
+{
+    using namespace Bsp::Components;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+    if (bus == Bus::SPI1_BUS) {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_SPI1EN>::set();
+        Spi1::SckPin::init();
+        Spi1::MisoPin::init();
+        Spi1::MosiPin::init();
+    } else {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_SPI2EN>::set();
+        Spi2::SckPin::init();
+        Spi2::MisoPin::init();
+        Spi2::MosiPin::init();
+    }
+
+    /*
+     * Master with software slave management (NSS held high internally), the
+     * chip selects are plain GPIOs. Both DMA requests stay enabled, a request
+     * of a disabled channel waits until the channel is enabled.
+     */
+    SPI_TypeDef * const regs = spi(bus);
+    regs->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI;
+    regs->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+
+    rxChannel(bus)->CCR  = 0;
+    rxChannel(bus)->CPAR = reinterpret_cast<uintptr_t>(&regs->DR);
+    txChannel(bus)->CCR  = 0;
+    txChannel(bus)->CPAR = reinterpret_cast<uintptr_t>(&regs->DR);
+
+    if (bus == Bus::SPI1_BUS) {
+        Nvic::enable<DMA1_Channel2_IRQn>();
+        Nvic::enable<DMA1_Channel3_IRQn>();
+    }
+}
+
+/* CR1 may only change with the peripheral disabled and idle */
+void SpiBus::configure(Bus bus, uint32_t settings)
+{
+    SPI_TypeDef * const regs = spi(bus);
+
+    while (regs->SR & SPI_SR_BSY) { }
+    regs->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI;
+    regs->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | settings;
+    regs->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | settings | SPI_CR1_SPE;
+}
+
+/*
+ * The receive channel is enabled first so it is ready for the first byte;
+ * enabling the transmit channel starts the clock. Only the receive channel
+ * completes a transfer, the transmit channel only reports errors.
+ */
+bool SpiBus::transfer(Bus bus, const Transaction &transaction)
+{
+    DMA_Channel_TypeDef * const rx = rxChannel(bus);
+    DMA_Channel_TypeDef * const tx = txChannel(bus);
+
+    DMA1->IFCR = rxFlags(bus, DMA_IFCR_CGIF1) | txFlags(bus, DMA_IFCR_CGIF1);
+
+    rx->CMAR  = reinterpret_cast<uintptr_t>(transaction.rx != nullptr ? transaction.rx : &g_sink);
+    rx->CNDTR = transaction.length;
+    rx->CCR   = (transaction.rx != nullptr ? DMA_CCR_MINC : 0) |
+                DMA_CCR_PL_1 | DMA_CCR_PL_0 | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+
+    tx->CMAR  = reinterpret_cast<uintptr_t>(transaction.tx != nullptr ? transaction.tx : &g_fill);
+    tx->CNDTR = transaction.length;
+    tx->CCR   = (transaction.tx != nullptr ? DMA_CCR_MINC : 0) |
+                DMA_CCR_PL_1 | DMA_CCR_DIR | DMA_CCR_TEIE | DMA_CCR_EN;
+    return true;
+}
+
+/* the last byte is in: every bit has been clocked */
+void SpiBus::rxIsr(Bus bus)
+{
+    const uint32_t isr = DMA1->ISR;
+
+    if (isr & rxFlags(bus, DMA_ISR_TEIF1)) {
+        stop(bus);
+        complete(bus, false);
+    } else if (isr & rxFlags(bus, DMA_ISR_TCIF1)) {
+        DMA1->IFCR = rxFlags(bus, DMA_IFCR_CGIF1);
+        rxChannel(bus)->CCR = 0;
+        txChannel(bus)->CCR = 0;
+        complete(bus, true);
+    }
+}
+
+void SpiBus::txIsr(Bus bus)
+{
+    if (DMA1->ISR & txFlags(bus, DMA_ISR_TEIF1)) {
+        stop(bus);
+        complete(bus, false);
+    }
+}
+
+SPI_TypeDef *SpiBus::spi(Bus bus)
+{
+    return (bus == Bus::SPI1_BUS) ? SPI1 : SPI2;
+}
+
+DMA_Channel_TypeDef *SpiBus::rxChannel(Bus bus)
+{
+    return (bus == Bus::SPI1_BUS) ? DMA1_Channel2 : DMA1_Channel4;
+}
+
+DMA_Channel_TypeDef *SpiBus::txChannel(Bus bus)
+{
+    return (bus == Bus::SPI1_BUS) ? DMA1_Channel3 : DMA1_Channel5;
+}
+
+/* a channel 1 flag of DMA1 ISR/IFCR moved to the receive channel */
+uint32_t SpiBus::rxFlags(Bus bus, uint32_t flag)
+{
+    return flag << ((bus == Bus::SPI1_BUS) ? 4 : 12);
+}
+
+uint32_t SpiBus::txFlags(Bus bus, uint32_t flag)
+{
+    return flag << ((bus == Bus::SPI1_BUS) ? 8 : 16);
+}
+
+/* abandon a transfer after a DMA error and drop what the SPI still holds */
+void SpiBus::stop(Bus bus)
+{
+    SPI_TypeDef * const regs = spi(bus);
+
+    rxChannel(bus)->CCR = 0;
+    txChannel(bus)->CCR = 0;
+    DMA1->IFCR = rxFlags(bus, DMA_IFCR_CGIF1) | txFlags(bus, DMA_IFCR_CGIF1);
+
+    while (regs->SR & SPI_SR_BSY) { }
+    (void)regs->DR;
+    (void)regs->SR;
+}
+#endif
@@ -0,0 +1,37 @@
+#include "stack_monitor.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+extern "C" {
+    /* main stack boundaries (defined in the linker script) */
+    extern uint32_t _sstack[];
+    extern uint32_t _estack[];
+}
+
+void StackMonitor::paint(uint32_t *base, uint32_t words)
+{
+    for (uint32_t i = 0; i < words; ++i) {
+        base[i] = PAINT;
+    }
+}
+
+uint32_t StackMonitor::used(const uint32_t *base, uint32_t words)
+{
+    /* The stack grows down, so the untouched words are at the bottom. */
+    uint32_t untouched = 0;
+    while (untouched < words && base[untouched] == PAINT) {
+        ++untouched;
+    }
+    return (words - untouched) * sizeof(uint32_t);
+}
+
+uint32_t StackMonitor::mainSize(void)
+{
+    return static_cast<uint32_t>(_estack - _sstack) * sizeof(uint32_t);
+}
+
+uint32_t StackMonitor::mainUsed(void)
+{
+    return used(_sstack, static_cast<uint32_t>(_estack - _sstack));
+}
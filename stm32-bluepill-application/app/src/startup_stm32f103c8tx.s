@@ -45,6 +45,15 @@ defined in linker script */
 .word _sbss
 /* end address for the .bss section. defined in linker script */
 .word _ebss
+/* start address for the initialization values of the .ramfunc section.
+defined in linker script */
+.word _siramfunc
+/* start address for the .ramfunc section. defined in linker script */
+.word _sramfunc
+/* end address for the .ramfunc section. defined in linker script */
+.word _eramfunc
+/* lowest address of the main stack. defined in linker script */
+.word _sstack
 
 .equ  BootRAM, 0xF108F85F
 /**
@@ -61,36 +70,47 @@ defined in linker script */
   .type Reset_Handler, %function
 Reset_Handler:
 
+/* Start the DWT cycle counter to measure the section initialization */
+  ldr r0, =0xE000EDFC   /* CoreDebug->DEMCR */
+  ldr r1, [r0]
+  orr r1, r1, #0x01000000 /* TRCENA */
+  str r1, [r0]
+  ldr r0, =0xE0001000   /* DWT->CTRL */
+  movs r1, #0
+  str r1, [r0, #4]      /* DWT->CYCCNT */
+  ldr r1, [r0]
+  orr r1, r1, #1        /* CYCCNTENA */
+  str r1, [r0]
+
 /* Copy the data segment initializers from flash to SRAM */
   ldr r0, =_sdata
   ldr r1, =_edata
   ldr r2, =_sidata
-  movs r3, #0
-  b LoopCopyDataInit
-
-CopyDataInit:
-  ldr r4, [r2, r3]
-  str r4, [r0, r3]
-  adds r3, r3, #4
-
-LoopCopyDataInit:
-  adds r4, r0, r3
-  cmp r4, r1
-  bcc CopyDataInit
-  
-/* Zero fill the bss segment. */
-  ldr r2, =_sbss
-  ldr r4, =_ebss
-  movs r3, #0
-  b LoopFillZerobss
-
-FillZerobss:
-  str  r3, [r2]
-  adds r2, r2, #4
-
-LoopFillZerobss:
-  cmp r2, r4
-  bcc FillZerobss
+  bl CopyWords
+
+/* Copy the RAM functions from flash to SRAM */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  bl CopyWords
+
+/* Zero fill the bss segment. The .noinit section is left untouched. */
+  ldr r0, =_sbss
+  ldr r1, =_ebss
+  movs r2, #0
+  bl FillWords
+
+/* Record the cycles spent initializing the sections */
+  ldr r0, =0xE0001004   /* DWT->CYCCNT */
+  ldr r1, [r0]
+  ldr r0, =g_startup_cycles
+  str r1, [r0]
+
+/* Paint the unused main stack for the high-water mark (see stack_monitor.hpp) */
+  ldr r0, =_sstack
+  mov r1, sp
+  ldr r2, =0xA5A5A5A5
+  bl FillWords
 
 /* Call the clock system intitialization function.*/
     bl  SystemInit
@@ -101,6 +121,72 @@ LoopFillZerobss:
   bx lr
 .size Reset_Handler, .-Reset_Handler
 
+/**
+ * @brief  Copy the words of [r2] to [r0, r1). Both ends are word aligned.
+ *         Blocks of 8 words move with one LDM/STM pair (1 + 8 cycles each
+ *         instead of 2 per load and store plus the loop overhead per word),
+ *         the remaining words one at a time. Clobbers r0-r11.
+*/
+  .section .text.Reset_Handler
+  .global CopyWords
+  .type CopyWords, %function
+CopyWords:
+  subs r3, r1, r0
+  lsrs r3, r3, #5       /* number of 32 byte blocks */
+  beq LoopCopyWordsTail
+
+CopyWordsBlock:
+  ldmia r2!, {r4-r11}
+  stmia r0!, {r4-r11}
+  subs r3, r3, #1
+  bne CopyWordsBlock
+
+LoopCopyWordsTail:
+  cmp r0, r1
+  bcs CopyWordsDone
+  ldr r4, [r2], #4
+  str r4, [r0], #4
+  b LoopCopyWordsTail
+
+CopyWordsDone:
+  bx lr
+.size CopyWords, .-CopyWords
+
+/**
+ * @brief  Fill [r0, r1) with the word in r2. Both ends are word aligned.
+ *         Blocks of 8 words are written with one STM, the remaining words
+ *         one at a time. Clobbers r0-r11.
+*/
+  .global FillWords
+  .type FillWords, %function
+FillWords:
+  mov r4, r2
+  mov r5, r2
+  mov r6, r2
+  mov r7, r2
+  mov r8, r2
+  mov r9, r2
+  mov r10, r2
+  mov r11, r2
+  subs r3, r1, r0
+  lsrs r3, r3, #5       /* number of 32 byte blocks */
+  beq LoopFillWordsTail
+
+FillWordsBlock:
+  stmia r0!, {r4-r11}
+  subs r3, r3, #1
+  bne FillWordsBlock
+
+LoopFillWordsTail:
+  cmp r0, r1
+  bcs FillWordsDone
+  str r4, [r0], #4
+  b LoopFillWordsTail
+
+FillWordsDone:
+  bx lr
+.size FillWords, .-FillWords
+
 /**
  * @brief  This is the code that gets called when the processor receives an
  *         unexpected interrupt.  This simply enters an infinite loop, preserving
@@ -4,8 +4,20 @@
 #include "stm32f1xx_hal.h"
 #else
 #include "bsp.hpp"
+#include "kernel.hpp"
+#include "soft_timer.hpp"
 #endif
 
+#include "adc_stream.hpp"
+#include "can_bus.hpp"
+#include "i2c_bus.hpp"
+#include "isr_stats.hpp"
+#include "pwm_stream.hpp"
+#include "spi_bus.hpp"
+#include "uart_log.hpp"
+#include "uart_rx.hpp"
+#include "usb_cdc.hpp"
+
 /* non-maskable interrupt handler */
 extern "C" void NMI_Handler(void)
 {
@@ -47,16 +59,137 @@ extern "C" void DebugMon_Handler(void)
 }
 
 /* pendable request for system service interrupt handler */
+#if defined(USE_HAL_DRIVER)
 extern "C" void PendSV_Handler(void)
 {
 }
+#else
+extern "C" __attribute__((naked)) void PendSV_Handler(void)
+{
+    /*
+     * Tail branch into the kernel context switch so the EXC_RETURN value in
+     * LR and the exception stack frame reach it untouched.
+     */
+    __asm volatile ("b kernelPendSv");
+}
+#endif
 
 /* system tick interrupt handler */
 extern "C" void SysTick_Handler(void)
 {
+    IsrStats::Scope scope(IsrStats::Id::SYSTICK);
+
+    /* The counter reloaded when the interrupt was requested. */
+    IsrStats::latency(IsrStats::Id::SYSTICK, SysTick->LOAD - SysTick->VAL);
+
 #if defined(USE_HAL_DRIVER)
     HAL_IncTick();
 #else
     ++Bsp::Util::g_tick_ms;
+    SoftTimer::tick();
+    Kernel::tick();
 #endif
+    I2cBus::watchdog();
+}
+
+/* DMA1 channel 1 (ADC1) interrupt handler */
+extern "C" void DMA1_Channel1_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL1);
+    AdcStream::isr();
+}
+
+/* DMA1 channel 2 (SPI1 RX or the TIM2 PWM stream) interrupt handler */
+extern "C" void DMA1_Channel2_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL2);
+    if (PwmStream::running()) {
+        PwmStream::isr();
+    } else {
+        SpiBus::rxIsr(SpiBus::Bus::SPI1_BUS);
+    }
+}
+
+/* DMA1 channel 3 (SPI1 TX) interrupt handler */
+extern "C" void DMA1_Channel3_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL3);
+    SpiBus::txIsr(SpiBus::Bus::SPI1_BUS);
+}
+
+/* DMA1 channel 4 (console USART TX) interrupt handler */
+extern "C" void DMA1_Channel4_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL4);
+    UartLog::isr();
+}
+
+/* DMA1 channel 5 (console USART RX) interrupt handler */
+extern "C" void DMA1_Channel5_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL5);
+    UartRx::dmaIsr();
+}
+
+/* DMA1 channel 6 (I2C1 TX) interrupt handler */
+extern "C" void DMA1_Channel6_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL6);
+    I2cBus::txIsr();
+}
+
+/* DMA1 channel 7 (I2C1 RX) interrupt handler */
+extern "C" void DMA1_Channel7_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::DMA1_CHANNEL7);
+    I2cBus::rxIsr();
+}
+
+/* CAN1 TX mailboxes (and USB high priority, not used) interrupt handler */
+extern "C" void USB_HP_CAN1_TX_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::CAN_TX);
+    CanBus::txIsr();
+}
+
+/*
+ * USB low priority or CAN1 RX FIFO 0 interrupt handler. The two share the
+ * packet memory, so only one of them is ever started.
+ */
+extern "C" void USB_LP_CAN1_RX0_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::USB_LP);
+    if (CanBus::running()) {
+        CanBus::rxIsr(0);
+    } else {
+        UsbCdc::isr();
+    }
+}
+
+/* CAN1 RX FIFO 1 interrupt handler */
+extern "C" void CAN1_RX1_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::CAN_RX1);
+    CanBus::rxIsr(1);
+}
+
+/* I2C1 event interrupt handler */
+extern "C" void I2C1_EV_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::I2C1_EV);
+    I2cBus::evIsr();
+}
+
+/* I2C1 error interrupt handler */
+extern "C" void I2C1_ER_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::I2C1_ER);
+    I2cBus::erIsr();
+}
+
+/* USART1 (console RX idle line and errors) interrupt handler */
+extern "C" void USART1_IRQHandler(void)
+{
+    IsrStats::Scope scope(IsrStats::Id::CONSOLE_RX);
+    UartRx::usartIsr();
 }
@@ -1,4 +1,5 @@
 #include "bsp.hpp"
+#include "pool.hpp"
 #include "stm32f1xx.h"
 
 #if defined(USE_HAL_DRIVER)
@@ -12,7 +13,9 @@
         #define HSI_VALUE 8000000U /* Hz */
     #endif
 #else
+    #include "bitband.hpp"
     #include "bsp.hpp"
+    #include "nvic.hpp"
     #define HSE_VALUE Bsp::Components::Osc::HSE_OSC_FREQ_HZ
     #define HSI_VALUE 8000000U /* Hz */
 #endif
@@ -34,14 +37,6 @@ extern "C" {
     const uint8_t APBPrescTable[8U]  = {0, 0, 0, 0, 1, 2, 3, 4};
 }
 
-#if !defined(USE_HAL_DRIVER)
-/*
- * GPIO initialization helper function prototypes.
- */
-static void enableGpioPortClk(const GPIO_TypeDef * const port);
-static void configureGpioPinOut(GPIO_TypeDef * const port, uint32_t pin);
-#endif
-
 /*
  * This function is called by the Reset_Handler after initializing the data
  * and BSS sections. The static constructors have not been called yet, so it
@@ -58,9 +53,10 @@ static void configureGpioPinOut(GPIO_TypeDef * const port, uint32_t pin);
  * For the template application not using the HAL, SystemInit will do the
  * following:
  * 
- *      1. Set the system clock frequency to the 72MHz maximum.
+ *      1. Set the system clock from the Bsp clock tree profile (72MHz).
+ *         Flash wait states follow the selected SYSCLK.
  *      2. Disable the HSI oscillator after configuring the system clock.
- *      3. Configure the IRQ priority bit usage.
+ *      3. Configure the IRQ priority bit usage and the priority plan.
  *      4. Configure (but not enable) the SysTick to tick at 1ms.
  *      5. Configure the LED's GPIO port.
  * 
@@ -69,104 +65,93 @@ static void configureGpioPinOut(GPIO_TypeDef * const port, uint32_t pin);
  */
 extern "C" void SystemInit (void)
 {
-#if !defined(USE_HAL_DRIVER)
-    /* CLOCK CONFIGURATION */
-    /*
-     * Configure the RCC control register to turn on HSE oscillator. To prevent
-     * system glitches while setting up the clocks, the HSI (default)
-     * oscillator is also enabled. The default value for the HSI trim (0x10) is
-     * also added to prevent potential glitches. See section 7.3.1 in the
-     * processor reference manual for more info.
-     */
-    RCC->CR = RCC_CR_HSEON | RCC_CR_HSION | (0x10 << RCC_CR_HSITRIM_Pos);
-
     /*
-     * Wait for the HSERDY bit to be set in the RCC control register. Normally
-     * it is bad form to do sit in a while loop monitoring a register without
-     * any kind of timeout, but for this demonstration project, it will be good
-     * enough.
+     * The memory pools must be ready before the static constructors run, as
+     * those may already allocate.
      */
-    while((RCC->CR & RCC_CR_HSERDY) == 0) { }
+    Pool::init();
 
+#if !defined(USE_HAL_DRIVER)
+    /* CLOCK CONFIGURATION */
     /*
-     * Configure the bus clock dividers in the RCC configuration register. To
-     * be extra safe, bus clock dividers are configured separate from PLL
-     * configuration. This is done to ensure that bus frequencies are for sure
-     * below f_MAX.
-     *
-     * The application will run at 72MHz once clock configuration is complete.
-     * All busses in the design will be configured to run at at their full
-     * speed. The table below summarizes the clock sources, clock source
-     * dividers, resultant clock speed, and resultant clock names.
+     * Every register value below comes from the clock tree profile selected
+     * in Bsp::Components::Clock. The ClockTree solver computes the PLL
+     * settings, prescalers and flash wait states at compile time and refuses
+     * to build a profile that breaks a datasheet limit. For the default
+     * profile the result is:
      *
      * bus  | source | div | MHz | Name
      * -----+--------+-----+-----+-------
+     * PLL  | HSE    | x9  | 72  | SYSCLK
      * AHB  | SYSCLK |  1  | 72  | HCLK
      * APB1 | HCLK   |  2  | 36  | PCLK1
      * APB2 | HCLK   |  1  | 72  | PCLK2
      * ADC  | PCLK2  |  6  | 12  | ADCCLK
-     *
-     * Based on the above table, the clock to timers 2-7 and 12-14 is 72Mhz
-     * (PCLK1 x 2). The clock to timers 1 and 8-11 is 72MHz (PCLK2 x 1).
-     *
-     * Even though USB is not used in this application, the USB prescaler is
-     * configured to give the appropriate USB clock (48MHz).
+     * USB  | PLL    | 1.5 | 48  | USBCLK
      *
      * For more information, see Figure 8 (Clock Tree) and section 7.3.2 in the
      * processor reference manual.
      */
-    RCC->CFGR = RCC_CFGR_USBPRE | RCC_CFGR_PPRE1_DIV2 | RCC_CFGR_ADCPRE_DIV6;
+    typedef Bsp::Components::Clock::Tree Tree;
 
     /*
-     * Configure the PLL parameters in the RCC configuration register. This
-     * sets the PLL source to the undivided HSE clock (8Mhz). The PLL
-     * multiplier is set to 9 to give the maximum clock speed of 72MHz.
+     * Turn on the oscillator of the profile. To prevent system glitches while
+     * setting up the clocks, the HSI (default) oscillator stays enabled with
+     * its default trim (0x10). See section 7.3.1 in the processor reference
+     * manual for more info.
      */
-    RCC->CFGR |= RCC_CFGR_PLLSRC | RCC_CFGR_PLLMULL9;
+    RCC->CR = Tree::CR;
 
     /*
-     * Turn on the PLL by setting the PLLON bit of the RCC control register.
+     * Wait for the HSERDY bit to be set in the RCC control register. Normally
+     * it is bad form to do sit in a while loop monitoring a register without
+     * any kind of timeout, but for this demonstration project, it will be good
+     * enough.
      */
-    RCC->CR |= RCC_CR_PLLON;
+    if (Tree::USES_HSE) {
+        while((RCC->CR & RCC_CR_HSERDY) == 0) { }
+    }
 
     /*
-     * Wait for the PLLRDY bit to be set in the RCC control register.
+     * The flash wait states must be raised before the system clock is. The
+     * prefetch buffer (enabled by default) is kept on. See section 3.3.3 in
+     * the processor reference manual for more information.
      */
-    while((RCC->CR & RCC_CR_PLLRDY) == 0) { }
+    FLASH->ACR = Tree::FLASH_ACR;
 
     /*
-     * Since the SYSCLK is being changed, the latency bits in the flash access
-     * control register must be modified. With a SYSCLK of 72MHz, two wait
-     * states are required for flash access. See section 3.3.3 in the processor
-     * reference manual for more information.
-     *
-     * Since the default configuration has the prefetch buffer enabled, the
-     * buffer enable is set as well.
-     *
-     * There is a bug in the HAL FLASH_ACR_LATENCY_2 is shifted 1 too many
-     * bits.
+     * Configure the bus clock dividers and the PLL parameters in the RCC
+     * configuration register. The system clock is still the HSI at this
+     * point.
      */
-    FLASH->ACR = FLASH_ACR_PRFTBE | (FLASH_ACR_LATENCY_2 >> 1);
+    RCC->CFGR = Tree::CFGR;
 
-    /*
-     * Now that the bus dividers and PLL are configured, the system clock can
-     * be changed from the HSI to the PLL output in the RCC configuration
-     * register.
-     *
-     * Care must be taken not to clear any previously configured bits.
-     */
-    RCC->CFGR |= (RCC->CFGR & RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+    if (Tree::USES_PLL) {
+        /*
+         * Turn on the PLL by setting the PLLON bit of the RCC control
+         * register. The bit-band alias sets the bit with a single store.
+         */
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, CR), RCC_CR_PLLON>::set();
+
+        /*
+         * Wait for the PLLRDY bit to be set in the RCC control register.
+         */
+        while((RCC->CR & RCC_CR_PLLRDY) == 0) { }
+    }
 
     /*
-     * Wait for the clock switch status to indicate the PLL is the system
-     * clock.
+     * Now that the bus dividers and PLL are configured, switch the system
+     * clock over and wait for the switch status to confirm it.
      */
-    while((RCC->CR & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL) { }
+    RCC->CFGR = Tree::CFGR | Tree::SW;
+    while((RCC->CFGR & RCC_CFGR_SWS) != Tree::SWS) { }
 
     /*
-     * Disable the HSI since it is no longer in use.
+     * Disable the HSI if it is no longer in use.
      */
-    RCC->CR &= ~(RCC_CR_HSION);
+    if (Tree::USES_HSE) {
+        Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, CR), RCC_CR_HSION>::clear();
+    }
 
     /*
      * Update the system core clock variable for CMSIS.
@@ -175,23 +160,11 @@ extern "C" void SystemInit (void)
 
     /* IRQ PRIORITY CONFIGURATION */
     /*
-     * Configure the System Control Block to give the maximum amount of bits to
-     * the interrupt group priority. See section 4.4.5 of the processor
-     * programming manual for more information.
-     *
-     * To get the appropriate priority group bits, the value 0x3 must be
-     * written to bits [10:8]
-     *
-     * A special value of 0x05FA must be written to the upper 16 bits for the
-     * register to update.
+     * Give all priority bits to the preemption priority and apply the
+     * priority plan in nvic.hpp. The SysTick and PendSV get the lowest
+     * priority.
      */
-    SCB->AIRCR = (0x05FA << 16) | (0x3 << 8);
-
-    /*
-     * Set the SysTick interrupt to the lowest priority (highest numerical 
-     * value).
-     */
-    NVIC_SetPriority(SysTick_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+    Nvic::init();
 
     /*
      * Configure the SysTick to trigger an interrupt every 1 ms. The system
@@ -206,8 +179,10 @@ extern "C" void SystemInit (void)
      * 72000 clock ticks. To compensate for the zero crossing tick, an extra
      * minus 1 is need.
      */
-    constexpr uint32_t ms_ticks = 72000000 / 1000;
-    constexpr uint32_t load     = (ms_ticks - 1) & 0xFFFFFF;
+    constexpr uint32_t ms_ticks = Bsp::Components::Clock::HCLK_FREQ_HZ /
+                                  Bsp::Components::Clock::TICK_FREQ_HZ;
+    static_assert(ms_ticks - 1 <= SysTick_LOAD_RELOAD_Msk, "SysTick reload does not fit in 24 bits");
+    constexpr uint32_t load     = ms_ticks - 1;
     SysTick->LOAD = load;
 
     /*
@@ -226,8 +201,7 @@ extern "C" void SystemInit (void)
     /*
      * Enable the peripheral clocks and IO used in the application.
      */
-    enableGpioPortClk(Bsp::Components::Led::port);
-    configureGpioPinOut(Bsp::Components::Led::port, Bsp::Components::Led::pin);
+    Bsp::Components::Led::Pin::init();
 
 #endif /* !defined(USE_HAL_DRIVER) */
 }
@@ -355,69 +329,3 @@ extern "C" void SystemCoreClockUpdate(void)
      */
     SystemCoreClock = (sysclk / ahb_div) >> 3;
 }
-
-#if !defined(USE_HAL_DRIVER)
-/*
- * Enable the given GPIO port peripheral clock in the RCC module.
- */
-static void enableGpioPortClk(const GPIO_TypeDef * const port)
-{
-    const uint32_t en = port == GPIOA ? RCC_APB2ENR_IOPAEN :
-                        port == GPIOB ? RCC_APB2ENR_IOPBEN :
-                        port == GPIOC ? RCC_APB2ENR_IOPCEN :
-                        port == GPIOD ? RCC_APB2ENR_IOPDEN :
-                        port == GPIOE ? RCC_APB2ENR_IOPEEN :
-                                        0                  ;
-
-    RCC->APB2ENR |= en;
-}
-
-/*
- * Configure the given GPIO pin as a push-pull fast output.
- */
-static void configureGpioPinOut(GPIO_TypeDef * const port, uint32_t pin)
-{
-    /*
-     * Exit the function early if the pin number is too high. 
-     */
-    if (pin > 15) return;
-
-    /*
-     * The GPIO pin configuration is distributed as 4 bits per pin in two
-     * registers. For GPIO pins 0-7 the CRL register is used. Pins 8-15 are
-     * configured in CRH. The offset for a given GPIO pins configuration
-     * register can be computed with the following formula:
-     *
-     *  offset = (pin % 8) * 4
-     * 
-     * or without using divides and multiplies
-     * 
-     *  offset = (pin & 7) << 2;
-     */
-    const uint32_t offset = (pin & 7) << 2;
-
-    /* 
-     * For push-pull outputs, the upper 2 configuration bits are 0x00. To
-     * enable fast mode on a pin the lower 2 configuration bits are 0x11;
-     */
-    constexpr uint32_t pin_cfg = 0x0011;
-    
-    /*
-     * Configure either the high or low configuration register based on the pin
-     * number.
-     */
-    const uint32_t mask = 0xFFFF  << offset;
-    const uint32_t cfg  = pin_cfg << offset;
-    if (pin <= 7) {
-        port->CRL = (port->CRL & ~mask) | cfg;
-    } else {
-        port->CRH = (port->CRH & ~mask) | cfg;
-    }
-
-    /*
-     * Default the newly configured pins to low. The atomic set and clear
-     * registers has the IO clear bits in the upper 16 bits.
-     */
-    port->BSRR = 1 << (pin + 16);
-}
-#endif
\ No newline at end of file
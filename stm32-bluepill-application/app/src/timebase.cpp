@@ -0,0 +1,112 @@
+#include "timebase.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+
+// APP
+#include "bsp.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+uint32_t g_startup_cycles;
+
+void Timebase::init(void)
+{
+    /*
+     * The DWT unit is part of the debug trace block. The trace enable bit in
+     * the debug exception and monitor control register must be set before the
+     * cycle counter can run. See section C1.8 of the ARMv7-M architecture
+     * reference manual.
+     */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t Timebase::micros(void)
+{
+    uint32_t ms  = 0;
+    uint32_t val = 0;
+
+    /*
+     * Sample the millisecond count and the SysTick down counter until both
+     * are read without a SysTick interrupt in between.
+     */
+    do {
+        ms  = Bsp::Util::g_tick_ms;
+        val = SysTick->VAL;
+    } while (ms != Bsp::Util::g_tick_ms);
+
+    /*
+     * If the counter has reloaded but the SysTick interrupt has not run yet
+     * (interrupts masked or called from a higher priority handler), the
+     * millisecond count is one behind. A freshly reloaded counter sits near
+     * the top of its range, so only compensate in that case.
+     */
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && (val > (SysTick->LOAD >> 1))) {
+        ++ms;
+    }
+
+    /* The SysTick counts down, so the elapsed cycles are LOAD - VAL. */
+    const uint32_t elapsed = SysTick->LOAD - val;
+    return (ms * 1000) + (elapsed / CYCLES_PER_US);
+}
+
+void Timebase::delayCycles(uint32_t count)
+{
+    const uint32_t start = cycles();
+
+    /*
+     * Unsigned subtraction keeps the comparison correct across a counter
+     * wrap.
+     */
+    while ((cycles() - start) < count) { }
+}
+
+void Timebase::delayUs(uint32_t delay_us)
+{
+    /*
+     * Short delays spin on the cycle counter directly. The limit keeps the
+     * cycle product well inside the 32 bit counter.
+     */
+    if (delay_us < 1000) {
+        delayCycles(delay_us * CYCLES_PER_US);
+        return;
+    }
+
+    /*
+     * Longer delays sleep through the whole milliseconds (minus one, since
+     * the current millisecond is already partially spent) and spin on the
+     * microsecond timestamp for the remainder.
+     */
+    const uint32_t deadline = micros() + delay_us;
+    sleepUntil(millis() + (delay_us / 1000) - 1);
+    while (!reached(micros(), deadline)) { }
+}
+
+void Timebase::sleepUntil(uint32_t deadline_ms)
+{
+    /*
+     * The SysTick interrupt wakes the core at least once every millisecond,
+     * so the deadline is re-checked on every tick. Any other interrupt simply
+     * causes an early re-check.
+     *
+     * The check and the WFI run with PRIMASK set: a tick that lands between
+     * them stays pending and makes the WFI return at once, instead of being
+     * served first and leaving the core asleep until the next one. Pending
+     * interrupts are then let through (the ISB makes sure they are taken
+     * before PRIMASK is set again).
+     */
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    while (!reached(millis(), deadline_ms)) {
+        __WFI();
+        __set_PRIMASK(primask);
+        __ISB();
+        __disable_irq();
+    }
+
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,142 @@
+#include "uart_log.hpp"
+
+// STANDARD LIBRARY
+#include <stdint.h>
+#include <string.h>
+
+// APP
+#include "bitband.hpp"
+#include "bsp.hpp"
+#include "noinit.hpp"
+#include "nvic.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+namespace UartLog {
+
+    /* ping-pong buffers (only ever read after being written) */
+    NOINIT static uint8_t g_buffers[2][BUFFER_SIZE];
+
+    /* index of the buffer log calls copy into */
+    static uint32_t g_active;
+
+    /* number of bytes in the active buffer */
+    static uint32_t g_fill;
+
+    /* set while the DMA drains the inactive buffer */
+    static bool g_busy;
+
+    /* bytes dropped because the active buffer was full */
+    static volatile uint32_t g_dropped;
+
+    static void startTransfer(void);
+}
+
+void UartLog::init(void)
+{
+    using namespace Bsp::Components;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_AFIOEN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB2ENR), RCC_APB2ENR_USART1EN>::set();
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+
+    /* The TX pin is an alternate function push-pull output. */
+    Console::TxPin::init();
+
+    /*
+     * With 16x oversampling the BRR register holds the USART divider in
+     * 1/16th units, which is simply the peripheral clock over the baud rate
+     * (rounded). See section 27.3.4 of the reference manual.
+     */
+    Console::usart->BRR = (Clock::PCLK2_FREQ_HZ + (Console::baud / 2)) / Console::baud;
+    Console::usart->CR3 = USART_CR3_DMAT;
+    Console::usart->CR1 = USART_CR1_UE | USART_CR1_TE;
+
+    /*
+     * DMA1 channel 4 is hard wired to the USART1 TX request. The channel
+     * moves bytes from memory (incrementing) to the fixed data register and
+     * interrupts when the whole buffer has been handed to the USART.
+     */
+    DMA1_Channel4->CCR  = 0;
+    DMA1_Channel4->CPAR = reinterpret_cast<uintptr_t>(&Console::usart->DR);
+
+    Nvic::enable<DMA1_Channel4_IRQn>();
+}
+
+uint32_t UartLog::write(const void *data, uint32_t len)
+{
+    Nvic::CriticalSection cs;
+
+    const uint32_t room  = BUFFER_SIZE - g_fill;
+    const uint32_t count = (len < room) ? len : room;
+    memcpy(&g_buffers[g_active][g_fill], data, count);
+    g_fill += count;
+
+    if (!g_busy) {
+        startTransfer();
+    }
+
+    g_dropped = g_dropped + (len - count);
+
+    return count;
+}
+
+bool UartLog::tryWrite(const void *data, uint32_t len)
+{
+    Nvic::CriticalSection cs;
+
+    if (len > BUFFER_SIZE - g_fill) {
+        g_dropped = g_dropped + len;
+        return false;
+    }
+
+    memcpy(&g_buffers[g_active][g_fill], data, len);
+    g_fill += len;
+
+    if (!g_busy) {
+        startTransfer();
+    }
+
+    return true;
+}
+
+uint32_t UartLog::write(const char *str)
+{
+    return write(str, strlen(str));
+}
+
+uint32_t UartLog::dropped(void)
+{
+    return g_dropped;
+}
+
+void UartLog::isr(void)
+{
+    DMA1->IFCR = DMA_IFCR_CGIF4;
+
+    /*
+     * The drained buffer is free again. Hand whatever collected in the
+     * active buffer meanwhile to the DMA (which swaps the buffers).
+     */
+    g_busy = false;
+    startTransfer();
+}
+
+/*
+ * Start draining the active buffer and make the other buffer active. Must be
+ * called with the log state protected (critical section or from the ISR).
+ */
+void UartLog::startTransfer(void)
+{
+    if (g_fill == 0) return;
+
+    DMA1_Channel4->CCR   = 0;
+    DMA1_Channel4->CMAR  = reinterpret_cast<uintptr_t>(g_buffers[g_active]);
+    DMA1_Channel4->CNDTR = g_fill;
+    DMA1_Channel4->CCR   = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE | DMA_CCR_EN;
+
+    g_active ^= 1;
+    g_fill    = 0;
+    g_busy    = true;
+}
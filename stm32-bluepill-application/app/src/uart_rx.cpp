@@ -0,0 +1,184 @@
+#include "uart_rx.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+
+// APP
+#include "bitband.hpp"
+#include "bsp.hpp"
+#include "noinit.hpp"
+#include "nvic.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+namespace UartRx {
+
+    static_assert(BUFFER_SIZE >= 2 && (BUFFER_SIZE & (BUFFER_SIZE - 1)) == 0,
+                  "the buffer size must be a power of two");
+    static_assert(Bsp::Components::Console::baud <= Bsp::Components::Clock::PCLK2_FREQ_HZ / 16,
+                  "the console baud rate is above PCLK2 / 16");
+
+    static constexpr uint32_t MASK = BUFFER_SIZE - 1;
+
+    /* written by the DMA only (only ever read after being written) */
+    NOINIT static uint8_t g_buffer[BUFFER_SIZE];
+
+    /*
+     * Bytes received up to the last published position (free running) and
+     * that position in the buffer. Written by the interrupts only; both run
+     * at the same priority, so they never preempt each other.
+     */
+    static volatile uint32_t g_head;
+    static volatile uint32_t g_position;
+
+    /* bytes released by the reader (free running, reader only) */
+    static uint32_t g_tail;
+
+    static volatile uint32_t g_overruns;
+    static volatile uint32_t g_errors;
+
+    static uint32_t position(void);
+    static uint32_t received(void);
+    static void publish(void);
+}
+
+void UartRx::init(void)
+{
+    using namespace Bsp::Components;
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, AHBENR), RCC_AHBENR_DMA1EN>::set();
+
+    Console::RxPin::init();
+
+    g_head     = 0;
+    g_position = 0;
+    g_tail     = 0;
+
+    /*
+     * DMA1 channel 5 is hard wired to the USART1 RX request. Circular mode
+     * reloads the counter at the end of the buffer, so the channel runs for
+     * good; the half transfer and transfer complete interrupts bound the time
+     * between two published positions to half a buffer.
+     */
+    DMA1_Channel5->CCR   = 0;
+    DMA1_Channel5->CPAR  = reinterpret_cast<uintptr_t>(&Console::usart->DR);
+    DMA1_Channel5->CMAR  = reinterpret_cast<uintptr_t>(g_buffer);
+    DMA1_Channel5->CNDTR = BUFFER_SIZE;
+    DMA1_Channel5->CCR   = DMA_CCR_PL_1 | DMA_CCR_MINC | DMA_CCR_CIRC |
+                           DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_EN;
+
+    Nvic::enable<DMA1_Channel5_IRQn>();
+    Nvic::enable<USART1_IRQn>();
+
+    /* UartLog owns the rest of the USART setup (baud rate, transmitter). */
+    {
+        Nvic::CriticalSection cs;
+        Console::usart->CR3 |= USART_CR3_DMAR | USART_CR3_EIE;
+        Console::usart->CR1 |= USART_CR1_RE | USART_CR1_IDLEIE;
+    }
+}
+
+ring::Span<const uint8_t> UartRx::readSpan(void)
+{
+    const uint32_t head = g_head;
+
+    /* Fell a whole buffer behind: what is left is overwritten. */
+    if (received() - g_tail > BUFFER_SIZE) {
+        g_overruns = g_overruns + 1;
+        g_tail     = head;
+    }
+
+    const uint32_t used   = head - g_tail;
+    const uint32_t offset = g_tail & MASK;
+    const uint32_t run    = BUFFER_SIZE - offset;
+    const ring::Span<const uint8_t> span = { &g_buffer[offset], (used < run) ? used : run };
+    return span;
+}
+
+/*
+ * The bytes were intact while the DMA had not come around to them again,
+ * i.e. while it had received less than a buffer past the first one.
+ */
+bool UartRx::release(uint32_t count)
+{
+    const uint32_t first = g_tail;
+
+    g_tail = first + count;
+    if (received() - first > BUFFER_SIZE) {
+        g_overruns = g_overruns + 1;
+        g_tail     = g_head;
+        return false;
+    }
+    return true;
+}
+
+uint32_t UartRx::overruns(void)
+{
+    return g_overruns;
+}
+
+uint32_t UartRx::errors(void)
+{
+    return g_errors;
+}
+
+/*
+ * Reading SR, then DR clears IDLE and the error flags. The DMA has taken
+ * every byte already, so the DR read does not steal one.
+ */
+void UartRx::usartIsr(void)
+{
+    USART_TypeDef * const usart = Bsp::Components::Console::usart;
+    const uint32_t        sr    = usart->SR;
+
+    if (sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE)) {
+        (void)usart->DR;
+    }
+    if (sr & (USART_SR_ORE | USART_SR_NE | USART_SR_FE)) {
+        g_errors = g_errors + 1;
+    }
+    publish();
+}
+
+void UartRx::dmaIsr(void)
+{
+    DMA1->IFCR = DMA_IFCR_CGIF5;
+    publish();
+}
+
+/* current DMA write position in the buffer (the counter reloads to BUFFER_SIZE) */
+uint32_t UartRx::position(void)
+{
+    return (BUFFER_SIZE - DMA1_Channel5->CNDTR) & MASK;
+}
+
+/*
+ * Bytes received so far, including those not published yet. Sample the
+ * published state and the DMA counter until no interrupt published in
+ * between (the same way as Timebase::micros()).
+ */
+uint32_t UartRx::received(void)
+{
+    uint32_t head    = 0;
+    uint32_t last    = 0;
+    uint32_t current = 0;
+
+    do {
+        head    = g_head;
+        last    = g_position;
+        current = position();
+    } while (head != g_head);
+
+    return head + ((current - last) & MASK);
+}
+
+/* at most half a buffer has come in since the last call, so the difference is unambiguous */
+void UartRx::publish(void)
+{
+    const uint32_t current = position();
+
+    g_head     = g_head + ((current - g_position) & MASK);
+    g_position = current;
+}
@@ -0,0 +1,1169 @@
+#include "usb_cdc.hpp"
+
+// STANDARD LIBRARY
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// APP
+#include "bsp.hpp"
+#include "nvic.hpp"
+
+// STATIC LIB
+#include "ring/spsc_ring.hpp"
+
+#if defined(USE_HAL_DRIVER)
+
+// STM32 HAL
+#include "stm32f1xx_hal.h"
+
+#else
+
+// APP
+#include "bitband.hpp"
+#include "timebase.hpp"
+
+// CMSIS
+#include "stm32f1xx.h"
+
+#endif
+
+namespace UsbCdc {
+
+    /* ENDPOINTS */
+    static constexpr uint32_t DATA_IN_EP  = 1;
+    static constexpr uint32_t DATA_OUT_EP = 2;
+    static constexpr uint32_t NOTIFY_EP   = 3;
+
+    /* direction bit of an endpoint address */
+    static constexpr uint32_t EP_IN = 0x80;
+
+    static constexpr uint32_t NOTIFY_PACKET_SIZE = 16;
+
+    /*
+     * Packet memory layout (byte offsets): the buffer table of 4 endpoints,
+     * then 64 bytes per buffer and 16 for the notifications (512 in all).
+     */
+    static constexpr uint32_t EP0_OUT_BUFFER      = 0x040;
+    static constexpr uint32_t EP0_IN_BUFFER       = 0x080;
+    static constexpr uint32_t DATA_IN_BUFFERS[2]  = { 0x0C0, 0x100 };
+    static constexpr uint32_t DATA_OUT_BUFFERS[2] = { 0x140, 0x180 };
+    static constexpr uint32_t NOTIFY_BUFFER       = 0x1C0;
+
+    /* time D+ is held low for the host to see a disconnect */
+    static constexpr uint32_t RECONNECT_MS = 10;
+
+    /* ST's virtual COM port IDs */
+    static constexpr uint32_t VENDOR_ID  = 0x0483;
+    static constexpr uint32_t PRODUCT_ID = 0x5740;
+
+    /* bmRequestType fields */
+    static constexpr uint32_t TYPE_MASK           = 0x60;
+    static constexpr uint32_t TYPE_STANDARD       = 0x00;
+    static constexpr uint32_t TYPE_CLASS          = 0x20;
+    static constexpr uint32_t RECIPIENT_MASK      = 0x1F;
+    static constexpr uint32_t RECIPIENT_DEVICE    = 0x00;
+    static constexpr uint32_t RECIPIENT_INTERFACE = 0x01;
+    static constexpr uint32_t RECIPIENT_ENDPOINT  = 0x02;
+
+    /* standard requests (section 9.4 of the USB 2.0 specification) */
+    static constexpr uint32_t GET_STATUS        = 0;
+    static constexpr uint32_t CLEAR_FEATURE     = 1;
+    static constexpr uint32_t SET_ADDRESS       = 5;
+    static constexpr uint32_t GET_DESCRIPTOR    = 6;
+    static constexpr uint32_t GET_CONFIGURATION = 8;
+    static constexpr uint32_t SET_CONFIGURATION = 9;
+    static constexpr uint32_t GET_INTERFACE     = 10;
+    static constexpr uint32_t SET_INTERFACE     = 11;
+
+    /* CDC PSTN requests (section 6.3 of the PSTN subclass specification) */
+    static constexpr uint32_t SET_LINE_CODING        = 0x20;
+    static constexpr uint32_t GET_LINE_CODING        = 0x21;
+    static constexpr uint32_t SET_CONTROL_LINE_STATE = 0x22;
+    static constexpr uint32_t SEND_BREAK             = 0x23;
+
+    /* descriptor types */
+    static constexpr uint8_t DEVICE_DESCRIPTOR_TYPE = 1;
+    static constexpr uint8_t CONFIG_DESCRIPTOR_TYPE = 2;
+    static constexpr uint8_t STRING_DESCRIPTOR_TYPE = 3;
+
+    /* string descriptor indexes */
+    static constexpr uint8_t STRING_MANUFACTURER = 1;
+    static constexpr uint8_t STRING_PRODUCT      = 2;
+    static constexpr uint8_t STRING_SERIAL       = 3;
+
+    static const uint8_t DEVICE_DESCRIPTOR[] = {
+        18, DEVICE_DESCRIPTOR_TYPE,
+        0x00, 0x02,                     /* USB 2.0                          */
+        0x02, 0x00, 0x00,               /* communications device class      */
+        PACKET_SIZE,
+        VENDOR_ID & 0xFF, VENDOR_ID >> 8,
+        PRODUCT_ID & 0xFF, PRODUCT_ID >> 8,
+        0x00, 0x01,                     /* device release 1.00              */
+        STRING_MANUFACTURER, STRING_PRODUCT, STRING_SERIAL,
+        1,                              /* configurations                   */
+    };
+
+    static const uint8_t CONFIG_DESCRIPTOR[] = {
+        /* configuration: 67 bytes in all, 2 interfaces, bus powered, 100 mA */
+        9, CONFIG_DESCRIPTOR_TYPE, 67, 0, 2, 1, 0, 0x80, 50,
+
+        /* interface 0: communications class, abstract control model, AT commands */
+        9, 4, 0, 0, 1, 0x02, 0x02, 0x01, 0,
+        5, 0x24, 0x00, 0x10, 0x01,      /* header, CDC 1.10                 */
+        5, 0x24, 0x01, 0x00, 0x01,      /* call management, data on if 1    */
+        4, 0x24, 0x02, 0x02,            /* ACM: line coding and state       */
+        5, 0x24, 0x06, 0x00, 0x01,      /* union: if 0 controls if 1        */
+        7, 5, EP_IN | NOTIFY_EP, 0x03, NOTIFY_PACKET_SIZE, 0, 16,
+
+        /* interface 1: data class, bulk OUT and IN */
+        9, 4, 1, 0, 2, 0x0A, 0x00, 0x00, 0,
+        7, 5, DATA_OUT_EP, 0x02, PACKET_SIZE, 0, 0,
+        7, 5, EP_IN | DATA_IN_EP, 0x02, PACKET_SIZE, 0, 0,
+    };
+
+    static_assert(sizeof(CONFIG_DESCRIPTOR) == 67, "wTotalLength of the configuration descriptor");
+
+    static const char * const STRINGS[] = { nullptr, "STM32 Blue Pill", "CDC Stream" };
+
+    /* setup packet */
+    struct Request {
+        uint8_t  type;
+        uint8_t  request;
+        uint16_t value;
+        uint16_t index;
+        uint16_t length;
+    };
+
+    /* control transfer stage */
+    enum class Stage : uint32_t {
+        IDLE,
+        DATA_IN,
+        DATA_OUT,
+        STATUS_IN,
+        STATUS_OUT,
+    };
+
+    static ring::SpscRing<uint8_t, TX_BUFFER_SIZE> g_tx;
+    static ring::SpscRing<uint8_t, RX_BUFFER_SIZE> g_rx;
+
+    /* configuration selected by the host (0: not configured) */
+    static volatile uint32_t g_configuration;
+
+    /* DTR of the last SET_CONTROL_LINE_STATE */
+    static volatile bool g_dtr;
+
+    /* dwDTERate, bCharFormat, bParityType, bDataBits (stored, not used) */
+    static uint8_t g_line_coding[7] = { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };
+
+    /* CONTROL TRANSFER */
+    static Request        g_request;
+    static Stage          g_stage;
+    static const uint8_t *g_ctrl_data;
+    static uint32_t       g_ctrl_remaining;
+    static bool           g_ctrl_zlp;
+    static uint8_t        g_ctrl_buffer[PACKET_SIZE];
+
+    static void kick(void);
+    static void busReset(void);
+    static void setup(const uint8_t *packet);
+    static bool standardRequest(void);
+    static bool classRequest(void);
+    static bool getDescriptor(void);
+    static uint32_t stringDescriptor(uint32_t index);
+    static void configure(uint32_t configuration);
+    static void sendControl(const uint8_t *data, uint32_t length);
+    static void sendNext(void);
+    static bool receiveControl(void);
+    static void sendStatus(void);
+    static void ep0In(void);
+    static void ep0Out(uint32_t count);
+
+    /* DRIVER PRIMITIVES (register level or HAL) */
+    static void start(void);
+    static void ep0Send(const uint8_t *data, uint32_t length);
+    static void ep0Receive(uint32_t length);
+    static void ep0Stall(void);
+    static void setAddress(uint32_t address);
+    static void openEndpoint(uint32_t address);
+    static void closeEndpoints(void);
+    static void txPump(void);
+    static void rxPump(void);
+}
+
+#if defined(USE_HAL_DRIVER)
+namespace UsbCdc {
+    static PCD_HandleTypeDef g_hpcd;
+
+    /* bytes of the TX ring handed to the PCD driver */
+    static bool     g_tx_busy;
+    static uint32_t g_tx_length;
+
+    /* the last transfer ended with a full packet */
+    static bool     g_tx_zlp;
+
+    /* a receive into g_rx_packet is pending */
+    static bool     g_rx_armed;
+    static uint8_t  g_rx_packet[PACKET_SIZE];
+}
+#else
+namespace UsbCdc {
+
+    /* buffer table entry fields (half words) */
+    static constexpr uint32_t ADDR_TX  = 0;
+    static constexpr uint32_t COUNT_TX = 1;
+    static constexpr uint32_t ADDR_RX  = 2;
+    static constexpr uint32_t COUNT_RX = 3;
+
+    /*
+     * Double buffered endpoints keep buffer 0 in the TX fields and buffer 1
+     * in the RX fields of their entry, whatever the direction.
+     */
+    static constexpr uint32_t BUFFER_COUNT[2] = { COUNT_TX, COUNT_RX };
+
+    /* COUNTn_RX value of a 64 byte receive buffer (BL_SIZE, 2 blocks of 32) */
+    static constexpr uint32_t RX_SIZE_64 = 0x8400;
+
+    /* byte count of a COUNTn field */
+    static constexpr uint32_t COUNT_MASK = 0x3FF;
+
+    /* EPnR fields written as they are (the others toggle on a 1) */
+    static constexpr uint32_t EPR_CONFIG = USB_EP_T_FIELD | USB_EP_KIND | USB_EPADDR_FIELD;
+    static constexpr uint32_t EPR_STATE  = USB_EP_DTOG_RX | USB_EPRX_STAT | USB_EP_DTOG_TX | USB_EPTX_STAT;
+
+    /*
+     * SW_BUF, the buffer the application owns, is DTOG_RX on an IN and
+     * DTOG_TX on an OUT double buffered endpoint.
+     */
+    static constexpr uint32_t IN_SW_BUF  = USB_EP_DTOG_RX;
+    static constexpr uint32_t OUT_SW_BUF = USB_EP_DTOG_TX;
+
+    /* IN buffers committed and not yet acknowledged by the host */
+    static uint32_t g_tx_queued;
+
+    /* size of the last committed IN packet */
+    static uint32_t g_tx_last;
+
+    /* OUT buffers received and not yet moved into the RX ring */
+    static uint32_t g_rx_filled;
+
+    static volatile uint16_t *pma(uint32_t offset);
+    static void setBufferTable(uint32_t ep, uint32_t field, uint32_t value);
+    static uint32_t bufferTable(uint32_t ep, uint32_t field);
+    static volatile uint16_t &epr(uint32_t ep);
+    static void eprInit(uint32_t ep, uint32_t config, uint32_t state);
+    static void eprToggle(uint32_t ep, uint32_t bits);
+    static void eprClear(uint32_t ep, uint32_t flags);
+    static void eprStatus(uint32_t ep, uint32_t mask, uint32_t status);
+    static void pmaWrite(uint32_t offset, const uint8_t *data, uint32_t length);
+    static void pmaRead(uint32_t offset, uint8_t *data, uint32_t length);
+    static void pmaFromRing(uint32_t offset, uint32_t length);
+    static void pmaToRing(uint32_t offset, uint32_t length);
+    static void reset(void);
+    static void control(void);
+}
+#endif
+
+void UsbCdc::init(void)
+{
+    start();
+}
+
+bool UsbCdc::connected(void)
+{
+    return g_configuration != 0 && g_dtr;
+}
+
+uint32_t UsbCdc::write(const void *data, uint32_t len)
+{
+    const uint32_t count = g_tx.push(static_cast<const uint8_t *>(data), len);
+    if (count != 0) {
+        kick();
+    }
+    return count;
+}
+
+ring::Span<uint8_t> UsbCdc::writeSpan(void)
+{
+    return g_tx.writeSpan();
+}
+
+void UsbCdc::commit(uint32_t count)
+{
+    g_tx.commit(count);
+    kick();
+}
+
+uint32_t UsbCdc::read(void *data, uint32_t len)
+{
+    const uint32_t count = g_rx.pop(static_cast<uint8_t *>(data), len);
+
+    /* The OUT endpoint may be waiting for room. */
+    if (count != 0) {
+        kick();
+    }
+    return count;
+}
+
+uint32_t UsbCdc::available(void)
+{
+    return g_rx.size();
+}
+
+/* let the interrupt move data (it owns the endpoints) */
+void UsbCdc::kick(void)
+{
+    NVIC_SetPendingIRQ(USB_LP_CAN1_RX0_IRQn);
+}
+
+/* back to the default state after a bus reset, unsent data is dropped */
+void UsbCdc::busReset(void)
+{
+    g_configuration = 0;
+    g_dtr           = false;
+    g_stage         = Stage::IDLE;
+    g_tx.release(g_tx.size());
+}
+
+void UsbCdc::setup(const uint8_t *packet)
+{
+    g_request.type    = packet[0];
+    g_request.request = packet[1];
+    g_request.value   = static_cast<uint16_t>(packet[2] | (packet[3] << 8));
+    g_request.index   = static_cast<uint16_t>(packet[4] | (packet[5] << 8));
+    g_request.length  = static_cast<uint16_t>(packet[6] | (packet[7] << 8));
+
+    /* A SETUP aborts whatever transfer was in progress. */
+    g_stage = Stage::IDLE;
+
+    bool handled = false;
+    switch (g_request.type & TYPE_MASK) {
+        case TYPE_STANDARD: handled = standardRequest(); break;
+        case TYPE_CLASS:    handled = classRequest();    break;
+        default:                                         break;
+    }
+
+    if (!handled) {
+        g_stage = Stage::IDLE;
+        ep0Stall();
+    }
+}
+
+bool UsbCdc::standardRequest(void)
+{
+    const uint32_t recipient = g_request.type & RECIPIENT_MASK;
+
+    switch (g_request.request) {
+        case GET_STATUS:
+            /* bus powered, no remote wakeup, no halted endpoint */
+            g_ctrl_buffer[0] = 0;
+            g_ctrl_buffer[1] = 0;
+            sendControl(g_ctrl_buffer, 2);
+            return true;
+
+        case CLEAR_FEATURE:
+            /* ENDPOINT_HALT: restart the endpoint with DATA0 */
+            if (recipient != RECIPIENT_ENDPOINT || g_request.value != 0) return false;
+            if ((g_request.index & ~EP_IN) != 0) {
+                if (g_configuration == 0) return false;
+                if (g_request.index != (EP_IN | DATA_IN_EP) &&
+                    g_request.index != DATA_OUT_EP &&
+                    g_request.index != (EP_IN | NOTIFY_EP)) return false;
+                openEndpoint(g_request.index);
+            }
+            sendStatus();
+            return true;
+
+        case SET_ADDRESS:
+            /* applied when the status stage completes */
+            if (recipient != RECIPIENT_DEVICE) return false;
+            sendStatus();
+            return true;
+
+        case GET_DESCRIPTOR:
+            return getDescriptor();
+
+        case GET_CONFIGURATION:
+            g_ctrl_buffer[0] = static_cast<uint8_t>(g_configuration);
+            sendControl(g_ctrl_buffer, 1);
+            return true;
+
+        case SET_CONFIGURATION:
+            if (g_request.value > 1) return false;
+            configure(g_request.value);
+            sendStatus();
+            return true;
+
+        case GET_INTERFACE:
+            if (g_configuration == 0 || g_request.index > 1) return false;
+            g_ctrl_buffer[0] = 0;
+            sendControl(g_ctrl_buffer, 1);
+            return true;
+
+        case SET_INTERFACE:
+            if (g_configuration == 0 || g_request.index > 1 || g_request.value != 0) return false;
+            sendStatus();
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool UsbCdc::classRequest(void)
+{
+    /* Only the communications interface takes class requests. */
+    if ((g_request.type & RECIPIENT_MASK) != RECIPIENT_INTERFACE || g_request.index != 0) return false;
+
+    switch (g_request.request) {
+        case SET_LINE_CODING:
+            return g_request.length == sizeof(g_line_coding) && receiveControl();
+
+        case GET_LINE_CODING:
+            sendControl(g_line_coding, sizeof(g_line_coding));
+            return true;
+
+        case SET_CONTROL_LINE_STATE:
+            g_dtr = (g_request.value & 0x1) != 0;
+            sendStatus();
+            return true;
+
+        case SEND_BREAK:
+            sendStatus();
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool UsbCdc::getDescriptor(void)
+{
+    const uint32_t type  = g_request.value >> 8;
+    const uint32_t index = g_request.value & 0xFF;
+
+    switch (type) {
+        case DEVICE_DESCRIPTOR_TYPE:
+            sendControl(DEVICE_DESCRIPTOR, sizeof(DEVICE_DESCRIPTOR));
+            return true;
+
+        case CONFIG_DESCRIPTOR_TYPE:
+            sendControl(CONFIG_DESCRIPTOR, sizeof(CONFIG_DESCRIPTOR));
+            return true;
+
+        case STRING_DESCRIPTOR_TYPE: {
+            const uint32_t length = stringDescriptor(index);
+            if (length == 0) return false;
+            sendControl(g_ctrl_buffer, length);
+            return true;
+        }
+
+        /* A full speed only device has no device qualifier. */
+        default:
+            return false;
+    }
+}
+
+/*
+ * Build string descriptor index (UTF-16LE) in g_ctrl_buffer, returns its
+ * length or 0 if there is none. The serial number is the 96 bit unique
+ * device ID in hex.
+ */
+uint32_t UsbCdc::stringDescriptor(uint32_t index)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+
+    uint32_t length = 2;
+    if (index == 0) {
+        /* supported languages: English (United States) */
+        g_ctrl_buffer[length++] = 0x09;
+        g_ctrl_buffer[length++] = 0x04;
+    } else if (index == STRING_SERIAL) {
+        const uint8_t *uid = reinterpret_cast<const uint8_t *>(UID_BASE);
+        for (uint32_t i = 0; i < 12; ++i) {
+            g_ctrl_buffer[length++] = HEX[uid[i] >> 4];
+            g_ctrl_buffer[length++] = 0;
+            g_ctrl_buffer[length++] = HEX[uid[i] & 0xF];
+            g_ctrl_buffer[length++] = 0;
+        }
+    } else if (index < sizeof(STRINGS) / sizeof(STRINGS[0])) {
+        for (const char *c = STRINGS[index]; *c != '\0' && length < PACKET_SIZE; ++c) {
+            g_ctrl_buffer[length++] = static_cast<uint8_t>(*c);
+            g_ctrl_buffer[length++] = 0;
+        }
+    } else {
+        return 0;
+    }
+
+    g_ctrl_buffer[0] = static_cast<uint8_t>(length);
+    g_ctrl_buffer[1] = STRING_DESCRIPTOR_TYPE;
+    return length;
+}
+
+/* SET_CONFIGURATION: (re)start the data endpoints with DATA0 */
+void UsbCdc::configure(uint32_t configuration)
+{
+    closeEndpoints();
+    g_dtr           = false;
+    g_configuration = configuration;
+
+    if (configuration != 0) {
+        openEndpoint(EP_IN | DATA_IN_EP);
+        openEndpoint(DATA_OUT_EP);
+        openEndpoint(EP_IN | NOTIFY_EP);
+    }
+}
+
+/* IN data stage of up to wLength bytes of data, one packet at a time */
+void UsbCdc::sendControl(const uint8_t *data, uint32_t length)
+{
+    if (length > g_request.length) {
+        length = g_request.length;
+    }
+
+    /* Less than asked for ending on a full packet needs a zero length packet. */
+    g_ctrl_data      = data;
+    g_ctrl_remaining = length;
+    g_ctrl_zlp       = length != 0 && length < g_request.length && length % PACKET_SIZE == 0;
+    g_stage          = Stage::DATA_IN;
+    sendNext();
+}
+
+void UsbCdc::sendNext(void)
+{
+    const uint32_t chunk = (g_ctrl_remaining < PACKET_SIZE) ? g_ctrl_remaining : PACKET_SIZE;
+    ep0Send(g_ctrl_data, chunk);
+    g_ctrl_data      += chunk;
+    g_ctrl_remaining -= chunk;
+}
+
+/* OUT data stage into g_ctrl_buffer (a single packet) */
+bool UsbCdc::receiveControl(void)
+{
+    if (g_request.length > PACKET_SIZE) return false;
+
+    g_stage = Stage::DATA_OUT;
+    ep0Receive(g_request.length);
+    return true;
+}
+
+/* zero length IN status stage */
+void UsbCdc::sendStatus(void)
+{
+    g_stage = Stage::STATUS_IN;
+    ep0Send(nullptr, 0);
+}
+
+/* an EP0 IN packet went out */
+void UsbCdc::ep0In(void)
+{
+    switch (g_stage) {
+        case Stage::DATA_IN:
+            if (g_ctrl_remaining != 0) {
+                sendNext();
+            } else if (g_ctrl_zlp) {
+                g_ctrl_zlp = false;
+                ep0Send(nullptr, 0);
+            } else {
+                g_stage = Stage::STATUS_OUT;
+                ep0Receive(0);
+            }
+            break;
+
+        case Stage::STATUS_IN:
+            /* The new address only applies after the status stage. */
+            if ((g_request.type & TYPE_MASK) == TYPE_STANDARD && g_request.request == SET_ADDRESS) {
+                setAddress(g_request.value & 0x7F);
+            }
+            g_stage = Stage::IDLE;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* an EP0 OUT packet of count bytes arrived in g_ctrl_buffer */
+void UsbCdc::ep0Out(uint32_t count)
+{
+    switch (g_stage) {
+        case Stage::DATA_OUT:
+            if (g_request.request == SET_LINE_CODING && count >= sizeof(g_line_coding)) {
+                memcpy(g_line_coding, g_ctrl_buffer, sizeof(g_line_coding));
+            }
+            sendStatus();
+            break;
+
+        case Stage::STATUS_OUT:
+            g_stage = Stage::IDLE;
+            break;
+
+        default:
+            break;
+    }
+}
+
+#if defined(USE_HAL_DRIVER)
+void UsbCdc::start(void)
+{
+    /* Drive D+ low so the host sees a disconnect. */
+    GPIO_InitTypeDef pin;
+    pin.Pin   = GPIO_PIN_12;
+    pin.Mode  = GPIO_MODE_OUTPUT_PP;
+    pin.Pull  = GPIO_NOPULL;
+    pin.Speed = GPIO_SPEED_FREQ_LOW;
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    HAL_GPIO_WritePin(GPIOA, GPIO_PIN_12, GPIO_PIN_RESET);
+    HAL_GPIO_Init(GPIOA, &pin);
+    HAL_Delay(RECONNECT_MS);
+    HAL_GPIO_DeInit(GPIOA, GPIO_PIN_12);
+
+    /* 72 MHz PLL output divided by 1.5 */
+    RCC_PeriphCLKInitTypeDef clock = RCC_PeriphCLKInitTypeDef();
+    clock.PeriphClockSelection = RCC_PERIPHCLK_USB;
+    clock.UsbClockSelection    = RCC_USBCLKSOURCE_PLL_DIV1_5;
+    if (HAL_RCCEx_PeriphCLKConfig(&clock) != HAL_OK) {
+        __BKPT(0);
+    }
+    __HAL_RCC_USB_CLK_ENABLE();
+
+    g_hpcd.Instance                      = USB;
+    g_hpcd.Init.dev_endpoints            = 8;
+    g_hpcd.Init.speed                    = PCD_SPEED_FULL;
+    g_hpcd.Init.phy_itface               = PCD_PHY_EMBEDDED;
+    g_hpcd.Init.Sof_enable               = DISABLE;
+    g_hpcd.Init.low_power_enable         = DISABLE;
+    g_hpcd.Init.lpm_enable               = DISABLE;
+    g_hpcd.Init.battery_charging_enable  = DISABLE;
+    if (HAL_PCD_Init(&g_hpcd) != HAL_OK) {
+        __BKPT(0);
+    }
+
+    HAL_PCDEx_PMAConfig(&g_hpcd, 0x00, PCD_SNG_BUF, EP0_OUT_BUFFER);
+    HAL_PCDEx_PMAConfig(&g_hpcd, EP_IN, PCD_SNG_BUF, EP0_IN_BUFFER);
+    HAL_PCDEx_PMAConfig(&g_hpcd, EP_IN | DATA_IN_EP, PCD_DBL_BUF,
+                        DATA_IN_BUFFERS[0] | (DATA_IN_BUFFERS[1] << 16));
+    HAL_PCDEx_PMAConfig(&g_hpcd, DATA_OUT_EP, PCD_DBL_BUF,
+                        DATA_OUT_BUFFERS[0] | (DATA_OUT_BUFFERS[1] << 16));
+    HAL_PCDEx_PMAConfig(&g_hpcd, EP_IN | NOTIFY_EP, PCD_SNG_BUF, NOTIFY_BUFFER);
+
+    Nvic::enable<USB_LP_CAN1_RX0_IRQn>();
+
+    if (HAL_PCD_Start(&g_hpcd) != HAL_OK) {
+        __BKPT(0);
+    }
+}
+
+void UsbCdc::isr(void)
+{
+    HAL_PCD_IRQHandler(&g_hpcd);
+    txPump();
+    rxPump();
+}
+
+void UsbCdc::ep0Send(const uint8_t *data, uint32_t length)
+{
+    HAL_PCD_EP_Transmit(&g_hpcd, EP_IN, const_cast<uint8_t *>(data), length);
+}
+
+void UsbCdc::ep0Receive(uint32_t length)
+{
+    HAL_PCD_EP_Receive(&g_hpcd, 0x00, (length != 0) ? g_ctrl_buffer : nullptr, length);
+}
+
+void UsbCdc::ep0Stall(void)
+{
+    HAL_PCD_EP_SetStall(&g_hpcd, EP_IN);
+    HAL_PCD_EP_SetStall(&g_hpcd, 0x00);
+}
+
+/* the PCD driver writes it after the current EP0 IN packet */
+void UsbCdc::setAddress(uint32_t address)
+{
+    HAL_PCD_SetAddress(&g_hpcd, static_cast<uint8_t>(address));
+}
+
+void UsbCdc::openEndpoint(uint32_t address)
+{
+    const bool     notify = (address == (EP_IN | NOTIFY_EP));
+    const uint8_t  ep     = static_cast<uint8_t>(address);
+
+    HAL_PCD_EP_Close(&g_hpcd, ep);
+    HAL_PCD_EP_Open(&g_hpcd, ep, notify ? NOTIFY_PACKET_SIZE : PACKET_SIZE,
+                    notify ? EP_TYPE_INTR : EP_TYPE_BULK);
+
+    if (address == (EP_IN | DATA_IN_EP)) {
+        g_tx_busy = false;
+        g_tx_zlp  = false;
+    } else if (address == DATA_OUT_EP) {
+        g_rx_armed = false;
+    }
+}
+
+void UsbCdc::closeEndpoints(void)
+{
+    HAL_PCD_EP_Close(&g_hpcd, EP_IN | DATA_IN_EP);
+    HAL_PCD_EP_Close(&g_hpcd, DATA_OUT_EP);
+    HAL_PCD_EP_Close(&g_hpcd, EP_IN | NOTIFY_EP);
+    g_tx_busy  = false;
+    g_tx_zlp   = false;
+    g_rx_armed = false;
+}
+
+/*
+ * Hand the contiguous run at the read position of the TX ring to the driver
+ * as one transfer. It fills the two packet buffers from the ring directly.
+ */
+void UsbCdc::txPump(void)
+{
+    if (g_configuration == 0 || g_tx_busy) return;
+
+    const ring::Span<uint8_t> span = g_tx.readSpan();
+    if (span.empty() && !g_tx_zlp) return;
+
+    g_tx_length = span.size;
+    g_tx_zlp    = false;
+    g_tx_busy   = true;
+    HAL_PCD_EP_Transmit(&g_hpcd, EP_IN | DATA_IN_EP, span.data, span.size);
+}
+
+/* receive the next packet once the RX ring has room for it */
+void UsbCdc::rxPump(void)
+{
+    if (g_configuration == 0 || g_rx_armed) return;
+    if (RX_BUFFER_SIZE - g_rx.size() < PACKET_SIZE) return;
+
+    g_rx_armed = true;
+    HAL_PCD_EP_Receive(&g_hpcd, DATA_OUT_EP, g_rx_packet, PACKET_SIZE);
+}
+
+extern "C" void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+    HAL_PCD_EP_Open(hpcd, 0x00, UsbCdc::PACKET_SIZE, EP_TYPE_CTRL);
+    HAL_PCD_EP_Open(hpcd, UsbCdc::EP_IN, UsbCdc::PACKET_SIZE, EP_TYPE_CTRL);
+    UsbCdc::closeEndpoints();
+    UsbCdc::busReset();
+}
+
+extern "C" void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+    UsbCdc::setup(reinterpret_cast<const uint8_t *>(hpcd->Setup));
+}
+
+extern "C" void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    using namespace UsbCdc;
+
+    if (epnum == 0) {
+        ep0In();
+    } else if (epnum == DATA_IN_EP) {
+        g_tx.release(g_tx_length);
+        g_tx_zlp  = g_tx_length != 0 && g_tx_length % PACKET_SIZE == 0;
+        g_tx_busy = false;
+        txPump();
+    }
+}
+
+extern "C" void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+    using namespace UsbCdc;
+
+    if (epnum == 0) {
+        ep0Out(HAL_PCD_EP_GetRxCount(hpcd, 0x00));
+    } else if (epnum == DATA_OUT_EP) {
+        g_rx.push(g_rx_packet, HAL_PCD_EP_GetRxCount(hpcd, DATA_OUT_EP));
+        g_rx_armed = false;
+        rxPump();
+    }
+}
+#else
+void UsbCdc::start(void)
+{
+    static_assert(Bsp::Components::Clock::Tree::USB_CAPABLE, "USB needs a 48 MHz clock");
+
+    /* Drive D+ low so the host sees a disconnect. */
+    Bsp::Components::Usb::DpLow::init();
+    Timebase::delayUs(RECONNECT_MS * 1000);
+    Bsp::Components::Usb::DpPin::init();
+
+    Bitband::Bit<RCC_BASE + offsetof(RCC_TypeDef, APB1ENR), RCC_APB1ENR_USBEN>::set();
+
+    /*
+     * Power up the transceiver (PDWN clear) and keep the peripheral in reset
+     * until it is stable (tSTARTUP, 1 us). The host then resets the bus,
+     * which sets up the buffer table and EP0.
+     */
+    USB->CNTR = USB_CNTR_FRES;
+    Timebase::delayUs(1);
+    USB->CNTR = 0;
+    USB->ISTR = 0;
+    USB->CNTR = USB_CNTR_CTRM | USB_CNTR_RESETM;
+
+    Nvic::enable<USB_LP_CAN1_RX0_IRQn>();
+}
+
+void UsbCdc::isr(void)
+{
+    if (USB->ISTR & USB_ISTR_RESET) {
+        USB->ISTR = static_cast<uint16_t>(~USB_ISTR_RESET);
+        reset();
+    }
+
+    /* ISTR names the highest priority endpoint with a completed transfer. */
+    uint32_t istr;
+    while ((istr = USB->ISTR) & USB_ISTR_CTR) {
+        const uint32_t ep = istr & USB_ISTR_EP_ID;
+        if (ep == 0) {
+            control();
+        } else if (ep == DATA_IN_EP) {
+            txPump();
+        } else if (ep == DATA_OUT_EP) {
+            rxPump();
+        } else {
+            eprClear(ep, USB_EP_CTR_RX | USB_EP_CTR_TX);
+        }
+    }
+
+    /* Move data queued by the thread side. */
+    txPump();
+    rxPump();
+}
+
+/* half word at byte offset of the packet memory (one per 32 bit word) */
+volatile uint16_t *UsbCdc::pma(uint32_t offset)
+{
+    return reinterpret_cast<volatile uint16_t *>(USB_PMAADDR + 2 * offset);
+}
+
+void UsbCdc::setBufferTable(uint32_t ep, uint32_t field, uint32_t value)
+{
+    *pma(8 * ep + 2 * field) = static_cast<uint16_t>(value);
+}
+
+uint32_t UsbCdc::bufferTable(uint32_t ep, uint32_t field)
+{
+    return *pma(8 * ep + 2 * field);
+}
+
+volatile uint16_t &UsbCdc::epr(uint32_t ep)
+{
+    return (&USB->EP0R)[2 * ep];
+}
+
+/* set type, kind and address and toggle DTOG/STAT to state, CTR cleared */
+void UsbCdc::eprInit(uint32_t ep, uint32_t config, uint32_t state)
+{
+    epr(ep) = static_cast<uint16_t>(config | ((epr(ep) & EPR_STATE) ^ state));
+}
+
+/*
+ * Toggle DTOG/STAT bits. The CTR flags are written 1, which leaves them
+ * alone, so a transfer completing meanwhile is not lost.
+ */
+void UsbCdc::eprToggle(uint32_t ep, uint32_t bits)
+{
+    epr(ep) = static_cast<uint16_t>((epr(ep) & EPR_CONFIG) | USB_EP_CTR_RX | USB_EP_CTR_TX | bits);
+}
+
+/* clear CTR flags */
+void UsbCdc::eprClear(uint32_t ep, uint32_t flags)
+{
+    epr(ep) = static_cast<uint16_t>(((epr(ep) & EPR_CONFIG) | USB_EP_CTR_RX | USB_EP_CTR_TX) & ~flags);
+}
+
+/* set the STAT field(s) of mask to status */
+void UsbCdc::eprStatus(uint32_t ep, uint32_t mask, uint32_t status)
+{
+    eprToggle(ep, (epr(ep) & mask) ^ status);
+}
+
+void UsbCdc::pmaWrite(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+    volatile uint16_t *word = pma(offset);
+    for (uint32_t i = 0; i + 1 < length; i += 2) {
+        *word = static_cast<uint16_t>(data[i] | (data[i + 1] << 8));
+        word += 2;
+    }
+    if (length & 1) {
+        *word = data[length - 1];
+    }
+}
+
+void UsbCdc::pmaRead(uint32_t offset, uint8_t *data, uint32_t length)
+{
+    const volatile uint16_t *word = pma(offset);
+    for (uint32_t i = 0; i + 1 < length; i += 2) {
+        const uint32_t half = *word;
+        data[i]     = static_cast<uint8_t>(half);
+        data[i + 1] = static_cast<uint8_t>(half >> 8);
+        word += 2;
+    }
+    if (length & 1) {
+        data[length - 1] = static_cast<uint8_t>(*word);
+    }
+}
+
+/*
+ * Move length bytes (at most what the TX ring holds) from its read position
+ * into the packet memory. The ring may wrap in the middle of the packet and
+ * leave an odd byte to pair with the first one of the next run.
+ */
+void UsbCdc::pmaFromRing(uint32_t offset, uint32_t length)
+{
+    volatile uint16_t *word = pma(offset);
+    uint32_t half = 0;
+    bool     odd  = false;
+
+    while (length != 0) {
+        const ring::Span<uint8_t> span  = g_tx.readSpan();
+        const uint32_t            chunk = (length < span.size) ? length : span.size;
+        const uint8_t            *byte  = span.data;
+        const uint8_t * const     end   = span.data + chunk;
+
+        if (odd && byte != end) {
+            *word = static_cast<uint16_t>(half | (*byte++ << 8));
+            word += 2;
+            odd   = false;
+        }
+        for (; end - byte >= 2; byte += 2) {
+            *word = static_cast<uint16_t>(byte[0] | (byte[1] << 8));
+            word += 2;
+        }
+        if (byte != end) {
+            half = *byte;
+            odd  = true;
+        }
+
+        g_tx.release(chunk);
+        length -= chunk;
+    }
+
+    if (odd) {
+        *word = static_cast<uint16_t>(half);
+    }
+}
+
+/* move length bytes (at most the free room of the RX ring) out of the packet memory */
+void UsbCdc::pmaToRing(uint32_t offset, uint32_t length)
+{
+    const volatile uint16_t *word = pma(offset);
+    uint32_t half = 0;
+    bool     odd  = false;
+
+    while (length != 0) {
+        const ring::Span<uint8_t> span  = g_rx.writeSpan();
+        const uint32_t            chunk = (length < span.size) ? length : span.size;
+        uint8_t                  *byte  = span.data;
+        uint8_t * const           end   = span.data + chunk;
+
+        if (odd && byte != end) {
+            *byte++ = static_cast<uint8_t>(half >> 8);
+            odd     = false;
+        }
+        for (; end - byte >= 2; byte += 2) {
+            half    = *word;
+            word   += 2;
+            byte[0] = static_cast<uint8_t>(half);
+            byte[1] = static_cast<uint8_t>(half >> 8);
+        }
+        if (byte != end) {
+            half    = *word;
+            word   += 2;
+            *byte++ = static_cast<uint8_t>(half);
+            odd     = true;
+        }
+
+        g_rx.commit(chunk);
+        length -= chunk;
+    }
+}
+
+/* bus reset: buffer table, EP0 and the default address */
+void UsbCdc::reset(void)
+{
+    USB->BTABLE = 0;
+
+    setBufferTable(0, ADDR_TX, EP0_IN_BUFFER);
+    setBufferTable(0, COUNT_TX, 0);
+    setBufferTable(0, ADDR_RX, EP0_OUT_BUFFER);
+    setBufferTable(0, COUNT_RX, RX_SIZE_64);
+
+    setBufferTable(DATA_IN_EP, ADDR_TX, DATA_IN_BUFFERS[0]);
+    setBufferTable(DATA_IN_EP, COUNT_TX, 0);
+    setBufferTable(DATA_IN_EP, ADDR_RX, DATA_IN_BUFFERS[1]);
+    setBufferTable(DATA_IN_EP, COUNT_RX, 0);
+
+    setBufferTable(DATA_OUT_EP, ADDR_TX, DATA_OUT_BUFFERS[0]);
+    setBufferTable(DATA_OUT_EP, COUNT_TX, RX_SIZE_64);
+    setBufferTable(DATA_OUT_EP, ADDR_RX, DATA_OUT_BUFFERS[1]);
+    setBufferTable(DATA_OUT_EP, COUNT_RX, RX_SIZE_64);
+
+    setBufferTable(NOTIFY_EP, ADDR_TX, NOTIFY_BUFFER);
+    setBufferTable(NOTIFY_EP, COUNT_TX, 0);
+
+    eprInit(0, USB_EP_CONTROL, USB_EP_RX_VALID | USB_EP_TX_NAK);
+    closeEndpoints();
+    USB->DADDR = USB_DADDR_EF;
+
+    busReset();
+}
+
+/*
+ * EP0 transfer complete. An IN completion is handled first: it belongs to a
+ * stage that ended before the OUT or SETUP that may be pending as well.
+ */
+void UsbCdc::control(void)
+{
+    const uint32_t reg = epr(0);
+
+    if (reg & USB_EP_CTR_TX) {
+        eprClear(0, USB_EP_CTR_TX);
+        ep0In();
+    }
+
+    if (reg & USB_EP_CTR_RX) {
+        uint32_t count = bufferTable(0, COUNT_RX) & COUNT_MASK;
+        if (count > PACKET_SIZE) {
+            count = PACKET_SIZE;
+        }
+
+        /* SETUP stays valid until CTR_RX is cleared */
+        if (reg & USB_EP_SETUP) {
+            uint8_t packet[8] = { 0 };
+            pmaRead(EP0_OUT_BUFFER, packet, (count < sizeof(packet)) ? count : sizeof(packet));
+            eprClear(0, USB_EP_CTR_RX);
+            setup(packet);
+        } else {
+            pmaRead(EP0_OUT_BUFFER, g_ctrl_buffer, count);
+            eprClear(0, USB_EP_CTR_RX);
+            ep0Out(count);
+        }
+    }
+}
+
+void UsbCdc::ep0Send(const uint8_t *data, uint32_t length)
+{
+    pmaWrite(EP0_IN_BUFFER, data, length);
+    setBufferTable(0, COUNT_TX, length);
+    eprStatus(0, USB_EPTX_STAT, USB_EP_TX_VALID);
+}
+
+/* EP0 always receives into its 64 byte buffer */
+void UsbCdc::ep0Receive(uint32_t length)
+{
+    eprStatus(0, USB_EPRX_STAT, USB_EP_RX_VALID);
+}
+
+/* a SETUP is still accepted, which clears the stall */
+void UsbCdc::ep0Stall(void)
+{
+    eprStatus(0, USB_EPTX_STAT | USB_EPRX_STAT, USB_EP_TX_STALL | USB_EP_RX_STALL);
+}
+
+void UsbCdc::setAddress(uint32_t address)
+{
+    USB->DADDR = static_cast<uint16_t>(USB_DADDR_EF | address);
+}
+
+/*
+ * Both data endpoints start with DTOG and SW_BUF at 0: the IN endpoint NAKs
+ * until the first packet is committed, the OUT endpoint owns both buffers.
+ */
+void UsbCdc::openEndpoint(uint32_t address)
+{
+    if (address == (EP_IN | DATA_IN_EP)) {
+        eprInit(DATA_IN_EP, USB_EP_BULK | USB_EP_KIND | DATA_IN_EP, USB_EP_TX_NAK);
+        g_tx_queued = 0;
+        g_tx_last   = 0;
+    } else if (address == DATA_OUT_EP) {
+        eprInit(DATA_OUT_EP, USB_EP_BULK | USB_EP_KIND | DATA_OUT_EP, USB_EP_RX_VALID);
+        g_rx_filled = 0;
+    } else if (address == (EP_IN | NOTIFY_EP)) {
+        eprInit(NOTIFY_EP, USB_EP_INTERRUPT | NOTIFY_EP, USB_EP_TX_NAK);
+    }
+}
+
+void UsbCdc::closeEndpoints(void)
+{
+    eprInit(DATA_IN_EP, 0, 0);
+    eprInit(DATA_OUT_EP, 0, 0);
+    eprInit(NOTIFY_EP, 0, 0);
+}
+
+/*
+ * IN endpoint. The peripheral sends the buffer DTOG_TX points to and the
+ * application fills the one SW_BUF points to; toggling SW_BUF commits it.
+ * When the peripheral finds no committed buffer after a transaction it
+ * switches STAT_TX to NAK, so up to two packets are queued: one on the bus,
+ * one waiting. A transfer ending on a full packet is closed with a zero
+ * length packet once nothing else is queued.
+ */
+void UsbCdc::txPump(void)
+{
+    if (epr(DATA_IN_EP) & USB_EP_CTR_TX) {
+        eprClear(DATA_IN_EP, USB_EP_CTR_TX);
+        if (g_tx_queued != 0) {
+            --g_tx_queued;
+        }
+    }
+
+    if (g_configuration == 0) return;
+
+    while (g_tx_queued < 2) {
+        const uint32_t pending = g_tx.size();
+        const uint32_t count   = (pending < PACKET_SIZE) ? pending : PACKET_SIZE;
+        if (count == 0 && (g_tx_last != PACKET_SIZE || g_tx_queued != 0)) break;
+
+        const uint32_t buffer = (epr(DATA_IN_EP) & IN_SW_BUF) ? 1 : 0;
+        pmaFromRing(DATA_IN_BUFFERS[buffer], count);
+        setBufferTable(DATA_IN_EP, BUFFER_COUNT[buffer], count);
+        eprToggle(DATA_IN_EP, IN_SW_BUF);
+
+        ++g_tx_queued;
+        g_tx_last = count;
+    }
+
+    /*
+     * Restart an idle endpoint. With a completion pending the count is out
+     * of date, the next pass gets it right.
+     */
+    const uint32_t reg = epr(DATA_IN_EP);
+    if (g_tx_queued != 0 && (reg & USB_EP_CTR_TX) == 0 && (reg & USB_EPTX_STAT) == USB_EP_TX_NAK) {
+        eprStatus(DATA_IN_EP, USB_EPTX_STAT, USB_EP_TX_VALID);
+    }
+}
+
+/*
+ * OUT endpoint. The peripheral receives into the buffer DTOG_RX points to
+ * and the application reads the one SW_BUF points to; toggling SW_BUF hands
+ * it back. With both buffers full the peripheral switches STAT_RX to NAK.
+ * A packet is only taken when the RX ring has room for a whole one, until
+ * then the host is held off.
+ */
+void UsbCdc::rxPump(void)
+{
+    if (epr(DATA_OUT_EP) & USB_EP_CTR_RX) {
+        eprClear(DATA_OUT_EP, USB_EP_CTR_RX);
+        ++g_rx_filled;
+    }
+
+    if (g_configuration == 0) return;
+
+    while (g_rx_filled != 0 && RX_BUFFER_SIZE - g_rx.size() >= PACKET_SIZE) {
+        const uint32_t buffer = (epr(DATA_OUT_EP) & OUT_SW_BUF) ? 1 : 0;
+        uint32_t count = bufferTable(DATA_OUT_EP, BUFFER_COUNT[buffer]) & COUNT_MASK;
+        if (count > PACKET_SIZE) {
+            count = PACKET_SIZE;
+        }
+
+        pmaToRing(DATA_OUT_BUFFERS[buffer], count);
+        eprToggle(DATA_OUT_EP, OUT_SW_BUF);
+        --g_rx_filled;
+    }
+
+    const uint32_t reg = epr(DATA_OUT_EP);
+    if (g_rx_filled < 2 && (reg & USB_EP_CTR_RX) == 0 && (reg & USB_EPRX_STAT) == USB_EP_RX_NAK) {
+        eprStatus(DATA_OUT_EP, USB_EPRX_STAT, USB_EP_RX_VALID);
+    }
+}
+#endif
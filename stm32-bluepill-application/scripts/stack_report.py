@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+#
+# Static worst-case stack usage report.
+#
+# Combines the per-function frame sizes GCC writes to the .su files
+# (-fstack-usage) with the call graph of the linked ELF (direct calls found
+# in the objdump disassembly) and prints the deepest call chain of every
+# entry point: main, the Reset_Handler and every exception/interrupt handler.
+#
+#   usage: stack_report.py [--objdump TOOL] [--entry NAME]... ELF OBJ_DIR
+#
+# The result is a lower bound wherever the report shows a flag:
+#
+#   indirect   a function pointer call (e.g. a soft timer callback or a task
+#              entry) that cannot be followed. Pass the targets with --entry
+#              to get their depth.
+#   recursion  a call cycle, only counted once.
+#   dynamic    a frame with a run-time size (alloca, VLA).
+#   no-su      a function without .su data (assembly, libraries), counted
+#              as 0 bytes.
+
+import argparse
+import collections
+import os
+import re
+import subprocess
+import sys
+
+# Bytes the core stacks on exception entry (R0-R3, R12, LR, PC, xPSR).
+EXCEPTION_FRAME = 32
+
+ENTRY_PATTERN = re.compile(r'^(main|Reset_Handler|\w+_Handler|\w+_IRQHandler)$')
+FUNC_PATTERN = re.compile(r'^[0-9a-f]+ <(.+)>:$')
+CALL_PATTERN = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{2,8} ?)+\s+'
+                          r'(bl|blx|b|b\.w|b\.n|call|jmp)\s+([0-9a-f]+)?\s*(?:<(.+)>)?')
+INDIRECT_PATTERN = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{2,8} ?)+\s+(blx|call)\s+\*?%?r')
+
+
+def strip_return_type(name):
+    """Turn 'void Ns::func(int)' into 'Ns::func(int)', 'main' into 'main()'."""
+    depth = 0
+    paren = -1
+    for i, c in enumerate(name):
+        if c == '<':
+            depth += 1
+        elif c == '>':
+            depth -= 1
+        elif c == '(' and depth == 0:
+            paren = i
+            break
+
+    if paren < 0:
+        return name + '()'
+
+    depth = 0
+    start = 0
+    for i in range(paren - 1, -1, -1):
+        c = name[i]
+        if c == '>':
+            depth += 1
+        elif c == '<':
+            depth -= 1
+        elif c == ' ' and depth == 0:
+            start = i + 1
+            break
+
+    result = name[start:]
+    if name[:start].rstrip().endswith('operator'):
+        result = name[:start].rstrip().split(' ')[-1] + ' ' + result
+    return result
+
+
+def normalize(symbol):
+    """Demangled objdump symbol to the same form as strip_return_type."""
+    symbol = symbol.split('+')[0]
+    return symbol if '(' in symbol else symbol + '()'
+
+
+def load_frames(obj_dir):
+    frames = {}
+    dynamic = set()
+    for root, _, files in os.walk(obj_dir):
+        for file in files:
+            if not file.endswith('.su'):
+                continue
+            with open(os.path.join(root, file)) as su:
+                for line in su:
+                    parts = line.rstrip('\n').split('\t')
+                    if len(parts) < 3:
+                        continue
+                    name = strip_return_type(parts[0].split(':', 3)[-1])
+                    size = int(parts[1])
+                    frames[name] = max(size, frames.get(name, 0))
+                    if 'dynamic' in parts[2] and 'bounded' not in parts[2]:
+                        dynamic.add(name)
+    return frames, dynamic
+
+
+def load_calls(objdump, elf):
+    output = subprocess.run([objdump, '-d', '-C', elf], check=True,
+                            stdout=subprocess.PIPE, universal_newlines=True).stdout
+    calls = collections.defaultdict(set)
+    indirect = set()
+    functions = set()
+    current = None
+    for line in output.splitlines():
+        match = FUNC_PATTERN.match(line)
+        if match:
+            current = normalize(match.group(1))
+            functions.add(current)
+            continue
+        if current is None:
+            continue
+
+        if INDIRECT_PATTERN.match(line):
+            indirect.add(current)
+            continue
+
+        match = CALL_PATTERN.match(line)
+        if not match or not match.group(3):
+            continue
+
+        mnemonic, target = match.group(1), match.group(3)
+
+        # Plain branches inside a function are loops and ifs. Only a branch to
+        # the start of another function (a tail call) is a call.
+        if mnemonic in ('b', 'b.w', 'b.n', 'jmp') and '+' in target:
+            continue
+        calls[current].add(normalize(target))
+    return functions, calls, indirect
+
+
+def worst_case(name, frames, calls, memo, stack):
+    """Return (depth, path, flags) of the deepest chain starting at name."""
+    if name in memo:
+        return memo[name]
+    if name in stack:
+        return 0, [], {'recursion'}
+
+    stack.add(name)
+    best = (0, [], set())
+    flags = set()
+    for callee in sorted(calls.get(name, ())):
+        depth, path, callee_flags = worst_case(callee, frames, calls, memo, stack)
+        flags |= callee_flags
+        if depth > best[0] or not best[1]:
+            best = (depth, path, callee_flags)
+    stack.discard(name)
+
+    own = frames.get(name, 0)
+    result = (own + best[0], [name] + best[1], flags)
+    memo[name] = result
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Worst-case stack usage per entry point')
+    parser.add_argument('--objdump', default='arm-none-eabi-objdump')
+    parser.add_argument('--entry', action='append', default=[],
+                        help='additional entry point without parameters (e.g. Kernel::idle)')
+    parser.add_argument('elf')
+    parser.add_argument('obj_dir')
+    args = parser.parse_args()
+
+    frames, dynamic = load_frames(args.obj_dir)
+    functions, calls, indirect = load_calls(args.objdump, args.elf)
+
+    entries = sorted(f for f in functions if ENTRY_PATTERN.match(f[:-2]))
+    for name in args.entry:
+        entries += sorted(f for f in functions if f.split('(')[0] == name and f not in entries)
+
+    memo = {}
+    results = []
+    for entry in entries:
+        depth, path, _ = worst_case(entry, frames, calls, memo, set())
+        flags = set()
+        for func in path:
+            if func in indirect:
+                flags.add('indirect')
+            if func in dynamic:
+                flags.add('dynamic')
+            if func not in frames:
+                flags.add('no-su')
+        flags |= memo[entry][2]
+
+        is_exception = entry.endswith('Handler()') and entry != 'Reset_Handler()'
+        total = depth + (EXCEPTION_FRAME if is_exception else 0)
+        results.append((entry, total, path, flags, is_exception))
+
+    print('{:<36} {:>7}  {}'.format('entry point', 'bytes', 'flags'))
+    for entry, total, path, flags, _ in results:
+        print('{:<36} {:>7}  {}'.format(entry, total, ','.join(sorted(flags))))
+        print('    ' + ' -> '.join(path))
+
+    # Handlers nest on the main stack. Without knowing which of them can
+    # preempt each other, the sum of all of them is a safe upper bound. Tasks
+    # given with --entry run on their own stacks and are not part of it.
+    startup = [r[1] for r in results if r[0] in ('main()', 'Reset_Handler()')]
+    handlers = [r[1] for r in results if r[4]]
+    print('')
+    print('main stack bound (startup + all handlers nested): {} bytes'.format(
+        (max(startup) if startup else 0) + sum(handlers)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())